@@ -27,6 +27,11 @@ extern "C" {
 #define SPA_TYPE__Clock		SPA_TYPE_INTERFACE_BASE "Clock"
 #define SPA_TYPE_CLOCK_BASE	SPA_TYPE__Clock ":"
 
+/** Key in the info of a clock with the name of its clock domain. Clocks
+ * of the same domain, such as the devices of one sound card, run at the
+ * same rate. */
+#define SPA_CLOCK_INFO_DOMAIN	"clock.domain"
+
 /** The state of the clock */
 enum spa_clock_state {
 	SPA_CLOCK_STATE_STOPPED,	/*< the clock is stopped */
@@ -114,11 +119,47 @@ struct spa_clock {
 			 int32_t *rate,
 			 int64_t *ticks,
 			 int64_t *monotonic_time);
+
+	/** Get the measured speed of \a clock
+	 *
+	 * \param clock the clock
+	 * \param rate_diff result: the number of ticks per second measured
+	 *        against the monotonic clock, divided by the nominal rate.
+	 *        This is 1.0 when the clock runs at exactly its nominal rate.
+	 * \return 0 on success
+	 *         -EIO when no measurement is available yet
+	 *
+	 * This field can be NULL when the clock can't measure its speed.
+	 */
+	int (*get_rate_diff) (struct spa_clock *clock, double *rate_diff);
+
+	/** Get the timing errors of \a clock
+	 *
+	 * Clocks that predict their position between measurements report
+	 * how good the prediction is.
+	 *
+	 * \param clock the clock
+	 * \param prediction_error result: the difference in nanoseconds
+	 *        between the predicted and the measured position at the
+	 *        last measurement.
+	 * \param measurement_error result: the difference in nanoseconds
+	 *        between the last measured time and the filtered time of
+	 *        the clock, the jitter of the measurement.
+	 * \return 0 on success
+	 *         -EIO when no measurement is available yet
+	 *
+	 * This field can be NULL when the clock makes no predictions.
+	 */
+	int (*get_error) (struct spa_clock *clock,
+			  int64_t *prediction_error,
+			  int64_t *measurement_error);
 };
 
 #define spa_clock_enum_params(n,...)	(n)->enum_params((n),__VA_ARGS__)
 #define spa_clock_set_param(n,...)	(n)->set_param((n),__VA_ARGS__)
 #define spa_clock_get_time(n,...)	(n)->get_time((n),__VA_ARGS__)
+#define spa_clock_get_rate_diff(n,...)	(n)->get_rate_diff((n),__VA_ARGS__)
+#define spa_clock_get_error(n,...)	(n)->get_error((n),__VA_ARGS__)
 
 #ifdef __cplusplus
 }  /* extern "C" */
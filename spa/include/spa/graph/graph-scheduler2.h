@@ -26,71 +26,96 @@ extern "C" {
 
 #include <spa/graph/graph.h>
 
-static inline int spa_graph_scheduler_default(struct spa_graph_node *node)
+#define SPA_GRAPH_STATE_IN		0
+#define SPA_GRAPH_STATE_OUT		1
+#define SPA_GRAPH_STATE_CHECK_IN	2
+#define SPA_GRAPH_STATE_CHECK_OUT	3
+#define SPA_GRAPH_STATE_CHECK_OK	4
+#define SPA_GRAPH_STATE_END		5
+
+struct spa_graph_data {
+	struct spa_graph *graph;
+	struct spa_list ready;
+	struct spa_list pending;
+	struct spa_graph_node *node;
+};
+
+static inline void spa_graph_data_init(struct spa_graph_data *data,
+				       struct spa_graph *graph)
+{
+	data->graph = graph;
+	spa_list_init(&data->ready);
+	spa_list_init(&data->pending);
+	data->node = NULL;
+}
+
+static inline int spa_graph_data_process(struct spa_graph_node *node)
 {
 	int res;
-	struct spa_node *n = node->user_data;
 
-	if (node->action == SPA_GRAPH_ACTION_IN)
-		res = spa_node_process_input(n);
-	else if (node->action == SPA_GRAPH_ACTION_OUT)
-		res = spa_node_process_output(n);
+	if (node->state == SPA_GRAPH_STATE_IN)
+		res = spa_node_process_input(node->implementation);
+	else if (node->state == SPA_GRAPH_STATE_OUT)
+		res = spa_node_process_output(node->implementation);
 	else
 		res = -EBADF;
 
 	return res;
 }
 
-static inline void spa_graph_port_check(struct spa_graph *graph, struct spa_graph_port *port)
+static inline void spa_graph_data_port_check(struct spa_graph_data *data, struct spa_graph_port *port)
 {
 	struct spa_graph_node *node = port->node;
+	uint32_t required = node->required[SPA_DIRECTION_INPUT];
 
 	if (port->io->status == SPA_STATUS_HAVE_BUFFER)
-		node->ready++;
+		node->ready[SPA_DIRECTION_INPUT]++;
 
-	spa_debug("port %p node %p check %d %d %d", port, node, port->io->status, node->ready, node->required);
+	spa_debug("port %p node %p check %d %d %d", port, node,
+		  port->io->status, node->ready[SPA_DIRECTION_INPUT], required);
 
-	if (node->required > 0 && node->ready == node->required) {
-		node->action = SPA_GRAPH_ACTION_IN;
+	if (required > 0 && node->ready[SPA_DIRECTION_INPUT] == required) {
+		node->state = SPA_GRAPH_STATE_IN;
 		if (node->ready_link.next == NULL)
-			spa_list_append(&graph->ready, &node->ready_link);
+			spa_list_append(&data->ready, &node->ready_link);
 	} else if (node->ready_link.next) {
 		spa_list_remove(&node->ready_link);
 		node->ready_link.next = NULL;
 	}
 }
 
-static inline void spa_graph_node_update(struct spa_graph *graph, struct spa_graph_node *node) {
+static inline void spa_graph_data_node_update(struct spa_graph_data *data, struct spa_graph_node *node)
+{
 	struct spa_graph_port *p;
 
-	node->ready = 0;
+	node->ready[SPA_DIRECTION_INPUT] = 0;
 	spa_list_for_each(p, &node->ports[SPA_DIRECTION_INPUT], link) {
 		if (p->io->status == SPA_STATUS_OK && !(node->flags & SPA_GRAPH_NODE_FLAG_ASYNC))
-			node->ready++;
+			node->ready[SPA_DIRECTION_INPUT]++;
 	}
-	spa_debug("node %p update %d ready", node, node->ready);
+	spa_debug("node %p update %d ready", node, node->ready[SPA_DIRECTION_INPUT]);
 }
 
-static inline bool spa_graph_scheduler_iterate(struct spa_graph *graph)
+static inline bool spa_graph_data_iterate(struct spa_graph_data *data)
 {
 	bool empty;
 	struct spa_graph_port *p;
 	struct spa_graph_node *n;
 	int iter = 1;
-	uint32_t state;
+	int state;
 
 next:
-	empty = spa_list_is_empty(&graph->ready);
-	if (empty && !spa_list_is_empty(&graph->pending)) {
+	empty = spa_list_is_empty(&data->ready);
+	if (empty && !spa_list_is_empty(&data->pending)) {
 		spa_debug("copy pending");
-		spa_list_insert_list(&graph->ready, &graph->pending);
-		spa_list_init(&graph->pending);
+		spa_list_insert_list(&data->ready, &data->pending);
+		spa_list_init(&data->pending);
 		empty = false;
 	}
 	if (iter-- == 0 || empty)
 		return !empty;
 
-	n = spa_list_first(&graph->ready, struct spa_graph_node, ready_link);
+	n = spa_list_first(&data->ready, struct spa_graph_node, ready_link);
 	spa_list_remove(&n->ready_link);
 	n->ready_link.next = NULL;
 
@@ -103,54 +128,56 @@ next:
 		if (n->state == SPA_GRAPH_STATE_END)
 			n->state = SPA_GRAPH_STATE_OUT;
 
-		state = n->schedule(n);
-		spa_debug("node %p schedule %d res %d", n, action, state);
+		state = spa_graph_data_process(n);
+		spa_debug("node %p process %d res %d", n, n->state, state);
 
-		if (n->state == SPA_GRAPH_STATE_IN && n == graph->node)
+		if (n->state == SPA_GRAPH_STATE_IN && n == data->node)
 			break;
 
-		if (n->state != SPA_GRAPH_STATE_END) {
-			spa_debug("node %p add ready for CHECK", n);
-			if (state == SPA_STATUS_NEED_BUFFER)
-				n->state = SPA_GRAPH_STATE_CHECK_IN;
-			else if (state == SPA_STATUS_HAVE_BUFFER)
-				n->state = SPA_GRAPH_STATE_CHECK_OUT;
-			else if (state == SPA_STATUS_OK)
-				n->state = SPA_GRAPH_STATE_CHECK_OK;
-			spa_list_append(&graph->ready, &n->ready_link);
-		}
-		else {
-			spa_graph_node_update(graph, n);
-		}
+		spa_debug("node %p add ready for CHECK", n);
+		if (state == SPA_STATUS_NEED_BUFFER)
+			n->state = SPA_GRAPH_STATE_CHECK_IN;
+		else if (state == SPA_STATUS_HAVE_BUFFER)
+			n->state = SPA_GRAPH_STATE_CHECK_OUT;
+		else
+			n->state = SPA_GRAPH_STATE_CHECK_OK;
+		spa_list_append(&data->ready, &n->ready_link);
 		break;
 
 	case SPA_GRAPH_STATE_CHECK_IN:
-		n->ready = 0;
+		n->ready[SPA_DIRECTION_INPUT] = 0;
 		spa_list_for_each(p, &n->ports[SPA_DIRECTION_INPUT], link) {
-			struct spa_graph_node *pn = p->peer->node;
+			struct spa_graph_node *pn;
+
+			if (p->peer == NULL)
+				continue;
+			pn = p->peer->node;
 			if (p->io->status == SPA_STATUS_NEED_BUFFER) {
-				if (pn != graph->node
-				    || pn->flags & SPA_GRAPH_NODE_FLAG_ASYNC) {
+				if ((pn != data->node
+				    || pn->flags & SPA_GRAPH_NODE_FLAG_ASYNC) &&
+				    pn->ready_link.next == NULL) {
 					pn->state = SPA_GRAPH_STATE_OUT;
 					spa_debug("node %p add ready OUT", n);
-					spa_list_append(&graph->ready, &pn->ready_link);
+					spa_list_append(&data->ready, &pn->ready_link);
 				}
 			} else if (p->io->status == SPA_STATUS_OK)
-				n->ready++;
+				n->ready[SPA_DIRECTION_INPUT]++;
 		}
 		break;
 
 	case SPA_GRAPH_STATE_CHECK_OUT:
-		spa_list_for_each(p, &n->ports[SPA_DIRECTION_OUTPUT], link)
-			spa_graph_port_check(graph, p->peer);
+		spa_list_for_each(p, &n->ports[SPA_DIRECTION_OUTPUT], link) {
+			if (p->peer)
+				spa_graph_data_port_check(data, p->peer);
+		}
 
 		spa_debug("node %p add pending", n);
 		n->state = SPA_GRAPH_STATE_END;
-		spa_list_insert(&graph->pending, &n->ready_link);
+		spa_list_insert(&data->pending, &n->ready_link);
 		break;
 
 	case SPA_GRAPH_STATE_CHECK_OK:
-		spa_graph_node_update(graph, n);
+		spa_graph_data_node_update(data, n);
 		break;
 
 	default:
@@ -159,25 +186,41 @@ next:
 	goto next;
 }
 
-static inline void spa_graph_scheduler_pull(struct spa_graph *graph, struct spa_graph_node *node)
+static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *node)
 {
-	node->action = SPA_GRAPH_ACTION_CHECK;
-	node->state = SPA_STATUS_NEED_BUFFER;
-	graph->node = node;
+	struct spa_graph_data *d = data;
 	spa_debug("node %p start pull", node);
+	node->state = SPA_GRAPH_STATE_CHECK_IN;
+	d->node = node;
 	if (node->ready_link.next == NULL)
-		spa_list_append(&graph->ready, &node->ready_link);
+		spa_list_append(&d->ready, &node->ready_link);
+
+	while(spa_graph_data_iterate(data));
+
+	return 0;
 }
 
-static inline void spa_graph_scheduler_push(struct spa_graph *graph, struct spa_graph_node *node)
+static inline int spa_graph_impl_have_output(void *data, struct spa_graph_node *node)
 {
-	node->action = SPA_GRAPH_ACTION_OUT;
-	graph->node = node;
+	struct spa_graph_data *d = data;
 	spa_debug("node %p start push", node);
+	node->state = SPA_GRAPH_STATE_OUT;
+	d->node = node;
 	if (node->ready_link.next == NULL)
-		spa_list_append(&graph->ready, &node->ready_link);
+		spa_list_append(&d->ready, &node->ready_link);
+
+	while(spa_graph_data_iterate(data));
+
+	return 0;
 }
 
+static const struct spa_graph_callbacks spa_graph_impl_default = {
+	SPA_VERSION_GRAPH_CALLBACKS,
+	.need_input = spa_graph_impl_need_input,
+	.have_output = spa_graph_impl_have_output,
+};
+
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
@@ -43,14 +43,14 @@ static inline void spa_graph_impl_activate(void *data, struct spa_graph_node *no
 {
 	int res = node->state;
 
-	debug("node %p activate %d\n", node, node->state);
+	spa_debug("node %p activate %d", node, node->state);
 	if (node->state == SPA_STATUS_NEED_BUFFER) {
                 res = spa_node_process_input(node->implementation);
-		debug("node %p process in %d\n", node, res);
+		spa_debug("node %p process in %d", node, res);
 	}
 	else if (node->state == SPA_STATUS_HAVE_BUFFER) {
                 res = spa_node_process_output(node->implementation);
-		debug("node %p process out %d\n", node, res);
+		spa_debug("node %p process out %d", node, res);
 	}
 
 	if (recurse && (res == SPA_STATUS_NEED_BUFFER || res == SPA_STATUS_OK))
@@ -60,7 +60,7 @@ static inline void spa_graph_impl_activate(void *data, struct spa_graph_node *no
 	else
 		node->state = res;
 
-	debug("node %p activate end %d\n", node, node->state);
+	spa_debug("node %p activate end %d", node, node->state);
 }
 
 static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *node)
@@ -68,7 +68,7 @@ static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *n
 	struct spa_graph_port *p;
 	uint32_t required;
 
-	debug("node %p start pull\n", node);
+	spa_debug("node %p start pull", node);
 
 	node->state = SPA_STATUS_NEED_BUFFER;
 	node->ready[SPA_DIRECTION_INPUT] = 0;
@@ -83,14 +83,14 @@ static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *n
 			continue;
 		pnode = pport->node;
 		prequired = pnode->required[SPA_DIRECTION_OUTPUT];
-		debug("node %p pull peer %p io %d %d\n", node, pnode, pport->io->status, pport->io->buffer_id);
+		spa_debug("node %p pull peer %p io %d %d", node, pnode, pport->io->status, pport->io->buffer_id);
 
 		if (pport->io->status == SPA_STATUS_NEED_BUFFER)
 			pnode->ready[SPA_DIRECTION_OUTPUT]++;
 		else if (pport->io->status == SPA_STATUS_OK)
 			node->ready[SPA_DIRECTION_INPUT]++;
 
-		debug("node %p pull peer %p out %d %d\n", node, pnode, prequired, pnode->ready[SPA_DIRECTION_OUTPUT]);
+		spa_debug("node %p pull peer %p out %d %d", node, pnode, prequired, pnode->ready[SPA_DIRECTION_OUTPUT]);
 		if (prequired > 0 && pnode->ready[SPA_DIRECTION_OUTPUT] >= prequired) {
 			if (pnode->state == SPA_STATUS_NEED_BUFFER)
 				pnode->state = SPA_STATUS_HAVE_BUFFER;
@@ -100,7 +100,7 @@ static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *n
 	if (required > 0 && node->ready[SPA_DIRECTION_INPUT] >= required)
 		spa_graph_impl_activate(data, node, false);
 
-	debug("node %p end pull\n", node);
+	spa_debug("node %p end pull", node);
 
 	return 0;
 }
@@ -108,8 +108,9 @@ static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *n
 static inline int spa_graph_impl_have_output(void *data, struct spa_graph_node *node)
 {
 	struct spa_graph_port *p;
+	uint32_t required;
 
-	debug("node %p start push\n", node);
+	spa_debug("node %p start push", node);
 
 	node->state = SPA_STATUS_HAVE_BUFFER;
 	node->ready[SPA_DIRECTION_OUTPUT] = 0;
@@ -125,13 +126,13 @@ static inline int spa_graph_impl_have_output(void *data, struct spa_graph_node *
 
 		pnode = pport->node;
 		prequired = pnode->required[SPA_DIRECTION_INPUT];
-		debug("node %p push peer %p io %d %d\n", node, pnode, pport->io->status, pport->io->buffer_id);
+		spa_debug("node %p push peer %p io %d %d", node, pnode, pport->io->status, pport->io->buffer_id);
 
 		if (pport->io->status == SPA_STATUS_HAVE_BUFFER) {
 			pnode->ready[SPA_DIRECTION_INPUT]++;
 			node->required[SPA_DIRECTION_OUTPUT]++;
 		}
-		debug("node %p push peer %p in %d %d\n", node, pnode, prequired, pnode->ready[SPA_DIRECTION_INPUT]);
+		spa_debug("node %p push peer %p in %d %d", node, pnode, prequired, pnode->ready[SPA_DIRECTION_INPUT]);
 		if (prequired > 0 && pnode->ready[SPA_DIRECTION_INPUT] >= prequired)
 			spa_graph_impl_activate(data, pnode, true);
 	}
@@ -139,7 +140,7 @@ static inline int spa_graph_impl_have_output(void *data, struct spa_graph_node *
 	if (required > 0 && node->ready[SPA_DIRECTION_OUTPUT] >= required)
 		spa_graph_impl_activate(data, node, false);
 
-	debug("node %p end push\n", node);
+	spa_debug("node %p end push", node);
 
 	return 0;
 }
@@ -26,6 +26,15 @@ extern "C" {
 
 #include <spa/graph/graph.h>
 
+/* define these before including the scheduler to wrap the processing
+ * of the nodes, to measure them for example */
+#ifndef spa_graph_node_process_input
+#define spa_graph_node_process_input(n)		spa_node_process_input((n)->implementation)
+#endif
+#ifndef spa_graph_node_process_output
+#define spa_graph_node_process_output(n)	spa_node_process_output((n)->implementation)
+#endif
+
 struct spa_graph_data {
 	struct spa_graph *graph;
 };
@@ -42,8 +51,23 @@ static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *n
 
 	spa_debug("node %p start pull", node);
 
+	/* count all ports before running a peer, the peers can come back
+	 * to this node and must see the complete count */
 	node->ready[SPA_DIRECTION_INPUT] = 0;
 	node->required[SPA_DIRECTION_INPUT] = 0;
+	spa_list_for_each(p, &node->ports[SPA_DIRECTION_INPUT], link) {
+		struct spa_graph_port *pport;
+
+		if ((pport = p->peer) == NULL)
+			continue;
+
+		if (pport->io->status == SPA_STATUS_NEED_BUFFER) {
+			pport->node->ready[SPA_DIRECTION_OUTPUT]++;
+			if (!(p->flags & SPA_PORT_INFO_FLAG_OPTIONAL))
+				node->required[SPA_DIRECTION_INPUT]++;
+		}
+	}
+
 	spa_list_for_each(p, &node->ports[SPA_DIRECTION_INPUT], link) {
 		struct spa_graph_port *pport;
 		struct spa_graph_node *pnode;
@@ -55,12 +79,6 @@ static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *n
 		}
 		pnode = pport->node;
 
-		if (pport->io->status == SPA_STATUS_NEED_BUFFER) {
-			pnode->ready[SPA_DIRECTION_OUTPUT]++;
-			if (!(p->flags & SPA_PORT_INFO_FLAG_OPTIONAL))
-				node->required[SPA_DIRECTION_INPUT]++;
-		}
-
 		pready = pnode->ready[SPA_DIRECTION_OUTPUT];
 		prequired = pnode->required[SPA_DIRECTION_OUTPUT];
 
@@ -68,7 +86,7 @@ static inline int spa_graph_impl_need_input(void *data, struct spa_graph_node *n
 				pport->io->buffer_id, pready, prequired);
 
 		if (prequired > 0 && pready >= prequired) {
-			pnode->state = spa_node_process_output(pnode->implementation);
+			pnode->state = spa_graph_node_process_output(pnode);
 
 			spa_debug("peer %p processed out %d", pnode, pnode->state);
 			if (pnode->state == SPA_STATUS_HAVE_BUFFER)
@@ -87,8 +105,23 @@ static inline int spa_graph_impl_have_output(void *data, struct spa_graph_node *
 
 	spa_debug("node %p start push", node);
 
+	/* count all ports before running a peer, the peers can come back
+	 * to this node and must see the complete count */
 	node->ready[SPA_DIRECTION_OUTPUT] = 0;
 	node->required[SPA_DIRECTION_OUTPUT] = 0;
+	spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link) {
+		struct spa_graph_port *pport;
+
+		if ((pport = p->peer) == NULL)
+			continue;
+
+		if (pport->io->status == SPA_STATUS_HAVE_BUFFER) {
+			pport->node->ready[SPA_DIRECTION_INPUT]++;
+			if (!(p->flags & SPA_PORT_INFO_FLAG_OPTIONAL))
+				node->required[SPA_DIRECTION_OUTPUT]++;
+		}
+	}
+
 	spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link) {
 		struct spa_graph_port *pport;
 		struct spa_graph_node *pnode;
@@ -100,12 +133,6 @@ static inline int spa_graph_impl_have_output(void *data, struct spa_graph_node *
 		}
 		pnode = pport->node;
 
-		if (pport->io->status == SPA_STATUS_HAVE_BUFFER) {
-			pnode->ready[SPA_DIRECTION_INPUT]++;
-			if (!(p->flags & SPA_PORT_INFO_FLAG_OPTIONAL))
-				node->required[SPA_DIRECTION_OUTPUT]++;
-		}
-
 		pready = pnode->ready[SPA_DIRECTION_INPUT];
 		prequired = pnode->required[SPA_DIRECTION_INPUT];
 
@@ -113,7 +140,7 @@ static inline int spa_graph_impl_have_output(void *data, struct spa_graph_node *
 				pport->io->buffer_id, pready, prequired);
 
 		if (prequired > 0 && pready >= prequired) {
-			pnode->state = spa_node_process_input(pnode->implementation);
+			pnode->state = spa_graph_node_process_input(pnode);
 
 			spa_debug("peer %p processed in %d", pnode, pnode->state);
 			if (pnode->state == SPA_STATUS_HAVE_BUFFER)
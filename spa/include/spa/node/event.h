@@ -36,12 +36,14 @@ extern "C" {
 #define SPA_TYPE_EVENT_NODE__Buffering		SPA_TYPE_EVENT_NODE_BASE "Buffering"
 #define SPA_TYPE_EVENT_NODE__RequestRefresh	SPA_TYPE_EVENT_NODE_BASE "RequestRefresh"
 #define SPA_TYPE_EVENT_NODE__RequestClockUpdate	SPA_TYPE_EVENT_NODE_BASE "RequestClockUpdate"
+#define SPA_TYPE_EVENT_NODE__Xrun		SPA_TYPE_EVENT_NODE_BASE "Xrun"
 
 struct spa_type_event_node {
 	uint32_t Error;
 	uint32_t Buffering;
 	uint32_t RequestRefresh;
 	uint32_t RequestClockUpdate;
+	uint32_t Xrun;
 };
 
 static inline void
@@ -52,6 +54,7 @@ spa_type_event_node_map(struct spa_type_map *map, struct spa_type_event_node *ty
 		type->Buffering = spa_type_map_get_id(map, SPA_TYPE_EVENT_NODE__Buffering);
 		type->RequestRefresh = spa_type_map_get_id(map, SPA_TYPE_EVENT_NODE__RequestRefresh);
 		type->RequestClockUpdate = spa_type_map_get_id(map, SPA_TYPE_EVENT_NODE__RequestClockUpdate);
+		type->Xrun = spa_type_map_get_id(map, SPA_TYPE_EVENT_NODE__Xrun);
 	}
 }
 
@@ -77,6 +80,26 @@ struct spa_event_node_request_clock_update {
 		SPA_POD_LONG_INIT(timestamp),						\
 		SPA_POD_LONG_INIT(offset))
 
+/** The node could not produce or consume its data in time. The event is
+ * emitted from the data thread. */
+struct spa_event_node_xrun_body {
+	struct spa_pod_object_body body;
+	struct spa_pod_long missing		SPA_ALIGNED(8);	/**< missing samples or frames,
+								  *  0 when unknown */
+	struct spa_pod_long timestamp		SPA_ALIGNED(8);	/**< monotonic time of the xrun */
+};
+
+struct spa_event_node_xrun {
+	struct spa_pod pod;
+	struct spa_event_node_xrun_body body;
+};
+
+#define SPA_EVENT_NODE_XRUN_INIT(type,missing,timestamp)			\
+	SPA_EVENT_INIT_FULL(struct spa_event_node_xrun,				\
+		sizeof(struct spa_event_node_xrun_body), type,			\
+		SPA_POD_LONG_INIT(missing),					\
+		SPA_POD_LONG_INIT(timestamp))
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
@@ -35,6 +35,13 @@ extern "C" {
 #define SPA_TYPE_PARAM_BUFFERS__stride		SPA_TYPE_PARAM_BUFFERS_BASE "stride"
 #define SPA_TYPE_PARAM_BUFFERS__buffers		SPA_TYPE_PARAM_BUFFERS_BASE "buffers"
 #define SPA_TYPE_PARAM_BUFFERS__align		SPA_TYPE_PARAM_BUFFERS_BASE "align"
+/** the number of data blocks in a buffer, 1 when not given. Each block has
+ *  the size and stride of the param. */
+#define SPA_TYPE_PARAM_BUFFERS__blocks		SPA_TYPE_PARAM_BUFFERS_BASE "blocks"
+/** the type of the buffer memory, one of the SPA_TYPE_DATA_* types. Ports
+ *  list the memory types they can handle and the link picks the first common
+ *  one. */
+#define SPA_TYPE_PARAM_BUFFERS__dataType	SPA_TYPE_PARAM_BUFFERS_BASE "dataType"
 
 struct spa_type_param_buffers {
 	uint32_t Buffers;
@@ -42,6 +49,8 @@ struct spa_type_param_buffers {
 	uint32_t stride;
 	uint32_t buffers;
 	uint32_t align;
+	uint32_t blocks;
+	uint32_t dataType;
 };
 
 static inline void
@@ -54,6 +63,8 @@ spa_type_param_buffers_map(struct spa_type_map *map,
 		type->stride = spa_type_map_get_id(map, SPA_TYPE_PARAM_BUFFERS__stride);
 		type->buffers = spa_type_map_get_id(map, SPA_TYPE_PARAM_BUFFERS__buffers);
 		type->align = spa_type_map_get_id(map, SPA_TYPE_PARAM_BUFFERS__align);
+		type->blocks = spa_type_map_get_id(map, SPA_TYPE_PARAM_BUFFERS__blocks);
+		type->dataType = spa_type_map_get_id(map, SPA_TYPE_PARAM_BUFFERS__dataType);
 	}
 }
 
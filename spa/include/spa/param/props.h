@@ -46,6 +46,11 @@ extern "C" {
 #define SPA_TYPE_PROPS__volume		SPA_TYPE_PROPS_BASE "volume"
 #define SPA_TYPE_PROPS__mute		SPA_TYPE_PROPS_BASE "mute"
 #define SPA_TYPE_PROPS__patternType	SPA_TYPE_PROPS_BASE "patternType"
+#define SPA_TYPE_PROPS__rate		SPA_TYPE_PROPS_BASE "rate"
+#define SPA_TYPE_PROPS__adaptive	SPA_TYPE_PROPS_BASE "adaptive"
+#define SPA_TYPE_PROPS__quantum		SPA_TYPE_PROPS_BASE "quantum"
+#define SPA_TYPE_PROPS__threads		SPA_TYPE_PROPS_BASE "threads"
+#define SPA_TYPE_PROPS__threadType	SPA_TYPE_PROPS_BASE "threadType"
 
 #ifdef __cplusplus
 }  /* extern "C" */
@@ -82,7 +82,8 @@ struct spa_loop {
 	/** update the source io mask */
 	int (*update_source) (struct spa_source *source);
 
-	/** remove a source from the loop */
+	/** remove a source from the loop. The source of a loop that runs
+	 * in another thread must be removed with an invoke. */
 	void (*remove_source) (struct spa_source *source);
 
 	/** invoke a function in the context of this loop */
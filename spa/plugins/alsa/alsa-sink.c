@@ -41,6 +41,7 @@ static void reset_props(struct props *props)
 	strncpy(props->device, default_device, 64);
 	props->min_latency = default_min_latency;
 	props->max_latency = default_max_latency;
+	props->quantum = 0;
 }
 
 static int impl_node_enum_params(struct spa_node *node,
@@ -116,6 +117,14 @@ static int impl_node_enum_params(struct spa_node *node,
 				":", t->param.propType, "ir", p->max_latency,
 							2, 1, INT32_MAX);
 			break;
+		case 5:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_quantum,
+				":", t->param.propName, "s", "The requested graph quantum, 0 for minimum latency",
+				":", t->param.propType, "ir", p->quantum,
+							2, 0, INT32_MAX);
+			break;
 		default:
 			return 0;
 		}
@@ -131,7 +140,8 @@ static int impl_node_enum_params(struct spa_node *node,
 				":", t->prop_device_name, "S-r", p->device_name, sizeof(p->device_name),
 				":", t->prop_card_name,   "S-r", p->card_name, sizeof(p->card_name),
 				":", t->prop_min_latency, "i",   p->min_latency,
-				":", t->prop_max_latency, "i",   p->max_latency);
+				":", t->prop_max_latency, "i",   p->max_latency,
+				":", t->prop_quantum,     "i",   p->quantum);
 			break;
 		default:
 			return 0;
@@ -164,12 +174,18 @@ static int impl_node_set_param(struct spa_node *node, uint32_t id, uint32_t flag
 
 		if (param == NULL) {
 			reset_props(p);
+			spa_alsa_update_clock_info(this);
+			spa_alsa_update_threshold(this);
 			return 0;
 		}
 		spa_pod_object_parse(param,
 			":", t->prop_device,      "?S", p->device, sizeof(p->device),
 			":", t->prop_min_latency, "?i", &p->min_latency,
-			":", t->prop_max_latency, "?i", &p->max_latency, NULL);
+			":", t->prop_max_latency, "?i", &p->max_latency,
+			":", t->prop_quantum,     "?i", &p->quantum, NULL);
+
+		spa_alsa_update_clock_info(this);
+		spa_alsa_update_threshold(this);
 	}
 	else
 		return -ENOENT;
@@ -687,6 +703,77 @@ static const struct spa_node impl_node = {
 	impl_node_process_output,
 };
 
+static int impl_clock_enum_params(struct spa_clock *clock, uint32_t id, uint32_t *index,
+				  struct spa_pod **param,
+				  struct spa_pod_builder *builder)
+{
+	return -ENOTSUP;
+}
+
+static int impl_clock_set_param(struct spa_clock *clock,
+				uint32_t id, uint32_t flags,
+				const struct spa_pod *param)
+{
+	return -ENOTSUP;
+}
+
+static int impl_clock_get_time(struct spa_clock *clock,
+			       int32_t *rate,
+			       int64_t *ticks,
+			       int64_t *monotonic_time)
+{
+	struct state *this;
+
+	spa_return_val_if_fail(clock != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(clock, struct state, clock);
+
+	if (rate)
+		*rate = this->rate;
+	if (ticks)
+		*ticks = this->last_ticks;
+	if (monotonic_time)
+		*monotonic_time = this->last_monotonic;
+
+	return 0;
+}
+
+static int impl_clock_get_rate_diff(struct spa_clock *clock, double *rate_diff)
+{
+	struct state *this;
+
+	spa_return_val_if_fail(clock != NULL, -EINVAL);
+	spa_return_val_if_fail(rate_diff != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(clock, struct state, clock);
+
+	return spa_alsa_get_rate_diff(this, rate_diff);
+}
+
+static int impl_clock_get_error(struct spa_clock *clock,
+				int64_t *prediction_error,
+				int64_t *measurement_error)
+{
+	struct state *this;
+
+	spa_return_val_if_fail(clock != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(clock, struct state, clock);
+
+	return spa_alsa_get_error(this, prediction_error, measurement_error);
+}
+
+static const struct spa_clock impl_clock = {
+	SPA_VERSION_CLOCK,
+	NULL,
+	SPA_CLOCK_STATE_STOPPED,
+	impl_clock_enum_params,
+	impl_clock_set_param,
+	impl_clock_get_time,
+	impl_clock_get_rate_diff,
+	impl_clock_get_error,
+};
+
 static int impl_get_interface(struct spa_handle *handle, uint32_t interface_id, void **interface)
 {
 	struct state *this;
@@ -698,6 +785,8 @@ static int impl_get_interface(struct spa_handle *handle, uint32_t interface_id,
 
 	if (interface_id == this->type.node)
 		*interface = &this->node;
+	else if (interface_id == this->type.clock)
+		*interface = &this->clock;
 	else
 		return -ENOENT;
 
@@ -749,6 +838,7 @@ impl_init(const struct spa_handle_factory *factory,
 	init_type(&this->type, this->map);
 
 	this->node = impl_node;
+	this->clock = impl_clock;
 	this->stream = SND_PCM_STREAM_PLAYBACK;
 	reset_props(&this->props);
 
@@ -761,12 +851,14 @@ impl_init(const struct spa_handle_factory *factory,
 			snprintf(this->props.device, 63, "%s", info->items[i].value);
 		}
 	}
+	spa_alsa_update_clock_info(this);
 
 	return 0;
 }
 
 static const struct spa_interface_info impl_interfaces[] = {
 	{SPA_TYPE__Node,},
+	{SPA_TYPE__Clock,},
 };
 
 static int
@@ -777,14 +869,11 @@ impl_enum_interface_info(const struct spa_handle_factory *factory,
 	spa_return_val_if_fail(info != NULL, -EINVAL);
 	spa_return_val_if_fail(index != NULL, -EINVAL);
 
-	switch (*index) {
-	case 0:
-		*info = &impl_interfaces[*index];
-		break;
-	default:
+	if (*index >= SPA_N_ELEMENTS(impl_interfaces))
 		return 0;
-	}
-	(*index)++;
+
+	*info = &impl_interfaces[(*index)++];
+
 	return 1;
 }
 
@@ -40,6 +40,7 @@ static void reset_props(struct props *props)
 {
 	strncpy(props->device, default_device, 64);
 	props->min_latency = default_min_latency;
+	props->quantum = 0;
 }
 
 static int impl_node_enum_params(struct spa_node *node,
@@ -108,6 +109,14 @@ static int impl_node_enum_params(struct spa_node *node,
 				":", t->param.propType, "ir", p->min_latency,
 							2, 1, INT32_MAX);
 			break;
+		case 4:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId, "I", t->prop_quantum,
+				":", t->param.propName, "s", "The requested graph quantum, 0 for minimum latency",
+				":", t->param.propType, "ir", p->quantum,
+							2, 0, INT32_MAX);
+			break;
 		default:
 			return 0;
 		}
@@ -120,7 +129,8 @@ static int impl_node_enum_params(struct spa_node *node,
 				":", t->prop_device,      "S",   p->device, sizeof(p->device),
 				":", t->prop_device_name, "S-r", p->device_name, sizeof(p->device_name),
 				":", t->prop_card_name,   "S-r", p->card_name, sizeof(p->card_name),
-				":", t->prop_min_latency, "i",   p->min_latency);
+				":", t->prop_min_latency, "i",   p->min_latency,
+				":", t->prop_quantum,     "i",   p->quantum);
 			break;
 		default:
 			return 0;
@@ -153,11 +163,17 @@ static int impl_node_set_param(struct spa_node *node, uint32_t id, uint32_t flag
 
 		if (param == NULL) {
 			reset_props(p);
+			spa_alsa_update_clock_info(this);
+			spa_alsa_update_threshold(this);
 			return 0;
 		}
 		spa_pod_object_parse(param,
 			":", t->prop_device,      "?S", p->device, sizeof(p->device),
-			":", t->prop_min_latency, "?i", &p->min_latency, NULL);
+			":", t->prop_min_latency, "?i", &p->min_latency,
+			":", t->prop_quantum,     "?i", &p->quantum, NULL);
+
+		spa_alsa_update_clock_info(this);
+		spa_alsa_update_threshold(this);
 	}
 	else
 		return -ENOENT;
@@ -744,7 +760,7 @@ static int impl_clock_get_time(struct spa_clock *clock,
 	this = SPA_CONTAINER_OF(clock, struct state, clock);
 
 	if (rate)
-		*rate = SPA_USEC_PER_SEC;
+		*rate = this->rate;
 	if (ticks)
 		*ticks = this->last_ticks;
 	if (monotonic_time)
@@ -753,6 +769,31 @@ static int impl_clock_get_time(struct spa_clock *clock,
 	return 0;
 }
 
+static int impl_clock_get_rate_diff(struct spa_clock *clock, double *rate_diff)
+{
+	struct state *this;
+
+	spa_return_val_if_fail(clock != NULL, -EINVAL);
+	spa_return_val_if_fail(rate_diff != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(clock, struct state, clock);
+
+	return spa_alsa_get_rate_diff(this, rate_diff);
+}
+
+static int impl_clock_get_error(struct spa_clock *clock,
+				int64_t *prediction_error,
+				int64_t *measurement_error)
+{
+	struct state *this;
+
+	spa_return_val_if_fail(clock != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(clock, struct state, clock);
+
+	return spa_alsa_get_error(this, prediction_error, measurement_error);
+}
+
 static const struct spa_clock impl_clock = {
 	SPA_VERSION_CLOCK,
 	NULL,
@@ -760,6 +801,8 @@ static const struct spa_clock impl_clock = {
 	impl_clock_enum_params,
 	impl_clock_set_param,
 	impl_clock_get_time,
+	impl_clock_get_rate_diff,
+	impl_clock_get_error,
 };
 
 static int impl_get_interface(struct spa_handle *handle, uint32_t interface_id, void **interface)
@@ -843,6 +886,7 @@ impl_init(const struct spa_handle_factory *factory,
 			snprintf(this->props.device, 63, "%s", info->items[i].value);
 		}
 	}
+	spa_alsa_update_clock_info(this);
 	return 0;
 }
 
@@ -305,6 +305,7 @@ static int set_swparams(struct state *state)
 	CHECK(snd_pcm_sw_params_current(hndl, params), "sw_params_current");
 
 	CHECK(snd_pcm_sw_params_set_tstamp_mode(hndl, params, SND_PCM_TSTAMP_ENABLE), "sw_params_set_tstamp_mode");
+	CHECK(snd_pcm_sw_params_set_tstamp_type(hndl, params, SND_PCM_TSTAMP_TYPE_MONOTONIC), "sw_params_set_tstamp_type");
 
 	/* start the transfer */
 	CHECK(snd_pcm_sw_params_set_start_threshold(hndl, params, LONG_MAX), "set_start_threshold");
@@ -335,6 +336,197 @@ static inline void calc_timeout(size_t target, size_t current,
 	}
 }
 
+/* smallest quantum that is used for the wakeups */
+#define MIN_QUANTUM	16
+
+/* The wakeup threshold is the requested quantum, limited to what fits in
+ * the buffers, or the minimum latency when no quantum was requested. */
+static int get_threshold(struct state *state)
+{
+	uint32_t max;
+
+	if (state->props.quantum == 0)
+		return state->props.min_latency;
+
+	/* capture buffers are sized for min_latency */
+	if (state->stream == SND_PCM_STREAM_PLAYBACK)
+		max = state->props.max_latency;
+	else
+		max = state->props.min_latency;
+	if (state->buffer_frames > 0)
+		max = SPA_MIN(max, state->buffer_frames / 2);
+
+	return SPA_CLAMP(state->props.quantum, SPA_MIN(MIN_QUANTUM, max), max);
+}
+
+static int do_update_threshold(struct spa_loop *loop,
+			       bool async,
+			       uint32_t seq,
+			       const void *data,
+			       size_t size,
+			       void *user_data)
+{
+	struct state *state = user_data;
+	int threshold = get_threshold(state);
+
+	if (threshold != state->threshold) {
+		spa_log_debug(state->log, "alsa %p: threshold %d -> %d", state,
+			      state->threshold, threshold);
+		state->threshold = threshold;
+	}
+	return 0;
+}
+
+/* Apply changed latency properties to a running device. The new threshold
+ * is used from the next wakeup on, the stream keeps running. */
+int spa_alsa_update_threshold(struct state *state)
+{
+	if (!state->started)
+		return 0;
+
+	return spa_loop_invoke(state->data_loop, do_update_threshold, 0, NULL, 0, true, state);
+}
+
+/* All devices of a card share the clock of the card, "hw:0,1" is in the
+ * domain of "hw:0". */
+void spa_alsa_update_clock_info(struct state *state)
+{
+	char *p;
+
+	snprintf(state->clock_domain, sizeof(state->clock_domain), "alsa:%s",
+		 state->props.device);
+	if ((p = strchr(state->clock_domain, ',')) != NULL)
+		*p = '\0';
+
+	state->clock_info_items[0].key = SPA_CLOCK_INFO_DOMAIN;
+	state->clock_info_items[0].value = state->clock_domain;
+	state->clock_info = SPA_DICT_INIT(state->clock_info_items, 1);
+	state->clock.info = &state->clock_info;
+}
+
+/* bandwidth of the DLL in Hz, low enough to filter out the wakeup jitter */
+#define DLL_BANDWIDTH	0.05
+/* number of updates before the measured rate is used */
+#define DLL_SETTLE	16
+/* largest loop gain, the loop is only stable for a small omega */
+#define DLL_MAX_OMEGA	0.5
+
+static void dll_reset(struct state *state)
+{
+	state->dll_count = 0;
+	state->n_predicted = 0;
+	state->prediction_error = 0;
+	state->measurement_error = 0;
+	state->dll_period = 1.0 / state->rate;
+	state->rate_diff = 1.0;
+}
+
+/* Second order delay locked loop as described by Fons Adriaensen in
+ * "Using a DLL to filter time", extended to a variable number of frames
+ * between updates. It filters the jitter out of the ticks/monotonic time
+ * pairs and measures the real frame period of the device. */
+static void dll_update(struct state *state, int64_t ticks, int64_t monotonic)
+{
+	double now = monotonic / (double) SPA_NSEC_PER_SEC;
+	double err, omega;
+	int64_t frames;
+
+	if (state->dll_count == 0) {
+		state->dll_ticks = ticks;
+		state->dll_time = now;
+		state->dll_count++;
+		return;
+	}
+
+	frames = ticks - state->dll_ticks;
+	if (frames <= 0)
+		return;
+
+	/* reset after a discontinuity, such as a suspend */
+	err = now - (state->dll_time + frames * state->dll_period);
+	state->measurement_error = err * SPA_NSEC_PER_SEC;
+	if (fabs(err) > 0.1) {
+		spa_log_debug(state->log, "alsa %p: dll reset, error %f", state, err);
+		dll_reset(state);
+		return;
+	}
+
+	/* the updates are up to MAX_PREDICTED wakeups apart, the coefficients
+	 * are scaled to the time since the last update. A long time with a
+	 * large period would make the loop unstable, limit the gain. */
+	omega = 2.0 * M_PI * DLL_BANDWIDTH * frames * state->dll_period;
+	omega = SPA_MIN(omega, DLL_MAX_OMEGA);
+	state->dll_time += frames * state->dll_period + M_SQRT2 * omega * err;
+	state->dll_period += omega * omega * err / frames;
+	state->dll_ticks = ticks;
+
+	if (state->dll_count < DLL_SETTLE)
+		state->dll_count++;
+	else
+		state->rate_diff = 1.0 / (state->dll_period * state->rate);
+
+	spa_log_trace(state->log, "alsa %p: dll error %f rate diff %f", state, err,
+		      state->rate_diff);
+}
+
+/* The position of the device at \a monotonic as predicted by the DLL,
+ * false when the DLL has not settled yet. */
+static bool dll_predict(struct state *state, int64_t monotonic, int64_t *ticks)
+{
+	double now = monotonic / (double) SPA_NSEC_PER_SEC;
+
+	if (state->dll_count < DLL_SETTLE)
+		return false;
+
+	*ticks = state->dll_ticks + (int64_t) ((now - state->dll_time) / state->dll_period);
+	return true;
+}
+
+/* Feed a measured position to the DLL. The prediction error is the
+ * difference with the position predicted from the previous updates. */
+static void dll_measure(struct state *state, int64_t ticks, int64_t monotonic)
+{
+	int64_t pticks;
+
+	if (dll_predict(state, monotonic, &pticks)) {
+		state->prediction_error = (pticks - ticks) * state->dll_period *
+			SPA_NSEC_PER_SEC;
+		spa_log_trace(state->log, "alsa %p: prediction error %ld ns", state,
+			      state->prediction_error);
+	}
+	dll_update(state, ticks, monotonic);
+}
+
+int spa_alsa_get_rate_diff(struct state *state, double *rate_diff)
+{
+	if (!state->started || state->dll_count < DLL_SETTLE)
+		return -EIO;
+
+	*rate_diff = state->rate_diff;
+	return 0;
+}
+
+int spa_alsa_get_error(struct state *state, int64_t *prediction_error, int64_t *measurement_error)
+{
+	if (!state->started || state->dll_count < DLL_SETTLE)
+		return -EIO;
+
+	if (prediction_error)
+		*prediction_error = state->prediction_error;
+	if (measurement_error)
+		*measurement_error = state->measurement_error;
+	return 0;
+}
+
+static void emit_xrun(struct state *state, uint64_t missing)
+{
+	struct spa_event_node_xrun xrun =
+		SPA_EVENT_NODE_XRUN_INIT(state->type.event_node.Xrun,
+					 missing, state->last_monotonic);
+
+	state->callbacks->event(state->callbacks_data, (struct spa_event *) &xrun);
+}
+
 static inline void try_pull(struct state *state, snd_pcm_uframes_t frames,
 		snd_pcm_uframes_t written, bool do_pull)
 {
@@ -418,9 +610,11 @@ pull_frames(struct state *state,
 		underrun = true;
 	}
 
+	/* report the underrun when it is over or every second */
 	if (state->underrun > 0) {
 		if (state->underrun >= state->rate || !underrun) {
 			spa_log_warn(state->log, "underrun, for %zd frames", state->underrun);
+			emit_xrun(state, state->underrun);
 			state->underrun = 0;
 		}
 	}
@@ -438,6 +632,11 @@ push_frames(struct state *state,
 
 	if (spa_list_is_empty(&state->free)) {
 		spa_log_trace(state->log, "no more buffers");
+		state->overrun += frames;
+		if (state->overrun >= state->rate) {
+			emit_xrun(state, state->overrun);
+			state->overrun = 0;
+		}
 	} else {
 		uint8_t *src;
 		size_t n_bytes;
@@ -445,6 +644,12 @@ push_frames(struct state *state,
 		struct spa_data *d;
 		uint32_t index, offs, avail, l0, l1;
 
+		/* report the overrun when it is over or every second */
+		if (state->overrun > 0) {
+			emit_xrun(state, state->overrun);
+			state->overrun = 0;
+		}
+
 		b = spa_list_first(&state->free, struct buffer, link);
 		spa_list_remove(&b->link);
 
@@ -498,6 +703,48 @@ static int alsa_try_resume(struct state *state)
 	return res;
 }
 
+/* number of wakeups that use the predicted position of the device before
+ * it is measured again */
+#define MAX_PREDICTED	32
+
+static inline int64_t get_monotonic(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_TIME(&ts);
+}
+
+static int get_status(struct state *state, snd_pcm_sframes_t *avail, int64_t *monotonic)
+{
+	snd_pcm_status_t *status;
+	int res;
+
+	snd_pcm_status_alloca(&status);
+
+	if ((res = snd_pcm_status(state->hndl, status)) < 0) {
+		spa_log_error(state->log, "snd_pcm_status error: %s", snd_strerror(res));
+		return res;
+	}
+
+	*avail = snd_pcm_status_get_avail(status);
+	snd_pcm_status_get_htstamp(status, &state->now);
+	*monotonic = SPA_TIMESPEC_TO_TIME(&state->now);
+
+	return 0;
+}
+
+static void set_timeout(struct state *state, int64_t time)
+{
+	struct itimerspec ts;
+
+	ts.it_value.tv_sec = time / SPA_NSEC_PER_SEC;
+	ts.it_value.tv_nsec = time % SPA_NSEC_PER_SEC;
+	ts.it_interval.tv_sec = 0;
+	ts.it_interval.tv_nsec = 0;
+	timerfd_settime(state->timerfd, TFD_TIMER_ABSTIME, &ts, NULL);
+}
+
 static void alsa_on_playback_timeout_event(struct spa_source *source)
 {
 	uint64_t exp;
@@ -505,37 +752,50 @@ static void alsa_on_playback_timeout_event(struct spa_source *source)
 	struct state *state = source->data;
 	snd_pcm_t *hndl = state->hndl;
 	snd_pcm_sframes_t avail;
-	struct itimerspec ts;
 	snd_pcm_uframes_t total_written = 0;
 	const snd_pcm_channel_area_t *my_areas;
-	snd_pcm_status_t *status;
+	int64_t ticks, monotonic, timeout;
+	bool predicted = false;
 
 	if (state->started && read(state->timerfd, &exp, sizeof(uint64_t)) != sizeof(uint64_t))
 		spa_log_warn(state->log, "error reading timerfd: %s", strerror(errno));
 
-	snd_pcm_status_alloca(&status);
-
-	if ((res = snd_pcm_status(hndl, status)) < 0) {
-		spa_log_error(state->log, "snd_pcm_status error: %s", snd_strerror(res));
-		return;
+	/* between measurements, the fill level is predicted from the DLL. This
+	 * saves the status ioctl on most wakeups. */
+	if (state->alsa_started && state->n_predicted < MAX_PREDICTED) {
+		monotonic = get_monotonic();
+		if (dll_predict(state, monotonic, &ticks) &&
+		    ticks < state->sample_count) {
+			avail = state->buffer_frames - (state->sample_count - ticks);
+			predicted = true;
+		}
 	}
 
-	avail = snd_pcm_status_get_avail(status);
-	snd_pcm_status_get_htstamp(status, &state->now);
+	if (predicted) {
+		state->n_predicted++;
+	} else {
+		if ((res = get_status(state, &avail, &monotonic)) < 0)
+			return;
 
-	if (avail > state->buffer_frames)
-		avail = state->buffer_frames;
+		avail = SPA_MIN(avail, (snd_pcm_sframes_t) state->buffer_frames);
+		ticks = state->sample_count - (state->buffer_frames - avail);
 
-	state->filled = state->buffer_frames - avail;
+		state->n_predicted = 0;
 
-	state->last_ticks = state->sample_count - state->filled;
-	state->last_monotonic = (int64_t) state->now.tv_sec * SPA_NSEC_PER_SEC + (int64_t) state->now.tv_nsec;
+		if (state->alsa_started)
+			dll_measure(state, ticks, monotonic);
+	}
+	avail = SPA_CLAMP(avail, 0, (snd_pcm_sframes_t) state->buffer_frames);
+
+	state->filled = state->buffer_frames - avail;
+	state->last_ticks = ticks;
+	state->last_monotonic = monotonic;
 
-	spa_log_trace(state->log, "timeout %ld %d %ld %ld %ld", state->filled, state->threshold,
-		      state->sample_count, state->now.tv_sec, state->now.tv_nsec);
+	spa_log_trace(state->log, "timeout %ld %d %ld %ld %d", state->filled, state->threshold,
+		      state->sample_count, monotonic, predicted);
 
 	if (state->filled > state->threshold) {
-		if (snd_pcm_state(hndl) == SND_PCM_STATE_SUSPENDED) {
+		if (!predicted && snd_pcm_state(hndl) == SND_PCM_STATE_SUSPENDED) {
 			spa_log_error(state->log, "suspended: try resume");
 			if ((res = alsa_try_resume(state)) < 0)
 				return;
@@ -561,8 +821,11 @@ static void alsa_on_playback_timeout_event(struct spa_source *source)
 			spa_log_trace(state->log, "commit %ld %ld", offset, written);
 			if ((res = snd_pcm_mmap_commit(hndl, offset, written)) < 0) {
 				spa_log_error(state->log, "snd_pcm_mmap_commit error: %s", snd_strerror(res));
+				/* measure again on the next wakeup */
+				state->n_predicted = MAX_PREDICTED;
 				if (res != -EPIPE && res != -ESTRPIPE)
 					return;
+				emit_xrun(state, 0);
 			}
 			total_written += written;
 			state->sample_count += written;
@@ -579,14 +842,14 @@ static void alsa_on_playback_timeout_event(struct spa_source *source)
 		state->alsa_started = true;
 	}
 
-	calc_timeout(state->filled, state->threshold, state->rate, &state->now, &ts.it_value);
-
-	ts.it_interval.tv_sec = 0;
-	ts.it_interval.tv_nsec = 0;
-	timerfd_settime(state->timerfd, TFD_TIMER_ABSTIME, &ts, NULL);
+	/* wake up when threshold frames are left in the device, with the
+	 * measured speed of the device */
+	timeout = monotonic;
+	if (state->filled > state->threshold)
+		timeout += (state->filled - state->threshold) * state->dll_period * SPA_NSEC_PER_SEC;
+	set_timeout(state, timeout);
 }
 
-
 static void alsa_on_capture_timeout_event(struct spa_source *source)
 {
 	uint64_t exp;
@@ -616,6 +879,8 @@ static void alsa_on_capture_timeout_event(struct spa_source *source)
 	state->last_ticks = state->sample_count + avail;
 	state->last_monotonic = (int64_t) htstamp.tv_sec * SPA_NSEC_PER_SEC + (int64_t) htstamp.tv_nsec;
 
+	dll_measure(state, state->last_ticks, state->last_monotonic);
+
 	spa_log_trace(state->log, "timeout %ld %d %ld %ld %ld", avail, state->threshold,
 		      state->sample_count, htstamp.tv_sec, htstamp.tv_nsec);
 
@@ -645,6 +910,7 @@ static void alsa_on_capture_timeout_event(struct spa_source *source)
 				spa_log_error(state->log, "snd_pcm_mmap_commit error: %s", snd_strerror(res));
 				if (res != -EPIPE && res != -ESTRPIPE)
 					return;
+				emit_xrun(state, 0);
 			}
 			total_read += read;
 		}
@@ -686,7 +952,8 @@ int spa_alsa_start(struct state *state, bool xrun_recover)
 	state->source.rmask = 0;
 	spa_loop_add_source(state->data_loop, &state->source);
 
-	state->threshold = state->props.min_latency;
+	state->threshold = get_threshold(state);
+	dll_reset(state);
 
 	if (state->stream == SND_PCM_STREAM_PLAYBACK) {
 		state->alsa_started = false;
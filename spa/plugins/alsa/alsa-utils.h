@@ -46,6 +46,7 @@ struct props {
 	char card_name[128];
 	uint32_t min_latency;
 	uint32_t max_latency;
+	uint32_t quantum;
 };
 
 #define MAX_BUFFERS 32
@@ -67,6 +68,7 @@ struct type {
 	uint32_t prop_card_name;
 	uint32_t prop_min_latency;
 	uint32_t prop_max_latency;
+	uint32_t prop_quantum;
 	struct spa_type_io io;
 	struct spa_type_param param;
 	struct spa_type_meta meta;
@@ -93,6 +95,7 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 	type->prop_card_name = spa_type_map_get_id(map, SPA_TYPE_PROPS__cardName);
 	type->prop_min_latency = spa_type_map_get_id(map, SPA_TYPE_PROPS__minLatency);
 	type->prop_max_latency = spa_type_map_get_id(map, SPA_TYPE_PROPS__maxLatency);
+	type->prop_quantum = spa_type_map_get_id(map, SPA_TYPE_PROPS__quantum);
 
 	spa_type_io_map(map, &type->io);
 	spa_type_param_map(map, &type->param);
@@ -113,6 +116,9 @@ struct state {
 	struct spa_handle handle;
 	struct spa_node node;
 	struct spa_clock clock;
+	char clock_domain[64];
+	struct spa_dict_item clock_info_items[1];
+	struct spa_dict clock_info;
 
 	uint32_t seq;
 
@@ -167,7 +173,20 @@ struct state {
 	int64_t last_ticks;
 	int64_t last_monotonic;
 
+	/* delay locked loop that measures the speed of the device clock
+	 * against the monotonic clock */
+	uint32_t dll_count;
+	int64_t dll_ticks;
+	double dll_time;		/* filtered monotonic time of dll_ticks in seconds */
+	double dll_period;		/* measured seconds per frame */
+	double rate_diff;		/* measured rate / nominal rate */
+
+	uint32_t n_predicted;		/* wakeups since the last measurement */
+	int64_t prediction_error;	/* predicted - measured position in nsec */
+	int64_t measurement_error;	/* error of the last measurement in nsec */
+
 	uint64_t underrun;
+	uint64_t overrun;
 };
 
 int
@@ -183,6 +202,11 @@ int spa_alsa_start(struct state *state, bool xrun_recover);
 int spa_alsa_pause(struct state *state, bool xrun_recover);
 int spa_alsa_close(struct state *state);
 
+int spa_alsa_get_rate_diff(struct state *state, double *rate_diff);
+int spa_alsa_get_error(struct state *state, int64_t *prediction_error, int64_t *measurement_error);
+int spa_alsa_update_threshold(struct state *state);
+void spa_alsa_update_clock_info(struct state *state);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,1277 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+#include <spa/support/log.h>
+#include <spa/support/type-map.h>
+#include <spa/utils/list.h>
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/param/buffers.h>
+#include <spa/param/meta.h>
+#include <spa/param/io.h>
+
+#include <lib/pod.h>
+
+#include "fmt-ops.h"
+#include "channelmix-ops.h"
+#include "resample.h"
+
+#define NAME "audioconvert"
+
+#define DEFAULT_RATE		44100
+#define DEFAULT_CHANNELS	2
+
+#define DEFAULT_PROP_RATE	1.0
+#define DEFAULT_PROP_ADAPTIVE	false
+
+struct props {
+	double rate;
+	bool adaptive;
+};
+
+static void reset_props(struct props *props)
+{
+	props->rate = DEFAULT_PROP_RATE;
+	props->adaptive = DEFAULT_PROP_ADAPTIVE;
+}
+
+#define MAX_BUFFERS	16
+/* number of frames that are converted in one go */
+#define MAX_SAMPLES	1024
+
+struct buffer {
+	struct spa_buffer *outbuf;
+	bool outstanding;
+	struct spa_meta_header *h;
+	struct spa_list link;
+};
+
+struct port {
+	bool have_format;
+	struct spa_audio_info format;
+	const struct format_info *fmt;
+	uint32_t layout;
+	uint32_t bpf;
+
+	struct spa_port_info info;
+
+	struct buffer buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
+	struct spa_io_buffers *io;
+	struct spa_io_control_range *range;
+
+	uint32_t offset;		/**< frames of the input buffer that are consumed */
+
+	struct spa_list empty;
+};
+
+struct type {
+	uint32_t node;
+	uint32_t format;
+	uint32_t props;
+	uint32_t prop_rate;
+	uint32_t prop_adaptive;
+	struct spa_type_io io;
+	struct spa_type_param param;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
+	struct spa_type_command_node command_node;
+	struct spa_type_param_buffers param_buffers;
+	struct spa_type_param_meta param_meta;
+	struct spa_type_param_io param_io;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
+	type->prop_rate = spa_type_map_get_id(map, SPA_TYPE_PROPS__rate);
+	type->prop_adaptive = spa_type_map_get_id(map, SPA_TYPE_PROPS__adaptive);
+	spa_type_io_map(map, &type->io);
+	spa_type_param_map(map, &type->param);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_format_audio_map(map, &type->format_audio);
+	spa_type_audio_format_map(map, &type->audio_format);
+	spa_type_command_node_map(map, &type->command_node);
+	spa_type_param_buffers_map(map, &type->param_buffers);
+	spa_type_param_meta_map(map, &type->param_meta);
+	spa_type_param_io_map(map, &type->param_io);
+}
+
+struct impl {
+	struct spa_handle handle;
+	struct spa_node node;
+
+	struct type type;
+	struct spa_type_map *map;
+	struct spa_log *log;
+
+	struct props props;
+
+	const struct spa_node_callbacks *callbacks;
+	void *callbacks_data;
+
+	struct port in_ports[1];
+	struct port out_ports[1];
+
+	/* the conversion pipeline: input format -> planar float -> channel
+	 * mix -> resample -> output format */
+	bool configured;
+	convert_func_t to_f32d;
+	convert_func_t from_f32d;
+	bool do_mix;
+	struct channelmix mix;
+	bool do_resample;
+	struct resample resample;
+	uint32_t quality;
+	float *tmp;
+	float *tmp_planes[3][CHANNELMIX_MAX_CHANNELS];
+
+	bool started;
+};
+
+#define CHECK_IN_PORT(this,d,p)  ((d) == SPA_DIRECTION_INPUT && (p) == 0)
+#define CHECK_OUT_PORT(this,d,p) ((d) == SPA_DIRECTION_OUTPUT && (p) == 0)
+#define CHECK_PORT(this,d,p)     ((p) == 0)
+#define GET_IN_PORT(this,p)	 (&this->in_ports[p])
+#define GET_OUT_PORT(this,p)	 (&this->out_ports[p])
+#define GET_PORT(this,d,p)	 (d == SPA_DIRECTION_INPUT ? GET_IN_PORT(this,p) : GET_OUT_PORT(this,p))
+
+static void clear_convert(struct impl *this)
+{
+	if (this->do_resample)
+		resample_free(&this->resample);
+	this->do_resample = false;
+	free(this->tmp);
+	this->tmp = NULL;
+	this->configured = false;
+}
+
+static int setup_convert(struct impl *this)
+{
+	struct port *in_port = GET_IN_PORT(this, 0), *out_port = GET_OUT_PORT(this, 0);
+	struct spa_audio_info_raw *in = &in_port->format.info.raw;
+	struct spa_audio_info_raw *out = &out_port->format.info.raw;
+	uint32_t i, c, max_channels;
+	int res;
+
+	clear_convert(this);
+
+	if (!in_port->have_format || !out_port->have_format)
+		return 0;
+
+	this->to_f32d = get_to_f32d(in_port->fmt, in_port->layout, in->channels);
+	this->from_f32d = get_from_f32d(out_port->fmt, out_port->layout, out->channels);
+	if (this->to_f32d == NULL || this->from_f32d == NULL)
+		return -ENOTSUP;
+
+	this->mix.src_chan = in->channels;
+	this->mix.dst_chan = out->channels;
+	this->mix.src_mask = in->channel_mask;
+	this->mix.dst_mask = out->channel_mask;
+	if ((res = channelmix_init(&this->mix)) < 0)
+		return res;
+	this->do_mix = !this->mix.identity;
+
+	/* in adaptive mode the resampler follows the rate property */
+	if (in->rate != out->rate || this->props.adaptive) {
+		this->resample.channels = out->channels;
+		this->resample.i_rate = in->rate;
+		this->resample.o_rate = out->rate;
+		this->resample.quality = this->quality;
+		if ((res = resample_init(&this->resample)) < 0)
+			return res;
+		this->do_resample = true;
+	}
+
+	max_channels = SPA_MAX(in->channels, out->channels);
+	this->tmp = malloc(3 * max_channels * MAX_SAMPLES * sizeof(float));
+	if (this->tmp == NULL) {
+		clear_convert(this);
+		return -ENOMEM;
+	}
+	for (i = 0; i < 3; i++) {
+		for (c = 0; c < max_channels; c++)
+			this->tmp_planes[i][c] = &this->tmp[(i * max_channels + c) * MAX_SAMPLES];
+	}
+	this->configured = true;
+
+	spa_log_info(this->log, NAME " %p: %d channels %d Hz -> %d channels %d Hz, mix:%d resample:%d",
+		     this, in->channels, in->rate, out->channels, out->rate,
+		     this->do_mix, this->do_resample);
+
+	return 0;
+}
+
+static int impl_node_enum_params(struct spa_node *node,
+				 uint32_t id, uint32_t *index,
+				 const struct spa_pod *filter,
+				 struct spa_pod **result,
+				 struct spa_pod_builder *builder)
+{
+	struct impl *this;
+	struct type *t;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_pod *param;
+	struct props *p;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+	spa_return_val_if_fail(builder != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+	p = &this->props;
+
+      next:
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	if (id == t->param.idList) {
+		uint32_t list[] = { t->param.idPropInfo,
+				    t->param.idProps };
+
+		if (*index < SPA_N_ELEMENTS(list))
+			param = spa_pod_builder_object(&b, id, t->param.List,
+				":", t->param.listId, "I", list[*index]);
+		else
+			return 0;
+	}
+	else if (id == t->param.idPropInfo) {
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_rate,
+				":", t->param.propName, "s", "Adjustment of the input rate",
+				":", t->param.propType, "dr", p->rate, 2, 0.5, 2.0);
+			break;
+		case 1:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_adaptive,
+				":", t->param.propName, "s", "Always resample to follow the rate",
+				":", t->param.propType, "b", p->adaptive);
+			break;
+		default:
+			return 0;
+		}
+	}
+	else if (id == t->param.idProps) {
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->props,
+				":", t->prop_rate,     "d", p->rate,
+				":", t->prop_adaptive, "b", p->adaptive);
+			break;
+		default:
+			return 0;
+		}
+	}
+	else
+		return -ENOENT;
+
+	(*index)++;
+
+	if (spa_pod_filter(builder, result, param, filter) < 0)
+		goto next;
+
+	return 1;
+}
+
+static int impl_node_set_param(struct spa_node *node, uint32_t id, uint32_t flags,
+			       const struct spa_pod *param)
+{
+	struct impl *this;
+	struct type *t;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+
+	if (id == t->param.idProps) {
+		struct props *p = &this->props;
+		double rate = p->rate;
+
+		if (param == NULL) {
+			reset_props(p);
+			return 0;
+		}
+		spa_pod_object_parse(param,
+			":", t->prop_rate,     "?d", &rate,
+			":", t->prop_adaptive, "?b", &p->adaptive, NULL);
+
+		/* the rate is picked up by the data thread on the next cycle */
+		p->rate = SPA_CLAMP(rate, 0.5, 2.0);
+	}
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static int impl_node_send_command(struct spa_node *node, const struct spa_command *command)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+	spa_return_val_if_fail(command != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	if (SPA_COMMAND_TYPE(command) == this->type.command_node.Start) {
+		this->started = true;
+	} else if (SPA_COMMAND_TYPE(command) == this->type.command_node.Pause) {
+		this->started = false;
+	} else
+		return -ENOTSUP;
+
+	return 0;
+}
+
+static int
+impl_node_set_callbacks(struct spa_node *node,
+			const struct spa_node_callbacks *callbacks,
+			void *data)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	this->callbacks = callbacks;
+	this->callbacks_data = data;
+
+	return 0;
+}
+
+static int
+impl_node_get_n_ports(struct spa_node *node,
+		      uint32_t *n_input_ports,
+		      uint32_t *max_input_ports,
+		      uint32_t *n_output_ports,
+		      uint32_t *max_output_ports)
+{
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	if (n_input_ports)
+		*n_input_ports = 1;
+	if (max_input_ports)
+		*max_input_ports = 1;
+	if (n_output_ports)
+		*n_output_ports = 1;
+	if (max_output_ports)
+		*max_output_ports = 1;
+
+	return 0;
+}
+
+static int
+impl_node_get_port_ids(struct spa_node *node,
+		       uint32_t *input_ids,
+		       uint32_t n_input_ids,
+		       uint32_t *output_ids,
+		       uint32_t n_output_ids)
+{
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	if (n_input_ids > 0 && input_ids)
+		input_ids[0] = 0;
+	if (n_output_ids > 0 && output_ids)
+		output_ids[0] = 0;
+
+	return 0;
+}
+
+static int impl_node_add_port(struct spa_node *node, enum spa_direction direction, uint32_t port_id)
+{
+	return -ENOTSUP;
+}
+
+static int
+impl_node_remove_port(struct spa_node *node, enum spa_direction direction, uint32_t port_id)
+{
+	return -ENOTSUP;
+}
+
+static int
+impl_node_port_get_info(struct spa_node *node,
+			enum spa_direction direction,
+			uint32_t port_id,
+			const struct spa_port_info **info)
+{
+	struct impl *this;
+	struct port *port;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+	spa_return_val_if_fail(info != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	port = GET_PORT(this, direction, port_id);
+	*info = &port->info;
+
+	return 0;
+}
+
+static int port_enum_formats(struct spa_node *node,
+			     enum spa_direction direction, uint32_t port_id,
+			     uint32_t *index,
+			     const struct spa_pod *filter,
+			     struct spa_pod **result,
+			     struct spa_pod_builder *builder)
+{
+	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	struct type *t = &this->type;
+	struct port *other;
+	const struct format_info *infos;
+	uint32_t i, n_infos, rate, channels;
+	uint8_t buffer[2048];
+	struct spa_pod_builder b = { 0 };
+	struct spa_pod *fmt;
+
+	if (*index > 0)
+		return 0;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	/* prefer the rate and channels of the other side so that no
+	 * resampling or mixing is needed */
+	other = direction == SPA_DIRECTION_INPUT ? GET_OUT_PORT(this, 0) : GET_IN_PORT(this, 0);
+	if (other->have_format) {
+		rate = other->format.info.raw.rate;
+		channels = other->format.info.raw.channels;
+	} else {
+		rate = DEFAULT_RATE;
+		channels = DEFAULT_CHANNELS;
+	}
+
+	spa_pod_builder_push_object(&b, t->param.idEnumFormat, t->format);
+	spa_pod_builder_add(&b,
+			"I", t->media_type.audio,
+			"I", t->media_subtype.raw, 0);
+
+	spa_pod_builder_push_prop(&b, t->format_audio.format,
+			SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET);
+	infos = get_format_infos(&n_infos);
+	/* the first format is the default */
+	spa_pod_builder_id(&b, format_info_id(&t->audio_format, &infos[0]));
+	for (i = 0; i < n_infos; i++)
+		spa_pod_builder_id(&b, format_info_id(&t->audio_format, &infos[i]));
+	spa_pod_builder_pop(&b);
+
+	spa_pod_builder_add(&b,
+		":", t->format_audio.layout,   "ieu", SPA_AUDIO_LAYOUT_INTERLEAVED,
+							2, SPA_AUDIO_LAYOUT_INTERLEAVED,
+							   SPA_AUDIO_LAYOUT_NON_INTERLEAVED,
+		":", t->format_audio.rate,     "iru", rate,
+							2, 1, INT32_MAX,
+		":", t->format_audio.channels, "iru", channels,
+							2, 1, CHANNELMIX_MAX_CHANNELS,
+		NULL);
+
+	fmt = spa_pod_builder_pop(&b);
+
+	(*index)++;
+
+	if (spa_pod_filter(builder, result, fmt, filter) < 0)
+		return 0;
+
+	return 1;
+}
+
+static int port_get_format(struct spa_node *node,
+			   enum spa_direction direction, uint32_t port_id,
+			   uint32_t *index,
+			   const struct spa_pod *filter,
+			   struct spa_pod **param,
+			   struct spa_pod_builder *builder)
+{
+	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	struct port *port;
+	struct type *t = &this->type;
+
+	port = GET_PORT(this, direction, port_id);
+
+	if (!port->have_format)
+		return -EIO;
+	if (*index > 0)
+		return 0;
+
+	*param = spa_pod_builder_object(builder,
+			t->param.idFormat, t->format,
+			"I", t->media_type.audio,
+			"I", t->media_subtype.raw,
+			":", t->format_audio.format,   "I", port->format.info.raw.format,
+			":", t->format_audio.layout,   "i", port->format.info.raw.layout,
+			":", t->format_audio.rate,     "i", port->format.info.raw.rate,
+			":", t->format_audio.channels, "i", port->format.info.raw.channels);
+
+	return 1;
+}
+
+static int
+impl_node_port_enum_params(struct spa_node *node,
+			   enum spa_direction direction, uint32_t port_id,
+			   uint32_t id, uint32_t *index,
+			   const struct spa_pod *filter,
+			   struct spa_pod **result,
+			   struct spa_pod_builder *builder)
+{
+	struct impl *this;
+	struct type *t;
+	struct port *port;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[2048];
+	struct spa_pod *param;
+	int res;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+	spa_return_val_if_fail(builder != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	port = GET_PORT(this, direction, port_id);
+
+      next:
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	if (id == t->param.idList) {
+		uint32_t list[] = { t->param.idEnumFormat,
+				    t->param.idFormat,
+				    t->param.idBuffers,
+				    t->param.idMeta,
+				    t->param_io.idBuffers,
+				    t->param_io.idControl };
+
+		if (*index < SPA_N_ELEMENTS(list))
+			param = spa_pod_builder_object(&b, id, t->param.List,
+				":", t->param.listId, "I", list[*index]);
+		else
+			return 0;
+	}
+	else if (id == t->param.idEnumFormat) {
+		return port_enum_formats(node, direction, port_id, index, filter, result, builder);
+	}
+	else if (id == t->param.idFormat) {
+		if ((res = port_get_format(node, direction, port_id, index, filter, &param, &b)) <= 0)
+			return res;
+	}
+	else if (id == t->param.idBuffers) {
+		if (!port->have_format)
+			return -EIO;
+		if (*index > 0)
+			return 0;
+
+		/* planar data is stored as consecutive planes in one block */
+		param = spa_pod_builder_object(&b,
+			id, t->param_buffers.Buffers,
+			":", t->param_buffers.size,    "iru", MAX_SAMPLES * port->bpf,
+									2, 16 * port->bpf,
+									   INT32_MAX / port->bpf,
+			":", t->param_buffers.stride,  "i", 0,
+			":", t->param_buffers.buffers, "iru", 2,
+									2, 1, MAX_BUFFERS,
+			":", t->param_buffers.align,   "i", 16);
+	}
+	else if (id == t->param.idMeta) {
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param_meta.Meta,
+				":", t->param_meta.type, "I", t->meta.Header,
+				":", t->param_meta.size, "i", sizeof(struct spa_meta_header));
+			break;
+		default:
+			return 0;
+		}
+	}
+	else if (id == t->param_io.idBuffers) {
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param_io.Buffers,
+				":", t->param_io.id, "I", t->io.Buffers,
+				":", t->param_io.size, "i", sizeof(struct spa_io_buffers));
+			break;
+		default:
+			return 0;
+		}
+	}
+	else if (id == t->param_io.idControl) {
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param_io.Control,
+				":", t->param_io.id, "I", t->io.ControlRange,
+				":", t->param_io.size, "i", sizeof(struct spa_io_control_range));
+			break;
+		default:
+			return 0;
+		}
+	}
+	else
+		return -ENOENT;
+
+	(*index)++;
+
+	if (spa_pod_filter(builder, result, param, filter) < 0)
+		goto next;
+
+	return 1;
+}
+
+static int clear_buffers(struct impl *this, struct port *port)
+{
+	if (port->n_buffers > 0) {
+		spa_log_info(this->log, NAME " %p: clear buffers", this);
+		port->n_buffers = 0;
+		port->offset = 0;
+		spa_list_init(&port->empty);
+	}
+	return 0;
+}
+
+static int port_set_format(struct spa_node *node,
+			   enum spa_direction direction, uint32_t port_id,
+			   uint32_t flags,
+			   const struct spa_pod *format)
+{
+	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	struct port *port;
+	int res;
+
+	port = GET_PORT(this, direction, port_id);
+
+	if (format == NULL) {
+		port->have_format = false;
+		clear_buffers(this, port);
+		clear_convert(this);
+	} else {
+		struct spa_audio_info info = { 0 };
+		const struct format_info *fmt;
+
+		spa_pod_object_parse(format,
+			"I", &info.media_type,
+			"I", &info.media_subtype);
+
+		if (info.media_type != this->type.media_type.audio ||
+		    info.media_subtype != this->type.media_subtype.raw)
+			return -EINVAL;
+
+		if (spa_format_audio_raw_parse(format, &info.info.raw, &this->type.format_audio) < 0)
+			return -EINVAL;
+
+		if (info.info.raw.channels == 0 ||
+		    info.info.raw.channels > CHANNELMIX_MAX_CHANNELS ||
+		    info.info.raw.rate == 0)
+			return -EINVAL;
+
+		if ((fmt = find_format_info(&this->type.audio_format, info.info.raw.format)) == NULL)
+			return -ENOTSUP;
+
+		port->format = info;
+		port->fmt = fmt;
+		port->layout = info.info.raw.layout == SPA_AUDIO_LAYOUT_NON_INTERLEAVED ?
+			LAYOUT_PLANAR : LAYOUT_INTERLEAVED;
+		port->bpf = fmt->width * info.info.raw.channels;
+		port->have_format = true;
+
+		if ((res = setup_convert(this)) < 0) {
+			port->have_format = false;
+			return res;
+		}
+	}
+
+	return 0;
+}
+
+static int
+impl_node_port_set_param(struct spa_node *node,
+			 enum spa_direction direction, uint32_t port_id,
+			 uint32_t id, uint32_t flags,
+			 const struct spa_pod *param)
+{
+	struct impl *this;
+	struct type *t;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	if (id == t->param.idFormat) {
+		return port_set_format(node, direction, port_id, flags, param);
+	}
+	else
+		return -ENOENT;
+}
+
+static int
+impl_node_port_use_buffers(struct spa_node *node,
+			   enum spa_direction direction,
+			   uint32_t port_id,
+			   struct spa_buffer **buffers,
+			   uint32_t n_buffers)
+{
+	struct impl *this;
+	struct port *port;
+	uint32_t i, j;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	port = GET_PORT(this, direction, port_id);
+
+	if (!port->have_format)
+		return -EIO;
+
+	clear_buffers(this, port);
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b;
+		struct spa_data *d = buffers[i]->datas;
+
+		b = &port->buffers[i];
+		b->outbuf = buffers[i];
+		b->outstanding = direction == SPA_DIRECTION_INPUT;
+		b->h = spa_buffer_find_meta(buffers[i], this->type.meta.Header);
+
+		for (j = 0; j < buffers[i]->n_datas; j++) {
+			if ((d[j].type != this->type.data.MemPtr &&
+			     d[j].type != this->type.data.MemFd &&
+			     d[j].type != this->type.data.DmaBuf) || d[j].data == NULL) {
+				spa_log_error(this->log, NAME " %p: invalid memory on buffer %p", this,
+					      buffers[i]);
+				return -EINVAL;
+			}
+		}
+		if (buffers[i]->n_datas == 0) {
+			spa_log_error(this->log, NAME " %p: no data on buffer %p", this,
+				      buffers[i]);
+			return -EINVAL;
+		}
+		if (!b->outstanding)
+			spa_list_append(&port->empty, &b->link);
+	}
+	port->n_buffers = n_buffers;
+
+	return 0;
+}
+
+static int
+impl_node_port_alloc_buffers(struct spa_node *node,
+			     enum spa_direction direction,
+			     uint32_t port_id,
+			     struct spa_pod **params,
+			     uint32_t n_params,
+			     struct spa_buffer **buffers,
+			     uint32_t *n_buffers)
+{
+	return -ENOTSUP;
+}
+
+static int
+impl_node_port_set_io(struct spa_node *node,
+		      enum spa_direction direction,
+		      uint32_t port_id,
+		      uint32_t id,
+		      void *data, size_t size)
+{
+	struct impl *this;
+	struct port *port;
+	struct type *t;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	port = GET_PORT(this, direction, port_id);
+
+	if (id == t->io.Buffers)
+		port->io = data;
+	else if (id == t->io.ControlRange)
+		port->range = data;
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static void recycle_buffer(struct impl *this, uint32_t id)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct buffer *b = &port->buffers[id];
+
+	if (!b->outstanding) {
+		spa_log_warn(this->log, NAME " %p: buffer %d not outstanding", this, id);
+		return;
+	}
+
+	spa_list_append(&port->empty, &b->link);
+	b->outstanding = false;
+	spa_log_trace(this->log, NAME " %p: recycle buffer %d", this, id);
+}
+
+static int impl_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+{
+	struct impl *this;
+	struct port *port;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	spa_return_val_if_fail(CHECK_PORT(this, SPA_DIRECTION_OUTPUT, port_id),
+			       -EINVAL);
+
+	port = GET_OUT_PORT(this, port_id);
+
+	if (buffer_id >= port->n_buffers)
+		return -EINVAL;
+
+	recycle_buffer(this, buffer_id);
+
+	return 0;
+}
+
+static int
+impl_node_port_send_command(struct spa_node *node,
+			    enum spa_direction direction,
+			    uint32_t port_id,
+			    const struct spa_command *command)
+{
+	return -ENOTSUP;
+}
+
+static struct spa_buffer *find_free_buffer(struct impl *this, struct port *port)
+{
+	struct buffer *b;
+
+	if (spa_list_is_empty(&port->empty))
+		return NULL;
+
+	b = spa_list_first(&port->empty, struct buffer, link);
+	spa_list_remove(&b->link);
+	b->outstanding = true;
+
+	return b->outbuf;
+}
+
+/* Get pointers to the samples of every channel in \a buf and the number of
+ * frames. Planar data either uses one data block per channel or, when there
+ * are fewer data blocks than channels, the channels are consecutive planes
+ * of maxsize / channels bytes in the first data block. */
+static uint32_t get_planes(struct port *port, struct spa_buffer *buf, bool input,
+			   void **planes)
+{
+	struct spa_data *d = buf->datas;
+	uint32_t c, channels = port->format.info.raw.channels;
+	uint32_t width = port->fmt->width;
+	uint32_t offset, size, plane_size;
+
+	offset = input ? d[0].chunk->offset : 0;
+	size = input ? SPA_MIN(d[0].chunk->size, d[0].maxsize - offset) : d[0].maxsize;
+
+	if (port->layout == LAYOUT_INTERLEAVED) {
+		planes[0] = SPA_MEMBER(d[0].data, offset, void);
+		return size / port->bpf;
+	}
+	else if (buf->n_datas >= channels) {
+		for (c = 0; c < channels; c++) {
+			offset = input ? d[c].chunk->offset : 0;
+			planes[c] = SPA_MEMBER(d[c].data, offset, void);
+		}
+		return size / width;
+	}
+	else {
+		plane_size = (d[0].maxsize / channels / width) * width;
+		for (c = 0; c < channels; c++)
+			planes[c] = SPA_MEMBER(d[0].data, c * plane_size, void);
+		return input ? SPA_MIN(size / port->bpf, plane_size / width) : plane_size / width;
+	}
+}
+
+static void set_chunks(struct port *port, struct spa_buffer *buf, uint32_t n_frames)
+{
+	struct spa_data *d = buf->datas;
+	uint32_t c, channels = port->format.info.raw.channels;
+	uint32_t width = port->fmt->width;
+
+	if (port->layout == LAYOUT_PLANAR && buf->n_datas >= channels) {
+		for (c = 0; c < channels; c++) {
+			d[c].chunk->offset = 0;
+			d[c].chunk->size = n_frames * width;
+			d[c].chunk->stride = width;
+		}
+	} else {
+		d[0].chunk->offset = 0;
+		d[0].chunk->size = n_frames * port->bpf;
+		d[0].chunk->stride = port->layout == LAYOUT_PLANAR ? width : port->bpf;
+	}
+}
+
+static inline void offset_planes(struct port *port, void **planes, void **src, uint32_t offset)
+{
+	uint32_t c, n_planes = port->layout == LAYOUT_PLANAR ? port->format.info.raw.channels : 1;
+	uint32_t stride = port->layout == LAYOUT_PLANAR ? port->fmt->width : port->bpf;
+
+	for (c = 0; c < n_planes; c++)
+		planes[c] = SPA_MEMBER(src[c], offset * stride, void);
+}
+
+/* Convert the unconsumed samples in \a sbuf into \a dbuf. Returns true when
+ * the input buffer is completely consumed. */
+static bool convert(struct impl *this, struct spa_buffer *dbuf, struct spa_buffer *sbuf)
+{
+	struct port *in_port = GET_IN_PORT(this, 0), *out_port = GET_OUT_PORT(this, 0);
+	void *src[CHANNELMIX_MAX_CHANNELS], *dst[CHANNELMIX_MAX_CHANNELS];
+	void *sp[CHANNELMIX_MAX_CHANNELS], *dp[CHANNELMIX_MAX_CHANNELS];
+	uint32_t in_frames, out_frames, out_done = 0;
+	uint32_t in_channels = in_port->format.info.raw.channels;
+	uint32_t out_channels = out_port->format.info.raw.channels;
+
+	if (this->do_resample)
+		resample_update_rate(&this->resample, this->props.rate);
+
+	in_frames = get_planes(in_port, sbuf, true, src);
+	out_frames = get_planes(out_port, dbuf, false, dst);
+
+	while (out_done < out_frames) {
+		uint32_t n_in, n_out, avail = out_frames - out_done;
+		void **in = (void **) this->tmp_planes[0];
+		void **mixed = (void **) this->tmp_planes[1];
+
+		n_in = SPA_MIN(in_frames - in_port->offset, MAX_SAMPLES);
+		if (this->do_resample)
+			n_in = SPA_MIN(n_in, resample_in_len(&this->resample,
+							     SPA_MIN(avail, MAX_SAMPLES)));
+		else
+			n_in = SPA_MIN(n_in, avail);
+
+		if (n_in > 0) {
+			offset_planes(in_port, sp, src, in_port->offset);
+			this->to_f32d(in, (const void **) sp, in_channels, n_in);
+		}
+
+		if (this->do_mix)
+			channelmix_process(&this->mix, mixed, (const void **) in, n_in);
+		else
+			mixed = in;
+
+		if (this->do_resample) {
+			void **out = (void **) this->tmp_planes[2];
+
+			n_out = SPA_MIN(avail, MAX_SAMPLES);
+			resample_process(&this->resample, (const void **) mixed, &n_in, out, &n_out);
+			mixed = out;
+		} else
+			n_out = n_in;
+
+		if (n_in == 0 && n_out == 0)
+			break;
+
+		offset_planes(out_port, dp, dst, out_done);
+		this->from_f32d(dp, (const void **) mixed, out_channels, n_out);
+
+		in_port->offset += n_in;
+		out_done += n_out;
+	}
+	set_chunks(out_port, dbuf, out_done);
+
+	spa_log_trace(this->log, NAME " %p: converted %d/%d -> %d frames", this,
+		      in_port->offset, in_frames, out_done);
+
+	if (in_port->offset >= in_frames) {
+		in_port->offset = 0;
+		return true;
+	}
+	return false;
+}
+
+static int process(struct impl *this, struct spa_io_buffers *input, struct spa_io_buffers *output)
+{
+	struct port *in_port = GET_IN_PORT(this, 0), *out_port = GET_OUT_PORT(this, 0);
+	struct spa_buffer *dbuf, *sbuf;
+
+	if ((dbuf = find_free_buffer(this, out_port)) == NULL) {
+		spa_log_error(this->log, NAME " %p: out of buffers", this);
+		return -EPIPE;
+	}
+	sbuf = in_port->buffers[input->buffer_id].outbuf;
+
+	spa_log_trace(this->log, NAME " %p: convert %d -> %d", this, sbuf->id, dbuf->id);
+
+	/* the input buffer stays valid until we ask for a new one, we keep
+	 * the offset of the unconsumed samples and keep reporting the buffer
+	 * on the input until it is completely consumed */
+	if (convert(this, dbuf, sbuf))
+		input->status = SPA_STATUS_OK;
+	else
+		input->status = SPA_STATUS_HAVE_BUFFER;
+
+	output->buffer_id = dbuf->id;
+	output->status = SPA_STATUS_HAVE_BUFFER;
+
+	return SPA_STATUS_HAVE_BUFFER;
+}
+
+static int impl_node_process_input(struct spa_node *node)
+{
+	struct impl *this;
+	struct spa_io_buffers *input, *output;
+	struct port *in_port, *out_port;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	out_port = GET_OUT_PORT(this, 0);
+	output = out_port->io;
+	spa_return_val_if_fail(output != NULL, -EIO);
+
+	if (output->status == SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_HAVE_BUFFER;
+
+	in_port = GET_IN_PORT(this, 0);
+	input = in_port->io;
+	spa_return_val_if_fail(input != NULL, -EIO);
+
+	if (!this->configured)
+		return -EIO;
+
+	if (input->buffer_id >= in_port->n_buffers) {
+		input->status = -EINVAL;
+		return -EINVAL;
+	}
+	/* the offset is reset when the previous buffer was completely
+	 * consumed, a new buffer only arrives after that */
+	return process(this, input, output);
+}
+
+static int impl_node_process_output(struct spa_node *node)
+{
+	struct impl *this;
+	struct port *in_port, *out_port;
+	struct spa_io_buffers *input, *output;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	out_port = GET_OUT_PORT(this, 0);
+	output = out_port->io;
+	spa_return_val_if_fail(output != NULL, -EIO);
+
+	if (output->status == SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_HAVE_BUFFER;
+
+	/* recycle */
+	if (output->buffer_id < out_port->n_buffers) {
+		recycle_buffer(this, output->buffer_id);
+		output->buffer_id = SPA_ID_INVALID;
+	}
+
+	in_port = GET_IN_PORT(this, 0);
+	input = in_port->io;
+	spa_return_val_if_fail(input != NULL, -EIO);
+
+	/* finish the previous input buffer first */
+	if (input->status == SPA_STATUS_HAVE_BUFFER && input->buffer_id < in_port->n_buffers)
+		return process(this, input, output);
+
+	if (in_port->range && out_port->range) {
+		struct spa_io_control_range *ir = in_port->range, *or = out_port->range;
+		uint64_t num = (uint64_t) in_port->bpf * in_port->format.info.raw.rate;
+		uint64_t denom = (uint64_t) out_port->bpf * out_port->format.info.raw.rate;
+
+		ir->offset = or->offset;
+		ir->min_size = or->min_size * num / denom;
+		ir->max_size = or->max_size * num / denom;
+	}
+	input->status = SPA_STATUS_NEED_BUFFER;
+
+	return SPA_STATUS_NEED_BUFFER;
+}
+
+static const struct spa_node impl_node = {
+	SPA_VERSION_NODE,
+	NULL,
+	impl_node_enum_params,
+	impl_node_set_param,
+	impl_node_send_command,
+	impl_node_set_callbacks,
+	impl_node_get_n_ports,
+	impl_node_get_port_ids,
+	impl_node_add_port,
+	impl_node_remove_port,
+	impl_node_port_get_info,
+	impl_node_port_enum_params,
+	impl_node_port_set_param,
+	impl_node_port_use_buffers,
+	impl_node_port_alloc_buffers,
+	impl_node_port_set_io,
+	impl_node_port_reuse_buffer,
+	impl_node_port_send_command,
+	impl_node_process_input,
+	impl_node_process_output,
+};
+
+static int impl_get_interface(struct spa_handle *handle, uint32_t interface_id, void **interface)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+	spa_return_val_if_fail(interface != NULL, -EINVAL);
+
+	this = (struct impl *) handle;
+
+	if (interface_id == this->type.node)
+		*interface = &this->node;
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static int impl_clear(struct spa_handle *handle)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	this = (struct impl *) handle;
+
+	clear_convert(this);
+
+	return 0;
+}
+
+static int
+impl_init(const struct spa_handle_factory *factory,
+	  struct spa_handle *handle,
+	  const struct spa_dict *info,
+	  const struct spa_support *support,
+	  uint32_t n_support)
+{
+	struct impl *this;
+	uint32_t i;
+
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	handle->get_interface = impl_get_interface;
+	handle->clear = impl_clear;
+
+	this = (struct impl *) handle;
+
+	for (i = 0; i < n_support; i++) {
+		if (strcmp(support[i].type, SPA_TYPE__TypeMap) == 0)
+			this->map = support[i].data;
+		else if (strcmp(support[i].type, SPA_TYPE__Log) == 0)
+			this->log = support[i].data;
+	}
+	if (this->map == NULL) {
+		spa_log_error(this->log, "a type-map is needed");
+		return -EINVAL;
+	}
+	init_type(&this->type, this->map);
+
+	this->node = impl_node;
+	reset_props(&this->props);
+
+	this->quality = RESAMPLE_DEFAULT_QUALITY;
+	for (i = 0; info && i < info->n_items; i++) {
+		if (strcmp(info->items[i].key, "resample.quality") == 0)
+			this->quality = SPA_MIN(atoi(info->items[i].value), RESAMPLE_MAX_QUALITY);
+	}
+
+	this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+	spa_list_init(&this->in_ports[0].empty);
+
+	this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
+	    SPA_PORT_INFO_FLAG_NO_REF;
+	spa_list_init(&this->out_ports[0].empty);
+
+	return 0;
+}
+
+static const struct spa_interface_info impl_interfaces[] = {
+	{SPA_TYPE__Node,},
+};
+
+static int
+impl_enum_interface_info(const struct spa_handle_factory *factory,
+			 const struct spa_interface_info **info,
+			 uint32_t *index)
+{
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(info != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+
+	switch (*index) {
+	case 0:
+		*info = &impl_interfaces[*index];
+		break;
+	default:
+		return 0;
+	}
+	(*index)++;
+	return 1;
+}
+
+const struct spa_handle_factory spa_audioconvert_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	NAME,
+	NULL,
+	sizeof(struct impl),
+	impl_init,
+	impl_enum_interface_info,
+};
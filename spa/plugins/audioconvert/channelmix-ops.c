@@ -0,0 +1,253 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+
+#include "channelmix-ops.h"
+
+#define MASK(p)		(1u << (p))
+#define MASK_MONO	MASK(CHANNEL_FC)
+#define MASK_STEREO	(MASK(CHANNEL_FL) | MASK(CHANNEL_FR))
+#define MASK_QUAD	(MASK_STEREO | MASK(CHANNEL_RL) | MASK(CHANNEL_RR))
+#define MASK_5_1	(MASK_QUAD | MASK(CHANNEL_FC) | MASK(CHANNEL_LFE))
+#define MASK_7_1	(MASK_5_1 | MASK(CHANNEL_SL) | MASK(CHANNEL_SR))
+
+#define SQRT1_2		0.7071067811865476f
+
+static uint32_t default_mask(uint32_t channels)
+{
+	switch (channels) {
+	case 1:
+		return MASK_MONO;
+	case 2:
+		return MASK_STEREO;
+	case 3:
+		return MASK_STEREO | MASK(CHANNEL_FC);
+	case 4:
+		return MASK_QUAD;
+	case 5:
+		return MASK_QUAD | MASK(CHANNEL_FC);
+	case 6:
+		return MASK_5_1;
+	case 7:
+		return MASK_5_1 | MASK(CHANNEL_RC);
+	case 8:
+		return MASK_7_1;
+	default:
+		return 0;
+	}
+}
+
+/* the index of each position in the data, -1 when not present */
+static void mask_to_index(uint32_t mask, uint32_t channels, int index[CHANNEL_MAX_POSITION])
+{
+	uint32_t i, n = 0;
+
+	for (i = 0; i < CHANNEL_MAX_POSITION; i++)
+		index[i] = (mask & MASK(i)) && n < channels ? (int) n++ : -1;
+}
+
+static inline bool has(uint32_t mask, int pos)
+{
+	return (mask & MASK(pos)) != 0;
+}
+
+int channelmix_init(struct channelmix *mix)
+{
+	float m[CHANNEL_MAX_POSITION][CHANNEL_MAX_POSITION] = { { 0.0f, }, };
+	int si[CHANNEL_MAX_POSITION], di[CHANNEL_MAX_POSITION];
+	uint32_t src_mask, dst_mask, i, j;
+	float max = 0.0f;
+
+	if (mix->src_chan == 0 || mix->src_chan > CHANNELMIX_MAX_CHANNELS ||
+	    mix->dst_chan == 0 || mix->dst_chan > CHANNELMIX_MAX_CHANNELS)
+		return -EINVAL;
+
+	memset(mix->matrix, 0, sizeof(mix->matrix));
+
+	src_mask = mix->src_mask ? mix->src_mask : default_mask(mix->src_chan);
+	dst_mask = mix->dst_mask ? mix->dst_mask : default_mask(mix->dst_chan);
+
+	if (src_mask == 0 || dst_mask == 0 ||
+	    __builtin_popcount(src_mask) != mix->src_chan ||
+	    __builtin_popcount(dst_mask) != mix->dst_chan) {
+		/* unpositioned channels, copy the channels we have in common,
+		 * mono is copied to all channels */
+		for (i = 0; i < mix->dst_chan; i++) {
+			if (mix->src_chan == 1)
+				mix->matrix[i][0] = 1.0f;
+			else if (i < mix->src_chan)
+				mix->matrix[i][i] = 1.0f;
+		}
+		goto done;
+	}
+
+	/* positions that are in both the input and the output */
+	for (i = 0; i < CHANNEL_MAX_POSITION; i++)
+		if (has(src_mask, i) && has(dst_mask, i))
+			m[i][i] = 1.0f;
+
+	if (dst_mask == MASK_MONO) {
+		/* downmix everything but the LFE to mono */
+		uint32_t n = __builtin_popcount(src_mask & ~MASK(CHANNEL_LFE));
+		for (i = 0; i < CHANNEL_MAX_POSITION; i++)
+			if (i != CHANNEL_LFE && has(src_mask, i))
+				m[CHANNEL_FC][i] = n ? 1.0f / n : 0.0f;
+		goto positions_done;
+	}
+	if (src_mask == MASK_MONO) {
+		/* upmix mono to the front channels */
+		if (!has(dst_mask, CHANNEL_FC) ||
+		    ((dst_mask & MASK_STEREO) == MASK_STEREO)) {
+			m[CHANNEL_FC][CHANNEL_FC] = 0.0f;
+			m[CHANNEL_FL][CHANNEL_FC] = 1.0f;
+			m[CHANNEL_FR][CHANNEL_FC] = 1.0f;
+		}
+		goto positions_done;
+	}
+
+	/* downmix the positions that are missing in the output */
+	if (has(src_mask, CHANNEL_FC) && !has(dst_mask, CHANNEL_FC)) {
+		m[CHANNEL_FL][CHANNEL_FC] = SQRT1_2;
+		m[CHANNEL_FR][CHANNEL_FC] = SQRT1_2;
+	}
+	if (has(src_mask, CHANNEL_FLC) && !has(dst_mask, CHANNEL_FLC))
+		m[CHANNEL_FL][CHANNEL_FLC] = 1.0f;
+	if (has(src_mask, CHANNEL_FRC) && !has(dst_mask, CHANNEL_FRC))
+		m[CHANNEL_FR][CHANNEL_FRC] = 1.0f;
+	if (has(src_mask, CHANNEL_RL) && !has(dst_mask, CHANNEL_RL)) {
+		if (has(dst_mask, CHANNEL_SL))
+			m[CHANNEL_SL][CHANNEL_RL] = 1.0f;
+		else
+			m[CHANNEL_FL][CHANNEL_RL] = SQRT1_2;
+	}
+	if (has(src_mask, CHANNEL_RR) && !has(dst_mask, CHANNEL_RR)) {
+		if (has(dst_mask, CHANNEL_SR))
+			m[CHANNEL_SR][CHANNEL_RR] = 1.0f;
+		else
+			m[CHANNEL_FR][CHANNEL_RR] = SQRT1_2;
+	}
+	if (has(src_mask, CHANNEL_SL) && !has(dst_mask, CHANNEL_SL)) {
+		if (has(dst_mask, CHANNEL_RL))
+			m[CHANNEL_RL][CHANNEL_SL] = 1.0f;
+		else
+			m[CHANNEL_FL][CHANNEL_SL] = SQRT1_2;
+	}
+	if (has(src_mask, CHANNEL_SR) && !has(dst_mask, CHANNEL_SR)) {
+		if (has(dst_mask, CHANNEL_RR))
+			m[CHANNEL_RR][CHANNEL_SR] = 1.0f;
+		else
+			m[CHANNEL_FR][CHANNEL_SR] = SQRT1_2;
+	}
+	if (has(src_mask, CHANNEL_RC) && !has(dst_mask, CHANNEL_RC)) {
+		if ((dst_mask & MASK(CHANNEL_RL)) && (dst_mask & MASK(CHANNEL_RR))) {
+			m[CHANNEL_RL][CHANNEL_RC] = SQRT1_2;
+			m[CHANNEL_RR][CHANNEL_RC] = SQRT1_2;
+		} else if ((dst_mask & MASK(CHANNEL_SL)) && (dst_mask & MASK(CHANNEL_SR))) {
+			m[CHANNEL_SL][CHANNEL_RC] = SQRT1_2;
+			m[CHANNEL_SR][CHANNEL_RC] = SQRT1_2;
+		} else {
+			m[CHANNEL_FL][CHANNEL_RC] = 0.5f;
+			m[CHANNEL_FR][CHANNEL_RC] = 0.5f;
+		}
+	}
+	/* the LFE is dropped when the output has no LFE channel */
+
+      positions_done:
+	mask_to_index(src_mask, mix->src_chan, si);
+	mask_to_index(dst_mask, mix->dst_chan, di);
+
+	for (i = 0; i < CHANNEL_MAX_POSITION; i++) {
+		if (di[i] < 0)
+			continue;
+		for (j = 0; j < CHANNEL_MAX_POSITION; j++) {
+			if (si[j] < 0)
+				continue;
+			mix->matrix[di[i]][si[j]] = m[i][j];
+		}
+	}
+
+	/* scale the matrix so that no output channel can clip */
+	for (i = 0; i < mix->dst_chan; i++) {
+		float sum = 0.0f;
+		for (j = 0; j < mix->src_chan; j++)
+			sum += mix->matrix[i][j];
+		max = SPA_MAX(max, sum);
+	}
+	if (max > 1.0f) {
+		for (i = 0; i < mix->dst_chan; i++)
+			for (j = 0; j < mix->src_chan; j++)
+				mix->matrix[i][j] /= max;
+	}
+
+      done:
+	mix->identity = mix->src_chan == mix->dst_chan;
+	for (i = 0; i < mix->dst_chan && mix->identity; i++) {
+		for (j = 0; j < mix->src_chan; j++) {
+			if (mix->matrix[i][j] != (i == j ? 1.0f : 0.0f)) {
+				mix->identity = false;
+				break;
+			}
+		}
+	}
+	return 0;
+}
+
+void channelmix_process(struct channelmix *mix, void **dst, const void **src,
+			uint32_t n_samples)
+{
+	float **d = (float **) dst;
+	const float **s = (const float **) src;
+	uint32_t i, j, n;
+
+	if (mix->identity) {
+		for (i = 0; i < mix->dst_chan; i++) {
+			if (d[i] != s[i])
+				memcpy(d[i], s[i], n_samples * sizeof(float));
+		}
+		return;
+	}
+
+	for (i = 0; i < mix->dst_chan; i++) {
+		float *di = d[i];
+		bool first = true;
+
+		for (j = 0; j < mix->src_chan; j++) {
+			const float *sj = s[j];
+			float v = mix->matrix[i][j];
+
+			if (v == 0.0f)
+				continue;
+
+			if (first) {
+				if (v == 1.0f)
+					memcpy(di, sj, n_samples * sizeof(float));
+				else
+					for (n = 0; n < n_samples; n++)
+						di[n] = sj[n] * v;
+				first = false;
+			} else {
+				for (n = 0; n < n_samples; n++)
+					di[n] += sj[n] * v;
+			}
+		}
+		if (first)
+			memset(di, 0, n_samples * sizeof(float));
+	}
+}
@@ -0,0 +1,61 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include <spa/utils/defs.h>
+
+#define CHANNELMIX_MAX_CHANNELS	64
+
+/* channel positions, the bits of the channel mask in the order of the
+ * channels in the data */
+enum {
+	CHANNEL_FL,		/* front left */
+	CHANNEL_FR,		/* front right */
+	CHANNEL_FC,		/* front center */
+	CHANNEL_LFE,		/* low frequency effects */
+	CHANNEL_RL,		/* rear left */
+	CHANNEL_RR,		/* rear right */
+	CHANNEL_FLC,		/* front left of center */
+	CHANNEL_FRC,		/* front right of center */
+	CHANNEL_RC,		/* rear center */
+	CHANNEL_SL,		/* side left */
+	CHANNEL_SR,		/* side right */
+	CHANNEL_MAX_POSITION,
+};
+
+/** Mix planar float samples between two channel layouts with a matrix */
+struct channelmix {
+	uint32_t src_chan;
+	uint32_t dst_chan;
+	uint32_t src_mask;		/**< channel mask of the input or 0 for the default */
+	uint32_t dst_mask;		/**< channel mask of the output or 0 for the default */
+
+	bool identity;			/**< the matrix is an identity matrix */
+	float matrix[CHANNELMIX_MAX_CHANNELS][CHANNELMIX_MAX_CHANNELS];
+};
+
+/** Compute the mixing matrix. src_chan, dst_chan and the masks should be set */
+int channelmix_init(struct channelmix *mix);
+
+/** Mix \a n_samples from \a src into \a dst. When the matrix is an identity
+ * matrix, \a dst and \a src can be the same. */
+void channelmix_process(struct channelmix *mix, void **dst, const void **src,
+			uint32_t n_samples);
@@ -0,0 +1,435 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stddef.h>
+#include <byteswap.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "fmt-ops.h"
+
+/* raw access to the sample containers, in native (ne) and other (oe)
+ * endianness. 24 bits containers are stored in 3 bytes. */
+#define rd8(p)		((uint32_t) *(const uint8_t *)(p))
+#define wr8(p,v)	(*(uint8_t *)(p) = (v))
+#define rd16(p)		((uint32_t) *(const uint16_t *)(p))
+#define wr16(p,v)	(*(uint16_t *)(p) = (v))
+#define rd16_oe(p)	((uint32_t) bswap_16(*(const uint16_t *)(p)))
+#define wr16_oe(p,v)	(*(uint16_t *)(p) = bswap_16(v))
+#define rd32(p)		(*(const uint32_t *)(p))
+#define wr32(p,v)	(*(uint32_t *)(p) = (v))
+#define rd32_oe(p)	bswap_32(*(const uint32_t *)(p))
+#define wr32_oe(p,v)	(*(uint32_t *)(p) = bswap_32(v))
+
+static inline uint32_t rd24_le(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16);
+}
+
+static inline void wr24_le(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+}
+
+static inline uint32_t rd24_be(const uint8_t *p)
+{
+	return p[2] | (p[1] << 8) | (p[0] << 16);
+}
+
+static inline void wr24_be(uint8_t *p, uint32_t v)
+{
+	p[2] = v;
+	p[1] = v >> 8;
+	p[0] = v >> 16;
+}
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+#define rd24(p)		rd24_le(p)
+#define wr24(p,v)	wr24_le(p,v)
+#define rd24_oe(p)	rd24_be(p)
+#define wr24_oe(p,v)	wr24_be(p,v)
+#else
+#define rd24(p)		rd24_be(p)
+#define wr24(p,v)	wr24_be(p,v)
+#define rd24_oe(p)	rd24_le(p)
+#define wr24_oe(p,v)	wr24_le(p,v)
+#endif
+
+#define BITS_MASK(b)	((uint32_t)((1ull << (b)) - 1))
+#define BITS_BIAS(b)	((int64_t)1 << ((b) - 1))
+
+#define READ_S(RD,bits)							\
+	((float)((int32_t)(RD(s) << (32 - (bits))) >> (32 - (bits))) *	\
+	 (float)(1.0 / BITS_BIAS(bits)))
+#define READ_U(RD,bits)							\
+	((float)((int64_t)(RD(s) & BITS_MASK(bits)) - BITS_BIAS(bits)) *	\
+	 (float)(1.0 / BITS_BIAS(bits)))
+#define WRITE_S(WR,bits,v)						\
+	WR(d, (uint32_t)(int64_t)(SPA_CLAMP(v, -1.0f, 1.0f) * (double)(BITS_BIAS(bits) - 1)))
+#define WRITE_U(WR,bits,v)						\
+	WR(d, (uint32_t)((int64_t)(SPA_CLAMP(v, -1.0f, 1.0f) * (double)(BITS_BIAS(bits) - 1)) + \
+		BITS_BIAS(bits)))
+
+static inline float rd_f32_oe(const void *p)
+{
+	union { uint32_t i; float f; } v = { bswap_32(*(const uint32_t *)p) };
+	return v.f;
+}
+
+static inline void wr_f32_oe(void *p, float f)
+{
+	union { float f; uint32_t i; } v = { f };
+	*(uint32_t *)p = bswap_32(v.i);
+}
+
+static inline float rd_f64_oe(const void *p)
+{
+	union { uint64_t i; double f; } v = { bswap_64(*(const uint64_t *)p) };
+	return v.f;
+}
+
+static inline void wr_f64_oe(void *p, float f)
+{
+	union { double f; uint64_t i; } v = { f };
+	*(uint64_t *)p = bswap_64(v.i);
+}
+
+#define READ_F32(s)	(*(const float *)(s))
+#define WRITE_F32(d,v)	(*(float *)(d) = (v))
+#define READ_F64(s)	((float) *(const double *)(s))
+#define WRITE_F64(d,v)	(*(double *)(d) = (v))
+
+/* generate the 4 conversion functions between a format and planar float */
+#define DEFINE_CONV(name,width,READ,WRITE)						\
+static void conv_##name##_to_f32d(void **dst, const void **src,			\
+		uint32_t channels, uint32_t n_samples)					\
+{											\
+	const uint8_t *s = src[0];							\
+	float **d = (float **) dst;							\
+	uint32_t i, j;									\
+											\
+	for (j = 0; j < n_samples; j++) {						\
+		for (i = 0; i < channels; i++) {					\
+			d[i][j] = READ;							\
+			s += width;							\
+		}									\
+	}										\
+}											\
+static void conv_##name##p_to_f32d(void **dst, const void **src,			\
+		uint32_t channels, uint32_t n_samples)					\
+{											\
+	uint32_t i, j;									\
+											\
+	for (i = 0; i < channels; i++) {						\
+		const uint8_t *s = src[i];						\
+		float *d = dst[i];							\
+		for (j = 0; j < n_samples; j++) {					\
+			d[j] = READ;							\
+			s += width;							\
+		}									\
+	}										\
+}											\
+static void conv_f32d_to_##name(void **dst, const void **src,			\
+		uint32_t channels, uint32_t n_samples)					\
+{											\
+	const float **s = (const float **) src;						\
+	uint8_t *d = dst[0];								\
+	uint32_t i, j;									\
+											\
+	for (j = 0; j < n_samples; j++) {						\
+		for (i = 0; i < channels; i++) {					\
+			float v = s[i][j];						\
+			WRITE;								\
+			d += width;							\
+		}									\
+	}										\
+}											\
+static void conv_f32d_to_##name##p(void **dst, const void **src,			\
+		uint32_t channels, uint32_t n_samples)					\
+{											\
+	uint32_t i, j;									\
+											\
+	for (i = 0; i < channels; i++) {						\
+		const float *s = src[i];						\
+		uint8_t *d = dst[i];							\
+		for (j = 0; j < n_samples; j++) {					\
+			float v = s[j];							\
+			WRITE;								\
+			d += width;							\
+		}									\
+	}										\
+}
+
+#define DEFINE_CONV_S(name,width,bits,RD,WR)	\
+	DEFINE_CONV(name, width, READ_S(RD,bits), WRITE_S(WR,bits,v))
+#define DEFINE_CONV_U(name,width,bits,RD,WR)	\
+	DEFINE_CONV(name, width, READ_U(RD,bits), WRITE_U(WR,bits,v))
+
+DEFINE_CONV_S(s8, 1, 8, rd8, wr8)
+DEFINE_CONV_U(u8, 1, 8, rd8, wr8)
+DEFINE_CONV_S(s16, 2, 16, rd16, wr16)
+DEFINE_CONV_U(u16, 2, 16, rd16, wr16)
+DEFINE_CONV_S(s24, 3, 24, rd24, wr24)
+DEFINE_CONV_U(u24, 3, 24, rd24, wr24)
+DEFINE_CONV_S(s24_32, 4, 24, rd32, wr32)
+DEFINE_CONV_U(u24_32, 4, 24, rd32, wr32)
+DEFINE_CONV_S(s32, 4, 32, rd32, wr32)
+DEFINE_CONV_U(u32, 4, 32, rd32, wr32)
+DEFINE_CONV_S(s20, 3, 20, rd24, wr24)
+DEFINE_CONV_U(u20, 3, 20, rd24, wr24)
+DEFINE_CONV_S(s18, 3, 18, rd24, wr24)
+DEFINE_CONV_U(u18, 3, 18, rd24, wr24)
+DEFINE_CONV(f32, 4, READ_F32(s), WRITE_F32(d,v))
+DEFINE_CONV(f64, 8, READ_F64(s), WRITE_F64(d,v))
+
+DEFINE_CONV_S(s16_oe, 2, 16, rd16_oe, wr16_oe)
+DEFINE_CONV_U(u16_oe, 2, 16, rd16_oe, wr16_oe)
+DEFINE_CONV_S(s24_oe, 3, 24, rd24_oe, wr24_oe)
+DEFINE_CONV_U(u24_oe, 3, 24, rd24_oe, wr24_oe)
+DEFINE_CONV_S(s24_32_oe, 4, 24, rd32_oe, wr32_oe)
+DEFINE_CONV_U(u24_32_oe, 4, 24, rd32_oe, wr32_oe)
+DEFINE_CONV_S(s32_oe, 4, 32, rd32_oe, wr32_oe)
+DEFINE_CONV_U(u32_oe, 4, 32, rd32_oe, wr32_oe)
+DEFINE_CONV_S(s20_oe, 3, 20, rd24_oe, wr24_oe)
+DEFINE_CONV_U(u20_oe, 3, 20, rd24_oe, wr24_oe)
+DEFINE_CONV_S(s18_oe, 3, 18, rd24_oe, wr24_oe)
+DEFINE_CONV_U(u18_oe, 3, 18, rd24_oe, wr24_oe)
+DEFINE_CONV(f32_oe, 4, rd_f32_oe(s), wr_f32_oe(d,v))
+DEFINE_CONV(f64_oe, 8, rd_f64_oe(s), wr_f64_oe(d,v))
+
+#if defined(__SSE2__)
+/* S16 and F32 are the most common formats, they have vectorized versions
+ * for mono and stereo */
+static inline __m128 clamp_ps(__m128 v)
+{
+	return _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+}
+
+static void conv_s16_to_f32d_1_sse2(void **dst, const void **src,
+		uint32_t channels, uint32_t n_samples)
+{
+	const int16_t *s = src[0];
+	float *d0 = dst[0];
+	__m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+	uint32_t j = 0;
+
+	for (; j + 8 <= n_samples; j += 8) {
+		__m128i in = _mm_loadu_si128((const __m128i *) &s[j]);
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16);
+		_mm_storeu_ps(&d0[j], _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(&d0[j + 4], _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+	for (; j < n_samples; j++)
+		d0[j] = s[j] * (1.0f / 32768.0f);
+}
+
+static void conv_s16_to_f32d_2_sse2(void **dst, const void **src,
+		uint32_t channels, uint32_t n_samples)
+{
+	const int16_t *s = src[0];
+	float *d0 = dst[0], *d1 = dst[1];
+	__m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+	uint32_t j = 0;
+
+	for (; j + 4 <= n_samples; j += 4) {
+		/* L0 R0 L1 R1 L2 R2 L3 R3 */
+		__m128i in = _mm_loadu_si128((const __m128i *) &s[2 * j]);
+		/* sign extend the left and right samples to 32 bits */
+		__m128i l = _mm_srai_epi32(_mm_slli_epi32(in, 16), 16);
+		__m128i r = _mm_srai_epi32(in, 16);
+		_mm_storeu_ps(&d0[j], _mm_mul_ps(_mm_cvtepi32_ps(l), scale));
+		_mm_storeu_ps(&d1[j], _mm_mul_ps(_mm_cvtepi32_ps(r), scale));
+	}
+	for (; j < n_samples; j++) {
+		d0[j] = s[2 * j] * (1.0f / 32768.0f);
+		d1[j] = s[2 * j + 1] * (1.0f / 32768.0f);
+	}
+}
+
+static void conv_f32d_to_s16_1_sse2(void **dst, const void **src,
+		uint32_t channels, uint32_t n_samples)
+{
+	const float *s0 = src[0];
+	int16_t *d = dst[0];
+	__m128 scale = _mm_set1_ps(32767.0f);
+	uint32_t j = 0;
+
+	/* clamp like the scalar version, saturating would give -32768 */
+	for (; j + 8 <= n_samples; j += 8) {
+		__m128i lo = _mm_cvttps_epi32(_mm_mul_ps(clamp_ps(_mm_loadu_ps(&s0[j])), scale));
+		__m128i hi = _mm_cvttps_epi32(_mm_mul_ps(clamp_ps(_mm_loadu_ps(&s0[j + 4])), scale));
+		_mm_storeu_si128((__m128i *) &d[j], _mm_packs_epi32(lo, hi));
+	}
+	for (; j < n_samples; j++)
+		d[j] = SPA_CLAMP(s0[j], -1.0f, 1.0f) * 32767.0f;
+}
+
+static void conv_f32d_to_s16_2_sse2(void **dst, const void **src,
+		uint32_t channels, uint32_t n_samples)
+{
+	const float *s0 = src[0], *s1 = src[1];
+	int16_t *d = dst[0];
+	__m128 scale = _mm_set1_ps(32767.0f);
+	uint32_t j = 0;
+
+	for (; j + 4 <= n_samples; j += 4) {
+		__m128i l = _mm_cvttps_epi32(_mm_mul_ps(clamp_ps(_mm_loadu_ps(&s0[j])), scale));
+		__m128i r = _mm_cvttps_epi32(_mm_mul_ps(clamp_ps(_mm_loadu_ps(&s1[j])), scale));
+		__m128i p = _mm_packs_epi32(l, r);	/* L0 L1 L2 L3 R0 R1 R2 R3 */
+		_mm_storeu_si128((__m128i *) &d[2 * j],
+				 _mm_unpacklo_epi16(p, _mm_srli_si128(p, 8)));
+	}
+	for (; j < n_samples; j++) {
+		d[2 * j] = SPA_CLAMP(s0[j], -1.0f, 1.0f) * 32767.0f;
+		d[2 * j + 1] = SPA_CLAMP(s1[j], -1.0f, 1.0f) * 32767.0f;
+	}
+}
+
+static void conv_f32_to_f32d_2_sse2(void **dst, const void **src,
+		uint32_t channels, uint32_t n_samples)
+{
+	const float *s = src[0];
+	float *d0 = dst[0], *d1 = dst[1];
+	uint32_t j = 0;
+
+	for (; j + 4 <= n_samples; j += 4) {
+		__m128 a = _mm_loadu_ps(&s[2 * j]);	/* L0 R0 L1 R1 */
+		__m128 b = _mm_loadu_ps(&s[2 * j + 4]);	/* L2 R2 L3 R3 */
+		_mm_storeu_ps(&d0[j], _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(&d1[j], _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+	for (; j < n_samples; j++) {
+		d0[j] = s[2 * j];
+		d1[j] = s[2 * j + 1];
+	}
+}
+
+static void conv_f32d_to_f32_2_sse2(void **dst, const void **src,
+		uint32_t channels, uint32_t n_samples)
+{
+	const float *s0 = src[0], *s1 = src[1];
+	float *d = dst[0];
+	uint32_t j = 0;
+
+	for (; j + 4 <= n_samples; j += 4) {
+		__m128 l = _mm_loadu_ps(&s0[j]);
+		__m128 r = _mm_loadu_ps(&s1[j]);
+		_mm_storeu_ps(&d[2 * j], _mm_unpacklo_ps(l, r));
+		_mm_storeu_ps(&d[2 * j + 4], _mm_unpackhi_ps(l, r));
+	}
+	for (; j < n_samples; j++) {
+		d[2 * j] = s0[j];
+		d[2 * j + 1] = s1[j];
+	}
+}
+#endif
+
+#define MAKE_INFO(name,NAME,width)					\
+{									\
+	offsetof(struct spa_type_audio_format, NAME), width,		\
+	{ conv_##name##_to_f32d, conv_##name##p_to_f32d },		\
+	{ conv_f32d_to_##name, conv_f32d_to_##name##p }			\
+}
+
+static const struct format_info format_infos[] = {
+	/* sorted by preference, the first one is the default format */
+	MAKE_INFO(f32, F32, 4),
+	MAKE_INFO(s16, S16, 2),
+	MAKE_INFO(s32, S32, 4),
+	MAKE_INFO(s24, S24, 3),
+	MAKE_INFO(s24_32, S24_32, 4),
+	MAKE_INFO(f64, F64, 8),
+	MAKE_INFO(s8, S8, 1),
+	MAKE_INFO(u8, U8, 1),
+	MAKE_INFO(u16, U16, 2),
+	MAKE_INFO(u24, U24, 3),
+	MAKE_INFO(u24_32, U24_32, 4),
+	MAKE_INFO(u32, U32, 4),
+	MAKE_INFO(s20, S20, 3),
+	MAKE_INFO(u20, U20, 3),
+	MAKE_INFO(s18, S18, 3),
+	MAKE_INFO(u18, U18, 3),
+	MAKE_INFO(s16_oe, S16_OE, 2),
+	MAKE_INFO(u16_oe, U16_OE, 2),
+	MAKE_INFO(s24_oe, S24_OE, 3),
+	MAKE_INFO(u24_oe, U24_OE, 3),
+	MAKE_INFO(s24_32_oe, S24_32_OE, 4),
+	MAKE_INFO(u24_32_oe, U24_32_OE, 4),
+	MAKE_INFO(s32_oe, S32_OE, 4),
+	MAKE_INFO(u32_oe, U32_OE, 4),
+	MAKE_INFO(s20_oe, S20_OE, 3),
+	MAKE_INFO(u20_oe, U20_OE, 3),
+	MAKE_INFO(s18_oe, S18_OE, 3),
+	MAKE_INFO(u18_oe, U18_OE, 3),
+	MAKE_INFO(f32_oe, F32_OE, 4),
+	MAKE_INFO(f64_oe, F64_OE, 8),
+};
+
+const struct format_info *get_format_infos(uint32_t *n_infos)
+{
+	*n_infos = SPA_N_ELEMENTS(format_infos);
+	return format_infos;
+}
+
+const struct format_info *find_format_info(const struct spa_type_audio_format *types,
+					   uint32_t format)
+{
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(format_infos); i++) {
+		if (format_info_id(types, &format_infos[i]) == format)
+			return &format_infos[i];
+	}
+	return NULL;
+}
+
+convert_func_t get_to_f32d(const struct format_info *info, uint32_t layout, uint32_t channels)
+{
+#if defined(__SSE2__)
+	if (layout == LAYOUT_INTERLEAVED) {
+		if (info->to_f32d[layout] == conv_s16_to_f32d && channels == 1)
+			return conv_s16_to_f32d_1_sse2;
+		if (info->to_f32d[layout] == conv_s16_to_f32d && channels == 2)
+			return conv_s16_to_f32d_2_sse2;
+		if (info->to_f32d[layout] == conv_f32_to_f32d && channels == 2)
+			return conv_f32_to_f32d_2_sse2;
+	}
+#endif
+	return info->to_f32d[layout];
+}
+
+convert_func_t get_from_f32d(const struct format_info *info, uint32_t layout, uint32_t channels)
+{
+#if defined(__SSE2__)
+	if (layout == LAYOUT_INTERLEAVED) {
+		if (info->from_f32d[layout] == conv_f32d_to_s16 && channels == 1)
+			return conv_f32d_to_s16_1_sse2;
+		if (info->from_f32d[layout] == conv_f32d_to_s16 && channels == 2)
+			return conv_f32d_to_s16_2_sse2;
+		if (info->from_f32d[layout] == conv_f32d_to_f32 && channels == 2)
+			return conv_f32d_to_f32_2_sse2;
+	}
+#endif
+	return info->from_f32d[layout];
+}
@@ -0,0 +1,65 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include <spa/utils/defs.h>
+#include <spa/param/audio/raw-utils.h>
+
+/** Convert \a n_samples frames of \a channels channels from \a src to \a dst.
+ * Interleaved data only uses the first pointer, planar (non-interleaved) data
+ * has one pointer per channel. */
+typedef void (*convert_func_t) (void **dst, const void **src, uint32_t channels,
+				uint32_t n_samples);
+
+enum {
+	LAYOUT_INTERLEAVED,
+	LAYOUT_PLANAR,
+	LAYOUT_MAX,
+};
+
+struct format_info {
+	size_t type_offset;		/**< offset of the format id in spa_type_audio_format */
+	uint32_t width;			/**< bytes per sample */
+	convert_func_t to_f32d[LAYOUT_MAX];	/**< to planar float */
+	convert_func_t from_f32d[LAYOUT_MAX];	/**< from planar float */
+};
+
+/** Find the conversion functions for \a format, NULL when not supported */
+const struct format_info *find_format_info(const struct spa_type_audio_format *types,
+					   uint32_t format);
+
+/** Get the id of the format described by \a info */
+static inline uint32_t format_info_id(const struct spa_type_audio_format *types,
+				      const struct format_info *info)
+{
+	return *SPA_MEMBER(types, info->type_offset, uint32_t);
+}
+
+/** Get the list of supported formats. */
+const struct format_info *get_format_infos(uint32_t *n_infos);
+
+/** Get the fastest function to convert \a channels channels with \a layout to
+ * planar float */
+convert_func_t get_to_f32d(const struct format_info *info, uint32_t layout, uint32_t channels);
+
+/** Get the fastest function to convert \a channels channels of planar float
+ * to \a layout */
+convert_func_t get_from_f32d(const struct format_info *info, uint32_t layout, uint32_t channels);
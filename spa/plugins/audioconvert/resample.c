@@ -0,0 +1,324 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "resample.h"
+
+/* number of input samples that are buffered per call */
+#define BLOCK_SIZE		4096
+/* maximum number of phases of an exact filter bank */
+#define MAX_PHASES		1024
+/* number of phases of the interpolated filter bank */
+#define INTERP_PHASES		256
+#define MAX_TAPS		1024
+
+static const uint32_t quality_taps[RESAMPLE_MAX_QUALITY + 1] = {
+	8, 16, 24, 32, 48, 64, 96, 128, 160, 192, 256
+};
+
+struct native_data {
+	uint32_t in_rate;
+	uint32_t out_rate;
+	uint32_t n_taps;
+	uint32_t n_phases;
+	bool interp;			/* interpolate between the phases */
+
+	/* position of the next output sample: index in the history and a
+	 * fractional phase in 1/n_phases units */
+	uint32_t index;
+	double phase;
+	/* the increment of the position per output sample */
+	uint32_t inc;
+	double frac;
+
+	uint32_t hist;			/* number of samples in the history */
+	uint32_t hist_size;
+	float **history;
+
+	uint32_t filter_stride;
+	float *filter;			/* n_phases + 1 rows of n_taps */
+};
+
+static inline double sinc(double x)
+{
+	if (x == 0.0)
+		return 1.0;
+	x *= M_PI;
+	return sin(x) / x;
+}
+
+/* blackman-harris window for t in [-1, 1] */
+static inline double window(double t)
+{
+	if (t <= -1.0 || t >= 1.0)
+		return 0.0;
+	t *= M_PI;
+	return 0.35875 + 0.48829 * cos(t) + 0.14128 * cos(2.0 * t) + 0.01168 * cos(3.0 * t);
+}
+
+static void build_filter(struct native_data *d, double cutoff)
+{
+	uint32_t p, k, half = d->n_taps / 2;
+
+	for (p = 0; p <= d->n_phases; p++) {
+		float *taps = &d->filter[p * d->filter_stride];
+		double offset = (double) p / d->n_phases;
+
+		for (k = 0; k < d->n_taps; k++) {
+			double x = (double) k - (half - 1) - offset;
+			taps[k] = cutoff * sinc(cutoff * x) * window(x / half);
+		}
+	}
+}
+
+static inline float inner_product(const float *s, const float *taps, uint32_t n_taps)
+{
+	uint32_t i = 0;
+	float sum = 0.0f;
+#if defined(__SSE__)
+	__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+	float t[4];
+
+	/* n_taps is a multiple of 8 and the taps are aligned */
+	for (; i + 8 <= n_taps; i += 8) {
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(&s[i]), _mm_load_ps(&taps[i])));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(&s[i + 4]), _mm_load_ps(&taps[i + 4])));
+	}
+	_mm_storeu_ps(t, _mm_add_ps(acc0, acc1));
+	sum = t[0] + t[1] + t[2] + t[3];
+#endif
+	for (; i < n_taps; i++)
+		sum += s[i] * taps[i];
+	return sum;
+}
+
+int resample_init(struct resample *r)
+{
+	struct native_data *d;
+	uint32_t gcd, in_rate, out_rate, n_taps, n_phases, i, a, b;
+	double cutoff;
+	size_t filter_size;
+
+	if (r->channels == 0 || r->i_rate == 0 || r->o_rate == 0 ||
+	    r->quality > RESAMPLE_MAX_QUALITY)
+		return -EINVAL;
+
+	for (a = r->i_rate, b = r->o_rate; b != 0;) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	gcd = a;
+	in_rate = r->i_rate / gcd;
+	out_rate = r->o_rate / gcd;
+
+	/* lower the cutoff when downsampling and use more taps to keep the
+	 * same transition band */
+	cutoff = SPA_MIN(1.0, (double) r->o_rate / r->i_rate);
+	n_taps = quality_taps[r->quality] / cutoff;
+	n_taps = SPA_MIN(SPA_ROUND_UP_N(n_taps, 8), MAX_TAPS);
+	cutoff *= 0.95;
+
+	/* use a multiple of out_rate phases so that the phase of every output
+	 * sample falls on a filter, with enough phases for interpolating when
+	 * the rate is adjusted */
+	if (out_rate > MAX_PHASES)
+		n_phases = INTERP_PHASES;
+	else
+		n_phases = out_rate * SPA_MAX(1u, INTERP_PHASES / out_rate);
+
+	d = calloc(1, sizeof(struct native_data));
+	if (d == NULL)
+		return -ENOMEM;
+
+	d->in_rate = in_rate;
+	d->out_rate = out_rate;
+	d->n_taps = n_taps;
+	d->n_phases = n_phases;
+	d->interp = n_phases % out_rate != 0;
+	d->inc = in_rate / out_rate;
+	d->frac = (double) (in_rate % out_rate) * n_phases / out_rate;
+	d->filter_stride = n_taps;
+	d->hist_size = n_taps + BLOCK_SIZE;
+
+	filter_size = (n_phases + 1) * d->filter_stride * sizeof(float);
+	if (posix_memalign((void **) &d->filter, 16, filter_size) != 0)
+		goto no_mem;
+
+	d->history = calloc(r->channels, sizeof(float *));
+	if (d->history == NULL)
+		goto no_mem;
+	for (i = 0; i < r->channels; i++) {
+		d->history[i] = calloc(d->hist_size, sizeof(float));
+		if (d->history[i] == NULL)
+			goto no_mem;
+	}
+
+	build_filter(d, cutoff);
+
+	r->rate = 1.0;
+	r->data = d;
+	resample_reset(r);
+
+	return 0;
+
+      no_mem:
+	r->data = d;
+	resample_free(r);
+	return -ENOMEM;
+}
+
+void resample_free(struct resample *r)
+{
+	struct native_data *d = r->data;
+	uint32_t i;
+
+	if (d == NULL)
+		return;
+
+	if (d->history) {
+		for (i = 0; i < r->channels; i++)
+			free(d->history[i]);
+		free(d->history);
+	}
+	free(d->filter);
+	free(d);
+	r->data = NULL;
+}
+
+void resample_reset(struct resample *r)
+{
+	struct native_data *d = r->data;
+	uint32_t i;
+
+	/* prefill with silence so that the first output sample is aligned
+	 * with the first input sample */
+	d->hist = d->n_taps / 2 - 1;
+	d->index = 0;
+	d->phase = 0.0;
+	for (i = 0; i < r->channels; i++)
+		memset(d->history[i], 0, d->hist * sizeof(float));
+}
+
+void resample_update_rate(struct resample *r, double rate)
+{
+	struct native_data *d = r->data;
+	double step;
+
+	if (rate == r->rate)
+		return;
+
+	r->rate = rate;
+	step = d->in_rate * rate / d->out_rate;
+	d->inc = (uint32_t) step;
+	d->frac = (step - d->inc) * d->n_phases;
+	d->interp = rate != 1.0 || d->n_phases % d->out_rate != 0;
+}
+
+void resample_process(struct resample *r, const void **src, uint32_t *in_len,
+		      void **dst, uint32_t *out_len)
+{
+	struct native_data *d = r->data;
+	uint32_t c, in, total, o, index, n_taps = d->n_taps, n_phases = d->n_phases;
+	double phase;
+
+	in = SPA_MIN(*in_len, d->hist_size - d->hist);
+	for (c = 0; c < r->channels; c++)
+		memcpy(&d->history[c][d->hist], src[c], in * sizeof(float));
+	total = d->hist + in;
+
+	index = d->index;
+	phase = d->phase;
+
+	for (o = 0; o < *out_len && index + n_taps <= total; o++) {
+		uint32_t p = (uint32_t) phase;
+
+		if (d->interp) {
+			const float *t0 = &d->filter[p * d->filter_stride];
+			const float *t1 = t0 + d->filter_stride;
+			float x = phase - p;
+
+			for (c = 0; c < r->channels; c++) {
+				const float *s = &d->history[c][index];
+				float v0 = inner_product(s, t0, n_taps);
+				float v1 = inner_product(s, t1, n_taps);
+				((float *) dst[c])[o] = v0 + (v1 - v0) * x;
+			}
+		} else {
+			const float *t0 = &d->filter[p * d->filter_stride];
+
+			for (c = 0; c < r->channels; c++)
+				((float *) dst[c])[o] = inner_product(&d->history[c][index], t0, n_taps);
+		}
+
+		index += d->inc;
+		phase += d->frac;
+		if (phase >= n_phases) {
+			phase -= n_phases;
+			index++;
+		}
+	}
+
+	/* keep the samples that are still needed */
+	if (index >= total) {
+		d->index = index - total;
+		d->hist = 0;
+	} else {
+		d->hist = total - index;
+		d->index = 0;
+		if (index > 0) {
+			for (c = 0; c < r->channels; c++)
+				memmove(d->history[c], &d->history[c][index], d->hist * sizeof(float));
+		}
+	}
+	d->phase = phase;
+
+	*in_len = in;
+	*out_len = o;
+}
+
+uint32_t resample_in_len(struct resample *r, uint32_t out_len)
+{
+	struct native_data *d = r->data;
+	double pos;
+	uint32_t needed;
+
+	if (out_len == 0)
+		return 0;
+
+	/* position of the last output sample */
+	pos = d->index + (d->phase + (out_len - 1) * d->frac) / d->n_phases +
+		(double) (out_len - 1) * d->inc;
+	needed = (uint32_t) pos + d->n_taps;
+
+	return needed > d->hist ? needed - d->hist : 0;
+}
+
+uint32_t resample_delay(struct resample *r)
+{
+	struct native_data *d = r->data;
+	return d->n_taps / 2 - 1;
+}
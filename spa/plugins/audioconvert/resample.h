@@ -0,0 +1,61 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include <spa/utils/defs.h>
+
+#define RESAMPLE_DEFAULT_QUALITY	5
+#define RESAMPLE_MAX_QUALITY		10
+
+/** Polyphase windowed sinc resampler for planar float samples */
+struct resample {
+	uint32_t channels;
+	uint32_t i_rate;
+	uint32_t o_rate;
+	uint32_t quality;		/**< 0 to RESAMPLE_MAX_QUALITY */
+	double rate;			/**< adjustment of the input rate, 1.0 by default */
+
+	void *data;
+};
+
+/** Set up the resampler. channels, i_rate, o_rate and quality should be set */
+int resample_init(struct resample *r);
+
+void resample_free(struct resample *r);
+
+/** Clear the history of the resampler */
+void resample_reset(struct resample *r);
+
+/** Adjust the input rate by \a rate, the resampler then converts
+ * i_rate * rate to o_rate. Use this to follow the drift between two clocks. */
+void resample_update_rate(struct resample *r, double rate);
+
+/** Resample at most \a in_len samples from \a src into at most \a out_len
+ * samples in \a dst. On return \a in_len and \a out_len contain the number
+ * of consumed and produced samples. */
+void resample_process(struct resample *r, const void **src, uint32_t *in_len,
+		      void **dst, uint32_t *out_len);
+
+/** The number of input samples needed to produce \a out_len samples */
+uint32_t resample_in_len(struct resample *r, uint32_t out_len);
+
+/** The delay of the resampler in input samples */
+uint32_t resample_delay(struct resample *r);
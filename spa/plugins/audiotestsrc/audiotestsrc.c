@@ -102,6 +102,9 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 enum wave_type {
 	WAVE_SINE,
 	WAVE_SQUARE,
+	WAVE_SILENCE,
+	WAVE_WHITE_NOISE,
+	WAVE_LAST,
 };
 
 #define DEFAULT_LIVE false
@@ -168,8 +171,9 @@ struct impl {
 	bool have_format;
 	struct spa_audio_info current_format;
 	size_t bpf;
-	render_func_t render_func;
+	const render_func_t *render_funcs;
 	double accumulator;
+	uint32_t random_state;
 
 	struct buffer buffers[MAX_BUFFERS];
 	uint32_t n_buffers;
@@ -235,7 +239,9 @@ static int impl_node_enum_params(struct spa_node *node,
 				":", t->param.propType, "i", p->wave,
 				":", t->param.propLabels, "[-i",
 					"i", WAVE_SINE, "s", "Sine wave",
-					"i", WAVE_SQUARE, "s", "Square wave", "]");
+					"i", WAVE_SQUARE, "s", "Square wave",
+					"i", WAVE_SILENCE, "s", "Silence",
+					"i", WAVE_WHITE_NOISE, "s", "White noise", "]");
 			break;
 		case 2:
 			param = spa_pod_builder_object(&b,
@@ -401,9 +407,9 @@ static int make_buffer(struct impl *this)
 	l0 = SPA_MIN(n_bytes, maxsize - offset) / this->bpf;
 	l1 = n_samples - l0;
 
-	this->render_func(this, SPA_MEMBER(data, offset, void), l0);
+	render(this, SPA_MEMBER(data, offset, void), l0);
 	if (l1 > 0)
-		this->render_func(this, data, l1);
+		render(this, data, l1);
 
 	d[0].chunk->offset = index;
 	d[0].chunk->size = n_bytes;
@@ -742,7 +748,9 @@ impl_node_port_enum_params(struct spa_node *node,
 				":", t->param.propType, "i", p->wave,
 				":", t->param.propLabels, "[-i",
 					"i", WAVE_SINE, "s", "Sine wave",
-					"i", WAVE_SQUARE, "s", "Square wave", "]");
+					"i", WAVE_SQUARE, "s", "Square wave",
+					"i", WAVE_SILENCE, "s", "Silence",
+					"i", WAVE_WHITE_NOISE, "s", "White noise", "]");
 			break;
 		case 1:
 			param = spa_pod_builder_object(&b,
@@ -829,7 +837,7 @@ port_set_format(struct impl *this,
 		this->bpf = sizes[idx] * info.info.raw.channels;
 		this->current_format = info;
 		this->have_format = true;
-		this->render_func = sine_funcs[idx];
+		this->render_funcs = render_funcs[idx];
 	}
 
 	if (this->have_format) {
@@ -1190,6 +1198,7 @@ impl_init(const struct spa_handle_factory *factory,
 	this->io_wave = &this->props.wave;
 	this->io_freq = &this->props.freq;
 	this->io_volume = &this->props.volume;
+	this->random_state = 0x12345678;
 
 	spa_list_init(&this->empty);
 
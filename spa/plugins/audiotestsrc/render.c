@@ -21,9 +21,74 @@
 
 #define M_PI_M2 ( M_PI + M_PI )
 
+/* number of frames that are computed in parallel by the sine oscillator */
+#define SINE_LANES	4
+
+/* Advance the phase accumulator by n_samples steps and wrap it around */
+static inline void advance_accumulator(struct impl *this, double step, size_t n_samples)
+{
+	this->accumulator = fmod(this->accumulator + step * n_samples, M_PI_M2);
+	if (this->accumulator < 0.0)
+		this->accumulator += M_PI_M2;
+}
+
+static inline uint32_t next_random(struct impl *this)
+{
+	/* xorshift32 */
+	uint32_t x = this->random_state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return this->random_state = x;
+}
+
+/* The sine is generated with a recursive oscillator: SINE_LANES phasors,
+ * each one frame apart, are rotated by SINE_LANES * step for every block of
+ * frames. The lanes are independent so the inner loop vectorizes. The phasors
+ * are renormalised from the phase accumulator at the start of every call so
+ * that no rounding error accumulates across buffers. */
 #define DEFINE_SINE(type,scale)								\
 static void										\
 audio_test_src_create_sine_##type (struct impl *this, type *samples, size_t n_samples)	\
+{											\
+	int i, j, c, channels;								\
+	double step, amp, rc, rs;							\
+	double re[SINE_LANES], im[SINE_LANES];						\
+	double freq = *this->io_freq;							\
+	double volume = *this->io_volume;						\
+											\
+	channels = this->current_format.info.raw.channels;				\
+	step = M_PI_M2 * freq / this->current_format.info.raw.rate;			\
+	amp = volume * scale;								\
+											\
+	for (j = 0; j < SINE_LANES; j++) {						\
+		double phase = this->accumulator + step * (j + 1);			\
+		re[j] = cos(phase) * amp;						\
+		im[j] = sin(phase) * amp;						\
+	}										\
+	rc = cos(step * SINE_LANES);							\
+	rs = sin(step * SINE_LANES);							\
+											\
+	for (i = 0; i < n_samples; i += SINE_LANES) {					\
+		int n = SPA_MIN(SINE_LANES, n_samples - i);				\
+											\
+		for (j = 0; j < n; j++) {						\
+			type val = (type) im[j];					\
+			for (c = 0; c < channels; ++c)					\
+				*samples++ = val;					\
+		}									\
+		for (j = 0; j < SINE_LANES; j++) {					\
+			double r = re[j] * rc - im[j] * rs;				\
+			im[j] = re[j] * rs + im[j] * rc;				\
+			re[j] = r;							\
+		}									\
+	}										\
+	advance_accumulator(this, step, n_samples);					\
+}
+
+#define DEFINE_SQUARE(type,scale)							\
+static void										\
+audio_test_src_create_square_##type (struct impl *this, type *samples, size_t n_samples)	\
 {											\
 	int i, c, channels;								\
 	double step, amp;								\
@@ -39,20 +104,68 @@ audio_test_src_create_sine_##type (struct impl *this, type *samples, size_t n_sa
 		this->accumulator += step;						\
 		if (this->accumulator >= M_PI_M2)					\
 			this->accumulator -= M_PI_M2;					\
-		val = (type) (sin (this->accumulator) * amp);				\
+		val = (type) (this->accumulator < M_PI ? amp : -amp);			\
 		for (c = 0; c < channels; ++c)						\
 			*samples++ = val;						\
 	}										\
 }
 
-DEFINE_SINE(int16_t, 32767.0);
-DEFINE_SINE(int32_t, 2147483647.0);
-DEFINE_SINE(float, 1.0);
-DEFINE_SINE(double, 1.0);
+#define DEFINE_SILENCE(type)								\
+static void										\
+audio_test_src_create_silence_##type (struct impl *this, type *samples, size_t n_samples)	\
+{											\
+	memset(samples, 0, n_samples * this->bpf);					\
+}
 
-static const render_func_t sine_funcs[] = {
-	(render_func_t) audio_test_src_create_sine_int16_t,
-	(render_func_t) audio_test_src_create_sine_int32_t,
-	(render_func_t) audio_test_src_create_sine_float,
-	(render_func_t) audio_test_src_create_sine_double
+#define DEFINE_WHITE_NOISE(type,scale)							\
+static void										\
+audio_test_src_create_white_noise_##type (struct impl *this, type *samples, size_t n_samples)	\
+{											\
+	int i, c, channels;								\
+	double amp;									\
+	double volume = *this->io_volume;						\
+											\
+	channels = this->current_format.info.raw.channels;				\
+	amp = volume * scale / 2147483648.0;						\
+											\
+	for (i = 0; i < n_samples; i++) {						\
+		for (c = 0; c < channels; ++c)						\
+			*samples++ = (type) ((int32_t) next_random(this) * amp);	\
+	}										\
+}
+
+#define DEFINE_WAVES(type,scale)	\
+DEFINE_SINE(type,scale);		\
+DEFINE_SQUARE(type,scale);		\
+DEFINE_SILENCE(type);			\
+DEFINE_WHITE_NOISE(type,scale);
+
+DEFINE_WAVES(int16_t, 32767.0);
+DEFINE_WAVES(int32_t, 2147483647.0);
+DEFINE_WAVES(float, 1.0);
+DEFINE_WAVES(double, 1.0);
+
+#define MAKE_FUNCS(type)					\
+{								\
+	(render_func_t) audio_test_src_create_sine_##type,	\
+	(render_func_t) audio_test_src_create_square_##type,	\
+	(render_func_t) audio_test_src_create_silence_##type,	\
+	(render_func_t) audio_test_src_create_white_noise_##type	\
+}
+
+static const render_func_t render_funcs[][WAVE_LAST] = {
+	MAKE_FUNCS(int16_t),
+	MAKE_FUNCS(int32_t),
+	MAKE_FUNCS(float),
+	MAKE_FUNCS(double)
 };
+
+static inline void render(struct impl *this, void *samples, size_t n_samples)
+{
+	uint32_t wave = *this->io_wave;
+
+	if (wave >= WAVE_LAST)
+		wave = DEFAULT_WAVE;
+
+	this->render_funcs[wave](this, samples, n_samples);
+}
@@ -19,18 +19,29 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <string.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 
 #include <spa/support/type-map.h>
 #include <spa/support/log.h>
+#include <spa/utils/list.h>
 #include <spa/node/node.h>
 #include <spa/node/io.h>
+#include <spa/buffer/buffer.h>
+#include <spa/param/buffers.h>
+#include <spa/param/meta.h>
+#include <spa/param/props.h>
 #include <spa/param/video/format-utils.h>
 
 #include <lib/pod.h>
 
+#include "ffmpeg-utils.h"
+
+#define NAME "ffmpeg-dec"
+
 #define IS_VALID_PORT(this,d,id)	((id) == 0)
 #define GET_IN_PORT(this,p)		(&this->in_ports[p])
 #define GET_OUT_PORT(this,p)		(&this->out_ports[p])
@@ -38,40 +49,80 @@
 
 #define MAX_BUFFERS    32
 
+struct impl;
+
 struct buffer {
+	struct impl *impl;
 	struct spa_buffer *outbuf;
+	struct spa_meta_header *h;
+	/* output buffers are held by the consumer and by the frames of the
+	 * decoder, they are free when both released them */
 	bool outstanding;
-	struct buffer *next;
+	int refs;
+	struct spa_list link;
 };
 
 struct port {
 	bool have_format;
 	struct spa_video_info current_format;
-	bool have_buffers;
+	struct spa_rectangle size;
+	struct spa_fraction framerate;
+
 	struct buffer buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
+	struct spa_list free;
+
 	struct spa_port_info info;
 	struct spa_io_buffers *io;
+
+	/* layout of the decoded frames in the output buffers */
+	enum AVPixelFormat pix_fmt;
+	int width;
+	int height;
+	int linesize[4];
+	size_t offset[4];
+	size_t frame_size;
 };
 
 struct type {
 	uint32_t node;
+	uint32_t format;
+	uint32_t props;
+	uint32_t prop_threads;
+	uint32_t prop_thread_type;
 	struct spa_type_io io;
 	struct spa_type_param param;
 	struct spa_type_media_type media_type;
 	struct spa_type_media_subtype media_subtype;
+	struct spa_type_media_subtype_video media_subtype_video;
 	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
 	struct spa_type_command_node command_node;
+	struct spa_type_param_buffers param_buffers;
+	struct spa_type_param_meta param_meta;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
 };
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
 	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
+	type->prop_threads = spa_type_map_get_id(map, SPA_TYPE_PROPS__threads);
+	type->prop_thread_type = spa_type_map_get_id(map, SPA_TYPE_PROPS__threadType);
 	spa_type_io_map(map, &type->io);
 	spa_type_param_map(map, &type->param);
 	spa_type_media_type_map(map, &type->media_type);
 	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_media_subtype_video_map(map, &type->media_subtype_video);
 	spa_type_format_video_map(map, &type->format_video);
+	spa_type_video_format_map(map, &type->video_format);
 	spa_type_command_node_map(map, &type->command_node);
+	spa_type_param_buffers_map(map, &type->param_buffers);
+	spa_type_param_meta_map(map, &type->param_meta);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
 }
 
 struct impl {
@@ -85,10 +136,22 @@ struct impl {
 	const struct spa_node_callbacks *callbacks;
 	void *user_data;
 
+	struct props props;
+
 	struct port in_ports[1];
 	struct port out_ports[1];
 
 	bool started;
+
+	const AVCodec *codec;
+	AVCodecContext *context;
+	AVPacket *packet;
+	AVFrame *frame;
+	/* get_buffer2 and the buffer release are called from the decoder
+	 * threads, this protects the free list and the refs of the output
+	 * buffers */
+	pthread_mutex_t lock;
+	uint64_t seq;
 };
 
 static int spa_ffmpeg_dec_node_enum_params(struct spa_node *node,
@@ -97,14 +160,111 @@ static int spa_ffmpeg_dec_node_enum_params(struct spa_node *node,
 					   struct spa_pod **result,
 					   struct spa_pod_builder *builder)
 {
-	return -ENOTSUP;
+	struct impl *this;
+	struct type *t;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_pod *param;
+	struct props *p;
+
+	if (node == NULL || index == NULL || builder == NULL)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+	p = &this->props;
+
+      next:
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	if (id == t->param.idList) {
+		uint32_t list[] = { t->param.idPropInfo,
+				    t->param.idProps };
+
+		if (*index < SPA_N_ELEMENTS(list))
+			param = spa_pod_builder_object(&b, id, t->param.List,
+				":", t->param.listId, "I", list[*index]);
+		else
+			return 0;
+	}
+	else if (id == t->param.idPropInfo) {
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_threads,
+				":", t->param.propName, "s", "Number of decoder threads, 0 for automatic",
+				":", t->param.propType, "ir", p->threads,
+							2, 0, 64);
+			break;
+		case 1:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_thread_type,
+				":", t->param.propName, "s", "Select the threading method",
+				":", t->param.propType, "i", p->thread_type,
+				":", t->param.propLabels, "[-i",
+					"i", THREAD_TYPE_AUTO, "s", "Frame and slice threads",
+					"i", THREAD_TYPE_FRAME, "s", "Frame threads",
+					"i", THREAD_TYPE_SLICE, "s", "Slice threads",
+					"i", THREAD_TYPE_NONE, "s", "No threads", "]");
+			break;
+		default:
+			return 0;
+		}
+	}
+	else if (id == t->param.idProps) {
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->props,
+				":", t->prop_threads,     "i", p->threads,
+				":", t->prop_thread_type, "i", p->thread_type);
+			break;
+		default:
+			return 0;
+		}
+	}
+	else
+		return -ENOENT;
+
+	(*index)++;
+
+	if (spa_pod_filter(builder, result, param, filter) < 0)
+		goto next;
+
+	return 1;
 }
 
 static int spa_ffmpeg_dec_node_set_param(struct spa_node *node,
 					 uint32_t id, uint32_t flags,
 					 const struct spa_pod *param)
 {
-	return -ENOTSUP;
+	struct impl *this;
+	struct type *t;
+
+	if (node == NULL)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+
+	if (id == t->param.idProps) {
+		struct props *p = &this->props;
+
+		/* used the next time the decoder is opened */
+		if (param == NULL) {
+			reset_props(p);
+			return 0;
+		}
+		spa_pod_object_parse(param,
+			":", t->prop_threads,     "?i", &p->threads,
+			":", t->prop_thread_type, "?i", &p->thread_type, NULL);
+	}
+	else
+		return -ENOENT;
+
+	return 0;
 }
 
 static int spa_ffmpeg_dec_node_send_command(struct spa_node *node, const struct spa_command *command)
@@ -230,22 +390,81 @@ static int port_enum_formats(struct spa_node *node,
 			     struct spa_pod **param,
 			     struct spa_pod_builder *builder)
 {
-	//struct impl *this;
+	struct impl *this;
+	struct type *t;
+	struct port *in_port;
+	uint32_t subtype;
 
 	if (node == NULL || index == NULL)
 		return -EINVAL;
 
-	//this = SPA_CONTAINER_OF (node, struct impl, node);
+	this = SPA_CONTAINER_OF (node, struct impl, node);
+	t = &this->type;
 
 	if (!IS_VALID_PORT(this, direction, port_id))
 		return -EINVAL;
 
-	switch (*index) {
-	case 0:
-		*param = NULL;
-		break;
-	default:
+	if (*index > 0)
 		return 0;
+
+	in_port = GET_IN_PORT(this, 0);
+
+	if (direction == SPA_DIRECTION_INPUT) {
+		if ((subtype = ffmpeg_codec_to_subtype(&t->media_subtype_video,
+						       this->codec->id)) == 0)
+			return 0;
+
+		*param = spa_pod_builder_object(builder,
+			t->param.idEnumFormat, t->format,
+			"I", t->media_type.video,
+			"I", subtype,
+			":", t->format_video.size,      "Rru", &SPA_RECTANGLE(320, 240),
+				2, &SPA_RECTANGLE(1, 1),
+				   &SPA_RECTANGLE(INT32_MAX, INT32_MAX),
+			":", t->format_video.framerate, "Fru", &SPA_FRACTION(25,1),
+				2, &SPA_FRACTION(0, 1),
+				   &SPA_FRACTION(INT32_MAX, 1));
+	} else {
+		const enum AVPixelFormat *pix_fmts = this->codec->pix_fmts;
+		struct spa_pod_prop *prop;
+		uint32_t i, n_formats = 0;
+
+		if (!in_port->have_format)
+			return -EIO;
+
+		spa_pod_builder_push_object(builder, t->param.idEnumFormat, t->format);
+		spa_pod_builder_id(builder, t->media_type.video);
+		spa_pod_builder_id(builder, t->media_subtype.raw);
+
+		/* the decoder makes what the stream has, offer everything we
+		 * can map when the codec doesn't tell */
+		prop = spa_pod_builder_deref(builder,
+				spa_pod_builder_push_prop(builder, t->format_video.format,
+					SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET));
+		for (i = 0; i < SPA_N_ELEMENTS(ffmpeg_formats); i++) {
+			const enum AVPixelFormat *p;
+			uint32_t format;
+
+			if (pix_fmts != NULL) {
+				for (p = pix_fmts; *p != AV_PIX_FMT_NONE; p++)
+					if (*p == ffmpeg_formats[i].pix_fmt)
+						break;
+				if (*p == AV_PIX_FMT_NONE)
+					continue;
+			}
+			format = ffmpeg_pix_fmt_to_format(&t->video_format, ffmpeg_formats[i].pix_fmt);
+			if (n_formats++ == 0)
+				spa_pod_builder_id(builder, format);
+			spa_pod_builder_id(builder, format);
+		}
+		if (n_formats <= 1)
+			prop->body.flags &= ~(SPA_POD_PROP_RANGE_MASK | SPA_POD_PROP_FLAG_UNSET);
+		spa_pod_builder_pop(builder);
+
+		spa_pod_builder_add(builder,
+			":", t->format_video.size,      "R", &in_port->size,
+			":", t->format_video.framerate, "F", &in_port->framerate, NULL);
+		*param = spa_pod_builder_pop(builder);
 	}
 	return 1;
 }
@@ -258,6 +477,7 @@ static int port_get_format(struct spa_node *node,
 			   struct spa_pod_builder *builder)
 {
 	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	struct type *t = &this->type;
 	struct port *port;
 
 	port = GET_PORT(this, direction, port_id);
@@ -268,8 +488,22 @@ static int port_get_format(struct spa_node *node,
 	if (*index > 0)
 		return 0;
 
-	*param = NULL;
-
+	if (direction == SPA_DIRECTION_INPUT) {
+		*param = spa_pod_builder_object(builder,
+			t->param.idFormat, t->format,
+			"I", port->current_format.media_type,
+			"I", port->current_format.media_subtype,
+			":", t->format_video.size,      "R", &port->size,
+			":", t->format_video.framerate, "F", &port->framerate);
+	} else {
+		*param = spa_pod_builder_object(builder,
+			t->param.idFormat, t->format,
+			"I", port->current_format.media_type,
+			"I", port->current_format.media_subtype,
+			":", t->format_video.format,    "I", port->current_format.info.raw.format,
+			":", t->format_video.size,      "R", &port->size,
+			":", t->format_video.framerate, "F", &port->framerate);
+	}
 	return 1;
 }
 
@@ -286,14 +520,22 @@ spa_ffmpeg_dec_node_port_enum_params(struct spa_node *node,
 	struct spa_pod_builder b = { 0 };
 	uint8_t buffer[1024];
 	struct spa_pod *param;
+	struct port *port;
 	int res;
 
+	if (!IS_VALID_PORT(this, direction, port_id))
+		return -EINVAL;
+
+	port = GET_PORT(this, direction, port_id);
+
       next:
 	spa_pod_builder_init(&b, buffer, sizeof(buffer));
 
 	if (id == t->param.idList) {
 		uint32_t list[] = { t->param.idEnumFormat,
-				    t->param.idFormat };
+				    t->param.idFormat,
+				    t->param.idBuffers,
+				    t->param.idMeta };
 
 		if (*index < SPA_N_ELEMENTS(list))
 			param = spa_pod_builder_object(&b, id, t->param.List,
@@ -309,6 +551,45 @@ spa_ffmpeg_dec_node_port_enum_params(struct spa_node *node,
 		if ((res = port_get_format(node, direction, port_id, index, filter, &param, &b)) <= 0)
 			return res;
 	}
+	else if (id == t->param.idBuffers) {
+		if (!port->have_format)
+			return -EIO;
+		if (*index > 0)
+			return 0;
+
+		if (direction == SPA_DIRECTION_INPUT) {
+			param = spa_pod_builder_object(&b,
+				id, t->param_buffers.Buffers,
+				":", t->param_buffers.size,    "iru", 4096,
+									2, 1, INT32_MAX,
+				":", t->param_buffers.stride,  "i", 0,
+				":", t->param_buffers.buffers, "iru", 4,
+									2, 1, MAX_BUFFERS,
+				":", t->param_buffers.align,   "i", 16);
+		} else {
+			/* frames are decoded directly into the buffers, make room
+			 * to align the planes for libavcodec */
+			param = spa_pod_builder_object(&b,
+				id, t->param_buffers.Buffers,
+				":", t->param_buffers.size,    "i", port->frame_size + FFMPEG_ALIGN,
+				":", t->param_buffers.stride,  "i", port->linesize[0],
+				":", t->param_buffers.buffers, "iru", 8,
+									2, 2, MAX_BUFFERS,
+				":", t->param_buffers.align,   "i", FFMPEG_ALIGN);
+		}
+	}
+	else if (id == t->param.idMeta) {
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param_meta.Meta,
+				":", t->param_meta.type, "I", t->meta.Header,
+				":", t->param_meta.size, "i", sizeof(struct spa_meta_header));
+			break;
+		default:
+			return 0;
+		}
+	}
 	else
 		return -ENOENT;
 
@@ -320,6 +601,91 @@ spa_ffmpeg_dec_node_port_enum_params(struct spa_node *node,
 	return 1;
 }
 
+static void close_decoder(struct impl *this)
+{
+	if (this->context == NULL)
+		return;
+
+	avcodec_free_context(&this->context);
+}
+
+static int get_buffer(struct AVCodecContext *context, AVFrame *frame, int flags);
+
+static int open_decoder(struct impl *this)
+{
+	struct port *in_port = GET_IN_PORT(this, 0);
+	AVCodecContext *context;
+	int res;
+
+	close_decoder(this);
+
+	if ((context = avcodec_alloc_context3(this->codec)) == NULL)
+		return -ENOMEM;
+
+	context->opaque = this;
+	context->width = in_port->size.width;
+	context->height = in_port->size.height;
+	ffmpeg_apply_props(context, &this->props);
+
+	/* with direct rendering, frames are decoded into the output buffers */
+	if (this->codec->capabilities & AV_CODEC_CAP_DR1) {
+		context->get_buffer2 = get_buffer;
+#if LIBAVCODEC_VERSION_MAJOR < 59
+		context->thread_safe_callbacks = 1;
+#endif
+	}
+
+	if ((res = avcodec_open2(context, this->codec, NULL)) < 0) {
+		spa_log_error(this->log, NAME " %p: can't open decoder %s: %s", this,
+			      this->codec->name, av_err2str(res));
+		avcodec_free_context(&context);
+		return -EINVAL;
+	}
+	spa_log_info(this->log, NAME " %p: opened decoder %s with %d threads, type %d", this,
+		     this->codec->name, context->thread_count, context->active_thread_type);
+
+	this->context = context;
+
+	return 0;
+}
+
+/* place the planes of a width x height frame in one buffer the way
+ * libavcodec wants them */
+static int compute_layout(struct impl *this, struct port *port,
+			  enum AVPixelFormat pix_fmt, int width, int height)
+{
+	int i, res, linesize_align[AV_NUM_DATA_POINTERS];
+	uint8_t *data[4];
+	AVCodecContext *context = this->context;
+	enum AVPixelFormat old = context->pix_fmt;
+
+	context->pix_fmt = pix_fmt;
+	avcodec_align_dimensions2(context, &width, &height, linesize_align);
+	context->pix_fmt = old;
+
+	if ((res = av_image_fill_linesizes(port->linesize, pix_fmt, width)) < 0)
+		return -EINVAL;
+
+	for (i = 0; i < 4; i++)
+		port->linesize[i] = SPA_ROUND_UP_N(port->linesize[i], FFMPEG_ALIGN);
+
+	if ((res = av_image_fill_pointers(data, pix_fmt, height, NULL, port->linesize)) < 0)
+		return -EINVAL;
+
+	for (i = 0; i < 4; i++)
+		port->offset[i] = data[i] ? SPA_ROUND_UP_N(data[i] - data[0], FFMPEG_ALIGN) : 0;
+
+	port->pix_fmt = pix_fmt;
+	port->width = width;
+	port->height = height;
+	port->frame_size = SPA_ROUND_UP_N(res, FFMPEG_ALIGN) + FFMPEG_ALIGN * 3;
+
+	spa_log_debug(this->log, NAME " %p: layout %dx%d stride %d size %zd", this,
+		      width, height, port->linesize[0], port->frame_size);
+
+	return 0;
+}
+
 static int port_set_format(struct spa_node *node,
 			   enum spa_direction direction, uint32_t port_id,
 			   uint32_t flags,
@@ -327,11 +693,14 @@ static int port_set_format(struct spa_node *node,
 {
 	struct impl *this;
 	struct port *port;
+	struct type *t;
+	int res;
 
-	if (node == NULL || format == NULL)
+	if (node == NULL)
 		return -EINVAL;
 
 	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
 
 	if (!IS_VALID_PORT(this, direction, port_id))
 		return -EINVAL;
@@ -340,24 +709,66 @@ static int port_set_format(struct spa_node *node,
 
 	if (format == NULL) {
 		port->have_format = false;
+		if (direction == SPA_DIRECTION_INPUT)
+			close_decoder(this);
 		return 0;
 	} else {
 		struct spa_video_info info = { 0 };
+		struct spa_rectangle size = { 0, 0 };
+		struct spa_fraction framerate = { 0, 1 };
 
 		spa_pod_object_parse(format,
 			"I", &info.media_type,
 			"I", &info.media_subtype);
 
-		if (info.media_type != this->type.media_type.video &&
-		    info.media_subtype != this->type.media_subtype.raw)
+		if (info.media_type != t->media_type.video)
 			return -EINVAL;
 
-		if (spa_format_video_raw_parse(format, &info.info.raw, &this->type.format_video) < 0)
-			return -EINVAL;
+		if (direction == SPA_DIRECTION_INPUT) {
+			if (info.media_subtype != ffmpeg_codec_to_subtype(&t->media_subtype_video,
+									  this->codec->id))
+				return -EINVAL;
+
+			spa_pod_object_parse(format,
+				":", t->format_video.size,      "?R", &size,
+				":", t->format_video.framerate, "?F", &framerate, NULL);
+		} else {
+			enum AVPixelFormat pix_fmt;
+
+			if (info.media_subtype != t->media_subtype.raw)
+				return -EINVAL;
+
+			if (spa_format_video_raw_parse(format, &info.info.raw, &t->format_video) < 0)
+				return -EINVAL;
+
+			pix_fmt = ffmpeg_format_to_pix_fmt(&t->video_format,
+							   info.info.raw.format,
+							   this->codec->pix_fmts);
+			if (pix_fmt == AV_PIX_FMT_NONE)
+				return -EINVAL;
+
+			if (this->context == NULL)
+				return -EIO;
+
+			size = info.info.raw.size;
+			framerate = info.info.raw.framerate;
+
+			if (!(flags & SPA_NODE_PARAM_FLAG_TEST_ONLY) &&
+			    (res = compute_layout(this, port, pix_fmt, size.width, size.height)) < 0)
+				return res;
+		}
 
 		if (!(flags & SPA_NODE_PARAM_FLAG_TEST_ONLY)) {
 			port->current_format = info;
+			port->size = size;
+			port->framerate = framerate;
 			port->have_format = true;
+
+			if (direction == SPA_DIRECTION_INPUT &&
+			    (res = open_decoder(this)) < 0) {
+				port->have_format = false;
+				return res;
+			}
 		}
 	}
 	return 0;
@@ -379,6 +790,106 @@ spa_ffmpeg_dec_node_port_set_param(struct spa_node *node,
 		return -ENOENT;
 }
 
+static void unref_buffer(struct impl *this, struct buffer *b)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+
+	pthread_mutex_lock(&this->lock);
+	if (--b->refs == 0)
+		spa_list_append(&port->free, &b->link);
+	pthread_mutex_unlock(&this->lock);
+}
+
+static struct buffer *get_free_buffer(struct impl *this)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct buffer *b = NULL;
+
+	pthread_mutex_lock(&this->lock);
+	if (!spa_list_is_empty(&port->free)) {
+		b = spa_list_first(&port->free, struct buffer, link);
+		spa_list_remove(&b->link);
+		b->refs = 1;
+	}
+	pthread_mutex_unlock(&this->lock);
+
+	return b;
+}
+
+static uint8_t *buffer_data(struct buffer *b)
+{
+	return (uint8_t *) SPA_ROUND_UP_N((uintptr_t) b->outbuf->datas[0].data, FFMPEG_ALIGN);
+}
+
+static void release_buffer(void *opaque, uint8_t *data)
+{
+	struct buffer *b = opaque;
+	unref_buffer(b->impl, b);
+}
+
+static int get_buffer(struct AVCodecContext *context, AVFrame *frame, int flags)
+{
+	struct impl *this = context->opaque;
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct buffer *b;
+	uint8_t *data;
+	int i;
+
+	/* frames that don't fit the negotiated format are decoded in
+	 * libavcodec memory */
+	if (!port->have_format || port->n_buffers == 0 ||
+	    frame->format != port->pix_fmt ||
+	    frame->width > port->width || frame->height > port->height)
+		return avcodec_default_get_buffer2(context, frame, flags);
+
+	if ((b = get_free_buffer(this)) == NULL) {
+		spa_log_trace(this->log, NAME " %p: no free buffer, using default", this);
+		return avcodec_default_get_buffer2(context, frame, flags);
+	}
+
+	data = buffer_data(b);
+	for (i = 0; i < 4; i++) {
+		frame->data[i] = port->linesize[i] ? data + port->offset[i] : NULL;
+		frame->linesize[i] = port->linesize[i];
+	}
+	frame->extended_data = frame->data;
+
+	frame->buf[0] = av_buffer_create(data, port->frame_size, release_buffer, b, 0);
+	if (frame->buf[0] == NULL) {
+		unref_buffer(this, b);
+		return AVERROR(ENOMEM);
+	}
+	return 0;
+}
+
+/* the output buffer the frame was decoded in, NULL when it is libavcodec memory */
+static struct buffer *frame_buffer(struct impl *this, AVFrame *frame)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct buffer *b;
+
+	if (frame->buf[0] == NULL)
+		return NULL;
+
+	b = av_buffer_get_opaque(frame->buf[0]);
+	if (b < &port->buffers[0] || b >= &port->buffers[port->n_buffers])
+		return NULL;
+	return b;
+}
+
+static int clear_buffers(struct impl *this, struct port *port)
+{
+	if (port->n_buffers > 0) {
+		spa_log_info(this->log, NAME " %p: clear buffers", this);
+		/* drop the frames that still reference the buffers */
+		if (this->context && port == GET_OUT_PORT(this, 0))
+			avcodec_flush_buffers(this->context);
+		port->n_buffers = 0;
+		spa_list_init(&port->free);
+	}
+	return 0;
+}
+
 static int
 spa_ffmpeg_dec_node_port_use_buffers(struct spa_node *node,
 				     enum spa_direction direction,
@@ -386,13 +897,55 @@ spa_ffmpeg_dec_node_port_use_buffers(struct spa_node *node,
 				     struct spa_buffer **buffers,
 				     uint32_t n_buffers)
 {
+	struct impl *this;
+	struct port *port;
+	uint32_t i;
+
 	if (node == NULL)
 		return -EINVAL;
 
-	if (!IS_VALID_PORT(node, direction, port_id))
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	if (!IS_VALID_PORT(this, direction, port_id))
 		return -EINVAL;
 
-	return -ENOTSUP;
+	port = GET_PORT(this, direction, port_id);
+
+	if (!port->have_format)
+		return -EIO;
+
+	clear_buffers(this, port);
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+		struct spa_data *d = buffers[i]->datas;
+
+		b->impl = this;
+		b->outbuf = buffers[i];
+		b->h = spa_buffer_find_meta(buffers[i], this->type.meta.Header);
+		b->outstanding = false;
+		b->refs = 0;
+
+		if (buffers[i]->n_datas < 1 || d[0].data == NULL ||
+		    (d[0].type != this->type.data.MemPtr &&
+		     d[0].type != this->type.data.MemFd &&
+		     d[0].type != this->type.data.DmaBuf)) {
+			spa_log_error(this->log, NAME " %p: invalid memory on buffer %p", this,
+				      buffers[i]);
+			return -EINVAL;
+		}
+		if (direction == SPA_DIRECTION_OUTPUT) {
+			if (d[0].maxsize < port->frame_size + FFMPEG_ALIGN) {
+				spa_log_error(this->log, NAME " %p: buffer %p too small", this,
+					      buffers[i]);
+				return -EINVAL;
+			}
+			spa_list_append(&port->free, &b->link);
+		}
+	}
+	port->n_buffers = n_buffers;
+
+	return 0;
 }
 
 static int
@@ -437,46 +990,250 @@ spa_ffmpeg_dec_node_port_set_io(struct spa_node *node,
 	return 0;
 }
 
+static void recycle_buffer(struct impl *this, uint32_t id)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct buffer *b = &port->buffers[id];
+
+	if (!b->outstanding) {
+		spa_log_warn(this->log, NAME " %p: buffer %d not outstanding", this, id);
+		return;
+	}
+	b->outstanding = false;
+	unref_buffer(this, b);
+	spa_log_trace(this->log, NAME " %p: recycle buffer %d", this, id);
+}
+
+/* take a decoded frame and place it on the output, returns 1 when there
+ * was a frame */
+static int output_frame(struct impl *this)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct spa_io_buffers *output = port->io;
+	AVFrame *frame = this->frame;
+	struct buffer *b;
+	struct spa_data *d;
+	uint8_t *data;
+	int res;
+
+	if ((res = avcodec_receive_frame(this->context, frame)) < 0) {
+		if (res == AVERROR(EAGAIN) || res == AVERROR_EOF)
+			return 0;
+		spa_log_error(this->log, NAME " %p: decode error: %s", this, av_err2str(res));
+		return -EIO;
+	}
+
+	if ((b = frame_buffer(this, frame)) != NULL) {
+		pthread_mutex_lock(&this->lock);
+		b->refs++;
+		pthread_mutex_unlock(&this->lock);
+		data = buffer_data(b);
+	} else {
+		uint8_t *dst[4];
+		int i;
+
+		/* not decoded in our memory, copy */
+		if (frame->format != port->pix_fmt ||
+		    frame->width > port->width || frame->height > port->height) {
+			spa_log_error(this->log, NAME " %p: frame format %d %dx%d not negotiated",
+				      this, frame->format, frame->width, frame->height);
+			av_frame_unref(frame);
+			return -EINVAL;
+		}
+		if ((b = get_free_buffer(this)) == NULL) {
+			spa_log_warn(this->log, NAME " %p: out of buffers, dropping frame", this);
+			av_frame_unref(frame);
+			return 0;
+		}
+		data = buffer_data(b);
+		for (i = 0; i < 4; i++)
+			dst[i] = port->linesize[i] ? data + port->offset[i] : NULL;
+
+		av_image_copy(dst, port->linesize,
+			      (const uint8_t **) frame->data, frame->linesize,
+			      frame->format, frame->width, frame->height);
+	}
+	b->outstanding = true;
+
+	d = b->outbuf->datas;
+	d[0].chunk->offset = data - (uint8_t *) d[0].data;
+	d[0].chunk->size = port->frame_size;
+	d[0].chunk->stride = port->linesize[0];
+
+	if (b->h) {
+		b->h->flags = 0;
+		if (frame->decode_error_flags)
+			b->h->flags |= SPA_META_HEADER_FLAG_CORRUPTED;
+		b->h->seq = this->seq++;
+		b->h->pts = frame->pts;
+		b->h->dts_offset = 0;
+	}
+	/* drops the reference of the decoder */
+	av_frame_unref(frame);
+
+	output->buffer_id = b->outbuf->id;
+	output->status = SPA_STATUS_HAVE_BUFFER;
+
+	return 1;
+}
+
+/* send the packet in the input io area to the decoder, returns -EAGAIN
+ * when the decoder wants its frames taken out first */
+static int send_packet(struct impl *this)
+{
+	struct port *in_port = GET_IN_PORT(this, 0);
+	struct spa_io_buffers *input = in_port->io;
+	struct buffer *b;
+	struct spa_data *d;
+	AVPacket *packet;
+	int res;
+
+	if (input->buffer_id >= in_port->n_buffers) {
+		input->status = -EINVAL;
+		return -EINVAL;
+	}
+	b = &in_port->buffers[input->buffer_id];
+	d = b->outbuf->datas;
+
+	packet = this->packet;
+	packet->data = SPA_MEMBER(d[0].data, d[0].chunk->offset % d[0].maxsize, uint8_t);
+	packet->size = SPA_MIN(d[0].chunk->size, d[0].maxsize);
+	packet->pts = b->h ? b->h->pts : AV_NOPTS_VALUE;
+	packet->dts = b->h ? b->h->pts + b->h->dts_offset : AV_NOPTS_VALUE;
+
+	/* the packet is not refcounted, libavcodec copies what it keeps */
+	res = avcodec_send_packet(this->context, packet);
+	if (res == AVERROR(EAGAIN))
+		return -EAGAIN;
+
+	input->status = SPA_STATUS_OK;
+
+	if (res < 0)
+		spa_log_warn(this->log, NAME " %p: can't decode packet: %s", this, av_err2str(res));
+
+	return 0;
+}
+
+/* take out the decoded frames and feed the decoder. The input stays in the
+ * io area until the decoder took it. */
+static int decode(struct impl *this)
+{
+	struct spa_io_buffers *input = GET_IN_PORT(this, 0)->io;
+	int res;
+
+	/* frames of earlier packets go first */
+	if ((res = output_frame(this)) != 0)
+		goto done;
+
+	if (input->status != SPA_STATUS_HAVE_BUFFER) {
+		input->status = SPA_STATUS_NEED_BUFFER;
+		return SPA_STATUS_NEED_BUFFER;
+	}
+
+	if ((res = send_packet(this)) == -EAGAIN) {
+		/* the decoder is full, the packet is sent again when the
+		 * next frame was taken */
+		if ((res = output_frame(this)) != 0)
+			goto done;
+		return SPA_STATUS_OK;
+	}
+	else if (res < 0)
+		return res;
+
+	/* a packet can make more than one frame */
+	if ((res = output_frame(this)) != 0)
+		goto done;
+
+	input->status = SPA_STATUS_NEED_BUFFER;
+	return SPA_STATUS_NEED_BUFFER;
+
+      done:
+	return res > 0 ? SPA_STATUS_HAVE_BUFFER : res;
+}
+
 static int spa_ffmpeg_dec_node_process_input(struct spa_node *node)
 {
-	return -EINVAL;
+	struct impl *this;
+	struct port *in_port, *out_port;
+	struct spa_io_buffers *input, *output;
+
+	if (node == NULL)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	in_port = GET_IN_PORT(this, 0);
+	out_port = GET_OUT_PORT(this, 0);
+
+	if ((input = in_port->io) == NULL || (output = out_port->io) == NULL)
+		return -EIO;
+
+	if (output->status == SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_HAVE_BUFFER;
+
+	if (this->context == NULL || !out_port->have_format) {
+		input->status = -EIO;
+		return -EIO;
+	}
+
+	return decode(this);
 }
 
 static int spa_ffmpeg_dec_node_process_output(struct spa_node *node)
 {
 	struct impl *this;
-	struct port *port;
-	struct spa_io_buffers *output;
+	struct port *in_port, *out_port;
+	struct spa_io_buffers *input, *output;
 
 	if (node == NULL)
 		return -EINVAL;
 
 	this = SPA_CONTAINER_OF(node, struct impl, node);
 
-	port = &this->out_ports[0];
+	in_port = GET_IN_PORT(this, 0);
+	out_port = GET_OUT_PORT(this, 0);
 
-	if ((output = port->io) == NULL)
+	if ((output = out_port->io) == NULL || (input = in_port->io) == NULL)
 		return -EIO;
 
-	if (!port->have_format) {
+	if (!out_port->have_format || this->context == NULL) {
 		output->status = -EIO;
 		return -EIO;
 	}
-	output->status = SPA_STATUS_OK;
 
-	return SPA_STATUS_OK;
+	if (output->status == SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_HAVE_BUFFER;
+
+	if (output->buffer_id < out_port->n_buffers) {
+		recycle_buffer(this, output->buffer_id);
+		output->buffer_id = SPA_ID_INVALID;
+	}
+
+	/* a packet that didn't fit in the decoder is still in the input */
+	return decode(this);
 }
 
 static int
 spa_ffmpeg_dec_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
 {
+	struct impl *this;
+	struct port *port;
+
 	if (node == NULL)
 		return -EINVAL;
 
 	if (port_id != 0)
 		return -EINVAL;
 
-	return -ENOTSUP;
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	port = GET_OUT_PORT(this, port_id);
+
+	if (buffer_id >= port->n_buffers)
+		return -EINVAL;
+
+	recycle_buffer(this, buffer_id);
+
+	return 0;
 }
 
 static int
@@ -530,8 +1287,31 @@ spa_ffmpeg_dec_get_interface(struct spa_handle *handle, uint32_t interface_id, v
 	return 0;
 }
 
+static int spa_ffmpeg_dec_clear(struct spa_handle *handle)
+{
+	struct impl *this;
+
+	if (handle == NULL)
+		return -EINVAL;
+
+	this = (struct impl *) handle;
+
+	close_decoder(this);
+	av_packet_free(&this->packet);
+	av_frame_free(&this->frame);
+	pthread_mutex_destroy(&this->lock);
+
+	return 0;
+}
+
+size_t spa_ffmpeg_dec_get_size(void)
+{
+	return sizeof(struct impl);
+}
+
 int
 spa_ffmpeg_dec_init(struct spa_handle *handle,
+		    const AVCodec *codec,
 		    const struct spa_dict *info,
 		    const struct spa_support *support,
 		    uint32_t n_support)
@@ -540,6 +1320,7 @@ spa_ffmpeg_dec_init(struct spa_handle *handle,
 	uint32_t i;
 
 	handle->get_interface = spa_ffmpeg_dec_get_interface;
+	handle->clear = spa_ffmpeg_dec_clear;
 
 	this = (struct impl *) handle;
 
@@ -556,9 +1337,21 @@ spa_ffmpeg_dec_init(struct spa_handle *handle,
 	init_type(&this->type, this->map);
 
 	this->node = ffmpeg_dec_node;
+	this->codec = codec;
+	reset_props(&this->props);
+
+	if ((this->packet = av_packet_alloc()) == NULL ||
+	    (this->frame = av_frame_alloc()) == NULL) {
+		av_packet_free(&this->packet);
+		return -ENOMEM;
+	}
+	pthread_mutex_init(&this->lock, NULL);
+
+	spa_list_init(&this->in_ports[0].free);
+	spa_list_init(&this->out_ports[0].free);
 
-	this->in_ports[0].info.flags = 0;
-	this->out_ports[0].info.flags = 0;
+	this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+	this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
 
 	return 0;
 }
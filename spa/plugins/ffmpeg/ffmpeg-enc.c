@@ -19,18 +19,28 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 
-#include <spa/support/log.h>
 #include <spa/support/type-map.h>
+#include <spa/support/log.h>
+#include <spa/utils/list.h>
 #include <spa/node/node.h>
 #include <spa/node/io.h>
+#include <spa/buffer/buffer.h>
+#include <spa/param/buffers.h>
+#include <spa/param/meta.h>
+#include <spa/param/props.h>
 #include <spa/param/video/format-utils.h>
 
 #include <lib/pod.h>
 
+#include "ffmpeg-utils.h"
+
+#define NAME "ffmpeg-enc"
+
 #define IS_VALID_PORT(this,d,id)	((id) == 0)
 #define GET_IN_PORT(this,p)		(&this->in_ports[p])
 #define GET_OUT_PORT(this,p)		(&this->out_ports[p])
@@ -39,43 +49,65 @@
 #define MAX_BUFFERS    32
 
 struct buffer {
-	struct spa_buffer buffer;
-	struct spa_meta metas[1];
-	struct spa_meta_header header;
-	struct spa_data datas[1];
-	struct spa_buffer *imported;
+	struct spa_buffer *outbuf;
+	struct spa_meta_header *h;
 	bool outstanding;
-	struct buffer *next;
+	struct spa_list link;
 };
 
 struct port {
 	bool have_format;
 	struct spa_video_info current_format;
-	bool have_buffers;
+	struct spa_rectangle size;
+	struct spa_fraction framerate;
+
 	struct buffer buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
+	struct spa_list free;
+
 	struct spa_port_info info;
 	struct spa_io_buffers *io;
 };
 
 struct type {
 	uint32_t node;
+	uint32_t format;
+	uint32_t props;
+	uint32_t prop_threads;
+	uint32_t prop_thread_type;
 	struct spa_type_io io;
 	struct spa_type_param param;
 	struct spa_type_media_type media_type;
 	struct spa_type_media_subtype media_subtype;
+	struct spa_type_media_subtype_video media_subtype_video;
 	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
 	struct spa_type_command_node command_node;
+	struct spa_type_param_buffers param_buffers;
+	struct spa_type_param_meta param_meta;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
 };
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
 	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
+	type->prop_threads = spa_type_map_get_id(map, SPA_TYPE_PROPS__threads);
+	type->prop_thread_type = spa_type_map_get_id(map, SPA_TYPE_PROPS__threadType);
 	spa_type_io_map(map, &type->io);
 	spa_type_param_map(map, &type->param);
 	spa_type_media_type_map(map, &type->media_type);
 	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_media_subtype_video_map(map, &type->media_subtype_video);
 	spa_type_format_video_map(map, &type->format_video);
+	spa_type_video_format_map(map, &type->video_format);
 	spa_type_command_node_map(map, &type->command_node);
+	spa_type_param_buffers_map(map, &type->param_buffers);
+	spa_type_param_meta_map(map, &type->param_meta);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
 }
 
 struct impl {
@@ -89,25 +121,132 @@ struct impl {
 	const struct spa_node_callbacks *callbacks;
 	void *user_data;
 
+	struct props props;
+
 	struct port in_ports[1];
 	struct port out_ports[1];
 
 	bool started;
+
+	const AVCodec *codec;
+	AVCodecContext *context;
+	AVPacket *packet;
+	AVFrame *frame;
+	enum AVPixelFormat pix_fmt;
+	uint64_t seq;
 };
 
 static int spa_ffmpeg_enc_node_enum_params(struct spa_node *node,
 					   uint32_t id, uint32_t *index,
 					   const struct spa_pod *filter,
-					   struct spa_pod **param,
+					   struct spa_pod **result,
 					   struct spa_pod_builder *builder)
 {
-	return -ENOTSUP;
+	struct impl *this;
+	struct type *t;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_pod *param;
+	struct props *p;
+
+	if (node == NULL || index == NULL || builder == NULL)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+	p = &this->props;
+
+      next:
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	if (id == t->param.idList) {
+		uint32_t list[] = { t->param.idPropInfo,
+				    t->param.idProps };
+
+		if (*index < SPA_N_ELEMENTS(list))
+			param = spa_pod_builder_object(&b, id, t->param.List,
+				":", t->param.listId, "I", list[*index]);
+		else
+			return 0;
+	}
+	else if (id == t->param.idPropInfo) {
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_threads,
+				":", t->param.propName, "s", "Number of encoder threads, 0 for automatic",
+				":", t->param.propType, "ir", p->threads,
+							2, 0, 64);
+			break;
+		case 1:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_thread_type,
+				":", t->param.propName, "s", "Select the threading method",
+				":", t->param.propType, "i", p->thread_type,
+				":", t->param.propLabels, "[-i",
+					"i", THREAD_TYPE_AUTO, "s", "Frame and slice threads",
+					"i", THREAD_TYPE_FRAME, "s", "Frame threads",
+					"i", THREAD_TYPE_SLICE, "s", "Slice threads",
+					"i", THREAD_TYPE_NONE, "s", "No threads", "]");
+			break;
+		default:
+			return 0;
+		}
+	}
+	else if (id == t->param.idProps) {
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->props,
+				":", t->prop_threads,     "i", p->threads,
+				":", t->prop_thread_type, "i", p->thread_type);
+			break;
+		default:
+			return 0;
+		}
+	}
+	else
+		return -ENOENT;
+
+	(*index)++;
+
+	if (spa_pod_filter(builder, result, param, filter) < 0)
+		goto next;
+
+	return 1;
 }
 
-static int spa_ffmpeg_enc_node_set_param(struct spa_node *node, uint32_t id, uint32_t flags,
+static int spa_ffmpeg_enc_node_set_param(struct spa_node *node,
+					 uint32_t id, uint32_t flags,
 					 const struct spa_pod *param)
 {
-	return -ENOTSUP;
+	struct impl *this;
+	struct type *t;
+
+	if (node == NULL)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+
+	if (id == t->param.idProps) {
+		struct props *p = &this->props;
+
+		/* used the next time the decoder is opened */
+		if (param == NULL) {
+			reset_props(p);
+			return 0;
+		}
+		spa_pod_object_parse(param,
+			":", t->prop_threads,     "?i", &p->threads,
+			":", t->prop_thread_type, "?i", &p->thread_type, NULL);
+	}
+	else
+		return -ENOENT;
+
+	return 0;
 }
 
 static int spa_ffmpeg_enc_node_send_command(struct spa_node *node, const struct spa_command *command)
@@ -196,7 +335,8 @@ spa_ffmpeg_enc_node_add_port(struct spa_node *node, enum spa_direction direction
 
 static int
 spa_ffmpeg_enc_node_remove_port(struct spa_node *node,
-				enum spa_direction direction, uint32_t port_id)
+				enum spa_direction direction,
+				uint32_t port_id)
 {
 	return -ENOTSUP;
 }
@@ -204,7 +344,8 @@ spa_ffmpeg_enc_node_remove_port(struct spa_node *node,
 static int
 spa_ffmpeg_enc_node_port_get_info(struct spa_node *node,
 				  enum spa_direction direction,
-				  uint32_t port_id, const struct spa_port_info **info)
+				  uint32_t port_id,
+				  const struct spa_port_info **info)
 {
 	struct impl *this;
 	struct port *port;
@@ -218,6 +359,7 @@ spa_ffmpeg_enc_node_port_get_info(struct spa_node *node,
 		return -EINVAL;
 
 	port = GET_PORT(this, direction, port_id);
+
 	*info = &port->info;
 
 	return 0;
@@ -230,17 +372,81 @@ static int port_enum_formats(struct spa_node *node,
 			     struct spa_pod **param,
 			     struct spa_pod_builder *builder)
 {
-	//struct impl *this = SPA_CONTAINER_OF (node, struct impl, node);
-	//struct port *port;
+	struct impl *this;
+	struct type *t;
+	struct port *in_port;
+	uint32_t subtype;
 
-	//port = GET_PORT(this, direction, port_id);
+	if (node == NULL || index == NULL)
+		return -EINVAL;
 
-	switch (*index) {
-	case 0:
-		*param = NULL;
-		break;
-	default:
+	this = SPA_CONTAINER_OF (node, struct impl, node);
+	t = &this->type;
+
+	if (!IS_VALID_PORT(this, direction, port_id))
+		return -EINVAL;
+
+	if (*index > 0)
 		return 0;
+
+	in_port = GET_IN_PORT(this, 0);
+
+	if (direction == SPA_DIRECTION_INPUT) {
+		const enum AVPixelFormat *pix_fmts = this->codec->pix_fmts;
+		struct spa_pod_prop *prop;
+		uint32_t i, n_formats = 0;
+
+		spa_pod_builder_push_object(builder, t->param.idEnumFormat, t->format);
+		spa_pod_builder_id(builder, t->media_type.video);
+		spa_pod_builder_id(builder, t->media_subtype.raw);
+
+		prop = spa_pod_builder_deref(builder,
+				spa_pod_builder_push_prop(builder, t->format_video.format,
+					SPA_POD_PROP_RANGE_ENUM | SPA_POD_PROP_FLAG_UNSET));
+		for (i = 0; i < SPA_N_ELEMENTS(ffmpeg_formats); i++) {
+			const enum AVPixelFormat *p;
+			uint32_t format;
+
+			if (pix_fmts != NULL) {
+				for (p = pix_fmts; *p != AV_PIX_FMT_NONE; p++)
+					if (*p == ffmpeg_formats[i].pix_fmt)
+						break;
+				if (*p == AV_PIX_FMT_NONE)
+					continue;
+			}
+			format = ffmpeg_pix_fmt_to_format(&t->video_format, ffmpeg_formats[i].pix_fmt);
+			if (n_formats++ == 0)
+				spa_pod_builder_id(builder, format);
+			spa_pod_builder_id(builder, format);
+		}
+		if (n_formats == 0)
+			return 0;
+		if (n_formats == 1)
+			prop->body.flags &= ~(SPA_POD_PROP_RANGE_MASK | SPA_POD_PROP_FLAG_UNSET);
+		spa_pod_builder_pop(builder);
+
+		spa_pod_builder_add(builder,
+			":", t->format_video.size,      "Rru", &SPA_RECTANGLE(320, 240),
+				2, &SPA_RECTANGLE(1, 1),
+				   &SPA_RECTANGLE(INT32_MAX, INT32_MAX),
+			":", t->format_video.framerate, "Fru", &SPA_FRACTION(25,1),
+				2, &SPA_FRACTION(1, INT32_MAX),
+				   &SPA_FRACTION(INT32_MAX, 1), NULL);
+		*param = spa_pod_builder_pop(builder);
+	} else {
+		if (!in_port->have_format)
+			return -EIO;
+
+		if ((subtype = ffmpeg_codec_to_subtype(&t->media_subtype_video,
+						       this->codec->id)) == 0)
+			return 0;
+
+		*param = spa_pod_builder_object(builder,
+			t->param.idEnumFormat, t->format,
+			"I", t->media_type.video,
+			"I", subtype,
+			":", t->format_video.size,      "R", &in_port->size,
+			":", t->format_video.framerate, "F", &in_port->framerate);
 	}
 	return 1;
 }
@@ -253,6 +459,7 @@ static int port_get_format(struct spa_node *node,
 			   struct spa_pod_builder *builder)
 {
 	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	struct type *t = &this->type;
 	struct port *port;
 
 	port = GET_PORT(this, direction, port_id);
@@ -263,8 +470,22 @@ static int port_get_format(struct spa_node *node,
 	if (*index > 0)
 		return 0;
 
-	*param = NULL;
-
+	if (direction == SPA_DIRECTION_INPUT) {
+		*param = spa_pod_builder_object(builder,
+			t->param.idFormat, t->format,
+			"I", port->current_format.media_type,
+			"I", port->current_format.media_subtype,
+			":", t->format_video.format,    "I", port->current_format.info.raw.format,
+			":", t->format_video.size,      "R", &port->size,
+			":", t->format_video.framerate, "F", &port->framerate);
+	} else {
+		*param = spa_pod_builder_object(builder,
+			t->param.idFormat, t->format,
+			"I", port->current_format.media_type,
+			"I", port->current_format.media_subtype,
+			":", t->format_video.size,      "R", &port->size,
+			":", t->format_video.framerate, "F", &port->framerate);
+	}
 	return 1;
 }
 
@@ -281,14 +502,22 @@ spa_ffmpeg_enc_node_port_enum_params(struct spa_node *node,
 	struct spa_pod_builder b = { 0 };
 	uint8_t buffer[1024];
 	struct spa_pod *param;
+	struct port *port;
 	int res;
 
+	if (!IS_VALID_PORT(this, direction, port_id))
+		return -EINVAL;
+
+	port = GET_PORT(this, direction, port_id);
+
       next:
 	spa_pod_builder_init(&b, buffer, sizeof(buffer));
 
 	if (id == t->param.idList) {
 		uint32_t list[] = { t->param.idEnumFormat,
-				    t->param.idFormat };
+				    t->param.idFormat,
+				    t->param.idBuffers,
+				    t->param.idMeta };
 
 		if (*index < SPA_N_ELEMENTS(list))
 			param = spa_pod_builder_object(&b, id, t->param.List,
@@ -304,6 +533,51 @@ spa_ffmpeg_enc_node_port_enum_params(struct spa_node *node,
 		if ((res = port_get_format(node, direction, port_id, index, filter, &param, &b)) <= 0)
 			return res;
 	}
+	else if (id == t->param.idBuffers) {
+		if (!port->have_format)
+			return -EIO;
+		if (*index > 0)
+			return 0;
+
+		if (direction == SPA_DIRECTION_INPUT) {
+			int size = av_image_get_buffer_size(this->pix_fmt,
+					port->size.width, port->size.height, 1);
+			int stride = av_image_get_linesize(this->pix_fmt, port->size.width, 0);
+
+			param = spa_pod_builder_object(&b,
+				id, t->param_buffers.Buffers,
+				":", t->param_buffers.size,    "i", size,
+				":", t->param_buffers.stride,  "i", stride,
+				":", t->param_buffers.buffers, "iru", 4,
+									2, 1, MAX_BUFFERS,
+				":", t->param_buffers.align,   "i", 16);
+		} else {
+			/* a compressed frame is never bigger than the raw frame
+			 * with some room for the headers */
+			int size = av_image_get_buffer_size(this->pix_fmt,
+					port->size.width, port->size.height, 1);
+
+			param = spa_pod_builder_object(&b,
+				id, t->param_buffers.Buffers,
+				":", t->param_buffers.size,    "i", size + AV_INPUT_BUFFER_MIN_SIZE,
+				":", t->param_buffers.stride,  "i", 0,
+				":", t->param_buffers.buffers, "iru", 4,
+									2, 1, MAX_BUFFERS,
+				":", t->param_buffers.align,   "i", 16);
+		}
+	}
+	else if (id == t->param.idMeta) {
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param_meta.Meta,
+				":", t->param_meta.type, "I", t->meta.Header,
+				":", t->param_meta.size, "i", sizeof(struct spa_meta_header));
+			break;
+		default:
+			return 0;
+		}
+	}
 	else
 		return -ENOENT;
 
@@ -315,35 +589,130 @@ spa_ffmpeg_enc_node_port_enum_params(struct spa_node *node,
 	return 1;
 }
 
+static void close_encoder(struct impl *this)
+{
+	if (this->context == NULL)
+		return;
+
+	avcodec_free_context(&this->context);
+}
+
+static int open_encoder(struct impl *this)
+{
+	struct port *in_port = GET_IN_PORT(this, 0);
+	AVCodecContext *context;
+	int res;
+
+	close_encoder(this);
+
+	if ((context = avcodec_alloc_context3(this->codec)) == NULL)
+		return -ENOMEM;
+
+	context->width = in_port->size.width;
+	context->height = in_port->size.height;
+	context->pix_fmt = this->pix_fmt;
+	if (in_port->framerate.num > 0 && in_port->framerate.denom > 0) {
+		context->framerate = (AVRational) { in_port->framerate.num, in_port->framerate.denom };
+		context->time_base = (AVRational) { in_port->framerate.denom, in_port->framerate.num };
+	} else {
+		context->time_base = (AVRational) { 1, 25 };
+	}
+	ffmpeg_apply_props(context, &this->props);
+
+	if ((res = avcodec_open2(context, this->codec, NULL)) < 0) {
+		spa_log_error(this->log, NAME " %p: can't open encoder %s: %s", this,
+			      this->codec->name, av_err2str(res));
+		avcodec_free_context(&context);
+		return -EINVAL;
+	}
+	spa_log_info(this->log, NAME " %p: opened encoder %s with %d threads, type %d", this,
+		     this->codec->name, context->thread_count, context->active_thread_type);
+
+	this->context = context;
+
+	return 0;
+}
+
 static int port_set_format(struct spa_node *node,
 			   enum spa_direction direction, uint32_t port_id,
-			   uint32_t flags, const struct spa_pod *format)
+			   uint32_t flags,
+			   const struct spa_pod *format)
 {
-	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	struct impl *this;
 	struct port *port;
+	struct type *t;
+	int res;
+
+	if (node == NULL)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+
+	if (!IS_VALID_PORT(this, direction, port_id))
+		return -EINVAL;
 
 	port = GET_PORT(this, direction, port_id);
 
 	if (format == NULL) {
 		port->have_format = false;
+		if (direction == SPA_DIRECTION_INPUT)
+			close_encoder(this);
 		return 0;
 	} else {
 		struct spa_video_info info = { 0 };
+		struct spa_rectangle size = { 0, 0 };
+		struct spa_fraction framerate = { 0, 1 };
+		enum AVPixelFormat pix_fmt = AV_PIX_FMT_NONE;
 
 		spa_pod_object_parse(format,
 			"I", &info.media_type,
 			"I", &info.media_subtype);
 
-		if (info.media_type != this->type.media_type.video &&
-		    info.media_subtype != this->type.media_subtype.raw)
+		if (info.media_type != t->media_type.video)
 			return -EINVAL;
 
-		if (spa_format_video_raw_parse(format, &info.info.raw, &this->type.format_video) < 0)
-			return -EINVAL;
+		if (direction == SPA_DIRECTION_INPUT) {
+			if (info.media_subtype != t->media_subtype.raw)
+				return -EINVAL;
+
+			if (spa_format_video_raw_parse(format, &info.info.raw, &t->format_video) < 0)
+				return -EINVAL;
+
+			pix_fmt = ffmpeg_format_to_pix_fmt(&t->video_format,
+							   info.info.raw.format,
+							   this->codec->pix_fmts);
+			if (pix_fmt == AV_PIX_FMT_NONE)
+				return -EINVAL;
+
+			size = info.info.raw.size;
+			framerate = info.info.raw.framerate;
+		} else {
+			if (info.media_subtype != ffmpeg_codec_to_subtype(&t->media_subtype_video,
+									  this->codec->id))
+				return -EINVAL;
+
+			if (this->context == NULL)
+				return -EIO;
+
+			spa_pod_object_parse(format,
+				":", t->format_video.size,      "?R", &size,
+				":", t->format_video.framerate, "?F", &framerate, NULL);
+		}
 
 		if (!(flags & SPA_NODE_PARAM_FLAG_TEST_ONLY)) {
 			port->current_format = info;
+			port->size = size;
+			port->framerate = framerate;
 			port->have_format = true;
+
+			if (direction == SPA_DIRECTION_INPUT) {
+				this->pix_fmt = pix_fmt;
+				if ((res = open_encoder(this)) < 0) {
+					port->have_format = false;
+					return res;
+				}
+			}
 		}
 	}
 	return 0;
@@ -365,19 +734,64 @@ spa_ffmpeg_enc_node_port_set_param(struct spa_node *node,
 		return -ENOENT;
 }
 
+static int clear_buffers(struct impl *this, struct port *port)
+{
+	if (port->n_buffers > 0) {
+		spa_log_info(this->log, NAME " %p: clear buffers", this);
+		port->n_buffers = 0;
+		spa_list_init(&port->free);
+	}
+	return 0;
+}
+
 static int
 spa_ffmpeg_enc_node_port_use_buffers(struct spa_node *node,
 				     enum spa_direction direction,
 				     uint32_t port_id,
-				     struct spa_buffer **buffers, uint32_t n_buffers)
+				     struct spa_buffer **buffers,
+				     uint32_t n_buffers)
 {
+	struct impl *this;
+	struct port *port;
+	uint32_t i;
+
 	if (node == NULL)
 		return -EINVAL;
 
-	if (!IS_VALID_PORT(node, direction, port_id))
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	if (!IS_VALID_PORT(this, direction, port_id))
 		return -EINVAL;
 
-	return -ENOTSUP;
+	port = GET_PORT(this, direction, port_id);
+
+	if (!port->have_format)
+		return -EIO;
+
+	clear_buffers(this, port);
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+		struct spa_data *d = buffers[i]->datas;
+
+		b->outbuf = buffers[i];
+		b->h = spa_buffer_find_meta(buffers[i], this->type.meta.Header);
+		b->outstanding = false;
+
+		if (buffers[i]->n_datas < 1 || d[0].data == NULL ||
+		    (d[0].type != this->type.data.MemPtr &&
+		     d[0].type != this->type.data.MemFd &&
+		     d[0].type != this->type.data.DmaBuf)) {
+			spa_log_error(this->log, NAME " %p: invalid memory on buffer %p", this,
+				      buffers[i]);
+			return -EINVAL;
+		}
+		if (direction == SPA_DIRECTION_OUTPUT)
+			spa_list_append(&port->free, &b->link);
+	}
+	port->n_buffers = n_buffers;
+
+	return 0;
 }
 
 static int
@@ -422,56 +836,254 @@ spa_ffmpeg_enc_node_port_set_io(struct spa_node *node,
 	return 0;
 }
 
-static int
-spa_ffmpeg_enc_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+
+static void recycle_buffer(struct impl *this, uint32_t id)
 {
-	if (node == NULL)
-		return -EINVAL;
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct buffer *b = &port->buffers[id];
 
-	if (port_id != 0)
+	if (!b->outstanding) {
+		spa_log_warn(this->log, NAME " %p: buffer %d not outstanding", this, id);
+		return;
+	}
+	b->outstanding = false;
+	spa_list_append(&port->free, &b->link);
+	spa_log_trace(this->log, NAME " %p: recycle buffer %d", this, id);
+}
+
+/* take an encoded packet and place it on the output, returns 1 when there
+ * was a packet */
+static int output_packet(struct impl *this)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct spa_io_buffers *output = port->io;
+	AVPacket *packet = this->packet;
+	struct buffer *b;
+	struct spa_data *d;
+	int res;
+
+	if ((res = avcodec_receive_packet(this->context, packet)) < 0) {
+		if (res == AVERROR(EAGAIN) || res == AVERROR_EOF)
+			return 0;
+		spa_log_error(this->log, NAME " %p: encode error: %s", this, av_err2str(res));
+		return -EIO;
+	}
+
+	if (spa_list_is_empty(&port->free)) {
+		spa_log_warn(this->log, NAME " %p: out of buffers, dropping packet", this);
+		av_packet_unref(packet);
+		return 0;
+	}
+	b = spa_list_first(&port->free, struct buffer, link);
+
+	d = b->outbuf->datas;
+	if (packet->size > d[0].maxsize) {
+		spa_log_error(this->log, NAME " %p: packet of %d bytes doesn't fit in %d", this,
+			      packet->size, d[0].maxsize);
+		av_packet_unref(packet);
+		return -ENOSPC;
+	}
+	spa_list_remove(&b->link);
+	b->outstanding = true;
+
+	memcpy(d[0].data, packet->data, packet->size);
+	d[0].chunk->offset = 0;
+	d[0].chunk->size = packet->size;
+	d[0].chunk->stride = 0;
+
+	if (b->h) {
+		b->h->flags = 0;
+		if (!(packet->flags & AV_PKT_FLAG_KEY))
+			b->h->flags |= SPA_META_HEADER_FLAG_DELTA_UNIT;
+		b->h->seq = this->seq++;
+		b->h->pts = packet->pts;
+		b->h->dts_offset = packet->dts != AV_NOPTS_VALUE ? packet->dts - packet->pts : 0;
+	}
+	av_packet_unref(packet);
+
+	output->buffer_id = b->outbuf->id;
+	output->status = SPA_STATUS_HAVE_BUFFER;
+
+	return 1;
+}
+
+/* send the frame in the input io area to the encoder, returns -EAGAIN
+ * when the encoder wants its packets taken out first */
+static int send_frame(struct impl *this)
+{
+	struct port *in_port = GET_IN_PORT(this, 0);
+	struct spa_io_buffers *input = in_port->io;
+	struct buffer *b;
+	struct spa_data *d;
+	AVFrame *frame;
+	int res;
+
+	if (input->buffer_id >= in_port->n_buffers) {
+		input->status = -EINVAL;
+		return -EINVAL;
+	}
+	b = &in_port->buffers[input->buffer_id];
+	d = b->outbuf->datas;
+
+	frame = this->frame;
+	frame->format = this->pix_fmt;
+	frame->width = in_port->size.width;
+	frame->height = in_port->size.height;
+	frame->pts = b->h ? b->h->pts : AV_NOPTS_VALUE;
+
+	if (av_image_fill_arrays(frame->data, frame->linesize,
+				 SPA_MEMBER(d[0].data, d[0].chunk->offset % d[0].maxsize, uint8_t),
+				 this->pix_fmt, frame->width, frame->height, 1) < 0) {
+		input->status = -EINVAL;
 		return -EINVAL;
+	}
 
-	return -ENOTSUP;
+	/* the frame is not refcounted so libavcodec copies it. The producer
+	 * reuses the input buffer as soon as it is consumed and the encoder
+	 * threads and reference frames can keep a frame much longer. */
+	res = avcodec_send_frame(this->context, frame);
+	if (res == AVERROR(EAGAIN))
+		return -EAGAIN;
+
+	input->status = SPA_STATUS_OK;
+
+	if (res < 0)
+		spa_log_warn(this->log, NAME " %p: can't encode frame: %s", this, av_err2str(res));
+
+	return 0;
 }
 
-static int
-spa_ffmpeg_enc_node_port_send_command(struct spa_node *node,
-				      enum spa_direction direction,
-				      uint32_t port_id, const struct spa_command *command)
+/* take out the encoded packets and feed the encoder. The input stays in
+ * the io area until the encoder took it. */
+static int encode(struct impl *this)
 {
-	return -ENOTSUP;
+	struct spa_io_buffers *input = GET_IN_PORT(this, 0)->io;
+	int res;
+
+	/* packets of earlier frames go first */
+	if ((res = output_packet(this)) != 0)
+		goto done;
+
+	if (input->status != SPA_STATUS_HAVE_BUFFER) {
+		input->status = SPA_STATUS_NEED_BUFFER;
+		return SPA_STATUS_NEED_BUFFER;
+	}
+
+	if ((res = send_frame(this)) == -EAGAIN) {
+		/* the encoder is full, the frame is sent again when the
+		 * next packet was taken */
+		if ((res = output_packet(this)) != 0)
+			goto done;
+		return SPA_STATUS_OK;
+	}
+	else if (res < 0)
+		return res;
+
+	if ((res = output_packet(this)) != 0)
+		goto done;
+
+	input->status = SPA_STATUS_NEED_BUFFER;
+	return SPA_STATUS_NEED_BUFFER;
+
+      done:
+	return res > 0 ? SPA_STATUS_HAVE_BUFFER : res;
 }
 
 static int spa_ffmpeg_enc_node_process_input(struct spa_node *node)
 {
-	return -EINVAL;
+	struct impl *this;
+	struct port *in_port, *out_port;
+	struct spa_io_buffers *input, *output;
+
+	if (node == NULL)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	in_port = GET_IN_PORT(this, 0);
+	out_port = GET_OUT_PORT(this, 0);
+
+	if ((input = in_port->io) == NULL || (output = out_port->io) == NULL)
+		return -EIO;
+
+	if (output->status == SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_HAVE_BUFFER;
+
+	if (this->context == NULL || !out_port->have_format) {
+		input->status = -EIO;
+		return -EIO;
+	}
+
+	return encode(this);
 }
 
 static int spa_ffmpeg_enc_node_process_output(struct spa_node *node)
 {
 	struct impl *this;
-	struct port *port;
-	struct spa_io_buffers *output;
+	struct port *in_port, *out_port;
+	struct spa_io_buffers *input, *output;
 
 	if (node == NULL)
 		return -EINVAL;
 
 	this = SPA_CONTAINER_OF(node, struct impl, node);
 
-	if ((output = this->out_ports[0].io) == NULL)
-		return -EIO;
+	in_port = GET_IN_PORT(this, 0);
+	out_port = GET_OUT_PORT(this, 0);
 
-	port = &this->out_ports[0];
+	if ((output = out_port->io) == NULL || (input = in_port->io) == NULL)
+		return -EIO;
 
-	if (!port->have_format) {
+	if (!out_port->have_format || this->context == NULL) {
 		output->status = -EIO;
 		return -EIO;
 	}
-	output->status = SPA_STATUS_OK;
 
-	return SPA_STATUS_OK;
+	if (output->status == SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_HAVE_BUFFER;
+
+	if (output->buffer_id < out_port->n_buffers) {
+		recycle_buffer(this, output->buffer_id);
+		output->buffer_id = SPA_ID_INVALID;
+	}
+
+	/* a frame that didn't fit in the encoder is still in the input */
+	return encode(this);
 }
 
+static int
+spa_ffmpeg_enc_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+{
+	struct impl *this;
+	struct port *port;
+
+	if (node == NULL)
+		return -EINVAL;
+
+	if (port_id != 0)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	port = GET_OUT_PORT(this, port_id);
+
+	if (buffer_id >= port->n_buffers)
+		return -EINVAL;
+
+	recycle_buffer(this, buffer_id);
+
+	return 0;
+}
+
+static int
+spa_ffmpeg_enc_node_port_send_command(struct spa_node *node,
+				      enum spa_direction direction,
+				      uint32_t port_id,
+				      const struct spa_command *command)
+{
+	return -ENOTSUP;
+}
+
+
 static const struct spa_node ffmpeg_enc_node = {
 	SPA_VERSION_NODE,
 	NULL,
@@ -513,15 +1125,39 @@ spa_ffmpeg_enc_get_interface(struct spa_handle *handle, uint32_t interface_id, v
 	return 0;
 }
 
+static int spa_ffmpeg_enc_clear(struct spa_handle *handle)
+{
+	struct impl *this;
+
+	if (handle == NULL)
+		return -EINVAL;
+
+	this = (struct impl *) handle;
+
+	close_encoder(this);
+	av_packet_free(&this->packet);
+	av_frame_free(&this->frame);
+
+	return 0;
+}
+
+size_t spa_ffmpeg_enc_get_size(void)
+{
+	return sizeof(struct impl);
+}
+
 int
 spa_ffmpeg_enc_init(struct spa_handle *handle,
+		    const AVCodec *codec,
 		    const struct spa_dict *info,
-		    const struct spa_support *support, uint32_t n_support)
+		    const struct spa_support *support,
+		    uint32_t n_support)
 {
 	struct impl *this;
 	uint32_t i;
 
 	handle->get_interface = spa_ffmpeg_enc_get_interface;
+	handle->clear = spa_ffmpeg_enc_clear;
 
 	this = (struct impl *) handle;
 
@@ -535,11 +1171,24 @@ spa_ffmpeg_enc_init(struct spa_handle *handle,
 		spa_log_error(this->log, "a type-map is needed");
 		return -EINVAL;
 	}
+	init_type(&this->type, this->map);
 
 	this->node = ffmpeg_enc_node;
+	this->codec = codec;
+	this->pix_fmt = AV_PIX_FMT_NONE;
+	reset_props(&this->props);
+
+	if ((this->packet = av_packet_alloc()) == NULL ||
+	    (this->frame = av_frame_alloc()) == NULL) {
+		av_packet_free(&this->packet);
+		return -ENOMEM;
+	}
+
+	spa_list_init(&this->in_ports[0].free);
+	spa_list_init(&this->out_ports[0].free);
 
-	this->in_ports[0].info.flags = 0;
-	this->out_ports[0].info.flags = 0;
+	this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+	this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
 
 	return 0;
 }
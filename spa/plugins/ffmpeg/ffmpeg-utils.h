@@ -0,0 +1,197 @@
+/* Spa FFMpeg
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_FFMPEG_UTILS_H__
+#define __SPA_FFMPEG_UTILS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+
+#include <spa/support/plugin.h>
+#include <spa/param/video/format-utils.h>
+
+/* alignment of the planes and strides we give to libavcodec */
+#define FFMPEG_ALIGN	64
+
+enum thread_type {
+	THREAD_TYPE_AUTO,
+	THREAD_TYPE_FRAME,
+	THREAD_TYPE_SLICE,
+	THREAD_TYPE_NONE,
+};
+
+#define DEFAULT_THREADS		0
+#define DEFAULT_THREAD_TYPE	THREAD_TYPE_AUTO
+
+struct props {
+	int threads;		/**< number of threads, 0 is one per CPU */
+	uint32_t thread_type;
+};
+
+static inline void reset_props(struct props *props)
+{
+	props->threads = DEFAULT_THREADS;
+	props->thread_type = DEFAULT_THREAD_TYPE;
+}
+
+/** Configure the threading of \a context from \a props */
+static inline void ffmpeg_apply_props(AVCodecContext *context, const struct props *props)
+{
+	context->thread_count = props->threads;
+	switch (props->thread_type) {
+	case THREAD_TYPE_FRAME:
+		context->thread_type = FF_THREAD_FRAME;
+		break;
+	case THREAD_TYPE_SLICE:
+		context->thread_type = FF_THREAD_SLICE;
+		break;
+	case THREAD_TYPE_NONE:
+		context->thread_count = 1;
+		break;
+	default:
+		context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+		break;
+	}
+}
+
+struct ffmpeg_format {
+	enum AVPixelFormat pix_fmt;
+	off_t format_offset;		/**< offset in spa_type_video_format */
+};
+
+#define FORMAT(f)	offsetof(struct spa_type_video_format, f)
+
+static const struct ffmpeg_format ffmpeg_formats[] = {
+	{ AV_PIX_FMT_YUV420P, FORMAT(I420) },
+	{ AV_PIX_FMT_YUVJ420P, FORMAT(I420) },
+	{ AV_PIX_FMT_NV12, FORMAT(NV12) },
+	{ AV_PIX_FMT_NV21, FORMAT(NV21) },
+	{ AV_PIX_FMT_YUYV422, FORMAT(YUY2) },
+	{ AV_PIX_FMT_UYVY422, FORMAT(UYVY) },
+	{ AV_PIX_FMT_YUV422P, FORMAT(Y42B) },
+	{ AV_PIX_FMT_YUVJ422P, FORMAT(Y42B) },
+	{ AV_PIX_FMT_YUV444P, FORMAT(Y444) },
+	{ AV_PIX_FMT_YUVJ444P, FORMAT(Y444) },
+	{ AV_PIX_FMT_YUV411P, FORMAT(Y41B) },
+	{ AV_PIX_FMT_GRAY8, FORMAT(GRAY8) },
+	{ AV_PIX_FMT_RGB24, FORMAT(RGB) },
+	{ AV_PIX_FMT_BGR24, FORMAT(BGR) },
+	{ AV_PIX_FMT_RGBA, FORMAT(RGBA) },
+	{ AV_PIX_FMT_BGRA, FORMAT(BGRA) },
+	{ AV_PIX_FMT_ARGB, FORMAT(ARGB) },
+	{ AV_PIX_FMT_ABGR, FORMAT(ABGR) },
+	{ AV_PIX_FMT_RGB0, FORMAT(RGBx) },
+	{ AV_PIX_FMT_BGR0, FORMAT(BGRx) },
+	{ AV_PIX_FMT_0RGB, FORMAT(xRGB) },
+	{ AV_PIX_FMT_0BGR, FORMAT(xBGR) },
+};
+
+#undef FORMAT
+
+static inline uint32_t
+ffmpeg_pix_fmt_to_format(const struct spa_type_video_format *types, enum AVPixelFormat pix_fmt)
+{
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(ffmpeg_formats); i++) {
+		if (ffmpeg_formats[i].pix_fmt == pix_fmt)
+			return *SPA_MEMBER(types, ffmpeg_formats[i].format_offset, uint32_t);
+	}
+	return types->UNKNOWN;
+}
+
+/** Find the pixel format for \a format, the first one in \a pix_fmts when
+ * given. Returns AV_PIX_FMT_NONE when there is none. */
+static inline enum AVPixelFormat
+ffmpeg_format_to_pix_fmt(const struct spa_type_video_format *types, uint32_t format,
+			 const enum AVPixelFormat *pix_fmts)
+{
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(ffmpeg_formats); i++) {
+		const enum AVPixelFormat *p;
+
+		if (*SPA_MEMBER(types, ffmpeg_formats[i].format_offset, uint32_t) != format)
+			continue;
+		if (pix_fmts == NULL)
+			return ffmpeg_formats[i].pix_fmt;
+		for (p = pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
+			if (*p == ffmpeg_formats[i].pix_fmt)
+				return *p;
+		}
+	}
+	return AV_PIX_FMT_NONE;
+}
+
+struct ffmpeg_codec {
+	enum AVCodecID codec_id;
+	off_t subtype_offset;		/**< offset in spa_type_media_subtype_video */
+};
+
+#define SUBTYPE(s)	offsetof(struct spa_type_media_subtype_video, s)
+
+static const struct ffmpeg_codec ffmpeg_codecs[] = {
+	{ AV_CODEC_ID_H264, SUBTYPE(h264) },
+	{ AV_CODEC_ID_MJPEG, SUBTYPE(mjpg) },
+	{ AV_CODEC_ID_DVVIDEO, SUBTYPE(dv) },
+	{ AV_CODEC_ID_H263, SUBTYPE(h263) },
+	{ AV_CODEC_ID_MPEG1VIDEO, SUBTYPE(mpeg1) },
+	{ AV_CODEC_ID_MPEG2VIDEO, SUBTYPE(mpeg2) },
+	{ AV_CODEC_ID_MPEG4, SUBTYPE(mpeg4) },
+	{ AV_CODEC_ID_VC1, SUBTYPE(vc1) },
+	{ AV_CODEC_ID_VP8, SUBTYPE(vp8) },
+	{ AV_CODEC_ID_VP9, SUBTYPE(vp9) },
+};
+
+#undef SUBTYPE
+
+/** The media subtype of \a codec_id, 0 when the codec has no subtype */
+static inline uint32_t
+ffmpeg_codec_to_subtype(const struct spa_type_media_subtype_video *types, enum AVCodecID codec_id)
+{
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(ffmpeg_codecs); i++) {
+		if (ffmpeg_codecs[i].codec_id == codec_id)
+			return *SPA_MEMBER(types, ffmpeg_codecs[i].subtype_offset, uint32_t);
+	}
+	return 0;
+}
+
+int spa_ffmpeg_dec_init(struct spa_handle *handle, const AVCodec *codec,
+			const struct spa_dict *info,
+			const struct spa_support *support, uint32_t n_support);
+size_t spa_ffmpeg_dec_get_size(void);
+
+int spa_ffmpeg_enc_init(struct spa_handle *handle, const AVCodec *codec,
+			const struct spa_dict *info,
+			const struct spa_support *support, uint32_t n_support);
+size_t spa_ffmpeg_enc_get_size(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __SPA_FFMPEG_UTILS_H__ */
@@ -19,6 +19,7 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <spa/support/plugin.h>
 #include <spa/node/node.h>
@@ -26,10 +27,10 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 
-int spa_ffmpeg_dec_init(struct spa_handle *handle, const struct spa_dict *info,
-			const struct spa_support *support, uint32_t n_support);
-int spa_ffmpeg_enc_init(struct spa_handle *handle, const struct spa_dict *info,
-			const struct spa_support *support, uint32_t n_support);
+#include "ffmpeg-utils.h"
+
+#define DEC_PREFIX	"ffdec_"
+#define ENC_PREFIX	"ffenc_"
 
 static int
 ffmpeg_dec_init(const struct spa_handle_factory *factory,
@@ -38,10 +39,15 @@ ffmpeg_dec_init(const struct spa_handle_factory *factory,
 		const struct spa_support *support,
 		uint32_t n_support)
 {
+	const AVCodec *codec;
+
 	if (factory == NULL || handle == NULL)
 		return -EINVAL;
 
-	return spa_ffmpeg_dec_init(handle, info, support, n_support);
+	if ((codec = avcodec_find_decoder_by_name(factory->name + strlen(DEC_PREFIX))) == NULL)
+		return -ENOENT;
+
+	return spa_ffmpeg_dec_init(handle, codec, info, support, n_support);
 }
 
 static int
@@ -51,10 +57,15 @@ ffmpeg_enc_init(const struct spa_handle_factory *factory,
 		const struct spa_support *support,
 		uint32_t n_support)
 {
+	const AVCodec *codec;
+
 	if (factory == NULL || handle == NULL)
 		return -EINVAL;
 
-	return spa_ffmpeg_enc_init(handle, info, support, n_support);
+	if ((codec = avcodec_find_encoder_by_name(factory->name + strlen(ENC_PREFIX))) == NULL)
+		return -ENOENT;
+
+	return spa_ffmpeg_enc_init(handle, codec, info, support, n_support);
 }
 
 static const struct spa_interface_info ffmpeg_interfaces[] = {
@@ -98,15 +109,28 @@ int spa_handle_factory_enum(const struct spa_handle_factory **factory, uint32_t
 		return 0;
 
 	if (av_codec_is_encoder(c)) {
-		snprintf(name, 128, "ffenc_%s", c->name);
-		f.init = ffmpeg_enc_init;
+		struct spa_handle_factory enc = {
+			SPA_VERSION_HANDLE_FACTORY,
+			name,
+			NULL,
+			spa_ffmpeg_enc_get_size(),
+			ffmpeg_enc_init,
+			ffmpeg_enum_interface_info,
+		};
+		snprintf(name, 128, ENC_PREFIX "%s", c->name);
+		memcpy(&f, &enc, sizeof(f));
 	} else {
-		snprintf(name, 128, "ffdec_%s", c->name);
-		f.init = ffmpeg_dec_init;
+		struct spa_handle_factory dec = {
+			SPA_VERSION_HANDLE_FACTORY,
+			name,
+			NULL,
+			spa_ffmpeg_dec_get_size(),
+			ffmpeg_dec_init,
+			ffmpeg_enum_interface_info,
+		};
+		snprintf(name, 128, DEC_PREFIX "%s", c->name);
+		memcpy(&f, &dec, sizeof(f));
 	}
-	f.name = name;
-	f.info = NULL;
-	f.enum_interface_info = ffmpeg_enum_interface_info;
 
 	*factory = &f;
 	(*index)++;
@@ -18,10 +18,13 @@
  */
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/eventfd.h>
 
 #include <spa/support/type-map.h>
@@ -36,6 +39,11 @@
 
 #define TRACE_BUFFER (16*1024)
 
+#define BINARY_BUFFER (64*1024)		/* per thread */
+#define BINARY_RINGS 16			/* threads that can log in binary mode */
+#define BINARY_MAX_RECORD 1024
+#define BINARY_MAX_STRING 256
+
 struct type {
 	uint32_t log;
 };
@@ -57,8 +65,439 @@ struct impl {
 
 	bool have_source;
 	struct spa_source source;
+
+	bool binary;
+	struct thread_ring *rings;
+	pthread_key_t ring_key;
+	int fd;				/* to wake up the formatting */
+	bool have_thread;
+	bool running;
+	pthread_t thread;
+};
+
+/* In binary mode every thread writes the format, the arguments and a
+ * timestamp of its messages in its own ring. The messages are formatted
+ * later in the main loop or in the thread of the logger. The rings are
+ * made with the logger so that the threads that log, which can be
+ * realtime, don't allocate memory. */
+struct thread_ring {
+	struct thread_ring *next;
+	int in_use;
+	uint32_t dropped;
+	struct spa_ringbuffer rb;
+	uint8_t data[BINARY_BUFFER];
+};
+
+struct record {
+	uint32_t size;		/* with the arguments, a multiple of 8 */
+	uint32_t level;
+	uint64_t time;
+	uint32_t fmt;		/* offsets of the strings after the arguments */
+	uint32_t file;
+	uint32_t func;
+	int32_t line;
+	/* followed by the arguments and the strings */
 };
 
+#define RECORD_DATA(rec)	SPA_MEMBER(rec, sizeof(struct record), uint8_t)
+#define RECORD_STRING(rec,o)	SPA_MEMBER(rec, sizeof(struct record) + (o), const char)
+
+enum arg_type {
+	ARG_NONE,
+	ARG_PERCENT,
+	ARG_INT,
+	ARG_LONG,
+	ARG_LONG_LONG,
+	ARG_SIZE,
+	ARG_DOUBLE,
+	ARG_LONG_DOUBLE,
+	ARG_STRING,
+	ARG_POINTER,
+	ARG_INVALID,
+};
+
+struct conversion {
+	const char *start;	/* the % */
+	const char *end;	/* after the conversion */
+	int n_star;		/* int arguments for width and precision */
+	enum arg_type type;
+};
+
+static const char *levels[] = { "-", "E", "W", "I", "D", "T", "*T*" };
+
+/* find the next conversion in \a fmt, type is ARG_NONE at the end */
+static void parse_conversion(const char *fmt, struct conversion *c)
+{
+	const char *p;
+	int longs = 0;
+	bool size = false, ldouble = false;
+
+	c->n_star = 0;
+	if ((p = strchr(fmt, '%')) == NULL) {
+		c->start = c->end = fmt + strlen(fmt);
+		c->type = ARG_NONE;
+		return;
+	}
+	c->start = p++;
+
+	while (*p && strchr("-+ #0'", *p))
+		p++;
+	if (*p == '*') {
+		c->n_star++;
+		p++;
+	}
+	while (*p >= '0' && *p <= '9')
+		p++;
+	if (*p == '.') {
+		if (*++p == '*') {
+			c->n_star++;
+			p++;
+		}
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+	for (; *p && strchr("hlLqjzt", *p); p++) {
+		if (*p == 'l' || *p == 'q')
+			longs++;
+		else if (*p == 'L')
+			ldouble = true;
+		else if (*p != 'h')
+			size = true;
+	}
+
+	switch (*p) {
+	case '%':
+		c->type = ARG_PERCENT;
+		break;
+	case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+		c->type = size ? ARG_SIZE :
+		    longs > 1 ? ARG_LONG_LONG :
+		    longs ? ARG_LONG : ARG_INT;
+		break;
+	case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+		c->type = ldouble ? ARG_LONG_DOUBLE : ARG_DOUBLE;
+		break;
+	case 's':
+		c->type = longs ? ARG_INVALID : ARG_STRING;
+		break;
+	case 'p':
+		c->type = ARG_POINTER;
+		break;
+	default:
+		c->type = ARG_INVALID;
+		c->end = p;
+		return;
+	}
+	c->end = p + 1;
+}
+
+/* copy the arguments for \a fmt to \a data. Returns the size or -1 when
+ * the message can't be encoded. */
+static int encode_args(uint8_t *data, uint32_t maxsize, const char *fmt, va_list args)
+{
+	struct conversion c;
+	uint32_t size = 0, len;
+	const char *str;
+	int i;
+
+	for (;; fmt = c.end) {
+		parse_conversion(fmt, &c);
+		if (c.type == ARG_NONE)
+			break;
+		if (c.type == ARG_INVALID)
+			return -1;
+		if (c.type == ARG_PERCENT)
+			continue;
+
+		if (size + 8 * c.n_star + 16 > maxsize)
+			return -1;
+
+		for (i = 0; i < c.n_star; i++, size += 8)
+			*(int64_t *) (data + size) = va_arg(args, int);
+
+		switch (c.type) {
+		case ARG_INT:
+			*(int64_t *) (data + size) = va_arg(args, int);
+			break;
+		case ARG_LONG:
+			*(int64_t *) (data + size) = va_arg(args, long);
+			break;
+		case ARG_LONG_LONG:
+			*(int64_t *) (data + size) = va_arg(args, long long);
+			break;
+		case ARG_SIZE:
+			*(int64_t *) (data + size) = va_arg(args, size_t);
+			break;
+		case ARG_DOUBLE:
+			*(double *) (data + size) = va_arg(args, double);
+			break;
+		case ARG_LONG_DOUBLE:
+			*(long double *) (data + size) = va_arg(args, long double);
+			size += 8;
+			break;
+		case ARG_POINTER:
+			*(void **) (data + size) = va_arg(args, void *);
+			break;
+		case ARG_STRING:
+			/* the string can be gone when we format, copy it */
+			if ((str = va_arg(args, const char *)) == NULL)
+				str = "(null)";
+			len = strnlen(str, SPA_MIN(BINARY_MAX_STRING, maxsize - size - 5));
+			*(uint32_t *) (data + size) = len;
+			memcpy(data + size + 4, str, len);
+			data[size + 4 + len] = '\0';
+			size += SPA_ROUND_UP_N(4 + len + 1, 8) - 8;
+			break;
+		default:
+			break;
+		}
+		size += 8;
+	}
+	return size;
+}
+
+#define FORMAT_ARG(type,val)								\
+	(c.n_star == 0 ? snprintf(text + len, maxsize - len, spec, (type) (val)) :	\
+	 c.n_star == 1 ? snprintf(text + len, maxsize - len, spec, star[0], (type) (val)) :	\
+	 snprintf(text + len, maxsize - len, spec, star[0], star[1], (type) (val)))
+
+/* format the message of \a rec in \a text, the inverse of encode_args() */
+static void format_record(struct record *rec, char *text, size_t maxsize)
+{
+	const uint8_t *data = RECORD_DATA(rec);
+	const char *fmt = RECORD_STRING(rec, rec->fmt);
+	struct conversion c;
+	char spec[64];
+	size_t len = 0, spec_len;
+	int i, star[2] = { 0, 0 };
+
+	text[0] = '\0';
+	for (; len < maxsize; fmt = c.end) {
+		parse_conversion(fmt, &c);
+
+		len += snprintf(text + len, maxsize - len, "%.*s", (int) (c.start - fmt), fmt);
+		if (c.type == ARG_NONE || c.type == ARG_INVALID || len >= maxsize)
+			break;
+
+		if (c.type == ARG_PERCENT) {
+			len += snprintf(text + len, maxsize - len, "%%");
+			continue;
+		}
+
+		spec_len = SPA_MIN((size_t) (c.end - c.start), sizeof(spec) - 1);
+		memcpy(spec, c.start, spec_len);
+		spec[spec_len] = '\0';
+
+		for (i = 0; i < c.n_star; i++, data += 8)
+			star[i] = *(const int64_t *) data;
+
+		switch (c.type) {
+		case ARG_INT:
+			len += FORMAT_ARG(int, *(const int64_t *) data);
+			break;
+		case ARG_LONG:
+			len += FORMAT_ARG(long, *(const int64_t *) data);
+			break;
+		case ARG_LONG_LONG:
+			len += FORMAT_ARG(long long, *(const int64_t *) data);
+			break;
+		case ARG_SIZE:
+			len += FORMAT_ARG(size_t, *(const int64_t *) data);
+			break;
+		case ARG_DOUBLE:
+			len += FORMAT_ARG(double, *(const double *) data);
+			break;
+		case ARG_LONG_DOUBLE:
+			len += FORMAT_ARG(long double, *(const long double *) data);
+			data += 8;
+			break;
+		case ARG_POINTER:
+			len += FORMAT_ARG(void *, *(void * const *) data);
+			break;
+		case ARG_STRING:
+			len += FORMAT_ARG(const char *, data + 4);
+			data += SPA_ROUND_UP_N(4 + *(const uint32_t *) data + 1, 8) - 8;
+			break;
+		default:
+			break;
+		}
+		data += 8;
+	}
+}
+
+#undef FORMAT_ARG
+
+/* copy \a str with the 0 to \a data. Returns the size or -1 when it
+ * does not fit. */
+static int encode_string(uint8_t *data, uint32_t maxsize, const char *str)
+{
+	size_t len = strlen(str) + 1;
+
+	if (len > maxsize)
+		return -1;
+	memcpy(data, str, len);
+	return len;
+}
+
+static void ring_release(void *data)
+{
+	struct thread_ring *r = data;
+	__atomic_store_n(&r->in_use, 0, __ATOMIC_RELEASE);
+}
+
+/* the ring of the current thread, it takes a free ring the first time.
+ * NULL when all rings are taken. */
+static struct thread_ring *get_ring(struct impl *impl)
+{
+	struct thread_ring *r;
+	int expected;
+
+	if (SPA_LIKELY((r = pthread_getspecific(impl->ring_key)) != NULL))
+		return r;
+
+	for (r = impl->rings; r; r = r->next) {
+		expected = 0;
+		if (__atomic_compare_exchange_n(&r->in_use, &expected, 1, false,
+						__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			pthread_setspecific(impl->ring_key, r);
+			return r;
+		}
+	}
+	return NULL;
+}
+
+static bool
+log_binary(struct impl *impl,
+	   enum spa_log_level level,
+	   const char *file,
+	   int line,
+	   const char *func,
+	   const char *fmt,
+	   va_list args)
+{
+	uint64_t buffer[BINARY_MAX_RECORD / sizeof(uint64_t)];
+	struct record *rec = (struct record *) buffer;
+	uint8_t *data = RECORD_DATA(rec);
+	uint32_t maxsize = sizeof(buffer) - sizeof(struct record);
+	struct thread_ring *r;
+	struct timespec now;
+	int32_t filled;
+	uint32_t index;
+	uint64_t count = 1;
+	va_list copy;
+	const char *p;
+	int size, len;
+
+	if ((r = get_ring(impl)) == NULL)
+		return false;
+
+	va_copy(copy, args);
+	size = encode_args(data, maxsize, fmt, copy);
+	va_end(copy);
+	if (size < 0)
+		return false;
+
+	/* the strings are in the module that logs, it can be unloaded before
+	 * the record is formatted */
+	if ((p = strrchr(file, '/')) != NULL)
+		file = p + 1;
+
+	rec->fmt = size;
+	if ((len = encode_string(data + size, maxsize - size, fmt)) < 0)
+		return false;
+	size += len;
+	rec->file = size;
+	if ((len = encode_string(data + size, maxsize - size, file)) < 0)
+		return false;
+	size += len;
+	rec->func = size;
+	if ((len = encode_string(data + size, maxsize - size, func)) < 0)
+		return false;
+	size += len;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	rec->size = sizeof(struct record) + SPA_ROUND_UP_N(size, 8);
+	rec->level = level;
+	rec->time = SPA_TIMESPEC_TO_TIME(&now);
+	rec->line = line;
+
+	filled = spa_ringbuffer_get_write_index(&r->rb, &index);
+	if (filled + rec->size > BINARY_BUFFER) {
+		__atomic_add_fetch(&r->dropped, 1, __ATOMIC_RELAXED);
+		return true;
+	}
+	spa_ringbuffer_write_data(&r->rb, r->data, BINARY_BUFFER,
+				  index & (BINARY_BUFFER - 1), rec, rec->size);
+	spa_ringbuffer_write_update(&r->rb, index + rec->size);
+
+	/* the ring is drained completely, wake up only for the first one */
+	if (filled == 0 &&
+	    write(impl->fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
+		fprintf(stderr, "error signaling eventfd: %s\n", strerror(errno));
+
+	return true;
+}
+
+/* format the messages of all threads in the order they were logged */
+static void flush_rings(struct impl *impl)
+{
+	uint64_t buffer[BINARY_MAX_RECORD / sizeof(uint64_t)];
+	struct record *rec = (struct record *) buffer, head;
+	struct thread_ring *r, *oldest;
+	uint64_t oldest_time = 0;
+	uint32_t index, dropped;
+	char text[512];
+
+	while (true) {
+		oldest = NULL;
+
+		for (r = impl->rings; r; r = r->next) {
+			if ((dropped = __atomic_exchange_n(&r->dropped, 0, __ATOMIC_RELAXED)) > 0)
+				fprintf(stderr, "[W][logger] %u messages dropped\n", dropped);
+
+			if (spa_ringbuffer_get_read_index(&r->rb, &index) <= 0)
+				continue;
+
+			spa_ringbuffer_read_data(&r->rb, r->data, BINARY_BUFFER,
+						 index & (BINARY_BUFFER - 1), &head, sizeof(head));
+			if (oldest == NULL || head.time < oldest_time) {
+				oldest = r;
+				oldest_time = head.time;
+			}
+		}
+		if (oldest == NULL)
+			break;
+
+		spa_ringbuffer_get_read_index(&oldest->rb, &index);
+		spa_ringbuffer_read_data(&oldest->rb, oldest->data, BINARY_BUFFER,
+					 index & (BINARY_BUFFER - 1), rec, sizeof(struct record));
+		spa_ringbuffer_read_data(&oldest->rb, oldest->data, BINARY_BUFFER,
+					 index & (BINARY_BUFFER - 1), rec, rec->size);
+		spa_ringbuffer_read_update(&oldest->rb, index + rec->size);
+
+		format_record(rec, text, sizeof(text));
+		fprintf(stderr, "[%s][%s:%i %s()] %s\n", levels[rec->level],
+			RECORD_STRING(rec, rec->file), rec->line,
+			RECORD_STRING(rec, rec->func), text);
+	}
+}
+
+static void *log_thread(void *data)
+{
+	struct impl *impl = data;
+	uint64_t count;
+
+	while (__atomic_load_n(&impl->running, __ATOMIC_ACQUIRE)) {
+		if (read(impl->fd, &count, sizeof(uint64_t)) != sizeof(uint64_t) &&
+		    errno != EINTR)
+			break;
+		flush_rings(impl);
+	}
+	flush_rings(impl);
+	return NULL;
+}
+
 static void
 impl_log_logv(struct spa_log *log,
 	      enum spa_log_level level,
@@ -70,10 +509,12 @@ impl_log_logv(struct spa_log *log,
 {
 	struct impl *impl = SPA_CONTAINER_OF(log, struct impl, log);
 	char text[512], location[1024];
-	static const char *levels[] = { "-", "E", "W", "I", "D", "T", "*T*" };
 	int size;
 	bool do_trace;
 
+	if (impl->binary && log_binary(impl, level, file, line, func, fmt, args))
+		return;
+
 	if ((do_trace = (level == SPA_LOG_LEVEL_TRACE && impl->have_source)))
 		level++;
 
@@ -137,6 +578,8 @@ static void on_trace_event(struct spa_source *source)
 		}
 		spa_ringbuffer_read_update(&impl->trace_rb, index + avail);
         }
+	if (impl->binary)
+		flush_rings(impl);
 }
 
 static const struct spa_log impl_log = {
@@ -172,11 +615,32 @@ static int impl_clear(struct spa_handle *handle)
 
 	this = (struct impl *) handle;
 
+	if (this->have_thread) {
+		uint64_t count = 1;
+
+		__atomic_store_n(&this->running, false, __ATOMIC_RELEASE);
+		if (write(this->fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
+			fprintf(stderr, "error signaling eventfd: %s\n", strerror(errno));
+		pthread_join(this->thread, NULL);
+		close(this->fd);
+		this->have_thread = false;
+	}
 	if (this->have_source) {
 		spa_loop_remove_source(this->source.loop, &this->source);
 		close(this->source.fd);
 		this->have_source = false;
 	}
+	if (this->binary) {
+		struct thread_ring *r;
+
+		flush_rings(this);
+		pthread_key_delete(this->ring_key);
+		while ((r = this->rings)) {
+			this->rings = r->next;
+			free(r);
+		}
+		this->binary = false;
+	}
 	return 0;
 }
 
@@ -189,7 +653,9 @@ impl_init(const struct spa_handle_factory *factory,
 {
 	struct impl *this;
 	uint32_t i;
+	int res;
 	struct spa_loop *loop = NULL;
+	struct thread_ring *r;
 
 	spa_return_val_if_fail(factory != NULL, -EINVAL);
 	spa_return_val_if_fail(handle != NULL, -EINVAL);
@@ -213,6 +679,12 @@ impl_init(const struct spa_handle_factory *factory,
 	}
 	init_type(&this->type, this->map);
 
+	for (i = 0; info && i < info->n_items; i++) {
+		if (strcmp(info->items[i].key, "log.binary") == 0)
+			this->binary = atoi(info->items[i].value) != 0 ||
+				strcmp(info->items[i].value, "true") == 0;
+	}
+
 	if (loop) {
 		this->source.func = on_trace_event;
 		this->source.data = this;
@@ -225,9 +697,45 @@ impl_init(const struct spa_handle_factory *factory,
 
 	spa_ringbuffer_init(&this->trace_rb);
 
+	if (this->binary) {
+		if ((res = pthread_key_create(&this->ring_key, ring_release)) != 0)
+			goto no_binary;
+
+		for (i = 0; i < BINARY_RINGS; i++) {
+			if ((r = calloc(1, sizeof(struct thread_ring))) == NULL)
+				break;
+			spa_ringbuffer_init(&r->rb);
+			r->next = this->rings;
+			this->rings = r;
+		}
+
+		if (this->have_source)
+			this->fd = this->source.fd;
+		else {
+			/* without a loop, format in our own thread */
+			this->fd = eventfd(0, EFD_CLOEXEC);
+			this->running = true;
+			if ((res = pthread_create(&this->thread, NULL, log_thread, this)) != 0) {
+				close(this->fd);
+				pthread_key_delete(this->ring_key);
+				goto no_binary;
+			}
+			this->have_thread = true;
+		}
+	}
+
 	spa_log_debug(&this->log, NAME " %p: initialized", this);
 
 	return 0;
+
+      no_binary:
+	while ((r = this->rings)) {
+		this->rings = r->next;
+		free(r);
+	}
+	this->binary = false;
+	spa_log_warn(&this->log, NAME " %p: can't enable binary mode: %s", this, strerror(res));
+	return 0;
 }
 
 static const struct spa_interface_info impl_interfaces[] = {
@@ -59,6 +59,12 @@ struct type {
 	uint32_t loop_utils;
 };
 
+struct dispatch {
+	struct dispatch *prev;
+	struct epoll_event *ep;
+	int n_ep;
+};
+
 static void loop_signal_event(struct spa_source *source);
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
@@ -85,6 +91,9 @@ struct impl {
 	int epoll_fd;
 	pthread_t thread;
 
+	struct dispatch *dispatch;	/* the batches that are being dispatched,
+					 * the innermost iteration first */
+
 	struct spa_source *wakeup;
 	int ack_fd;
 
@@ -143,6 +152,11 @@ static inline enum spa_io spa_epoll_to_io(uint32_t events)
 	return mask;
 }
 
+static inline bool loop_in_other_thread(struct impl *impl)
+{
+	return impl->thread != 0 && !pthread_equal(impl->thread, pthread_self());
+}
+
 static int loop_add_source(struct spa_loop *loop, struct spa_source *source)
 {
 	struct impl *impl = SPA_CONTAINER_OF(loop, struct impl, loop);
@@ -180,6 +194,19 @@ static int loop_update_source(struct spa_source *source)
 	return 0;
 }
 
+static void dispatch_remove_source(struct impl *impl, struct spa_source *source)
+{
+	struct dispatch *d;
+	int i;
+
+	for (d = impl->dispatch; d; d = d->prev) {
+		for (i = 0; i < d->n_ep; i++) {
+			if (d->ep[i].data.ptr == source)
+				d->ep[i].data.ptr = NULL;
+		}
+	}
+}
+
 static void loop_remove_source(struct spa_source *source)
 {
 	struct spa_loop *loop = source->loop;
@@ -188,6 +215,12 @@ static void loop_remove_source(struct spa_source *source)
 	if (source->fd != -1)
 		epoll_ctl(impl->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
 
+	/* the source can be freed after this, don't dispatch it anymore. The
+	 * batches of a loop that runs in another thread can't be touched,
+	 * sources of a running loop must be removed with an invoke. */
+	if (!loop_in_other_thread(impl))
+		dispatch_remove_source(impl, source);
+
 	source->loop = NULL;
 }
 
@@ -320,6 +353,7 @@ static int loop_iterate(struct spa_loop_control *ctrl, int timeout)
 {
 	struct impl *impl = SPA_CONTAINER_OF(ctrl, struct impl, control);
 	struct epoll_event ep[32];
+	struct dispatch dispatch;
 	int i, nfds, save_errno = 0;
 	struct source_impl *source, *tmp;
 
@@ -340,16 +374,32 @@ static int loop_iterate(struct spa_loop_control *ctrl, int timeout)
 		struct spa_source *s = ep[i].data.ptr;
 		s->rmask = spa_epoll_to_io(ep[i].events);
 	}
+	/* a callback can iterate the loop again, the sources it dispatches or
+	 * removes are taken out of the batches of the outer iterations */
+	if (SPA_UNLIKELY(impl->dispatch != NULL)) {
+		for (i = 0; i < nfds; i++)
+			dispatch_remove_source(impl, ep[i].data.ptr);
+	}
+
+	dispatch.prev = impl->dispatch;
+	dispatch.ep = ep;
+	dispatch.n_ep = nfds;
+	impl->dispatch = &dispatch;
 	for (i = 0; i < nfds; i++) {
 		struct spa_source *s = ep[i].data.ptr;
-		if (s->rmask && s->fd != -1) {
+		if (s && s->rmask && s->fd != -1) {
 			s->func(s);
 		}
 	}
-	spa_list_for_each_safe(source, tmp, &impl->destroy_list, link)
-		free(source);
+	impl->dispatch = dispatch.prev;
 
-	spa_list_init(&impl->destroy_list);
+	/* the outer iterations are still running callbacks */
+	if (impl->dispatch == NULL) {
+		spa_list_for_each_safe(source, tmp, &impl->destroy_list, link)
+			free(source);
+
+		spa_list_init(&impl->destroy_list);
+	}
 
 	return 0;
 }
@@ -33,7 +33,7 @@
 #include <spa/node/io.h>
 #include <spa/param/buffers.h>
 #include <spa/param/meta.h>
-#include <spa/param/format.h>
+#include <spa/param/format-utils.h>
 #include <spa/pod/parser.h>
 
 #include <lib/pod.h>
@@ -54,6 +54,8 @@ struct type {
 	struct spa_type_command_node command_node;
 	struct spa_type_param_buffers param_buffers;
 	struct spa_type_param_meta param_meta;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
 };
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
@@ -71,6 +73,8 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 	spa_type_command_node_map(map, &type->command_node);
 	spa_type_param_buffers_map(map, &type->param_buffers);
 	spa_type_param_meta_map(map, &type->param_meta);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
 }
 
 struct props {
@@ -115,6 +119,7 @@ struct impl {
 	uint32_t n_buffers;
 
 	bool started;
+	bool waiting;
 	uint64_t start_time;
 	uint64_t elapsed_time;
 
@@ -257,8 +262,10 @@ static int consume_buffer(struct impl *this)
 			this->callbacks->need_input(this->callbacks_data);
 	}
 	if (spa_list_is_empty(&this->ready)) {
-		spa_log_error(this->log, NAME " %p: no buffers", this);
-		return -EPIPE;
+		/* the peer answers later, process_input continues */
+		spa_log_trace(this->log, NAME " %p: wait for buffer", this);
+		this->waiting = true;
+		return SPA_STATUS_NEED_BUFFER;
 	}
 
 	b = spa_list_first(&this->ready, struct buffer, link);
@@ -327,6 +334,7 @@ static int impl_node_send_command(struct spa_node *node, const struct spa_comman
 		this->elapsed_time = 0;
 
 		this->started = true;
+		this->waiting = false;
 		set_timer(this, true);
 	} else if (SPA_COMMAND_TYPE(command) == this->type.command_node.Pause) {
 		if (!this->have_format)
@@ -440,7 +448,21 @@ static int port_enum_formats(struct spa_node *node,
 			     struct spa_pod **param,
 			     struct spa_pod_builder *builder)
 {
-	return 0;
+	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	struct type *t = &this->type;
+
+	/* the data is not looked at, any bytes will do */
+	switch (*index) {
+	case 0:
+		*param = spa_pod_builder_object(builder,
+			t->param.idEnumFormat, t->format,
+			"I", t->media_type.binary,
+			"I", t->media_subtype.raw);
+		break;
+	default:
+		return 0;
+	}
+	return 1;
 }
 
 static int port_get_format(struct spa_node *node,
@@ -734,8 +756,12 @@ static int impl_node_process_input(struct spa_node *node)
 	}
 	if (this->callbacks == NULL || this->callbacks->need_input == NULL)
 		return consume_buffer(this);
-	else
-		return SPA_STATUS_OK;
+
+	if (this->waiting && !spa_list_is_empty(&this->ready)) {
+		this->waiting = false;
+		set_timer(this, true);
+	}
+	return SPA_STATUS_OK;
 }
 
 static int impl_node_process_output(struct spa_node *node)
@@ -831,6 +857,18 @@ static int impl_get_interface(struct spa_handle *handle, uint32_t interface_id,
 	return 0;
 }
 
+static int do_remove_source(struct spa_loop *loop,
+			    bool async,
+			    uint32_t seq,
+			    const void *data,
+			    size_t size,
+			    void *user_data)
+{
+	struct impl *this = user_data;
+	spa_loop_remove_source(this->data_loop, &this->timer_source);
+	return 0;
+}
+
 static int impl_clear(struct spa_handle *handle)
 {
 	struct impl *this;
@@ -839,8 +877,9 @@ static int impl_clear(struct spa_handle *handle)
 
 	this = (struct impl *) handle;
 
+	/* the timer can be dispatched in the data loop while we clear */
 	if (this->data_loop)
-		spa_loop_remove_source(this->data_loop, &this->timer_source);
+		spa_loop_invoke(this->data_loop, do_remove_source, 0, NULL, 0, true, this);
 	close(this->timer_source.fd);
 
 	return 0;
@@ -33,7 +33,7 @@
 #include <spa/node/io.h>
 #include <spa/param/buffers.h>
 #include <spa/param/meta.h>
-#include <spa/param/format.h>
+#include <spa/param/format-utils.h>
 #include <spa/pod/parser.h>
 
 #include <lib/pod.h>
@@ -55,6 +55,8 @@ struct type {
 	struct spa_type_command_node command_node;
 	struct spa_type_param_buffers param_buffers;
 	struct spa_type_param_meta param_meta;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
 };
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
@@ -73,6 +75,8 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 	spa_type_command_node_map(map, &type->command_node);
 	spa_type_param_buffers_map(map, &type->param_buffers);
 	spa_type_param_meta_map(map, &type->param_meta);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
 }
 
 struct props {
@@ -456,7 +460,21 @@ static int port_enum_formats(struct spa_node *node,
 			     struct spa_pod **param,
 			     struct spa_pod_builder *builder)
 {
-	return 0;
+	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	struct type *t = &this->type;
+
+	/* the data is not looked at, any bytes will do */
+	switch (*index) {
+	case 0:
+		*param = spa_pod_builder_object(builder,
+			t->param.idEnumFormat, t->format,
+			"I", t->media_type.binary,
+			"I", t->media_subtype.raw);
+		break;
+	default:
+		return 0;
+	}
+	return 1;
 }
 
 static int port_get_format(struct spa_node *node,
@@ -866,6 +884,18 @@ static int impl_get_interface(struct spa_handle *handle, uint32_t interface_id,
 	return 0;
 }
 
+static int do_remove_source(struct spa_loop *loop,
+			    bool async,
+			    uint32_t seq,
+			    const void *data,
+			    size_t size,
+			    void *user_data)
+{
+	struct impl *this = user_data;
+	spa_loop_remove_source(this->data_loop, &this->timer_source);
+	return 0;
+}
+
 static int impl_clear(struct spa_handle *handle)
 {
 	struct impl *this;
@@ -874,8 +904,9 @@ static int impl_clear(struct spa_handle *handle)
 
 	this = (struct impl *) handle;
 
+	/* the timer can be dispatched in the data loop while we clear */
 	if (this->data_loop)
-		spa_loop_remove_source(this->data_loop, &this->timer_source);
+		spa_loop_invoke(this->data_loop, do_remove_source, 0, NULL, 0, true, this);
 	close(this->timer_source.fd);
 
 	return 0;
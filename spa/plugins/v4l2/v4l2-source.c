@@ -62,6 +62,7 @@ struct buffer {
 	bool outstanding;
 	bool allocated;
 	struct v4l2_buffer v4l2_buffer;
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
 };
 
 struct type {
@@ -149,6 +150,10 @@ struct port {
 
 	int64_t last_ticks;
 	int64_t last_monotonic;
+
+	bool have_sequence;
+	uint32_t sequence;		/* sequence of the last dequeued frame */
+	uint32_t missing;		/* frames lost since the last wakeup */
 };
 
 struct impl {
@@ -608,13 +613,22 @@ static int impl_node_port_enum_params(struct spa_node *node,
 		if (*index > 0)
 			return 0;
 
-		param = spa_pod_builder_object(&b,
-			id, t->param_buffers.Buffers,
-			":", t->param_buffers.size,    "i", port->fmt.fmt.pix.sizeimage,
-			":", t->param_buffers.stride,  "i", port->fmt.fmt.pix.bytesperline,
+		spa_pod_builder_push_object(&b, id, t->param_buffers.Buffers);
+		spa_pod_builder_add(&b,
+			":", t->param_buffers.size,    "i", get_max_plane_size(port),
+			":", t->param_buffers.stride,  "i", get_plane_stride(port, 0),
 			":", t->param_buffers.buffers, "iru", MAX_BUFFERS,
 									2, 2, MAX_BUFFERS,
-			":", t->param_buffers.align,   "i", 16);
+			":", t->param_buffers.blocks,  "i", get_n_planes(port),
+			":", t->param_buffers.align,   "i", 16, NULL);
+		/* we prefer to export the device memory as dmabuf, peers that
+		 * can't handle that get mmaped memory */
+		if (port->export_buf)
+			spa_pod_builder_add(&b,
+				":", t->param_buffers.dataType, "Ieu", t->data.DmaBuf,
+									2, t->data.DmaBuf,
+									   t->data.MemPtr, NULL);
+		param = spa_pod_builder_pop(&b);
 	}
 	else if (id == t->param.idMeta) {
 		switch (*index) {
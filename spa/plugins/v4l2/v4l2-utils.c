@@ -38,6 +38,52 @@ static int xioctl(int fd, int request, void *arg)
 	return err;
 }
 
+static inline bool is_mplane(struct port *port)
+{
+	return port->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+}
+
+static uint32_t get_n_planes(struct port *port)
+{
+	return is_mplane(port) ? port->fmt.fmt.pix_mp.num_planes : 1;
+}
+
+static uint32_t get_plane_stride(struct port *port, uint32_t plane)
+{
+	if (is_mplane(port))
+		return port->fmt.fmt.pix_mp.plane_fmt[plane].bytesperline;
+	return port->fmt.fmt.pix.bytesperline;
+}
+
+static uint32_t get_plane_size(struct port *port, uint32_t plane)
+{
+	if (is_mplane(port))
+		return port->fmt.fmt.pix_mp.plane_fmt[plane].sizeimage;
+	return port->fmt.fmt.pix.sizeimage;
+}
+
+static uint32_t get_max_plane_size(struct port *port)
+{
+	uint32_t i, size = 0;
+
+	for (i = 0; i < get_n_planes(port); i++)
+		size = SPA_MAX(size, get_plane_size(port, i));
+	return size;
+}
+
+/* make v4l2_buffer point to the plane array of the buffer */
+static void init_v4l2_buffer(struct port *port, struct buffer *b, uint32_t index)
+{
+	spa_zero(b->v4l2_buffer);
+	b->v4l2_buffer.type = port->type;
+	b->v4l2_buffer.memory = port->memtype;
+	b->v4l2_buffer.index = index;
+	if (is_mplane(port)) {
+		spa_zero(b->planes);
+		b->v4l2_buffer.m.planes = b->planes;
+		b->v4l2_buffer.length = get_n_planes(port);
+	}
+}
 
 static int spa_v4l2_open(struct impl *this)
 {
@@ -83,7 +129,11 @@ static int spa_v4l2_open(struct impl *this)
 		return -err;
 	}
 
-	if ((port->cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) == 0) {
+	if (port->cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)
+		port->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	else if (port->cap.capabilities & V4L2_CAP_VIDEO_CAPTURE_MPLANE)
+		port->type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	else {
 		spa_log_error(port->log, "v4l2: %s is no video capture device", props->device);
 		return -ENODEV;
 	}
@@ -123,7 +173,7 @@ static int spa_v4l2_clear_buffers(struct impl *this)
 {
 	struct port *port = &this->out_ports[0];
 	struct v4l2_requestbuffers reqbuf;
-	int i;
+	int i, j;
 
 	if (port->n_buffers == 0)
 		return 0;
@@ -137,16 +187,22 @@ static int spa_v4l2_clear_buffers(struct impl *this)
 			spa_v4l2_buffer_recycle(this, i);
 		}
 		if (b->allocated) {
-			if (b->outbuf->datas[0].data)
-				munmap(b->outbuf->datas[0].data, b->outbuf->datas[0].maxsize);
-			if (b->outbuf->datas[0].fd != -1)
-				close(b->outbuf->datas[0].fd);
-			b->outbuf->datas[0].type = SPA_ID_INVALID;
+			for (j = 0; j < b->outbuf->n_datas; j++) {
+				struct spa_data *d = &b->outbuf->datas[j];
+
+				if (d->type == SPA_ID_INVALID)
+					continue;
+				if (d->data)
+					munmap(d->data, d->maxsize);
+				if (d->fd != -1)
+					close(d->fd);
+				d->type = SPA_ID_INVALID;
+			}
 		}
 	}
 
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = port->type;
 	reqbuf.memory = port->memtype;
 	reqbuf.count = 0;
 
@@ -405,6 +461,40 @@ static const struct format_info *find_format_info_by_media_type(struct type *typ
 	return NULL;
 }
 
+static bool device_has_format(struct port *port, uint32_t fourcc)
+{
+	struct v4l2_fmtdesc fmtdesc;
+
+	spa_zero(fmtdesc);
+	fmtdesc.type = port->type;
+	for (fmtdesc.index = 0; xioctl(port->fd, VIDIOC_ENUM_FMT, &fmtdesc) == 0; fmtdesc.index++) {
+		if (fmtdesc.pixelformat == fourcc)
+			return true;
+	}
+	return false;
+}
+
+/* formats like NV12 have a single and a multi-planar fourcc, find the one
+ * the device supports */
+static const struct format_info *find_device_format_info(struct impl *this,
+							 uint32_t type,
+							 uint32_t subtype,
+							 uint32_t format)
+{
+	struct port *port = &this->out_ports[0];
+	const struct format_info *info, *first;
+
+	first = find_format_info_by_media_type(&this->type, type, subtype, format, 0);
+
+	for (info = first; info;
+	     info = find_format_info_by_media_type(&this->type, type, subtype, format,
+						   info - format_info + 1)) {
+		if (device_has_format(port, info->fourcc))
+			return info;
+	}
+	return first;
+}
+
 static uint32_t
 enum_filter_format(struct type *type, uint32_t media_type, int32_t media_subtype,
 		   const struct spa_pod *filter, uint32_t index)
@@ -550,7 +640,7 @@ spa_v4l2_enum_format(struct impl *this,
 	if (*index == 0) {
 		spa_zero(port->fmtdesc);
 		port->fmtdesc.index = 0;
-		port->fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		port->fmtdesc.type = port->type;
 		port->next_fmtdesc = true;
 		spa_zero(port->frmsize);
 		port->next_frmsize = true;
@@ -579,10 +669,10 @@ spa_v4l2_enum_format(struct impl *this,
 			if (video_format == t->video_format.UNKNOWN)
 				goto enum_end;
 
-			info = find_format_info_by_media_type(t,
-							      filter_media_type,
-							      filter_media_subtype,
-							      video_format, 0);
+			info = find_device_format_info(this,
+						       filter_media_type,
+						       filter_media_subtype,
+						       video_format);
 			if (info == NULL)
 				goto next_fmtdesc;
 
@@ -828,12 +918,14 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 	uint32_t video_format;
 	struct spa_rectangle *size = NULL;
 	struct spa_fraction *framerate = NULL;
-	struct type *t = &this->type;
+
+	if ((res = spa_v4l2_open(this)) < 0)
+		return res;
 
 	spa_zero(fmt);
 	spa_zero(streamparm);
-	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	fmt.type = port->type;
+	streamparm.type = port->type;
 
 	if (format->media_subtype == this->type.media_subtype.raw) {
 		video_format = format->info.raw.format;
@@ -852,9 +944,9 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 		video_format = this->type.video_format.ENCODED;
 	}
 
-	info = find_format_info_by_media_type(t,
-					      format->media_type,
-					      format->media_subtype, video_format, 0);
+	info = find_device_format_info(this,
+				       format->media_type,
+				       format->media_subtype, video_format);
 	if (info == NULL || size == NULL || framerate == NULL) {
 		spa_log_error(port->log, "v4l2: unknown media type %d %d %d", format->media_type,
 			      format->media_subtype, video_format);
@@ -862,6 +954,8 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 	}
 
 
+	/* pix_mp starts with the same width, height, pixelformat and field
+	 * as pix, so this works for both buffer types */
 	fmt.fmt.pix.pixelformat = info->fourcc;
 	fmt.fmt.pix.field = V4L2_FIELD_ANY;
 	fmt.fmt.pix.width = size->width;
@@ -876,9 +970,6 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 
 	reqfmt = fmt;
 
-	if ((res = spa_v4l2_open(this)) < 0)
-		return res;
-
 	cmd = try_only ? VIDIOC_TRY_FMT : VIDIOC_S_FMT;
 	if (xioctl(port->fd, cmd, &fmt) < 0) {
 		res = -errno;
@@ -1095,21 +1186,28 @@ spa_v4l2_enum_controls(struct impl *this,
 	goto exit;
 }
 
-static int mmap_read(struct impl *this)
+/* dequeue one filled buffer, returns -EAGAIN when there are none left */
+static int mmap_read(struct impl *this, struct buffer **buffer)
 {
 	struct port *port = &this->out_ports[0];
 	struct v4l2_buffer buf;
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
 	struct buffer *b;
 	struct spa_data *d;
 	int64_t pts;
-	struct spa_io_buffers *io = port->io;
+	uint32_t i, n_planes = get_n_planes(port);
 
 	spa_zero(buf);
-	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.type = port->type;
 	buf.memory = port->memtype;
+	if (is_mplane(port)) {
+		spa_zero(planes);
+		buf.m.planes = planes;
+		buf.length = n_planes;
+	}
 
 	if (xioctl(port->fd, VIDIOC_DQBUF, &buf) < 0)
-		return errno;
+		return -errno;
 
 	port->last_ticks = (int64_t) buf.timestamp.tv_sec * SPA_USEC_PER_SEC +
 			    (uint64_t) buf.timestamp.tv_usec;
@@ -1120,6 +1218,12 @@ static int mmap_read(struct impl *this)
 	else
 		port->last_monotonic = SPA_TIME_INVALID;
 
+	/* the driver skips sequence numbers for the frames it dropped */
+	if (port->have_sequence && buf.sequence - port->sequence > 1)
+		port->missing += buf.sequence - port->sequence - 1;
+	port->sequence = buf.sequence;
+	port->have_sequence = true;
+
 	b = &port->buffers[buf.index];
 	if (b->h) {
 		b->h->flags = 0;
@@ -1130,23 +1234,42 @@ static int mmap_read(struct impl *this)
 	}
 
 	d = b->outbuf->datas;
-	d[0].chunk->offset = 0;
-	d[0].chunk->size = buf.bytesused;
-	d[0].chunk->stride = port->fmt.fmt.pix.bytesperline;
+	if (is_mplane(port)) {
+		for (i = 0; i < n_planes && i < b->outbuf->n_datas; i++) {
+			d[i].chunk->offset = planes[i].data_offset;
+			d[i].chunk->size = planes[i].bytesused - planes[i].data_offset;
+			d[i].chunk->stride = get_plane_stride(port, i);
+		}
+	} else {
+		d[0].chunk->offset = 0;
+		d[0].chunk->size = buf.bytesused;
+		d[0].chunk->stride = port->fmt.fmt.pix.bytesperline;
+	}
 
 	b->outstanding = true;
-	io->buffer_id = b->outbuf->id;
-	io->status = SPA_STATUS_HAVE_BUFFER;
-
-	spa_log_trace(port->log, "v4l2 %p: have output %d", this, io->buffer_id);
-	this->callbacks->have_output(this->callbacks_data);
+	*buffer = b;
 
 	return 0;
 }
 
+static void emit_xrun(struct impl *this, struct port *port)
+{
+	struct spa_event_node_xrun xrun =
+		SPA_EVENT_NODE_XRUN_INIT(this->type.event_node.Xrun,
+					 port->missing, port->last_monotonic);
+
+	spa_log_trace(port->log, "v4l2 %p: lost %u frames", this, port->missing);
+	port->missing = 0;
+
+	this->callbacks->event(this->callbacks_data, (struct spa_event *) &xrun);
+}
+
 static void v4l2_on_fd_events(struct spa_source *source)
 {
 	struct impl *this = source->data;
+	struct port *port = &this->out_ports[0];
+	struct spa_io_buffers *io = port->io;
+	struct buffer *b, *last = NULL;
 
 	if (source->rmask & SPA_IO_ERR)
 		return;
@@ -1154,15 +1277,41 @@ static void v4l2_on_fd_events(struct spa_source *source)
 	if (!(source->rmask & SPA_IO_IN))
 		return;
 
-	if (mmap_read(this) < 0)
+	/* take all the ready buffers and only keep the most recent one, the
+	 * older frames are stale and queued again right away */
+	while (mmap_read(this, &b) == 0) {
+		if (last != NULL) {
+			spa_log_trace(port->log, "v4l2 %p: drop buffer %d", this, last->outbuf->id);
+			spa_v4l2_buffer_recycle(this, last->outbuf->id);
+			port->missing++;
+		}
+		last = b;
+	}
+	if (last == NULL)
 		return;
+
+	/* the consumer did not take the previous buffer yet */
+	if (io->status == SPA_STATUS_HAVE_BUFFER && io->buffer_id < port->n_buffers) {
+		spa_log_trace(port->log, "v4l2 %p: drop stale buffer %d", this, io->buffer_id);
+		spa_v4l2_buffer_recycle(this, io->buffer_id);
+		port->missing++;
+	}
+	if (port->missing > 0)
+		emit_xrun(this, port);
+
+	io->buffer_id = last->outbuf->id;
+	io->status = SPA_STATUS_HAVE_BUFFER;
+
+	spa_log_trace(port->log, "v4l2 %p: have output %d", this, io->buffer_id);
+	this->callbacks->have_output(this->callbacks_data);
 }
 
 static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers, uint32_t n_buffers)
 {
 	struct port *state = &this->out_ports[0];
 	struct v4l2_requestbuffers reqbuf;
-	int i;
+	int i, j;
+	uint32_t n_planes = get_n_planes(state);
 	struct spa_data *d;
 
 	if (n_buffers > 0) {
@@ -1181,7 +1330,7 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 	}
 
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = state->type;
 	reqbuf.memory = state->memtype;
 	reqbuf.count = n_buffers;
 
@@ -1206,18 +1355,23 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 
 		spa_log_info(state->log, "v4l2: import buffer %p", buffers[i]);
 
-		if (buffers[i]->n_datas < 1) {
+		if (buffers[i]->n_datas < n_planes) {
 			spa_log_error(state->log, "v4l2: invalid memory on buffer %p", buffers[i]);
 			return -EINVAL;
 		}
 		d = buffers[i]->datas;
 
-		spa_zero(b->v4l2_buffer);
-		b->v4l2_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		b->v4l2_buffer.memory = state->memtype;
-		b->v4l2_buffer.index = i;
+		init_v4l2_buffer(state, b, i);
 
-		if (d[0].type == this->type.data.MemPtr || d[0].type == this->type.data.MemFd) {
+		if (is_mplane(state)) {
+			for (j = 0; j < n_planes; j++) {
+				if (state->memtype == V4L2_MEMORY_USERPTR)
+					b->planes[j].m.userptr = (unsigned long) d[j].data;
+				else
+					b->planes[j].m.fd = d[j].fd;
+				b->planes[j].length = d[j].maxsize;
+			}
+		} else if (d[0].type == this->type.data.MemPtr || d[0].type == this->type.data.MemFd) {
 			b->v4l2_buffer.m.userptr = (unsigned long) d[0].data;
 			b->v4l2_buffer.length = d[0].maxsize;
 		} else if (d[0].type == this->type.data.DmaBuf) {
@@ -1230,6 +1384,26 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 	return 0;
 }
 
+/* the memory type negotiated in the buffers param, DmaBuf when the peer did
+ * not express a preference and we can export */
+static bool use_export_buf(struct impl *this, struct spa_pod **params, uint32_t n_params)
+{
+	struct port *state = &this->out_ports[0];
+	uint32_t i, data_type;
+
+	if (!state->export_buf)
+		return false;
+
+	data_type = this->type.data.DmaBuf;
+	for (i = 0; i < n_params; i++) {
+		if (!spa_pod_is_object_type(params[i], this->type.param_buffers.Buffers))
+			continue;
+		spa_pod_object_parse(params[i],
+			":", this->type.param_buffers.dataType, "?I", &data_type, NULL);
+	}
+	return data_type == this->type.data.DmaBuf;
+}
+
 static int
 mmap_init(struct impl *this,
 	  struct spa_pod **params,
@@ -1239,12 +1413,14 @@ mmap_init(struct impl *this,
 {
 	struct port *state = &this->out_ports[0];
 	struct v4l2_requestbuffers reqbuf;
-	int i;
+	int i, j;
+	uint32_t n_planes = get_n_planes(state);
+	bool export_buf;
 
 	state->memtype = V4L2_MEMORY_MMAP;
 
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = state->type;
 	reqbuf.memory = state->memtype;
 	reqbuf.count = *n_buffers;
 
@@ -1260,14 +1436,16 @@ mmap_init(struct impl *this,
 		spa_log_error(state->log, "v4l2: can't allocate enough buffers");
 		return -ENOMEM;
 	}
-	if (state->export_buf)
+	export_buf = use_export_buf(this, params, n_params);
+	if (export_buf)
 		spa_log_info(state->log, "v4l2: using EXPBUF");
 
 	for (i = 0; i < reqbuf.count; i++) {
 		struct buffer *b;
 		struct spa_data *d;
+		bool mapped = true;
 
-		if (buffers[i]->n_datas < 1) {
+		if (buffers[i]->n_datas < n_planes) {
 			spa_log_error(state->log, "v4l2: invalid buffer data");
 			return -EINVAL;
 		}
@@ -1278,10 +1456,7 @@ mmap_init(struct impl *this,
 		b->allocated = true;
 		b->h = spa_buffer_find_meta(b->outbuf, this->type.meta.Header);
 
-		spa_zero(b->v4l2_buffer);
-		b->v4l2_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		b->v4l2_buffer.memory = state->memtype;
-		b->v4l2_buffer.index = i;
+		init_v4l2_buffer(state, b, i);
 
 		if (xioctl(state->fd, VIDIOC_QUERYBUF, &b->v4l2_buffer) < 0) {
 			perror("VIDIOC_QUERYBUF");
@@ -1289,40 +1464,54 @@ mmap_init(struct impl *this,
 		}
 
 		d = buffers[i]->datas;
-		d[0].mapoffset = 0;
-		d[0].maxsize = b->v4l2_buffer.length;
-		d[0].chunk->offset = 0;
-		d[0].chunk->size = 0;
-		d[0].chunk->stride = state->fmt.fmt.pix.bytesperline;
-
-		if (state->export_buf) {
-			struct v4l2_exportbuffer expbuf;
-
-			spa_zero(expbuf);
-			expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			expbuf.index = i;
-			expbuf.flags = O_CLOEXEC | O_RDONLY;
-			if (xioctl(state->fd, VIDIOC_EXPBUF, &expbuf) < 0) {
-				perror("VIDIOC_EXPBUF");
-				continue;
+		for (j = 0; j < n_planes; j++) {
+			uint32_t length, offset;
+
+			if (is_mplane(state)) {
+				length = b->planes[j].length;
+				offset = b->planes[j].m.mem_offset;
+			} else {
+				length = b->v4l2_buffer.length;
+				offset = b->v4l2_buffer.m.offset;
 			}
-			d[0].type = this->type.data.DmaBuf;
-			d[0].fd = expbuf.fd;
-			d[0].data = NULL;
-		} else {
-			d[0].type = this->type.data.MemPtr;
-			d[0].fd = -1;
-			d[0].data = mmap(NULL,
-					 b->v4l2_buffer.length,
+
+			d[j].mapoffset = 0;
+			d[j].maxsize = length;
+			d[j].chunk->offset = 0;
+			d[j].chunk->size = 0;
+			d[j].chunk->stride = get_plane_stride(state, j);
+
+			if (export_buf) {
+				struct v4l2_exportbuffer expbuf;
+
+				spa_zero(expbuf);
+				expbuf.type = state->type;
+				expbuf.index = i;
+				expbuf.plane = j;
+				expbuf.flags = O_CLOEXEC | O_RDONLY;
+				if (xioctl(state->fd, VIDIOC_EXPBUF, &expbuf) == 0) {
+					d[j].type = this->type.data.DmaBuf;
+					d[j].fd = expbuf.fd;
+					d[j].data = NULL;
+					continue;
+				}
+				spa_log_warn(state->log, "VIDIOC_EXPBUF: %s, using mmap",
+					     strerror(errno));
+			}
+
+			d[j].type = this->type.data.MemPtr;
+			d[j].fd = -1;
+			d[j].data = mmap(NULL, length,
 					 PROT_READ, MAP_SHARED,
-					 state->fd,
-					 b->v4l2_buffer.m.offset);
-			if (d[0].data == MAP_FAILED) {
+					 state->fd, offset);
+			if (d[j].data == MAP_FAILED) {
 				perror("mmap");
-				continue;
+				d[j].data = NULL;
+				mapped = false;
 			}
 		}
-		spa_v4l2_buffer_recycle(this, i);
+		if (mapped)
+			spa_v4l2_buffer_recycle(this, i);
 	}
 	state->n_buffers = reqbuf.count;
 
@@ -1373,12 +1562,14 @@ static int spa_v4l2_stream_on(struct impl *this)
 	if (state->started)
 		return 0;
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	type = state->type;
 	if (xioctl(state->fd, VIDIOC_STREAMON, &type) < 0) {
 		spa_log_error(this->log, "VIDIOC_STREAMON: %s", strerror(errno));
 		return errno;
 	}
 	state->started = true;
+	state->have_sequence = false;
+	state->missing = 0;
 
 	return 0;
 }
@@ -1394,7 +1585,7 @@ static int spa_v4l2_stream_off(struct impl *this)
 
 	spa_v4l2_port_set_enabled(this, false);
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	type = state->type;
 	if (xioctl(state->fd, VIDIOC_STREAMOFF, &type) < 0) {
 		spa_log_error(this->log, "VIDIOC_STREAMOFF: %s", strerror(errno));
 		return errno;
@@ -18,6 +18,11 @@
  */
 
 #include <errno.h>
+#include <stdlib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 typedef enum {
 	GRAY = 0,
@@ -70,10 +75,8 @@ typedef struct _DrawingData DrawingData;
 typedef void (*DrawPixelFunc) (DrawingData * dd, int x, Pixel * pixel);
 
 struct _DrawingData {
-	char *line;
+	uint8_t *line[MAX_PLANES];
 	int width;
-	int height;
-	int stride;
 	DrawPixelFunc draw_pixel;
 };
 
@@ -112,171 +115,312 @@ static void init_colors(void)
 
 static void draw_pixel_rgb(DrawingData * dd, int x, Pixel * color)
 {
-	dd->line[3 * x + 0] = color->R;
-	dd->line[3 * x + 1] = color->G;
-	dd->line[3 * x + 2] = color->B;
+	dd->line[0][3 * x + 0] = color->R;
+	dd->line[0][3 * x + 1] = color->G;
+	dd->line[0][3 * x + 2] = color->B;
 }
 
 static void draw_pixel_uyvy(DrawingData * dd, int x, Pixel * color)
 {
 	if (x & 1) {
 		/* odd pixel */
-		dd->line[2 * (x - 1) + 3] = color->Y;
+		dd->line[0][2 * (x - 1) + 3] = color->Y;
 	} else {
 		/* even pixel */
-		dd->line[2 * x + 0] = color->U;
-		dd->line[2 * x + 1] = color->Y;
-		dd->line[2 * x + 2] = color->V;
+		dd->line[0][2 * x + 0] = color->U;
+		dd->line[0][2 * x + 1] = color->Y;
+		dd->line[0][2 * x + 2] = color->V;
 	}
 }
 
-static int drawing_data_init(DrawingData * dd, struct impl *this, char *data)
+static void draw_pixel_i420(DrawingData * dd, int x, Pixel * color)
 {
-	struct spa_video_info *format = &this->current_format;
-	struct spa_rectangle *size = &format->info.raw.size;
-
-	if ((format->media_type != this->type.media_type.video) ||
-	    (format->media_subtype != this->type.media_subtype.raw))
-		return -ENOTSUP;
-
-	if (format->info.raw.format == this->type.video_format.RGB) {
-		dd->draw_pixel = draw_pixel_rgb;
-	} else if (format->info.raw.format == this->type.video_format.UYVY) {
-		dd->draw_pixel = draw_pixel_uyvy;
-	} else
-		return -ENOTSUP;
-
-	dd->line = data;
-	dd->width = size->width;
-	dd->height = size->height;
-	dd->stride = this->stride;
+	dd->line[0][x] = color->Y;
+	if ((x & 1) == 0) {
+		dd->line[1][x / 2] = color->U;
+		dd->line[2][x / 2] = color->V;
+	}
+}
 
-	return 0;
+static void draw_pixel_nv12(DrawingData * dd, int x, Pixel * color)
+{
+	dd->line[0][x] = color->Y;
+	if ((x & 1) == 0) {
+		dd->line[1][x + 0] = color->U;
+		dd->line[1][x + 1] = color->V;
+	}
 }
 
-static inline void draw_pixels(DrawingData * dd, int offset, Color color, int length)
+static inline void draw_pixels(DrawingData * dd, int offset, Pixel * pixel, int length)
 {
 	int x;
 
 	for (x = offset; x < offset + length; x++) {
-		dd->draw_pixel(dd, x, &colors[color]);
+		dd->draw_pixel(dd, x, pixel);
 	}
 }
 
-static inline void next_line(DrawingData * dd)
+static inline void draw_color(DrawingData * dd, int offset, Color color, int length)
 {
-	dd->line += dd->stride;
+	draw_pixels(dd, offset, &colors[color], length);
 }
 
-static void draw_smpte_snow(DrawingData * dd)
+/* Fill data with random bytes. Four xorshift32 generators run in parallel
+ * so that 16 bytes are produced per step. */
+static void fill_random(struct impl *this, uint8_t *data, int size)
 {
-	int h, w;
-	int y1, y2;
-	int i, j;
-
-	w = dd->width;
-	h = dd->height;
-	y1 = 2 * h / 3;
-	y2 = 3 * h / 4;
-
-	for (i = 0; i < y1; i++) {
-		for (j = 0; j < 7; j++) {
-			int x1 = j * w / 7;
-			int x2 = (j + 1) * w / 7;
-			draw_pixels(dd, x1, j, x2 - x1);
-		}
-		next_line(dd);
-	}
+	uint32_t *state = this->random_state;
+	int i = 0;
 
-	for (i = y1; i < y2; i++) {
-		for (j = 0; j < 7; j++) {
-			int x1 = j * w / 7;
-			int x2 = (j + 1) * w / 7;
-			Color c = (j & 1) ? BLACK : BLUE - j;
+#if defined(__SSE2__)
+	__m128i x = _mm_loadu_si128((__m128i *) state);
 
-			draw_pixels(dd, x1, c, x2 - x1);
+	for (; i + 16 <= size; i += 16) {
+		x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+		x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+		_mm_storeu_si128((__m128i *) &data[i], x);
+	}
+	_mm_storeu_si128((__m128i *) state, x);
+#endif
+	for (; i < size; i += 16) {
+		uint32_t r[4];
+		int j;
+
+		for (j = 0; j < 4; j++) {
+			uint32_t s = state[j];
+			s ^= s << 13;
+			s ^= s >> 17;
+			s ^= s << 5;
+			r[j] = state[j] = s;
 		}
-		next_line(dd);
+		memcpy(&data[i], r, SPA_MIN(16, size - i));
 	}
+}
 
-	for (i = y2; i < h; i++) {
-		int x = 0;
-
-		/* negative I */
-		draw_pixels(dd, x, NEG_I, w / 6);
-		x += w / 6;
-
-		/* white */
-		draw_pixels(dd, x, WHITE, w / 6);
-		x += w / 6;
+static void draw_snow_rgb(struct impl *this, uint8_t *line, int offset, int width)
+{
+	int x;
 
-		/* positive Q */
-		draw_pixels(dd, x, POS_Q, w / 6);
-		x += w / 6;
+	fill_random(this, this->snow, width - offset);
+	for (x = offset; x < width; x++) {
+		uint8_t r = this->snow[x - offset];
+		line[3 * x + 0] = r;
+		line[3 * x + 1] = r;
+		line[3 * x + 2] = r;
+	}
+}
 
-		/* pluge */
-		draw_pixels(dd, x, DARK_BLACK, w / 12);
-		x += w / 12;
-		draw_pixels(dd, x, BLACK, w / 12);
-		x += w / 12;
-		draw_pixels(dd, x, LIGHT_BLACK, w / 12);
-		x += w / 12;
+static void draw_snow_uyvy(struct impl *this, uint8_t *line, int offset, int width)
+{
+	int x;
 
-		/* war of the ants (a.k.a. snow) */
-		for (j = x; j < w; j++) {
-			Pixel p;
-			unsigned char r = rand();
-
-			p.R = r;
-			p.G = r;
-			p.B = r;
-			update_yuv(&p);
-			dd->draw_pixel(dd, j, &p);
-		}
+	/* chroma of the snow is neutral and already in the cached row */
+	fill_random(this, this->snow, width - offset);
+	for (x = offset; x < width; x++)
+		line[2 * x + 1] = this->snow[x - offset];
+}
 
-		next_line(dd);
-	}
+static void draw_snow_planar(struct impl *this, uint8_t *line, int offset, int width)
+{
+	/* only the luma plane, the chroma planes come from the cached rows */
+	fill_random(this, &line[offset], width - offset);
 }
 
-static void draw_snow(DrawingData * dd)
+static inline uint8_t *get_row(struct impl *this, uint32_t band, uint32_t plane)
 {
-	int x, y;
-
-	for (y = 0; y < dd->height; y++) {
-		for (x = 0; x < dd->width; x++) {
-			Pixel p;
-			unsigned char r = rand();
-
-			p.R = r;
-			p.G = r;
-			p.B = r;
-			update_yuv(&p);
-			dd->draw_pixel(dd, x, &p);
-		}
+	return this->rows + band * this->row_size + this->planes[plane].row_offset;
+}
 
-		next_line(dd);
-	}
+static void add_band(struct impl *this, int y_end, int snow_x)
+{
+	this->bands[this->n_bands].y_end = y_end;
+	this->bands[this->n_bands].snow_x = snow_x;
+	this->n_bands++;
 }
 
-static int draw(struct impl *this, char *data)
+/* Render the distinct rows of the current pattern into the row cache. The
+ * part of a row that changes on every frame (the snow) is filled with gray
+ * so that only the luma needs to be generated for each frame. */
+static void render_rows(struct impl *this)
 {
 	DrawingData dd;
-	int res;
+	struct spa_video_info_raw *raw = &this->current_format.info.raw;
+	Pixel gray = { 128, 128, 128, 0, 0, 0 };
+	int w, h, y1, y2, x, j;
+	uint32_t i, b;
 
 	init_colors();
+	update_yuv(&gray);
+
+	w = raw->size.width;
+	h = raw->size.height;
 
-	if ((res = drawing_data_init(&dd, this, data)) < 0)
-		return res;
+	dd.width = w;
+	dd.draw_pixel = this->draw_pixel;
 
+	this->n_bands = 0;
 	switch (this->props.pattern) {
 	case PATTERN_SMPTE_SNOW:
-		draw_smpte_snow(&dd);
+		y1 = 2 * h / 3;
+		y2 = 3 * h / 4;
+		add_band(this, y1, w);
+		add_band(this, y2, w);
+		add_band(this, h, 3 * (w / 6) + 3 * (w / 12));
 		break;
 	case PATTERN_SNOW:
-		draw_snow(&dd);
-		break;
 	default:
+		add_band(this, h, 0);
+		break;
+	}
+
+	memset(this->rows, 0, this->n_bands * this->row_size);
+
+	for (b = 0; b < this->n_bands; b++) {
+		for (i = 0; i < this->n_planes; i++)
+			dd.line[i] = get_row(this, b, i);
+
+		if (this->props.pattern == PATTERN_SMPTE_SNOW && b < 2) {
+			for (j = 0; j < 7; j++) {
+				int x1 = j * w / 7;
+				int x2 = (j + 1) * w / 7;
+				Color c = (b == 0) ? j : (j & 1) ? BLACK : BLUE - j;
+
+				draw_color(&dd, x1, c, x2 - x1);
+			}
+		} else if (this->props.pattern == PATTERN_SMPTE_SNOW) {
+			x = 0;
+
+			/* negative I */
+			draw_color(&dd, x, NEG_I, w / 6);
+			x += w / 6;
+
+			/* white */
+			draw_color(&dd, x, WHITE, w / 6);
+			x += w / 6;
+
+			/* positive Q */
+			draw_color(&dd, x, POS_Q, w / 6);
+			x += w / 6;
+
+			/* pluge */
+			draw_color(&dd, x, DARK_BLACK, w / 12);
+			x += w / 12;
+			draw_color(&dd, x, BLACK, w / 12);
+			x += w / 12;
+			draw_color(&dd, x, LIGHT_BLACK, w / 12);
+		}
+		/* war of the ants (a.k.a. snow) */
+		draw_pixels(&dd, this->bands[b].snow_x, &gray, w - this->bands[b].snow_x);
+	}
+	this->rows_pattern = this->props.pattern;
+}
+
+static void clear_rows(struct impl *this)
+{
+	free(this->rows);
+	this->rows = NULL;
+	free(this->snow);
+	this->snow = NULL;
+}
+
+/* Compute the plane layout of the format and allocate the row cache. The
+ * planes are stored one after the other in the first data of the buffer. */
+static int setup_rows(struct impl *this, struct spa_video_info_raw *raw)
+{
+	struct type *t = &this->type;
+	int w = raw->size.width, h = raw->size.height;
+	int cw = (w + 1) / 2, ch = (h + 1) / 2;
+	uint32_t i, offset, row_offset;
+
+	if (raw->format == t->video_format.RGB) {
+		this->n_planes = 1;
+		this->planes[0].stride = SPA_ROUND_UP_N(3 * w, 4);
+		this->draw_pixel = draw_pixel_rgb;
+		this->draw_snow = draw_snow_rgb;
+	} else if (raw->format == t->video_format.UYVY) {
+		this->n_planes = 1;
+		this->planes[0].stride = SPA_ROUND_UP_N(2 * w, 4);
+		this->draw_pixel = draw_pixel_uyvy;
+		this->draw_snow = draw_snow_uyvy;
+	} else if (raw->format == t->video_format.I420) {
+		this->n_planes = 3;
+		this->planes[0].stride = SPA_ROUND_UP_N(w, 4);
+		this->planes[1].stride = SPA_ROUND_UP_N(cw, 4);
+		this->planes[2].stride = SPA_ROUND_UP_N(cw, 4);
+		this->draw_pixel = draw_pixel_i420;
+		this->draw_snow = draw_snow_planar;
+	} else if (raw->format == t->video_format.NV12) {
+		this->n_planes = 2;
+		this->planes[0].stride = SPA_ROUND_UP_N(w, 4);
+		this->planes[1].stride = SPA_ROUND_UP_N(2 * cw, 4);
+		this->draw_pixel = draw_pixel_nv12;
+		this->draw_snow = draw_snow_planar;
+	} else
+		return -EINVAL;
+
+	offset = row_offset = 0;
+	for (i = 0; i < this->n_planes; i++) {
+		struct plane *p = &this->planes[i];
+
+		p->vsub = i > 0 ? 1 : 0;
+		p->height = i > 0 ? ch : h;
+		p->offset = offset;
+		p->row_offset = row_offset;
+		offset += p->stride * p->height;
+		row_offset += p->stride;
+	}
+	this->frame_size = offset;
+	this->row_size = row_offset;
+
+	clear_rows(this);
+	this->rows = malloc(MAX_BANDS * this->row_size);
+	this->snow = malloc(SPA_ROUND_UP_N(w, 16));
+	if (this->rows == NULL || this->snow == NULL) {
+		clear_rows(this);
+		return -ENOMEM;
+	}
+	this->rows_pattern = UINT32_MAX;
+
+	return 0;
+}
+
+static int draw(struct impl *this, uint8_t *data)
+{
+	struct spa_video_info_raw *raw = &this->current_format.info.raw;
+	uint32_t i;
+	int y;
+
+	if (this->rows == NULL)
+		return -EIO;
+
+	if (this->props.pattern != PATTERN_SMPTE_SNOW &&
+	    this->props.pattern != PATTERN_SNOW)
 		return -ENOTSUP;
+
+	if (this->rows_pattern != this->props.pattern)
+		render_rows(this);
+
+	for (i = 0; i < this->n_planes; i++) {
+		struct plane *p = &this->planes[i];
+		uint8_t *line = data + p->offset;
+		uint32_t b = 0;
+
+		for (y = 0; y < p->height; y++) {
+			struct band *band;
+
+			while ((y << p->vsub) >= this->bands[b].y_end)
+				b++;
+			band = &this->bands[b];
+
+			/* the snow only writes the luma of its pixels, the chroma
+			 * and the padding of the row come from the cached row */
+			memcpy(line, get_row(this, b, i), p->stride);
+			if (i == 0 && band->snow_x < raw->size.width)
+				this->draw_snow(this, line, band->snow_x, raw->size.width);
+
+			line += p->stride;
+		}
 	}
 	return 0;
 }
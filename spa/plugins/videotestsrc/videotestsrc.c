@@ -115,6 +115,28 @@ struct buffer {
 	struct spa_list link;
 };
 
+#define MAX_PLANES 3
+#define MAX_BANDS 3
+
+struct plane {
+	uint32_t offset;	/* offset of the plane in the buffer */
+	uint32_t row_offset;	/* offset of the plane in a cached row */
+	int stride;
+	int height;
+	int vsub;
+};
+
+struct band {
+	int y_end;		/* first line after the band */
+	int snow_x;		/* first pixel of the snow in the band */
+};
+
+struct impl;
+struct _DrawingData;
+struct _Pixel;
+
+typedef void (*draw_snow_func_t) (struct impl *this, uint8_t *line, int offset, int width);
+
 struct impl {
 	struct spa_handle handle;
 	struct spa_node node;
@@ -139,8 +161,22 @@ struct impl {
 
 	bool have_format;
 	struct spa_video_info current_format;
-	size_t bpp;
 	int stride;
+	size_t frame_size;
+	uint32_t n_planes;
+	struct plane planes[MAX_PLANES];
+
+	void (*draw_pixel) (struct _DrawingData *dd, int x, struct _Pixel *pixel);
+	draw_snow_func_t draw_snow;
+	uint32_t random_state[4];
+	uint8_t *snow;
+
+	/* the distinct rows of the pattern, rendered once per format */
+	uint32_t rows_pattern;
+	struct band bands[MAX_BANDS];
+	uint32_t n_bands;
+	size_t row_size;
+	uint8_t *rows;
 
 	struct buffer buffers[MAX_BUFFERS];
 	uint32_t n_buffers;
@@ -274,7 +310,14 @@ static int impl_node_set_param(struct spa_node *node, uint32_t id, uint32_t flag
 
 static int fill_buffer(struct impl *this, struct buffer *b)
 {
-	return draw(this, b->outbuf->datas[0].data);
+	struct spa_data *d = b->outbuf->datas;
+
+	if (d[0].maxsize < this->frame_size) {
+		spa_log_error(this->log, NAME " %p: buffer too small %d < %zd", this,
+			      d[0].maxsize, this->frame_size);
+		return -ENOSPC;
+	}
+	return draw(this, d[0].data);
 }
 
 static void set_timer(struct impl *this, bool enabled)
@@ -509,8 +552,10 @@ static int port_enum_formats(struct spa_node *node,
 			"I", t->media_type.video,
 			"I", t->media_subtype.raw,
 			":", t->format_video.format,    "Ieu", t->video_format.RGB,
-								2, t->video_format.RGB,
+								4, t->video_format.RGB,
 								   t->video_format.UYVY,
+								   t->video_format.I420,
+								   t->video_format.NV12,
 			":", t->format_video.size,      "Rru", &SPA_RECTANGLE(320, 240),
 								2, &SPA_RECTANGLE(1, 1),
 								   &SPA_RECTANGLE(INT32_MAX, INT32_MAX),
@@ -598,7 +643,6 @@ impl_node_port_enum_params(struct spa_node *node,
 			return res;
 	}
 	else if (id == t->param.idBuffers) {
-		struct spa_video_info_raw *raw_info = &this->current_format.info.raw;
 
 		if (!this->have_format)
 			return -EIO;
@@ -607,7 +651,7 @@ impl_node_port_enum_params(struct spa_node *node,
 
 		param = spa_pod_builder_object(&b,
 			id, t->param_buffers.Buffers,
-			":", t->param_buffers.size,    "i", this->stride * raw_info->size.height,
+			":", t->param_buffers.size,    "i", this->frame_size,
 			":", t->param_buffers.stride,  "i", this->stride,
 			":", t->param_buffers.buffers, "ir", 2,
 								2, 1, 32,
@@ -658,6 +702,7 @@ static int port_set_format(struct spa_node *node,
 			   const struct spa_pod *format)
 {
 	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	int res;
 
 	if (format == NULL) {
 		this->have_format = false;
@@ -676,20 +721,12 @@ static int port_set_format(struct spa_node *node,
 		if (spa_format_video_raw_parse(format, &info.info.raw, &this->type.format_video) < 0)
 			return -EINVAL;
 
-		if (info.info.raw.format == this->type.video_format.RGB)
-			this->bpp = 3;
-		else if (info.info.raw.format == this->type.video_format.UYVY)
-			this->bpp = 2;
-		else
-			return -EINVAL;
+		if ((res = setup_rows(this, &info.info.raw)) < 0)
+			return res;
 
 		this->current_format = info;
 		this->have_format = true;
-	}
-
-	if (this->have_format) {
-		struct spa_video_info_raw *raw_info = &this->current_format.info.raw;
-		this->stride = SPA_ROUND_UP_N(this->bpp * raw_info->size.width, 4);
+		this->stride = this->planes[0].stride;
 	}
 
 	return 0;
@@ -988,6 +1025,7 @@ static int impl_clear(struct spa_handle *handle)
 	if (this->data_loop)
 		spa_loop_remove_source(this->data_loop, &this->timer_source);
 	close(this->timer_source.fd);
+	clear_rows(this);
 
 	return 0;
 }
@@ -1028,6 +1066,11 @@ impl_init(const struct spa_handle_factory *factory,
 	this->clock = impl_clock;
 	reset_props(&this->props);
 
+	this->random_state[0] = 0x12345678;
+	this->random_state[1] = 0x9abcdef0;
+	this->random_state[2] = 0x0fedcba9;
+	this->random_state[3] = 0x87654321;
+
 	spa_list_init(&this->empty);
 
 	this->timer_source.func = on_output;
@@ -0,0 +1,546 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+
+#include <spa/support/log-impl.h>
+#include <spa/support/type-map-impl.h>
+#include <spa/support/plugin.h>
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/buffer/buffer.h>
+#include <spa/param/param.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/param/format-utils.h>
+
+#include "../plugins/audioconvert/fmt-ops.h"
+#include "../plugins/audioconvert/channelmix-ops.h"
+#include "../plugins/audioconvert/resample.h"
+
+static SPA_TYPE_MAP_IMPL(default_map, 4096);
+static SPA_LOG_IMPL(default_log);
+
+extern const struct spa_handle_factory spa_audioconvert_factory;
+
+#define N_SAMPLES	256
+#define N_CHANNELS	3
+
+struct type {
+	uint32_t node;
+	uint32_t format;
+	struct spa_type_io io;
+	struct spa_type_param param;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	spa_type_io_map(map, &type->io);
+	spa_type_param_map(map, &type->param);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_format_audio_map(map, &type->format_audio);
+	spa_type_audio_format_map(map, &type->audio_format);
+}
+
+static struct type type;
+
+/* the error of a round trip is at most a couple of steps of the format */
+static float format_tolerance(const struct format_info *info)
+{
+	uint32_t id = format_info_id(&type.audio_format, info);
+
+	if (id == type.audio_format.F32 || id == type.audio_format.F32_OE ||
+	    id == type.audio_format.F64 || id == type.audio_format.F64_OE)
+		return 1e-6f;
+	if (id == type.audio_format.S18 || id == type.audio_format.U18 ||
+	    id == type.audio_format.S18_OE || id == type.audio_format.U18_OE)
+		return 4.0f / (1 << 17);
+	if (id == type.audio_format.S20 || id == type.audio_format.U20 ||
+	    id == type.audio_format.S20_OE || id == type.audio_format.U20_OE)
+		return 4.0f / (1 << 19);
+
+	switch (info->width) {
+	case 1:
+		return 4.0f / (1 << 7);
+	case 2:
+		return 4.0f / (1 << 15);
+	default:
+		/* 24 bits, also in 32 bits containers, and the float precision
+		 * for 32 bits */
+		return 4.0f / (1 << 23);
+	}
+}
+
+static void test_format_round_trip(const struct format_info *info, uint32_t layout,
+				   uint32_t channels)
+{
+	float in[N_CHANNELS][N_SAMPLES], out[N_CHANNELS][N_SAMPLES];
+	uint8_t data[N_CHANNELS * N_SAMPLES * 8];
+	void *ip[N_CHANNELS], *op[N_CHANNELS], *dp[N_CHANNELS];
+	convert_func_t from, to;
+	float tol = format_tolerance(info), max_err = 0.0f;
+	uint32_t i, j;
+
+	from = get_from_f32d(info, layout, channels);
+	to = get_to_f32d(info, layout, channels);
+	spa_assert_se(from != NULL && to != NULL);
+
+	for (i = 0; i < channels; i++) {
+		for (j = 0; j < N_SAMPLES; j++)
+			in[i][j] = sinf(j * 0.05f + i) * 0.9f;
+		ip[i] = in[i];
+		op[i] = out[i];
+		dp[i] = &data[i * N_SAMPLES * info->width];
+	}
+	/* the extremes must not wrap around */
+	in[0][0] = 1.0f;
+	in[0][1] = -1.0f;
+
+	from(dp, (const void **) ip, channels, N_SAMPLES);
+	to(op, (const void **) dp, channels, N_SAMPLES);
+
+	for (i = 0; i < channels; i++)
+		for (j = 0; j < N_SAMPLES; j++)
+			max_err = SPA_MAX(max_err, fabsf(in[i][j] - out[i][j]));
+
+	if (max_err > tol)
+		fprintf(stderr, "format %s layout %d channels %d: error %g > %g\n",
+			spa_type_map_get_type(&default_map.map,
+					      format_info_id(&type.audio_format, info)),
+			layout, channels, max_err, tol);
+	spa_assert_se(max_err <= tol);
+}
+
+static void test_formats(void)
+{
+	const struct format_info *infos;
+	uint32_t i, n_infos, channels;
+
+	infos = get_format_infos(&n_infos);
+	spa_assert_se(n_infos > 0);
+
+	/* 1 and 2 channels also take the vectorized paths */
+	for (i = 0; i < n_infos; i++) {
+		for (channels = 1; channels <= N_CHANNELS; channels++) {
+			test_format_round_trip(&infos[i], LAYOUT_INTERLEAVED, channels);
+			test_format_round_trip(&infos[i], LAYOUT_PLANAR, channels);
+		}
+	}
+}
+
+static void test_format_values(void)
+{
+	const struct format_info *info;
+	float in[2][4] = { { 0.0f, 0.5f, 1.0f, -1.0f }, { -0.5f, 0.25f, 2.0f, -2.0f } };
+	void *ip[2] = { in[0], in[1] };
+	int16_t s16[8];
+	uint8_t u8[4];
+	void *dp[1];
+
+	info = find_format_info(&type.audio_format, type.audio_format.S16);
+	spa_assert_se(info != NULL);
+
+	/* interleaved, clamped and scaled to the full range */
+	dp[0] = s16;
+	get_from_f32d(info, LAYOUT_INTERLEAVED, 2)(dp, (const void **) ip, 2, 4);
+	spa_assert_se(s16[0] == 0 && s16[1] == -16383);
+	spa_assert_se(s16[2] == 16383 && s16[3] == 8191);
+	spa_assert_se(s16[4] == 32767 && s16[5] == 32767);
+	spa_assert_se(s16[6] == -32767 && s16[7] == -32767);
+
+	info = find_format_info(&type.audio_format, type.audio_format.U8);
+	spa_assert_se(info != NULL);
+
+	/* unsigned formats are biased */
+	dp[0] = u8;
+	get_from_f32d(info, LAYOUT_PLANAR, 1)(dp, (const void **) ip, 1, 4);
+	spa_assert_se(u8[0] == 128 && u8[1] == 191 && u8[2] == 255 && u8[3] == 1);
+
+	spa_assert_se(find_format_info(&type.audio_format, type.audio_format.UNKNOWN) == NULL);
+}
+
+static void run_mix(struct channelmix *mix, float in[][N_SAMPLES], float out[][N_SAMPLES])
+{
+	void *ip[CHANNELMIX_MAX_CHANNELS], *op[CHANNELMIX_MAX_CHANNELS];
+	uint32_t i;
+
+	for (i = 0; i < mix->src_chan; i++)
+		ip[i] = in[i];
+	for (i = 0; i < mix->dst_chan; i++)
+		op[i] = out[i];
+
+	channelmix_process(mix, op, (const void **) ip, N_SAMPLES);
+}
+
+static void test_channelmix(void)
+{
+	struct channelmix mix = { 0, };
+	float in[6][N_SAMPLES], out[6][N_SAMPLES];
+	uint32_t i, j;
+
+	for (i = 0; i < 6; i++)
+		for (j = 0; j < N_SAMPLES; j++)
+			in[i][j] = (i + 1) * 0.1f;
+
+	/* same layout, the samples are copied */
+	mix.src_chan = mix.dst_chan = 2;
+	spa_assert_se(channelmix_init(&mix) == 0);
+	spa_assert_se(mix.identity);
+	run_mix(&mix, in, out);
+	spa_assert_se(out[0][0] == in[0][0] && out[1][N_SAMPLES-1] == in[1][N_SAMPLES-1]);
+
+	/* stereo to mono averages */
+	mix.src_chan = 2;
+	mix.dst_chan = 1;
+	spa_assert_se(channelmix_init(&mix) == 0);
+	spa_assert_se(!mix.identity);
+	run_mix(&mix, in, out);
+	spa_assert_se(fabsf(out[0][0] - 0.15f) < 1e-6f);
+
+	/* mono to stereo copies */
+	mix.src_chan = 1;
+	mix.dst_chan = 2;
+	spa_assert_se(channelmix_init(&mix) == 0);
+	run_mix(&mix, in, out);
+	spa_assert_se(fabsf(out[0][0] - 0.1f) < 1e-6f && fabsf(out[1][0] - 0.1f) < 1e-6f);
+
+	/* 5.1 to stereo, the LFE is dropped and the output can't clip */
+	mix.src_chan = 6;
+	mix.dst_chan = 2;
+	spa_assert_se(channelmix_init(&mix) == 0);
+	for (i = 0; i < mix.dst_chan; i++) {
+		float sum = 0.0f;
+		for (j = 0; j < mix.src_chan; j++)
+			sum += mix.matrix[i][j];
+		spa_assert_se(sum <= 1.0f + 1e-6f);
+		spa_assert_se(mix.matrix[i][CHANNEL_LFE] == 0.0f);
+	}
+	spa_assert_se(mix.matrix[0][CHANNEL_FR] == 0.0f && mix.matrix[1][CHANNEL_FL] == 0.0f);
+	spa_assert_se(mix.matrix[0][CHANNEL_FC] == mix.matrix[1][CHANNEL_FC]);
+
+	mix.src_chan = 0;
+	spa_assert_se(channelmix_init(&mix) == -EINVAL);
+}
+
+static void test_resample_rate(uint32_t i_rate, uint32_t o_rate)
+{
+	struct resample r = { 0, };
+	float in[4096], out[16384];
+	const void *ip[1] = { in };
+	void *op[1] = { out };
+	uint32_t i, in_len, out_len, in_done = 0, out_done = 0;
+
+	r.channels = 1;
+	r.i_rate = i_rate;
+	r.o_rate = o_rate;
+	r.quality = RESAMPLE_DEFAULT_QUALITY;
+	spa_assert_se(resample_init(&r) == 0);
+
+	for (i = 0; i < SPA_N_ELEMENTS(in); i++)
+		in[i] = 0.5f;
+
+	/* feed the input in small blocks like the node does */
+	while (in_done < SPA_N_ELEMENTS(in)) {
+		in_len = SPA_MIN(SPA_N_ELEMENTS(in) - in_done, 100);
+		out_len = SPA_N_ELEMENTS(out) - out_done;
+		ip[0] = &in[in_done];
+		op[0] = &out[out_done];
+		resample_process(&r, ip, &in_len, op, &out_len);
+		spa_assert_se(in_len > 0 || out_len > 0);
+		in_done += in_len;
+		out_done += out_len;
+	}
+
+	/* the number of samples follows the ratio, minus the delay */
+	spa_assert_se(fabs(out_done - (double) in_done * o_rate / i_rate) <=
+		      (double) (resample_delay(&r) + 2) * o_rate / i_rate);
+
+	/* DC passes unchanged once the filter is filled */
+	for (i = out_done / 2; i < out_done; i++) {
+		if (fabsf(out[i] - 0.5f) >= 1e-3f)
+			fprintf(stderr, "resample %d -> %d: sample %d is %f\n",
+				i_rate, o_rate, i, out[i]);
+		spa_assert_se(fabsf(out[i] - 0.5f) < 1e-3f);
+	}
+
+	/* asking for the input of some output gives that output, up to the
+	 * samples that one input sample makes */
+	resample_reset(&r);
+	in_len = resample_in_len(&r, 256);
+	out_len = SPA_N_ELEMENTS(out);
+	ip[0] = in;
+	op[0] = out;
+	resample_process(&r, ip, &in_len, op, &out_len);
+	spa_assert_se(out_len >= 255 && out_len <= 256 + SPA_MAX(1u, o_rate / i_rate));
+
+	resample_free(&r);
+}
+
+static void test_resample(void)
+{
+	test_resample_rate(44100, 48000);
+	test_resample_rate(48000, 44100);
+	test_resample_rate(48000, 48000);
+	test_resample_rate(32000, 96000);
+}
+
+#define IN_FRAMES	1000
+#define OUT_FRAMES	256
+
+struct node_buffer {
+	struct spa_buffer buffer;
+	struct spa_data datas[1];
+	struct spa_chunk chunks[1];
+	struct spa_buffer *ptr;
+};
+
+static void init_buffer(struct node_buffer *b, uint32_t id, void *data, uint32_t size)
+{
+	b->buffer.id = id;
+	b->buffer.metas = NULL;
+	b->buffer.n_metas = 0;
+	b->buffer.datas = b->datas;
+	b->buffer.n_datas = 1;
+	b->datas[0].type = type.data.MemPtr;
+	b->datas[0].flags = 0;
+	b->datas[0].fd = -1;
+	b->datas[0].mapoffset = 0;
+	b->datas[0].maxsize = size;
+	b->datas[0].data = data;
+	b->datas[0].chunk = &b->chunks[0];
+	b->chunks[0].offset = 0;
+	b->chunks[0].size = size;
+	b->chunks[0].stride = 0;
+	b->ptr = &b->buffer;
+}
+
+static int set_format(struct spa_node *node, enum spa_direction direction,
+		      uint32_t format, uint32_t rate, uint32_t channels)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *param;
+
+	param = spa_pod_builder_object(&b,
+		type.param.idFormat, type.format,
+		"I", type.media_type.audio,
+		"I", type.media_subtype.raw,
+		":", type.format_audio.format,   "I", format,
+		":", type.format_audio.layout,   "i", SPA_AUDIO_LAYOUT_INTERLEAVED,
+		":", type.format_audio.rate,     "i", rate,
+		":", type.format_audio.channels, "i", channels);
+
+	return spa_node_port_set_param(node, direction, 0, type.param.idFormat, 0, param);
+}
+
+/* push one input buffer that needs several output buffers and check that the
+ * input is reported as not consumed until all of it is converted */
+static void test_partial_consume(uint32_t in_rate, uint32_t out_rate)
+{
+	const struct spa_support support[] = {
+		{ SPA_TYPE__TypeMap, &default_map.map },
+		{ SPA_TYPE__Log, &default_log.log },
+	};
+	struct spa_handle *handle;
+	struct spa_node *node;
+	struct spa_io_buffers in_io = SPA_IO_BUFFERS_INIT, out_io = SPA_IO_BUFFERS_INIT;
+	struct node_buffer in_buf, out_bufs[2];
+	struct spa_buffer *bufs[2];
+	int16_t in_data[IN_FRAMES * 2];
+	float out_data[2][OUT_FRAMES * 2], last = -1.0f;
+	uint32_t i, n_out = 0, frames = 0, expected;
+	void *iface;
+	int res;
+
+	handle = calloc(1, spa_audioconvert_factory.size);
+	spa_assert_se(spa_handle_factory_init(&spa_audioconvert_factory, handle,
+					      NULL, support, SPA_N_ELEMENTS(support)) == 0);
+	spa_assert_se(spa_handle_get_interface(handle, type.node, &iface) == 0);
+	node = iface;
+
+	spa_assert_se(set_format(node, SPA_DIRECTION_INPUT, type.audio_format.S16, in_rate, 2) == 0);
+	spa_assert_se(set_format(node, SPA_DIRECTION_OUTPUT, type.audio_format.F32, out_rate, 2) == 0);
+
+	/* a ramp, so that the output must increase when nothing is dropped */
+	for (i = 0; i < IN_FRAMES; i++)
+		in_data[i * 2] = in_data[i * 2 + 1] = i * 16;
+
+	init_buffer(&in_buf, 0, in_data, sizeof(in_data));
+	bufs[0] = in_buf.ptr;
+	spa_assert_se(spa_node_port_use_buffers(node, SPA_DIRECTION_INPUT, 0, bufs, 1) == 0);
+	for (i = 0; i < 2; i++) {
+		init_buffer(&out_bufs[i], i, out_data[i], sizeof(out_data[i]));
+		bufs[i] = out_bufs[i].ptr;
+	}
+	spa_assert_se(spa_node_port_use_buffers(node, SPA_DIRECTION_OUTPUT, 0, bufs, 2) == 0);
+
+	spa_node_port_set_io(node, SPA_DIRECTION_INPUT, 0, type.io.Buffers,
+			     &in_io, sizeof(in_io));
+	spa_node_port_set_io(node, SPA_DIRECTION_OUTPUT, 0, type.io.Buffers,
+			     &out_io, sizeof(out_io));
+
+	/* the first pull asks for input */
+	spa_assert_se(spa_node_process_output(node) == SPA_STATUS_NEED_BUFFER);
+	spa_assert_se(in_io.status == SPA_STATUS_NEED_BUFFER);
+
+	in_io.buffer_id = 0;
+	in_io.status = SPA_STATUS_HAVE_BUFFER;
+	res = spa_node_process_input(node);
+
+	while (res == SPA_STATUS_HAVE_BUFFER) {
+		struct spa_data *d = &out_bufs[out_io.buffer_id].datas[0];
+		float *samples = d->data;
+		uint32_t n = d->chunk->size / (2 * sizeof(float));
+
+		spa_assert_se(out_io.status == SPA_STATUS_HAVE_BUFFER);
+		spa_assert_se(n <= OUT_FRAMES);
+
+		for (i = 0; i < n; i++) {
+			spa_assert_se(samples[i * 2] == samples[i * 2 + 1]);
+			/* the resampler may overshoot a little on the ramp */
+			if (in_rate == out_rate)
+				spa_assert_se(samples[i * 2] > last);
+			last = samples[i * 2];
+		}
+		frames += n;
+		n_out++;
+
+		/* the input must be kept until it is completely consumed */
+		if (in_io.status != SPA_STATUS_HAVE_BUFFER)
+			break;
+
+		spa_assert_se(n_out < 64);
+
+		/* consume the output and pull again */
+		out_io.status = SPA_STATUS_NEED_BUFFER;
+		res = spa_node_process_output(node);
+	}
+	spa_assert_se(in_io.status == SPA_STATUS_OK);
+
+	expected = (uint64_t) IN_FRAMES * out_rate / in_rate;
+	if (in_rate == out_rate) {
+		spa_assert_se(frames == IN_FRAMES);
+		spa_assert_se(n_out == (IN_FRAMES + OUT_FRAMES - 1) / OUT_FRAMES);
+	} else {
+		/* minus what is still in the resampler */
+		spa_assert_se(frames <= expected + 1 && frames + 64 >= expected);
+		spa_assert_se(n_out > 1);
+	}
+
+	/* when the input is consumed, the next pull asks for more */
+	out_io.status = SPA_STATUS_NEED_BUFFER;
+	spa_assert_se(spa_node_process_output(node) == SPA_STATUS_NEED_BUFFER);
+	spa_assert_se(in_io.status == SPA_STATUS_NEED_BUFFER);
+
+	spa_handle_clear(handle);
+	free(handle);
+}
+
+static int enum_format(struct spa_node *node, enum spa_direction direction,
+		       const struct spa_pod *filter, struct spa_pod **format,
+		       struct spa_pod_builder *b)
+{
+	uint32_t index = 0;
+
+	return spa_node_port_enum_params(node, direction, 0, type.param.idEnumFormat,
+					 &index, filter, format, b);
+}
+
+/* the formats are intersected with the filter, a filter that can't match
+ * gives no format */
+static void test_enum_formats(void)
+{
+	const struct spa_support support[] = {
+		{ SPA_TYPE__TypeMap, &default_map.map },
+		{ SPA_TYPE__Log, &default_log.log },
+	};
+	struct spa_handle *handle;
+	struct spa_node *node;
+	uint8_t buffer[4096];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *filter, *format;
+	struct spa_audio_info_raw info = { 0, };
+	void *iface;
+
+	handle = calloc(1, spa_audioconvert_factory.size);
+	spa_assert_se(spa_handle_factory_init(&spa_audioconvert_factory, handle,
+					      NULL, support, SPA_N_ELEMENTS(support)) == 0);
+	spa_assert_se(spa_handle_get_interface(handle, type.node, &iface) == 0);
+	node = iface;
+
+	filter = spa_pod_builder_object(&b,
+		type.param.idEnumFormat, type.format,
+		"I", type.media_type.audio,
+		"I", type.media_subtype.raw,
+		":", type.format_audio.format,   "I", type.audio_format.S16,
+		":", type.format_audio.rate,     "i", 44100,
+		":", type.format_audio.channels, "i", 6);
+	spa_assert_se(enum_format(node, SPA_DIRECTION_INPUT, filter, &format, &b) == 1);
+	spa_assert_se(spa_format_audio_raw_parse(format, &info, &type.format_audio) >= 0);
+	spa_assert_se(info.format == type.audio_format.S16);
+	spa_assert_se(info.rate == 44100);
+	spa_assert_se(info.channels == 6);
+
+	filter = spa_pod_builder_object(&b,
+		type.param.idEnumFormat, type.format,
+		"I", type.media_type.audio,
+		"I", type.media_subtype.raw,
+		":", type.format_audio.channels, "i", CHANNELMIX_MAX_CHANNELS + 1);
+	spa_assert_se(enum_format(node, SPA_DIRECTION_OUTPUT, filter, &format, &b) == 0);
+
+	filter = spa_pod_builder_object(&b,
+		type.param.idEnumFormat, type.format,
+		"I", type.media_type.video,
+		"I", type.media_subtype.raw);
+	spa_assert_se(enum_format(node, SPA_DIRECTION_OUTPUT, filter, &format, &b) == 0);
+
+	spa_handle_clear(handle);
+	free(handle);
+}
+
+int main(int argc, char *argv[])
+{
+	init_type(&type, &default_map.map);
+	default_log.log.level = SPA_LOG_LEVEL_ERROR;
+
+	test_formats();
+	test_format_values();
+	test_channelmix();
+	test_resample();
+	test_partial_consume(48000, 48000);
+	test_partial_consume(44100, 48000);
+	test_partial_consume(48000, 32000);
+	test_enum_formats();
+
+	return 0;
+}
@@ -0,0 +1,303 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <poll.h>
+
+#include <spa/support/log-impl.h>
+#include <spa/support/loop.h>
+#include <spa/support/type-map-impl.h>
+#include <spa/support/plugin.h>
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/buffer/buffer.h>
+#include <spa/param/param.h>
+#include <spa/param/format-utils.h>
+
+static SPA_TYPE_MAP_IMPL(default_map, 4096);
+static SPA_LOG_IMPL(default_log);
+
+extern const struct spa_handle_factory spa_fakesrc_factory;
+extern const struct spa_handle_factory spa_fakesink_factory;
+
+/* The fakesrc and fakesink of the test plugin, with a data loop that only
+ * remembers the timer of the node, the test dispatches it. */
+
+#define N_BUFFERS	2
+#define BUFFER_SIZE	128
+
+struct type {
+	uint32_t node;
+	uint32_t format;
+	struct spa_type_io io;
+	struct spa_type_param param;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_command_node command_node;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	spa_type_io_map(map, &type->io);
+	spa_type_param_map(map, &type->param);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_command_node_map(map, &type->command_node);
+}
+
+static struct type type;
+
+struct data {
+	struct spa_loop data_loop;
+	struct spa_support support[3];
+	uint32_t n_support;
+
+	struct spa_source *timer;
+};
+
+static int do_add_source(struct spa_loop *loop, struct spa_source *source)
+{
+	struct data *data = SPA_CONTAINER_OF(loop, struct data, data_loop);
+	data->timer = source;
+	return 0;
+}
+
+static int do_update_source(struct spa_source *source)
+{
+	return 0;
+}
+
+static void do_remove_source(struct spa_source *source)
+{
+}
+
+static int
+do_invoke(struct spa_loop *loop,
+	  spa_invoke_func_t func, uint32_t seq, const void *data, size_t size, bool block, void *user_data)
+{
+	return func(loop, false, seq, data, size, user_data);
+}
+
+static void init_data(struct data *data)
+{
+	data->data_loop.version = SPA_VERSION_LOOP;
+	data->data_loop.add_source = do_add_source;
+	data->data_loop.update_source = do_update_source;
+	data->data_loop.remove_source = do_remove_source;
+	data->data_loop.invoke = do_invoke;
+
+	data->support[0] = SPA_SUPPORT_INIT(SPA_TYPE__TypeMap, &default_map.map);
+	data->support[1] = SPA_SUPPORT_INIT(SPA_TYPE__Log, &default_log.log);
+	data->support[2] = SPA_SUPPORT_INIT(SPA_TYPE_LOOP__DataLoop, &data->data_loop);
+	data->n_support = 3;
+	data->timer = NULL;
+}
+
+static struct spa_node *make_node(struct data *data, const struct spa_handle_factory *factory,
+				  struct spa_handle **handle)
+{
+	void *iface;
+
+	*handle = calloc(1, factory->size);
+	spa_assert_se(spa_handle_factory_init(factory, *handle, NULL,
+					      data->support, data->n_support) == 0);
+	spa_assert_se(spa_handle_get_interface(*handle, type.node, &iface) == 0);
+	return iface;
+}
+
+static void free_node(struct spa_handle *handle)
+{
+	spa_handle_clear(handle);
+	free(handle);
+}
+
+static struct spa_pod *enum_format(struct spa_node *node, enum spa_direction direction,
+				   const struct spa_pod *filter, struct spa_pod_builder *b)
+{
+	struct spa_pod *format;
+	uint32_t index = 0;
+
+	if (spa_node_port_enum_params(node, direction, 0, type.param.idEnumFormat,
+				      &index, filter, &format, b) <= 0)
+		return NULL;
+	return format;
+}
+
+/* the nodes take any bytes, a link between them must find a format */
+static void test_enum_formats(void)
+{
+	struct data data;
+	struct spa_handle *src_handle, *sink_handle;
+	struct spa_node *src, *sink;
+	uint8_t buffer[4096];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *src_format, *format;
+	uint32_t media_type, media_subtype;
+
+	init_data(&data);
+	src = make_node(&data, &spa_fakesrc_factory, &src_handle);
+	sink = make_node(&data, &spa_fakesink_factory, &sink_handle);
+
+	src_format = enum_format(src, SPA_DIRECTION_OUTPUT, NULL, &b);
+	spa_assert_se(src_format != NULL);
+	spa_assert_se(spa_pod_object_parse(src_format,
+				"I", &media_type, "I", &media_subtype) >= 0);
+	spa_assert_se(media_type == type.media_type.binary);
+	spa_assert_se(media_subtype == type.media_subtype.raw);
+
+	format = enum_format(sink, SPA_DIRECTION_INPUT, src_format, &b);
+	spa_assert_se(format != NULL);
+	spa_assert_se(spa_pod_object_parse(format,
+				"I", &media_type, "I", &media_subtype) >= 0);
+	spa_assert_se(media_type == type.media_type.binary);
+	spa_assert_se(media_subtype == type.media_subtype.raw);
+
+	free_node(sink_handle);
+	free_node(src_handle);
+}
+
+struct buffer {
+	struct spa_buffer buffer;
+	struct spa_meta metas[1];
+	struct spa_meta_header header;
+	struct spa_data datas[1];
+	struct spa_chunk chunks[1];
+	uint8_t data[BUFFER_SIZE];
+};
+
+static void init_buffers(struct spa_buffer **bufs, struct buffer *ba, uint32_t n_buffers)
+{
+	uint32_t i;
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &ba[i];
+
+		bufs[i] = &b->buffer;
+		b->buffer.id = i;
+		b->buffer.metas = b->metas;
+		b->buffer.n_metas = 1;
+		b->buffer.datas = b->datas;
+		b->buffer.n_datas = 1;
+
+		b->metas[0].type = type.meta.Header;
+		b->metas[0].data = &b->header;
+		b->metas[0].size = sizeof(b->header);
+
+		b->datas[0].type = type.data.MemPtr;
+		b->datas[0].flags = 0;
+		b->datas[0].fd = -1;
+		b->datas[0].mapoffset = 0;
+		b->datas[0].maxsize = BUFFER_SIZE;
+		b->datas[0].data = b->data;
+		b->datas[0].chunk = &b->chunks[0];
+	}
+}
+
+static bool timer_armed(struct data *data)
+{
+	struct pollfd pfd = { data->timer->fd, POLLIN, 0 };
+	return poll(&pfd, 1, 0) == 1;
+}
+
+static void dispatch_timer(struct data *data)
+{
+	spa_assert_se(timer_armed(data));
+	data->timer->func(data->timer);
+}
+
+static int n_need_input;
+
+static void on_need_input(void *data)
+{
+	n_need_input++;
+}
+
+static const struct spa_node_callbacks sink_callbacks = {
+	SPA_VERSION_NODE_CALLBACKS,
+	.need_input = on_need_input,
+};
+
+/* In pull mode the sink asks the peer for a buffer on its timer. An
+ * asynchronous peer answers later with process_input, the sink must
+ * consume that buffer on its next timeout. */
+static void test_pull_wait(void)
+{
+	struct data data;
+	struct spa_handle *handle;
+	struct spa_node *sink;
+	uint8_t buffer[4096];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *format;
+	struct spa_buffer *bufs[N_BUFFERS];
+	struct buffer ba[N_BUFFERS];
+	struct spa_io_buffers io = SPA_IO_BUFFERS_INIT;
+	struct spa_command start = SPA_COMMAND_INIT(type.command_node.Start);
+
+	init_data(&data);
+	sink = make_node(&data, &spa_fakesink_factory, &handle);
+	spa_assert_se(data.timer != NULL);
+	spa_node_set_callbacks(sink, &sink_callbacks, &data);
+
+	format = enum_format(sink, SPA_DIRECTION_INPUT, NULL, &b);
+	spa_assert_se(format != NULL);
+	spa_assert_se(spa_node_port_set_param(sink, SPA_DIRECTION_INPUT, 0,
+					      type.param.idFormat, 0, format) == 0);
+	init_buffers(bufs, ba, N_BUFFERS);
+	spa_assert_se(spa_node_port_use_buffers(sink, SPA_DIRECTION_INPUT, 0,
+						bufs, N_BUFFERS) == 0);
+	spa_assert_se(spa_node_port_set_io(sink, SPA_DIRECTION_INPUT, 0,
+					   type.io.Buffers, &io, sizeof(io)) == 0);
+	spa_assert_se(spa_node_send_command(sink, &start) == 0);
+
+	/* the peer does not answer right away */
+	n_need_input = 0;
+	dispatch_timer(&data);
+	spa_assert_se(n_need_input == 1);
+	spa_assert_se(io.status == SPA_STATUS_NEED_BUFFER);
+	spa_assert_se(!timer_armed(&data));
+
+	/* the buffer arrives, the sink takes it on its next timeout */
+	io.buffer_id = 0;
+	io.status = SPA_STATUS_HAVE_BUFFER;
+	spa_assert_se(spa_node_process_input(sink) == SPA_STATUS_OK);
+	spa_assert_se(io.status == SPA_STATUS_OK);
+	dispatch_timer(&data);
+	spa_assert_se(n_need_input == 1);
+	spa_assert_se(io.status == SPA_STATUS_NEED_BUFFER);
+	spa_assert_se(io.buffer_id == 0);
+
+	free_node(handle);
+}
+
+int main(int argc, char *argv[])
+{
+	init_type(&type, &default_map.map);
+
+	test_enum_formats();
+	test_pull_wait();
+
+	return 0;
+}
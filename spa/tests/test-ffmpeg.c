@@ -0,0 +1,376 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <spa/support/log-impl.h>
+#include <spa/support/type-map-impl.h>
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/buffer/buffer.h>
+#include <spa/param/param.h>
+#include <spa/param/video/format-utils.h>
+#include <spa/param/format-utils.h>
+
+#include "../plugins/ffmpeg/ffmpeg-utils.h"
+
+/* Frames are encoded with the ffmpeg encoder node and the packets are
+ * decoded again with the decoder node, the way the graph would drive the
+ * nodes. No frame may get lost on the way, also not when libavcodec is
+ * busy and doesn't take the input right away. */
+
+static SPA_TYPE_MAP_IMPL(default_map, 4096);
+static SPA_LOG_IMPL(default_log);
+
+#define CODEC		"mpeg4"
+#define WIDTH		64
+#define HEIGHT		48
+#define FRAME_SIZE	(WIDTH * HEIGHT * 3 / 2)
+#define N_FRAMES	64
+/* the frames that can stay in the codecs, there is no drain at the end */
+#define MAX_DELAY	16
+#define N_BUFFERS	16
+#define BUFFER_SIZE	(64 * 1024)
+#define MAX_ITER	16
+
+struct type {
+	uint32_t node;
+	uint32_t format;
+	struct spa_type_io io;
+	struct spa_type_param param;
+	struct spa_type_data data;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_media_subtype_video media_subtype_video;
+	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	spa_type_io_map(map, &type->io);
+	spa_type_param_map(map, &type->param);
+	spa_type_data_map(map, &type->data);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_media_subtype_video_map(map, &type->media_subtype_video);
+	spa_type_format_video_map(map, &type->format_video);
+	spa_type_video_format_map(map, &type->video_format);
+}
+
+static struct type type;
+
+struct node_buffer {
+	struct spa_buffer buffer;
+	struct spa_data datas[1];
+	struct spa_chunk chunks[1];
+	struct spa_buffer *ptr;
+	uint8_t data[BUFFER_SIZE];
+};
+
+struct port {
+	struct spa_io_buffers io;
+	struct node_buffer buffers[N_BUFFERS];
+	uint32_t n_buffers;
+};
+
+struct codec {
+	struct spa_handle *handle;
+	struct spa_node *node;
+	struct port in;
+	struct port out;
+};
+
+static void init_buffers(struct port *port, uint32_t n_buffers)
+{
+	uint32_t i;
+
+	for (i = 0; i < n_buffers; i++) {
+		struct node_buffer *b = &port->buffers[i];
+
+		b->buffer.id = i;
+		b->buffer.metas = NULL;
+		b->buffer.n_metas = 0;
+		b->buffer.datas = b->datas;
+		b->buffer.n_datas = 1;
+		b->datas[0].type = type.data.MemPtr;
+		b->datas[0].flags = 0;
+		b->datas[0].fd = -1;
+		b->datas[0].mapoffset = 0;
+		b->datas[0].maxsize = BUFFER_SIZE;
+		b->datas[0].data = b->data;
+		b->datas[0].chunk = &b->chunks[0];
+		b->chunks[0].offset = 0;
+		b->chunks[0].size = 0;
+		b->chunks[0].stride = 0;
+		b->ptr = &b->buffer;
+	}
+	port->n_buffers = n_buffers;
+	port->io = SPA_IO_BUFFERS_INIT;
+}
+
+static int use_buffers(struct codec *c, enum spa_direction direction, uint32_t n_buffers)
+{
+	struct port *port = direction == SPA_DIRECTION_INPUT ? &c->in : &c->out;
+	struct spa_buffer *bufs[N_BUFFERS];
+	uint32_t i;
+
+	init_buffers(port, n_buffers);
+	for (i = 0; i < n_buffers; i++)
+		bufs[i] = port->buffers[i].ptr;
+
+	spa_node_port_set_io(c->node, direction, 0, type.io.Buffers,
+			     &port->io, sizeof(port->io));
+	return spa_node_port_use_buffers(c->node, direction, 0, bufs, n_buffers);
+}
+
+static struct spa_pod *raw_format(struct spa_pod_builder *b)
+{
+	return spa_pod_builder_object(b,
+		type.param.idFormat, type.format,
+		"I", type.media_type.video,
+		"I", type.media_subtype.raw,
+		":", type.format_video.format,    "I", type.video_format.I420,
+		":", type.format_video.size,      "R", &SPA_RECTANGLE(WIDTH, HEIGHT),
+		":", type.format_video.framerate, "F", &SPA_FRACTION(25, 1));
+}
+
+static struct spa_pod *coded_format(struct spa_pod_builder *b)
+{
+	return spa_pod_builder_object(b,
+		type.param.idFormat, type.format,
+		"I", type.media_type.video,
+		"I", type.media_subtype_video.mpeg4,
+		":", type.format_video.size,      "R", &SPA_RECTANGLE(WIDTH, HEIGHT),
+		":", type.format_video.framerate, "F", &SPA_FRACTION(25, 1));
+}
+
+static int make_codec(struct codec *c, bool encoder)
+{
+	const struct spa_support support[] = {
+		{ SPA_TYPE__TypeMap, &default_map.map },
+		{ SPA_TYPE__Log, &default_log.log },
+	};
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *in_format, *out_format;
+	const AVCodec *codec;
+	void *iface;
+	int res;
+
+	codec = encoder ? avcodec_find_encoder_by_name(CODEC) : avcodec_find_decoder_by_name(CODEC);
+	if (codec == NULL) {
+		fprintf(stderr, "no %s %s in libavcodec\n", CODEC, encoder ? "encoder" : "decoder");
+		return -ENOENT;
+	}
+
+	c->handle = calloc(1, encoder ? spa_ffmpeg_enc_get_size() : spa_ffmpeg_dec_get_size());
+	res = encoder ?
+		spa_ffmpeg_enc_init(c->handle, codec, NULL, support, SPA_N_ELEMENTS(support)) :
+		spa_ffmpeg_dec_init(c->handle, codec, NULL, support, SPA_N_ELEMENTS(support));
+	if (res < 0)
+		return res;
+	if ((res = spa_handle_get_interface(c->handle, type.node, &iface)) < 0)
+		return res;
+	c->node = iface;
+
+	in_format = encoder ? raw_format(&b) : coded_format(&b);
+	out_format = encoder ? coded_format(&b) : raw_format(&b);
+
+	/* the codec is opened with the input format */
+	if ((res = spa_node_port_set_param(c->node, SPA_DIRECTION_INPUT, 0,
+					   type.param.idFormat, 0, in_format)) < 0 ||
+	    (res = spa_node_port_set_param(c->node, SPA_DIRECTION_OUTPUT, 0,
+					   type.param.idFormat, 0, out_format)) < 0)
+		return res;
+
+	if ((res = use_buffers(c, SPA_DIRECTION_INPUT, 1)) < 0 ||
+	    (res = use_buffers(c, SPA_DIRECTION_OUTPUT, N_BUFFERS)) < 0)
+		return res;
+
+	return 0;
+}
+
+static void destroy_codec(struct codec *c)
+{
+	if (c->handle) {
+		spa_handle_clear(c->handle);
+		free(c->handle);
+	}
+}
+
+/* a flat frame with a different value for each index */
+static uint8_t frame_value(uint32_t index)
+{
+	return 32 + (index * 3) % 192;
+}
+
+static void fill_frame(uint8_t *data, uint32_t index)
+{
+	memset(data, frame_value(index), WIDTH * HEIGHT);
+	memset(data + WIDTH * HEIGHT, 128, WIDTH * HEIGHT / 2);
+}
+
+struct result {
+	uint32_t n_frames;
+	uint32_t n_wrong;
+};
+
+static void check_frame(struct codec *dec, struct result *r)
+{
+	struct node_buffer *b;
+	uint8_t *data, value = frame_value(r->n_frames);
+	uint32_t x, y, stride;
+
+	spa_assert_se(dec->out.io.buffer_id < dec->out.n_buffers);
+
+	b = &dec->out.buffers[dec->out.io.buffer_id];
+	data = b->data + b->chunks[0].offset;
+	stride = b->chunks[0].stride;
+
+	/* the lossy codec gets flat frames almost right */
+	for (y = 0; y < HEIGHT; y++) {
+		for (x = 0; x < WIDTH; x++) {
+			if (abs(data[y * stride + x] - value) > 4) {
+				r->n_wrong++;
+				goto done;
+			}
+		}
+	}
+      done:
+	r->n_frames++;
+}
+
+/* the graph gives a consumed output buffer back and pulls */
+static int pull(struct codec *c)
+{
+	c->out.io.status = SPA_STATUS_NEED_BUFFER;
+	return spa_node_process_output(c->node);
+}
+
+/* push the packet in the output of the encoder to the decoder and take all
+ * the frames it has */
+static void decode_packet(struct codec *enc, struct codec *dec, struct result *r)
+{
+	struct node_buffer *src = &enc->out.buffers[enc->out.io.buffer_id];
+	struct node_buffer *dst = &dec->in.buffers[0];
+	uint32_t iter;
+	int res;
+
+	memcpy(dst->data, src->data + src->chunks[0].offset, src->chunks[0].size);
+	dst->chunks[0].offset = 0;
+	dst->chunks[0].size = src->chunks[0].size;
+
+	dec->in.io.buffer_id = 0;
+	dec->in.io.status = SPA_STATUS_HAVE_BUFFER;
+	res = spa_node_process_input(dec->node);
+
+	for (iter = 0; iter < MAX_ITER; iter++) {
+		if (res == SPA_STATUS_HAVE_BUFFER) {
+			check_frame(dec, r);
+			res = pull(dec);
+		}
+		else if (res == SPA_STATUS_NEED_BUFFER) {
+			/* the decoder must have taken the packet */
+			spa_assert_se(dec->in.io.status != SPA_STATUS_HAVE_BUFFER);
+			return;
+		}
+		else if (res == SPA_STATUS_OK) {
+			/* the decoder is busy and keeps the packet, try again */
+			spa_assert_se(dec->in.io.status == SPA_STATUS_HAVE_BUFFER);
+			res = pull(dec);
+		}
+		else {
+			spa_assert_se(res >= 0);
+			return;
+		}
+	}
+	spa_assert_se(iter < MAX_ITER);
+}
+
+static void test_round_trip(void)
+{
+	struct codec enc = { 0, }, dec = { 0, };
+	struct result r = { 0, };
+	uint32_t i, iter, n_packets = 0;
+	int res;
+
+	spa_assert_se(make_codec(&enc, true) == 0);
+	spa_assert_se(make_codec(&dec, false) == 0);
+
+	for (i = 0; i < N_FRAMES; i++) {
+		fill_frame(enc.in.buffers[0].data, i);
+		enc.in.buffers[0].chunks[0].size = FRAME_SIZE;
+
+		enc.in.io.buffer_id = 0;
+		enc.in.io.status = SPA_STATUS_HAVE_BUFFER;
+		res = spa_node_process_input(enc.node);
+
+		for (iter = 0; iter < MAX_ITER; iter++) {
+			if (res == SPA_STATUS_HAVE_BUFFER) {
+				decode_packet(&enc, &dec, &r);
+				n_packets++;
+				res = pull(&enc);
+			}
+			else if (res == SPA_STATUS_NEED_BUFFER) {
+				/* the encoder must have taken the frame */
+				spa_assert_se(enc.in.io.status != SPA_STATUS_HAVE_BUFFER);
+				break;
+			}
+			else if (res == SPA_STATUS_OK) {
+				spa_assert_se(enc.in.io.status == SPA_STATUS_HAVE_BUFFER);
+				res = pull(&enc);
+			}
+			else {
+				spa_assert_se(res >= 0);
+				break;
+			}
+		}
+		spa_assert_se(iter < MAX_ITER);
+	}
+
+	printf("%d frames: %d packets, %d frames decoded, %d wrong\n",
+	       N_FRAMES, n_packets, r.n_frames, r.n_wrong);
+
+	spa_assert_se(n_packets + MAX_DELAY >= N_FRAMES);
+	spa_assert_se(r.n_frames + MAX_DELAY >= N_FRAMES);
+	/* a lost packet shifts all the frames after it */
+	spa_assert_se(r.n_wrong == 0);
+
+	destroy_codec(&dec);
+	destroy_codec(&enc);
+}
+
+int main(int argc, char *argv[])
+{
+	init_type(&type, &default_map.map);
+	default_log.log.level = SPA_LOG_LEVEL_ERROR;
+
+#if LIBAVCODEC_VERSION_MAJOR < 58
+	avcodec_register_all();
+#endif
+	test_round_trip();
+
+	return 0;
+}
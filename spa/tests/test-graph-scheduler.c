@@ -0,0 +1,209 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/graph/graph.h>
+#include <spa/graph/graph-scheduler6.h>
+
+/* The default scheduler runs a node with several ports once, when all the
+ * ports of the node are ready. A mixer with two sources is pulled by a
+ * sink and a tee pushes to two sinks that pull again. */
+
+#define N_CYCLES	4
+#define MAX_PORTS	2
+
+struct node {
+	struct spa_node impl;
+	struct spa_graph_node node;
+	struct spa_graph_port in[MAX_PORTS];
+	struct spa_graph_port out[MAX_PORTS];
+	uint32_t n_in;
+	uint32_t n_out;
+	int count;
+};
+
+static void set_status(struct spa_graph_port *ports, uint32_t n_ports, int status)
+{
+	uint32_t i;
+
+	for (i = 0; i < n_ports; i++)
+		ports[i].io->status = status;
+}
+
+static bool has_status(struct spa_graph_port *ports, uint32_t n_ports, int status)
+{
+	uint32_t i;
+
+	for (i = 0; i < n_ports; i++) {
+		if (ports[i].io->status != status)
+			return false;
+	}
+	return true;
+}
+
+/* makes a buffer on all outputs when all of them were consumed */
+static int source_process_output(struct spa_node *impl)
+{
+	struct node *n = SPA_CONTAINER_OF(impl, struct node, impl);
+
+	spa_assert_se(has_status(n->out, n->n_out, SPA_STATUS_NEED_BUFFER));
+	n->count++;
+	set_status(n->out, n->n_out, SPA_STATUS_HAVE_BUFFER);
+	return SPA_STATUS_HAVE_BUFFER;
+}
+
+/* mixes the inputs when all of them have a buffer */
+static int mixer_process_input(struct spa_node *impl)
+{
+	struct node *n = SPA_CONTAINER_OF(impl, struct node, impl);
+
+	spa_assert_se(has_status(n->in, n->n_in, SPA_STATUS_HAVE_BUFFER));
+	n->count++;
+	set_status(n->in, n->n_in, SPA_STATUS_OK);
+	set_status(n->out, n->n_out, SPA_STATUS_HAVE_BUFFER);
+	return SPA_STATUS_HAVE_BUFFER;
+}
+
+static int mixer_process_output(struct spa_node *impl)
+{
+	struct node *n = SPA_CONTAINER_OF(impl, struct node, impl);
+
+	set_status(n->in, n->n_in, SPA_STATUS_NEED_BUFFER);
+	return SPA_STATUS_NEED_BUFFER;
+}
+
+/* consumes the buffer and asks for the next one for N_CYCLES */
+static int sink_process_input(struct spa_node *impl)
+{
+	struct node *n = SPA_CONTAINER_OF(impl, struct node, impl);
+
+	spa_assert_se(has_status(n->in, n->n_in, SPA_STATUS_HAVE_BUFFER));
+	if (++n->count == N_CYCLES) {
+		set_status(n->in, n->n_in, SPA_STATUS_OK);
+		return SPA_STATUS_OK;
+	}
+	set_status(n->in, n->n_in, SPA_STATUS_NEED_BUFFER);
+	return SPA_STATUS_NEED_BUFFER;
+}
+
+static void init_node(struct spa_graph *graph, struct node *n,
+		      uint32_t n_in, uint32_t n_out,
+		      int (*process_input) (struct spa_node *node),
+		      int (*process_output) (struct spa_node *node))
+{
+	uint32_t i;
+
+	n->impl.version = SPA_VERSION_NODE;
+	n->impl.process_input = process_input;
+	n->impl.process_output = process_output;
+	n->n_in = n_in;
+	n->n_out = n_out;
+	n->count = 0;
+
+	spa_graph_node_init(&n->node);
+	spa_graph_node_set_implementation(&n->node, &n->impl);
+	spa_graph_node_add(graph, &n->node);
+
+	for (i = 0; i < n_in; i++) {
+		spa_graph_port_init(&n->in[i], SPA_DIRECTION_INPUT, i, 0, NULL);
+		spa_graph_port_add(&n->node, &n->in[i]);
+	}
+	for (i = 0; i < n_out; i++) {
+		spa_graph_port_init(&n->out[i], SPA_DIRECTION_OUTPUT, i, 0, NULL);
+		spa_graph_port_add(&n->node, &n->out[i]);
+	}
+}
+
+static void link_ports(struct spa_graph_port *out, struct spa_graph_port *in,
+		       struct spa_io_buffers *io)
+{
+	*io = SPA_IO_BUFFERS_INIT;
+	out->io = in->io = io;
+	spa_graph_port_link(out, in);
+}
+
+static void init_graph(struct spa_graph *graph, struct spa_graph_data *data)
+{
+	spa_graph_init(graph);
+	spa_graph_data_init(data, graph);
+	spa_graph_set_callbacks(graph, &spa_graph_impl_default, data);
+}
+
+static void test_mixer(void)
+{
+	struct spa_graph graph;
+	struct spa_graph_data data;
+	struct node src[2], mixer, sink;
+	struct spa_io_buffers io[3];
+
+	init_graph(&graph, &data);
+	init_node(&graph, &src[0], 0, 1, NULL, source_process_output);
+	init_node(&graph, &src[1], 0, 1, NULL, source_process_output);
+	init_node(&graph, &mixer, 2, 1, mixer_process_input, mixer_process_output);
+	init_node(&graph, &sink, 1, 0, sink_process_input, NULL);
+
+	link_ports(&src[0].out[0], &mixer.in[0], &io[0]);
+	link_ports(&src[1].out[0], &mixer.in[1], &io[1]);
+	link_ports(&mixer.out[0], &sink.in[0], &io[2]);
+
+	/* the mixer runs when both sources made their buffer */
+	io[2].status = SPA_STATUS_NEED_BUFFER;
+	spa_graph_need_input(&graph, &sink.node);
+
+	spa_assert_se(src[0].count == N_CYCLES);
+	spa_assert_se(src[1].count == N_CYCLES);
+	spa_assert_se(mixer.count == N_CYCLES);
+	spa_assert_se(sink.count == N_CYCLES);
+}
+
+static void test_tee(void)
+{
+	struct spa_graph graph;
+	struct spa_graph_data data;
+	struct node tee, sink[2];
+	struct spa_io_buffers io[2];
+
+	init_graph(&graph, &data);
+	init_node(&graph, &tee, 0, 2, NULL, source_process_output);
+	init_node(&graph, &sink[0], 1, 0, sink_process_input, NULL);
+	init_node(&graph, &sink[1], 1, 0, sink_process_input, NULL);
+
+	link_ports(&tee.out[0], &sink[0].in[0], &io[0]);
+	link_ports(&tee.out[1], &sink[1].in[0], &io[1]);
+
+	/* the tee runs again when both sinks consumed its buffers */
+	tee.count = 1;
+	io[0].status = io[1].status = SPA_STATUS_HAVE_BUFFER;
+	spa_graph_have_output(&graph, &tee.node);
+
+	spa_assert_se(tee.count == N_CYCLES);
+	spa_assert_se(sink[0].count == N_CYCLES);
+	spa_assert_se(sink[1].count == N_CYCLES);
+}
+
+int main(int argc, char *argv[])
+{
+	test_mixer();
+	test_tee();
+
+	return 0;
+}
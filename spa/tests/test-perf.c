@@ -17,14 +17,50 @@
  * Boston, MA 02110-1301, USA.
  */
 
+/* Benchmark of the graph schedulers.
+ *
+ * Builds a graph of plugin nodes, runs it synchronously for a number of
+ * cycles and prints one JSON object per benchmark on stdout:
+ *
+ *  {"scheduler":6,"topology":"chain","size":4,"nodes":6,"mode":"pull",
+ *   "iterations":100000,"cycles_per_sec":...,"p50_ns":...,"p99_ns":...,
+ *   "max_ns":...,"ipc":...}
+ *
+ * ipc is the number of instructions per cpu cycle of the measured loop, it
+ * is null when the performance counters are not available.
+ *
+ * The scheduler is selected at build time with GRAPH_SCHEDULER, there is a
+ * test-perf-<n> for each of the schedulers 1 to 6. pw_core uses scheduler 6.
+ *
+ * The sources make one buffer in a cycle, like sources that are woken up
+ * by a timer. When a cycle does not bring exactly one buffer to the sink,
+ * the result has an "error" field instead of the timings. Schedulers 4 and
+ * 5 are unfinished, most of their results are errors.
+ *
+ * The topologies are:
+ *
+ *   chain  fakesrc -> size x volume -> fakesink
+ *   mixer  size x fakesrc -> audiomixer -> fakesink
+ *   fan    size x (fakesrc -> volume) -> audiomixer -> fakesink
+ *
+ * Without -t, all topologies are run with a set of sizes or with the size
+ * given with -n. Push mode only runs the chain. The plugins are
+ * loaded from SPA_PLUGIN_DIR, build/spa/plugins by default.
+ */
+
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <dlfcn.h>
 #include <errno.h>
-#include <pthread.h>
-#include <poll.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 
 #include <spa/support/log-impl.h>
 #include <spa/support/loop.h>
@@ -35,58 +71,86 @@
 #include <spa/param/props.h>
 #include <spa/param/audio/format-utils.h>
 #include <spa/param/format-utils.h>
+
+#ifndef GRAPH_SCHEDULER
+#define GRAPH_SCHEDULER 6
+#endif
+
 #include <spa/graph/graph.h>
+#if GRAPH_SCHEDULER == 1
 #include <spa/graph/graph-scheduler1.h>
-
-#define MODE_SYNC_PUSH          (1<<0)
-#define MODE_SYNC_PULL          (1<<1)
-#define MODE_ASYNC_PUSH         (1<<2)
-#define MODE_ASYNC_PULL         (1<<3)
-#define MODE_ASYNC_BOTH         (MODE_ASYNC_PUSH|MODE_ASYNC_PULL)
-#define MODE_DIRECT             (1<<4)
+#elif GRAPH_SCHEDULER == 2
+#include <spa/graph/graph-scheduler2.h>
+#elif GRAPH_SCHEDULER == 3
+#include <spa/graph/graph-scheduler3.h>
+struct spa_graph_data {
+	struct spa_graph *graph;
+};
+static inline void spa_graph_data_init(struct spa_graph_data *data,
+				       struct spa_graph *graph)
+{
+	data->graph = graph;
+}
+#elif GRAPH_SCHEDULER == 4
+#include <spa/graph/graph-scheduler4.h>
+#elif GRAPH_SCHEDULER == 5
+#include <spa/graph/graph-scheduler5.h>
+#elif GRAPH_SCHEDULER == 6
+#include <spa/graph/graph-scheduler6.h>
+#else
+#error "unsupported GRAPH_SCHEDULER"
+#endif
 
 static SPA_TYPE_MAP_IMPL(default_map, 4096);
 static SPA_LOG_IMPL(default_log);
 
 struct type {
 	uint32_t node;
-	uint32_t props;
 	uint32_t format;
-	uint32_t props_device;
-	uint32_t props_freq;
-	uint32_t props_volume;
-	uint32_t props_min_latency;
-	uint32_t props_live;
 	struct spa_type_io io;
 	struct spa_type_param param;
 	struct spa_type_meta meta;
 	struct spa_type_data data;
 	struct spa_type_media_type media_type;
 	struct spa_type_media_subtype media_subtype;
-	struct spa_type_event_node event_node;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
 	struct spa_type_command_node command_node;
 };
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
 	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
-	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
 	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
-	type->props_device = spa_type_map_get_id(map, SPA_TYPE_PROPS__device);
-	type->props_freq = spa_type_map_get_id(map, SPA_TYPE_PROPS__frequency);
-	type->props_volume = spa_type_map_get_id(map, SPA_TYPE_PROPS__volume);
-	type->props_min_latency = spa_type_map_get_id(map, SPA_TYPE_PROPS__minLatency);
-	type->props_live = spa_type_map_get_id(map, SPA_TYPE_PROPS__live);
 	spa_type_io_map(map, &type->io);
 	spa_type_param_map(map, &type->param);
 	spa_type_meta_map(map, &type->meta);
 	spa_type_data_map(map, &type->data);
 	spa_type_media_type_map(map, &type->media_type);
 	spa_type_media_subtype_map(map, &type->media_subtype);
-	spa_type_event_node_map(map, &type->event_node);
+	spa_type_format_audio_map(map, &type->format_audio);
+	spa_type_audio_format_map(map, &type->audio_format);
 	spa_type_command_node_map(map, &type->command_node);
 }
 
+#define MODE_PUSH	0
+#define MODE_PULL	1
+
+#define TOPOLOGY_CHAIN	0
+#define TOPOLOGY_MIXER	1
+#define TOPOLOGY_FAN	2
+
+static const char *mode_names[] = { "push", "pull" };
+static const char *topology_names[] = { "chain", "mixer", "fan" };
+
+#define MAX_NODES	256
+#define MAX_LINKS	256
+#define MAX_LIBS	8
+
+#define N_BUFFERS	2
+#define MIN_LATENCY	64
+#define BUFFER_SIZE	(MIN_LATENCY * 2 * sizeof(int16_t))
+
 struct buffer {
 	struct spa_buffer buffer;
 	struct spa_meta metas[1];
@@ -95,50 +159,86 @@ struct buffer {
 	struct spa_chunk chunks[1];
 };
 
+/* a source as seen by the scheduler, it makes one buffer in a cycle like a
+ * source that is woken up by a timer */
+struct source {
+	struct spa_node node;
+	struct spa_node *impl;
+	struct spa_io_buffers *io;
+	const uint64_t *cycle;
+	uint64_t last;
+};
+
+struct node {
+	struct spa_handle *handle;
+	struct spa_node *node;
+	struct spa_graph_node graph_node;
+	uint32_t n_input_ports;
+	struct source source;
+};
+
+struct link {
+	struct spa_io_buffers io;
+	struct spa_graph_port out;
+	struct spa_graph_port in;
+	struct spa_buffer *buffers[N_BUFFERS];
+	struct buffer buffer[N_BUFFERS];
+};
+
+/* the sink as seen by the scheduler, it counts the buffers that reach it */
+struct sink {
+	struct spa_node node;
+	struct spa_node *impl;
+	struct spa_io_buffers *io;
+	bool push;
+	uint64_t consumed;
+};
+
+struct lib {
+	const char *name;
+	void *hnd;
+};
+
 struct data {
 	struct spa_type_map *map;
 	struct spa_log *log;
 	struct spa_loop data_loop;
 	struct type type;
 
-	int mode;
-
 	struct spa_support support[4];
 	uint32_t n_support;
 
-	int iterations;
+	const char *plugin_dir;
+	struct lib libs[MAX_LIBS];
+	uint32_t n_libs;
 
 	struct spa_graph graph;
 	struct spa_graph_data graph_data;
-	struct spa_graph_node source_node;
-	struct spa_graph_port source_out;
-	struct spa_graph_port sink_in;
-	struct spa_graph_node sink_node;
 
-	struct spa_node *sink;
-	struct spa_io_buffers source_sink_io[1];
+	struct node nodes[MAX_NODES];
+	uint32_t n_nodes;
+	struct link links[MAX_LINKS];
+	uint32_t n_links;
 
-	struct spa_node *source;
-	struct spa_buffer *source_buffers[1];
-	struct buffer source_buffer[1];
+	struct node *source;
+	uint32_t n_sources;
+	struct node *sink_node;
+	struct sink sink;
+	uint64_t cycle;
 
-	bool running;
-	pthread_t thread;
-
-	struct spa_source sources[16];
-	unsigned int n_sources;
+	struct spa_pod *format;
+	uint8_t format_buffer[1024];
 
-	bool rebuild_fds;
-	struct pollfd fds[16];
-	unsigned int n_fds;
+	int perf_fd[2];
 
-	void *hnd;
+	int mode;
+	int topology;
+	uint32_t size;
+	uint32_t iterations;
+	uint32_t warmup;
+	uint64_t *times;
 };
 
-#define MIN_LATENCY     64
-
-#define BUFFER_SIZE    MIN_LATENCY
-
 static void
 init_buffer(struct data *data, struct spa_buffer **bufs, struct buffer *ba, int n_buffers,
 	    size_t size)
@@ -168,7 +268,7 @@ init_buffer(struct data *data, struct spa_buffer **bufs, struct buffer *ba, int
 		b->datas[0].fd = -1;
 		b->datas[0].mapoffset = 0;
 		b->datas[0].maxsize = size;
-		b->datas[0].data = malloc(size);
+		b->datas[0].data = calloc(1, size);
 		b->datas[0].chunk = &b->chunks[0];
 		b->datas[0].chunk->offset = 0;
 		b->datas[0].chunk->size = size;
@@ -176,22 +276,50 @@ init_buffer(struct data *data, struct spa_buffer **bufs, struct buffer *ba, int
 	}
 }
 
-static int make_node(struct data *data, struct spa_node **node, const char *lib, const char *name)
+static void *load_lib(struct data *data, const char *name)
 {
-	struct spa_handle *handle;
+	char path[PATH_MAX];
+	struct lib *l;
+	uint32_t i;
+
+	for (i = 0; i < data->n_libs; i++) {
+		if (strcmp(data->libs[i].name, name) == 0)
+			return data->libs[i].hnd;
+	}
+	if (data->n_libs == MAX_LIBS)
+		return NULL;
+
+	snprintf(path, sizeof(path), "%s/%s", data->plugin_dir, name);
+
+	l = &data->libs[data->n_libs];
+	if ((l->hnd = dlopen(path, RTLD_NOW)) == NULL) {
+		fprintf(stderr, "can't load %s: %s\n", path, dlerror());
+		return NULL;
+	}
+	l->name = name;
+	data->n_libs++;
+
+	return l->hnd;
+}
+
+static struct node *make_node(struct data *data, const char *lib, const char *name)
+{
+	struct node *node;
+	void *hnd;
 	int res;
 	spa_handle_factory_enum_func_t enum_func;
 	uint32_t i;
 
-	if (data->hnd == NULL) {
-		if ((data->hnd = dlopen(lib, RTLD_NOW)) == NULL) {
-			printf("can't load %s: %s\n", lib, dlerror());
-			return -errno;
-		}
+	if (data->n_nodes == MAX_NODES) {
+		fprintf(stderr, "too many nodes\n");
+		return NULL;
 	}
-	if ((enum_func = dlsym(data->hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
-		printf("can't find enum function\n");
-		return -errno;
+	if ((hnd = load_lib(data, lib)) == NULL)
+		return NULL;
+
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		fprintf(stderr, "can't find enum function\n");
+		return NULL;
 	}
 
 	for (i = 0;;) {
@@ -200,350 +328,553 @@ static int make_node(struct data *data, struct spa_node **node, const char *lib,
 
 		if ((res = enum_func(&factory, &i)) <= 0) {
 			if (res != 0)
-				printf("can't enumerate factories: %s\n", spa_strerror(res));
+				fprintf(stderr, "can't enumerate factories: %s\n", spa_strerror(res));
 			break;
 		}
 		if (strcmp(factory->name, name))
 			continue;
 
-		handle = calloc(1, factory->size);
-		if ((res =
-		     spa_handle_factory_init(factory, handle, NULL, data->support,
-					     data->n_support)) < 0) {
-			printf("can't make factory instance: %d\n", res);
-			return res;
+		node = &data->nodes[data->n_nodes];
+		node->handle = calloc(1, factory->size);
+		if ((res = spa_handle_factory_init(factory, node->handle, NULL,
+						   data->support, data->n_support)) < 0) {
+			fprintf(stderr, "can't make factory instance: %d\n", res);
+			free(node->handle);
+			return NULL;
 		}
-		if ((res = spa_handle_get_interface(handle, data->type.node, &iface)) < 0) {
-			printf("can't get interface %d\n", res);
-			return res;
+		if ((res = spa_handle_get_interface(node->handle, data->type.node, &iface)) < 0) {
+			fprintf(stderr, "can't get interface %d\n", res);
+			spa_handle_clear(node->handle);
+			free(node->handle);
+			return NULL;
 		}
-		*node = iface;
-		return 0;
-	}
-	return -EBADF;
-}
+		node->node = iface;
+		node->n_input_ports = 0;
+		spa_zero(node->source);
 
-static void on_sink_pull(struct data *data)
-{
-	spa_log_trace(data->log, "do sink pull");
-	data->sink_node.state = SPA_STATUS_NEED_BUFFER;
-	if (data->mode & MODE_DIRECT) {
-		spa_node_process_output(data->source);
-		spa_node_process_input(data->sink);
-	} else {
-		spa_graph_need_input(&data->graph, &data->sink_node);
+		spa_graph_node_init(&node->graph_node);
+		spa_graph_node_set_implementation(&node->graph_node, node->node);
+		spa_graph_node_add(&data->graph, &node->graph_node);
+
+		data->n_nodes++;
+		return node;
 	}
+	fprintf(stderr, "can't find factory %s\n", name);
+	return NULL;
 }
 
-static void on_source_push(struct data *data)
+/* the nodes run synchronously, their timers are never dispatched */
+static int do_add_source(struct spa_loop *loop, struct spa_source *source)
 {
-	spa_log_trace(data->log, "do source push");
-	if (data->mode & MODE_DIRECT) {
-		spa_node_process_output(data->source);
-		spa_node_process_input(data->sink);
-	} else {
-		spa_graph_have_output(&data->graph, &data->source_node);
-	}
+	return 0;
 }
 
-static void on_sink_done(void *_data, int seq, int res)
+static int do_update_source(struct spa_source *source)
 {
-	struct data *data = _data;
-	spa_log_trace(data->log, "got sink done %d %d", seq, res);
+	return 0;
 }
 
-static void on_sink_event(void *_data, struct spa_event *event)
+static void do_remove_source(struct spa_source *source)
 {
-	struct data *data = _data;
-	spa_log_trace(data->log, "got sink event %d", SPA_EVENT_TYPE(event));
 }
 
-static void on_sink_need_input(void *_data)
+static int
+do_invoke(struct spa_loop *loop,
+	  spa_invoke_func_t func, uint32_t seq, const void *data, size_t size, bool block, void *user_data)
 {
-	struct data *data = _data;
-	spa_log_trace(data->log, "need input");
-	on_sink_pull(data);
-	if (--data->iterations == 0)
-		data->running = false;
+	return func(loop, false, seq, data, size, user_data);
 }
 
-static void
-on_sink_reuse_buffer(void *_data, uint32_t port_id, uint32_t buffer_id)
+static int sink_process_input(struct spa_node *node)
 {
-	struct data *data = _data;
+	struct sink *s = SPA_CONTAINER_OF(node, struct sink, node);
+	int res;
 
-	data->source_sink_io[0].buffer_id = buffer_id;
+	/* the fakesink can't be called without a buffer */
+	if (s->io->status != SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_NEED_BUFFER;
+
+	res = spa_node_process_input(s->impl);
+	s->consumed++;
+
+#if GRAPH_SCHEDULER != 1 && GRAPH_SCHEDULER != 2
+	/* the recursive schedulers pull again right away when the sink needs a
+	 * buffer, end the cycle in the sink like an async sink does. In push
+	 * mode the pull makes the filters recycle and ask for a new buffer, the
+	 * cycle ends in the source. */
+	if (res == SPA_STATUS_NEED_BUFFER && !s->push)
+		res = SPA_STATUS_OK;
+#endif
+	return res;
 }
 
-static const struct spa_node_callbacks sink_callbacks = {
-	SPA_VERSION_NODE_CALLBACKS,
-	.done = on_sink_done,
-	.event = on_sink_event,
-	.need_input = on_sink_need_input,
-	.reuse_buffer = on_sink_reuse_buffer
-};
-
-static void on_source_done(void *_data, int seq, int res)
+static int sink_process_output(struct spa_node *node)
 {
-	struct data *data = _data;
-	spa_log_trace(data->log, "got source done %d %d", seq, res);
+	return -ENOTSUP;
 }
 
-static void on_source_event(void *_data, struct spa_event *event)
+static int source_process_input(struct spa_node *node)
 {
-	struct data *data = _data;
-	spa_log_trace(data->log, "got source event %d", SPA_EVENT_TYPE(event));
+	return -ENOTSUP;
 }
 
-static void on_source_have_output(void *_data)
+static int source_process_output(struct spa_node *node)
 {
-	struct data *data = _data;
-	spa_log_trace(data->log, "have_output");
-	on_source_push(data);
-	if (--data->iterations == 0)
-		data->running = false;
-}
+	struct source *s = SPA_CONTAINER_OF(node, struct source, node);
 
-static const struct spa_node_callbacks source_callbacks = {
-	SPA_VERSION_NODE_CALLBACKS,
-	.done = on_source_done,
-	.event = on_source_event,
-	.have_output = on_source_have_output
-};
+	/* the schedulers that have no end of the cycle ask again right away,
+	 * the next buffer is made in the next cycle */
+	if (s->last == *s->cycle && s->io->status != SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_OK;
 
+	s->last = *s->cycle;
+	return spa_node_process_output(s->impl);
+}
 
-static int do_add_source(struct spa_loop *loop, struct spa_source *source)
+static int link_nodes(struct data *data,
+		      struct node *out, uint32_t out_port,
+		      struct node *in, uint32_t in_port)
 {
-	struct data *data = SPA_CONTAINER_OF(loop, struct data, data_loop);
+	struct link *l;
+	int res;
+
+	if (data->n_links == MAX_LINKS) {
+		fprintf(stderr, "too many links\n");
+		return -ENOSPC;
+	}
+	l = &data->links[data->n_links++];
+
+	l->io = SPA_IO_BUFFERS_INIT;
+	if (out->source.impl)
+		out->source.io = &l->io;
+
+	if ((res = spa_node_port_set_io(out->node, SPA_DIRECTION_OUTPUT, out_port,
+					data->type.io.Buffers, &l->io, sizeof(l->io))) < 0)
+		return res;
+	if ((res = spa_node_port_set_io(in->node, SPA_DIRECTION_INPUT, in_port,
+					data->type.io.Buffers, &l->io, sizeof(l->io))) < 0)
+		return res;
+
+	if ((res = spa_node_port_set_param(out->node, SPA_DIRECTION_OUTPUT, out_port,
+					   data->type.param.idFormat, 0, data->format)) < 0)
+		return res;
+	if ((res = spa_node_port_set_param(in->node, SPA_DIRECTION_INPUT, in_port,
+					   data->type.param.idFormat, 0, data->format)) < 0)
+		return res;
+
+	init_buffer(data, l->buffers, l->buffer, N_BUFFERS, BUFFER_SIZE);
+
+	if ((res = spa_node_port_use_buffers(in->node, SPA_DIRECTION_INPUT, in_port,
+					     l->buffers, N_BUFFERS)) < 0)
+		return res;
+	if ((res = spa_node_port_use_buffers(out->node, SPA_DIRECTION_OUTPUT, out_port,
+					     l->buffers, N_BUFFERS)) < 0)
+		return res;
 
-	data->sources[data->n_sources] = *source;
-	data->n_sources++;
-	data->rebuild_fds = true;
+	/* the audiomixer resets the io when it gets buffers */
+	l->io.status = SPA_STATUS_NEED_BUFFER;
+
+	spa_graph_port_init(&l->out, SPA_DIRECTION_OUTPUT, out_port, 0, &l->io);
+	spa_graph_port_add(&out->graph_node, &l->out);
+	spa_graph_port_init(&l->in, SPA_DIRECTION_INPUT, in_port, 0, &l->io);
+	spa_graph_port_add(&in->graph_node, &l->in);
+	spa_graph_port_link(&l->out, &l->in);
 
 	return 0;
 }
 
-static int do_update_source(struct spa_source *source)
+#define PLUGIN_TEST		"test/libspa-test.so"
+#define PLUGIN_VOLUME		"volume/libspa-volume.so"
+#define PLUGIN_AUDIOMIXER	"audiomixer/libspa-audiomixer.so"
+
+static struct node *make_source(struct data *data)
 {
-	return 0;
+	struct node *n;
+
+	if ((n = make_node(data, PLUGIN_TEST, "fakesrc")) == NULL)
+		return NULL;
+
+	n->source.node.version = SPA_VERSION_NODE;
+	n->source.node.process_input = source_process_input;
+	n->source.node.process_output = source_process_output;
+	n->source.impl = n->node;
+	n->source.cycle = &data->cycle;
+	n->source.last = data->cycle;
+	spa_graph_node_set_implementation(&n->graph_node, &n->source.node);
+
+	if (data->n_sources++ == 0)
+		data->source = n;
+	return n;
 }
 
-static void do_remove_source(struct spa_source *source)
+static int link_to_mixer(struct data *data, struct node *out, struct node *mix)
 {
+	uint32_t port_id = mix->n_input_ports++;
+	int res;
+
+	if ((res = spa_node_add_port(mix->node, SPA_DIRECTION_INPUT, port_id)) < 0)
+		return res;
+
+	return link_nodes(data, out, 0, mix, port_id);
 }
 
-static int
-do_invoke(struct spa_loop *loop,
-	  spa_invoke_func_t func, uint32_t seq, const void *data, size_t size, bool block, void *user_data)
+static int make_graph(struct data *data)
 {
-	return func(loop, false, seq, data, size, user_data);
+	struct node *prev, *n, *mix = NULL;
+	uint32_t i;
+	int res;
+
+	if ((data->sink_node = make_node(data, PLUGIN_TEST, "fakesink")) == NULL)
+		return -EIO;
+
+	switch (data->topology) {
+	case TOPOLOGY_CHAIN:
+		if ((prev = make_source(data)) == NULL)
+			return -EIO;
+		for (i = 0; i < data->size; i++) {
+			if ((n = make_node(data, PLUGIN_VOLUME, "volume")) == NULL)
+				return -EIO;
+			if ((res = link_nodes(data, prev, 0, n, 0)) < 0)
+				return res;
+			prev = n;
+		}
+		break;
+
+	case TOPOLOGY_MIXER:
+	case TOPOLOGY_FAN:
+		if ((mix = make_node(data, PLUGIN_AUDIOMIXER, "audiomixer")) == NULL)
+			return -EIO;
+		for (i = 0; i < data->size; i++) {
+			if ((prev = make_source(data)) == NULL)
+				return -EIO;
+			if (data->topology == TOPOLOGY_FAN) {
+				if ((n = make_node(data, PLUGIN_VOLUME, "volume")) == NULL)
+					return -EIO;
+				if ((res = link_nodes(data, prev, 0, n, 0)) < 0)
+					return res;
+				prev = n;
+			}
+			if ((res = link_to_mixer(data, prev, mix)) < 0)
+				return res;
+		}
+		prev = mix;
+		break;
+
+	default:
+		return -EINVAL;
+	}
+
+	if ((res = link_nodes(data, prev, 0, data->sink_node, 0)) < 0)
+		return res;
+
+	data->sink.node.version = SPA_VERSION_NODE;
+	data->sink.node.process_input = sink_process_input;
+	data->sink.node.process_output = sink_process_output;
+	data->sink.impl = data->sink_node->node;
+	data->sink.io = &data->links[data->n_links - 1].io;
+	data->sink.push = data->mode == MODE_PUSH;
+	spa_graph_node_set_implementation(&data->sink_node->graph_node, &data->sink.node);
+
+	return 0;
 }
 
-static int make_nodes(struct data *data)
+static int make_format(struct data *data)
 {
+	struct spa_pod_builder b = { 0 };
+
+	spa_pod_builder_init(&b, data->format_buffer, sizeof(data->format_buffer));
+	data->format = spa_pod_builder_object(&b,
+		0, data->type.format,
+		"I", data->type.media_type.audio,
+		"I", data->type.media_subtype.raw,
+		":", data->type.format_audio.format,   "I", data->type.audio_format.S16,
+		":", data->type.format_audio.layout,   "i", SPA_AUDIO_LAYOUT_INTERLEAVED,
+		":", data->type.format_audio.rate,     "i", 44100,
+		":", data->type.format_audio.channels, "i", 2);
+
+	return data->format ? 0 : -ENOSPC;
+}
+
+static void send_command(struct data *data, uint32_t id)
+{
+	struct spa_command cmd = SPA_COMMAND_INIT(id);
+	uint32_t i;
 	int res;
 
-	if ((res = make_node(data, &data->sink,
-			     "build/spa/plugins/test/libspa-test.so", "fakesink")) < 0) {
-		printf("can't create fakesink: %d\n", res);
-		return res;
+	for (i = 0; i < data->n_nodes; i++) {
+		if ((res = spa_node_send_command(data->nodes[i].node, &cmd)) < 0)
+			fprintf(stderr, "node %d: got command error %d\n", i, res);
 	}
+}
 
-	if (data->mode & MODE_ASYNC_PULL)
-		spa_node_set_callbacks(data->sink, &sink_callbacks, data);
+static void clear_graph(struct data *data)
+{
+	uint32_t i, j;
 
-	if ((res = make_node(data, &data->source,
-			     "build/spa/plugins/test/libspa-test.so", "fakesrc")) < 0) {
-		printf("can't create fakesrc: %d\n", res);
-		return res;
+	for (i = 0; i < data->n_nodes; i++) {
+		spa_handle_clear(data->nodes[i].handle);
+		free(data->nodes[i].handle);
+	}
+	for (i = 0; i < data->n_links; i++) {
+		for (j = 0; j < N_BUFFERS; j++)
+			free(data->links[i].buffer[j].datas[0].data);
 	}
+	data->n_nodes = data->n_links = data->n_sources = 0;
+	data->source = data->sink_node = NULL;
+	spa_zero(data->sink);
+	spa_graph_init(&data->graph);
+}
+
+static int perf_open(uint64_t config, int group)
+{
+	struct perf_event_attr attr;
 
-	if (data->mode & MODE_ASYNC_PUSH)
-		spa_node_set_callbacks(data->source, &source_callbacks, data);
+	spa_zero(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = config;
+	attr.disabled = group == -1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
 
-	data->source_sink_io[0] = SPA_IO_BUFFERS_INIT;
-	data->source_sink_io[0].status = SPA_STATUS_NEED_BUFFER;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
 
-	spa_node_port_set_io(data->source,
-			     SPA_DIRECTION_OUTPUT, 0,
-			     data->type.io.Buffers,
-			     &data->source_sink_io[0], sizeof(data->source_sink_io[0]));
-	spa_node_port_set_io(data->sink,
-			     SPA_DIRECTION_INPUT, 0,
-			     data->type.io.Buffers,
-			     &data->source_sink_io[0], sizeof(data->source_sink_io[0]));
+static void perf_init(struct data *data)
+{
+	data->perf_fd[0] = perf_open(PERF_COUNT_HW_INSTRUCTIONS, -1);
+	if (data->perf_fd[0] < 0) {
+		data->perf_fd[1] = -1;
+		return;
+	}
+	data->perf_fd[1] = perf_open(PERF_COUNT_HW_CPU_CYCLES, data->perf_fd[0]);
+	if (data->perf_fd[1] < 0) {
+		close(data->perf_fd[0]);
+		data->perf_fd[0] = -1;
+	}
+}
 
-	spa_graph_node_init(&data->source_node);
-	spa_graph_node_set_implementation(&data->source_node, data->source);
-	spa_graph_node_add(&data->graph, &data->source_node);
+static void perf_start(struct data *data)
+{
+	if (data->perf_fd[0] < 0)
+		return;
+	ioctl(data->perf_fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(data->perf_fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
 
-	data->source_node.flags = (data->mode & MODE_ASYNC_PUSH) ? SPA_GRAPH_NODE_FLAG_ASYNC : 0;
-	spa_graph_port_init( &data->source_out, SPA_DIRECTION_OUTPUT, 0, 0, &data->source_sink_io[0]);
-	spa_graph_port_add(&data->source_node, &data->source_out);
+static double perf_stop(struct data *data)
+{
+	uint64_t instructions, cycles;
 
-	spa_graph_node_init(&data->sink_node);
-	spa_graph_node_set_implementation(&data->sink_node, data->sink);
-	spa_graph_node_add(&data->graph, &data->sink_node);
+	if (data->perf_fd[0] < 0)
+		return -1.0;
 
-	data->sink_node.flags = (data->mode & MODE_ASYNC_PULL) ? SPA_GRAPH_NODE_FLAG_ASYNC : 0;
-	spa_graph_port_init(&data->sink_in, SPA_DIRECTION_INPUT, 0, 0, &data->source_sink_io[0]);
-	spa_graph_port_add(&data->sink_node, &data->sink_in);
+	ioctl(data->perf_fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
 
-	spa_graph_port_link(&data->source_out, &data->sink_in);
+	if (read(data->perf_fd[0], &instructions, sizeof(instructions)) != sizeof(instructions) ||
+	    read(data->perf_fd[1], &cycles, sizeof(cycles)) != sizeof(cycles) ||
+	    cycles == 0)
+		return -1.0;
 
-	return res;
+	return (double) instructions / cycles;
 }
 
-static int negotiate_formats(struct data *data)
+static inline uint64_t get_time(void)
 {
-	int res;
-	struct spa_pod *format;
-	struct spa_pod_builder b = { 0 };
-	uint8_t buffer[256];
-
-	spa_pod_builder_init(&b, buffer, sizeof(buffer));
-	format = spa_pod_builder_object(&b,
-			0, data->type.format,
-			"I", data->type.media_type.binary,
-			"I", data->type.media_subtype.raw);
-
-	if ((res = spa_node_port_set_param(data->sink,
-					   SPA_DIRECTION_INPUT, 0,
-					   data->type.param.idFormat, 0,
-					   format)) < 0)
-		return res;
-
-	if ((res = spa_node_port_set_param(data->source,
-					   SPA_DIRECTION_OUTPUT, 0,
-					   data->type.param.idFormat, 0,
-					   format)) < 0)
-		return res;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
 
-	init_buffer(data, data->source_buffers, data->source_buffer, 1, BUFFER_SIZE);
+static inline void run_cycle(struct data *data)
+{
+	data->cycle++;
 
-	if ((res =
-	     spa_node_port_use_buffers(data->sink, SPA_DIRECTION_INPUT, 0, data->source_buffers,
-				       1)) < 0)
-		return res;
-	if ((res =
-	     spa_node_port_use_buffers(data->source, SPA_DIRECTION_OUTPUT, 0, data->source_buffers,
-				       1)) < 0)
-		return res;
+	if (data->mode == MODE_PUSH) {
+		if (spa_node_process_output(&data->source->source.node) == SPA_STATUS_HAVE_BUFFER)
+			spa_graph_have_output(&data->graph, &data->source->graph_node);
+	} else {
+		data->sink_node->graph_node.state = SPA_STATUS_NEED_BUFFER;
+		spa_graph_need_input(&data->graph, &data->sink_node->graph_node);
+	}
+}
 
-	return 0;
+static int compare_time(const void *a, const void *b)
+{
+	uint64_t ta = *(const uint64_t *) a, tb = *(const uint64_t *) b;
+	return ta < tb ? -1 : ta > tb ? 1 : 0;
 }
 
-static void *loop(void *user_data)
+static int run_graph(struct data *data)
 {
-	struct data *data = user_data;
+	uint64_t start, stop, t, consumed;
+	uint32_t i;
+	double ipc;
 
-	printf("enter thread %d\n", data->n_sources);
-	while (data->running) {
-		int i, r;
+	send_command(data, data->type.command_node.Start);
 
-		/* rebuild */
-		if (data->rebuild_fds) {
-			for (i = 0; i < data->n_sources; i++) {
-				struct spa_source *p = &data->sources[i];
-				data->fds[i].fd = p->fd;
-				data->fds[i].events = p->mask;
-			}
-			data->n_fds = data->n_sources;
-			data->rebuild_fds = false;
-		}
+	for (i = 0; i < data->warmup; i++)
+		run_cycle(data);
 
-		r = poll(data->fds, data->n_fds, -1);
-		if (r < 0) {
-			if (errno == EINTR)
-				continue;
-			break;
-		}
-		if (r == 0) {
-			fprintf(stderr, "select timeout");
-			break;
-		}
+	consumed = data->sink.consumed;
 
-		/* after */
-		for (i = 0; i < data->n_sources; i++) {
-			struct spa_source *p = &data->sources[i];
-			p->rmask = 0;
-			if (data->fds[i].revents & POLLIN)
-				p->rmask |= SPA_IO_IN;
-			if (data->fds[i].revents & POLLOUT)
-				p->rmask |= SPA_IO_OUT;
-			if (data->fds[i].revents & POLLHUP)
-				p->rmask |= SPA_IO_HUP;
-			if (data->fds[i].revents & POLLERR)
-				p->rmask |= SPA_IO_ERR;
-		}
-		for (i = 0; i < data->n_sources; i++) {
-			struct spa_source *p = &data->sources[i];
-			if (p->rmask)
-				p->func(p);
-		}
+	perf_start(data);
+	start = t = get_time();
+	for (i = 0; i < data->iterations; i++) {
+		uint64_t now;
+
+		run_cycle(data);
+
+		now = get_time();
+		data->times[i] = now - t;
+		t = now;
+	}
+	stop = t;
+	ipc = perf_stop(data);
+
+	send_command(data, data->type.command_node.Pause);
+
+	printf("{\"scheduler\":%d,\"topology\":\"%s\",\"size\":%u,\"nodes\":%u,"
+	       "\"mode\":\"%s\",\"iterations\":%u",
+	       GRAPH_SCHEDULER, topology_names[data->topology], data->size, data->n_nodes,
+	       mode_names[data->mode], data->iterations);
+
+	/* every cycle must bring one buffer to the sink */
+	consumed = data->sink.consumed - consumed;
+	if (consumed != data->iterations) {
+		printf(",\"error\":\"%"PRIu64" buffers in %u cycles\"}\n",
+		       consumed, data->iterations);
+		fflush(stdout);
+		return 0;
 	}
-	printf("leave thread\n");
 
-	return NULL;
+	qsort(data->times, data->iterations, sizeof(uint64_t), compare_time);
+
+	printf(",\"cycles_per_sec\":%.0f,\"p50_ns\":%"PRIu64",\"p99_ns\":%"PRIu64
+	       ",\"max_ns\":%"PRIu64,
+	       stop > start ? (double) data->iterations * SPA_NSEC_PER_SEC / (stop - start) : 0.0,
+	       data->times[data->iterations / 2],
+	       data->times[(uint64_t) data->iterations * 99 / 100],
+	       data->times[data->iterations - 1]);
+	if (ipc < 0.0)
+		printf(",\"ipc\":null}\n");
+	else
+		printf(",\"ipc\":%.3f}\n", ipc);
+	fflush(stdout);
+
+	return 0;
 }
 
-static void run_graph(struct data *data)
+static int run_benchmark(struct data *data, int topology, uint32_t size)
 {
 	int res;
-	int err, i;
-	struct timespec now;
-	int64_t start, stop;
-
-	{
-		struct spa_command cmd = SPA_COMMAND_INIT(data->type.command_node.Start);
-		if ((res = spa_node_send_command(data->source, &cmd)) < 0)
-			printf("got source error %d\n", res);
-		if ((res = spa_node_send_command(data->sink, &cmd)) < 0)
-			printf("got sink error %d\n", res);
-	}
 
-	clock_gettime(CLOCK_MONOTONIC, &now);
-	start = SPA_TIMESPEC_TO_TIME(&now);
-
-	printf("running\n");
+	data->topology = topology;
+	data->size = size;
 
-	if (data->mode & MODE_SYNC_PUSH) {
-		for (i = 0; i < data->iterations; i++)
-			on_source_push(data);
-	} else if (data->mode & MODE_SYNC_PULL) {
-		for (i = 0; i < data->iterations; i++)
-			on_sink_pull(data);
-	} else {
-		data->running = true;
-		if ((err = pthread_create(&data->thread, NULL, loop, data)) != 0) {
-			printf("can't create thread: %d %s", err, strerror(err));
-			data->running = false;
-		}
-		if (data->running) {
-			pthread_join(data->thread, NULL);
-		}
+	if ((res = make_graph(data)) < 0) {
+		fprintf(stderr, "can't make %s graph of size %u: %s\n",
+			topology_names[topology], size, spa_strerror(res));
+		goto done;
+	}
+	if (data->mode == MODE_PUSH && data->n_sources != 1) {
+		fprintf(stderr, "push mode needs a graph with one source\n");
+		res = -EINVAL;
+		goto done;
 	}
+	res = run_graph(data);
 
-	clock_gettime(CLOCK_MONOTONIC, &now);
-	stop = SPA_TIMESPEC_TO_TIME(&now);
+      done:
+	clear_graph(data);
+	return res;
+}
 
-	printf("stopping, elapsed %" PRIi64 "\n", stop - start);
+static int find_name(const char *names[], int n_names, const char *name)
+{
+	int i;
 
-	{
-		struct spa_command cmd = SPA_COMMAND_INIT(data->type.command_node.Pause);
-		if ((res = spa_node_send_command(data->sink, &cmd)) < 0)
-			printf("got error %d\n", res);
-		if ((res = spa_node_send_command(data->source, &cmd)) < 0)
-			printf("got source error %d\n", res);
+	for (i = 0; i < n_names; i++) {
+		if (strcmp(names[i], name) == 0)
+			return i;
 	}
+	return -1;
+}
+
+static void show_help(const char *name)
+{
+	fprintf(stdout, "%s [options]\n"
+		"  -h, --help                            Show this help\n"
+		"  -t, --topology=TOPOLOGY               chain, mixer or fan, default all\n"
+		"  -n, --size=SIZE                       number of filters or inputs\n"
+		"  -m, --mode=MODE                       pull (default) or push\n"
+		"  -i, --iterations=N                    measured cycles (default 100000)\n"
+		"  -w, --warmup=N                        cycles before measuring (default 1000)\n",
+		name);
 }
 
 int main(int argc, char *argv[])
 {
+	static const struct option long_options[] = {
+		{"help",	0, NULL, 'h'},
+		{"topology",	1, NULL, 't'},
+		{"size",	1, NULL, 'n'},
+		{"mode",	1, NULL, 'm'},
+		{"iterations",	1, NULL, 'i'},
+		{"warmup",	1, NULL, 'w'},
+		{NULL,		0, NULL, 0}
+	};
+	/* the sizes of the default suite */
+	static const uint32_t chain_sizes[] = { 0, 1, 4, 16 };
+	static const uint32_t mix_sizes[] = { 1, 4, 16 };
 	struct data data = { NULL };
-	int res;
+	int c, t, topology = -1, failed = 0;
+	uint32_t i, size = 0;
+	bool have_size = false;
 	const char *str;
 
+	data.mode = MODE_PULL;
+	data.iterations = 100000;
+	data.warmup = 1000;
+
+	while ((c = getopt_long(argc, argv, "ht:n:m:i:w:", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_help(argv[0]);
+			return 0;
+		case 't':
+			if ((topology = find_name(topology_names,
+						  SPA_N_ELEMENTS(topology_names), optarg)) < 0) {
+				fprintf(stderr, "unknown topology %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'n':
+			size = atoi(optarg);
+			have_size = true;
+			break;
+		case 'm':
+			if ((data.mode = find_name(mode_names,
+						   SPA_N_ELEMENTS(mode_names), optarg)) < 0) {
+				fprintf(stderr, "unknown mode %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'i':
+			data.iterations = atoi(optarg);
+			break;
+		case 'w':
+			data.warmup = atoi(optarg);
+			break;
+		default:
+			show_help(argv[0]);
+			return -1;
+		}
+	}
+	if (data.iterations == 0) {
+		fprintf(stderr, "need at least one iteration\n");
+		return -1;
+	}
+
 	spa_graph_init(&data.graph);
 	spa_graph_data_init(&data.graph_data, &data.graph);
 	spa_graph_set_callbacks(&data.graph, &spa_graph_impl_default, &data.graph_data);
@@ -556,13 +887,13 @@ int main(int argc, char *argv[])
 	data.data_loop.remove_source = do_remove_source;
 	data.data_loop.invoke = do_invoke;
 
+	/* only errors, the log would be measured too */
+	data.log->level = SPA_LOG_LEVEL_ERROR;
 	if ((str = getenv("SPA_DEBUG")))
 		data.log->level = atoi(str);
 
-	data.mode = argc > 1 ? atoi(argv[1]) : MODE_SYNC_PUSH;
-	data.iterations = argc > 2 ? atoi(argv[2]) : 100000;
-
-	printf("mode %08x\n", data.mode);
+	if ((data.plugin_dir = getenv("SPA_PLUGIN_DIR")) == NULL)
+		data.plugin_dir = "build/spa/plugins";
 
 	data.support[0].type = SPA_TYPE__TypeMap;
 	data.support[0].data = data.map;
@@ -575,15 +906,32 @@ int main(int argc, char *argv[])
 	data.n_support = 4;
 
 	init_type(&data.type, data.map);
+	make_format(&data);
+	perf_init(&data);
 
-	if ((res = make_nodes(&data)) < 0) {
-		printf("can't make nodes: %d\n", res);
-		return -1;
-	}
-	if ((res = negotiate_formats(&data)) < 0) {
-		printf("can't negotiate nodes: %d\n", res);
+	if ((data.times = calloc(data.iterations, sizeof(uint64_t))) == NULL)
 		return -1;
+
+	for (t = 0; t < (int) SPA_N_ELEMENTS(topology_names); t++) {
+		const uint32_t *sizes = t == TOPOLOGY_CHAIN ? chain_sizes : mix_sizes;
+		uint32_t n_sizes = t == TOPOLOGY_CHAIN ?
+			SPA_N_ELEMENTS(chain_sizes) : SPA_N_ELEMENTS(mix_sizes);
+
+		if (topology >= 0 ? t != topology :
+		    data.mode == MODE_PUSH && t != TOPOLOGY_CHAIN)
+			continue;
+
+		if (have_size)
+			failed |= run_benchmark(&data, t, size) < 0;
+		else if (topology >= 0)
+			failed |= run_benchmark(&data, t, sizes[0]) < 0;
+		else {
+			for (i = 0; i < n_sizes; i++)
+				failed |= run_benchmark(&data, t, sizes[i]) < 0;
+		}
 	}
 
-	run_graph(&data);
+	free(data.times);
+
+	return failed ? -1 : 0;
 }
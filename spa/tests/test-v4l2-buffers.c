@@ -0,0 +1,833 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <linux/videodev2.h>
+
+#include <spa/support/log-impl.h>
+#include <spa/support/type-map-impl.h>
+#include <spa/support/loop.h>
+#include <spa/support/plugin.h>
+#include <spa/utils/defs.h>
+
+/* The v4l2 source is built into the test and talks to a fake capture
+ * device instead of a driver. The device can be single or multi-planar and
+ * can export its buffers as dmabuf or not, the memory of the buffers are
+ * memfds so the test can see where the frames end up. */
+
+#define FAKE_WIDTH		64
+#define FAKE_HEIGHT		48
+#define FAKE_MAX_BUFFERS	8
+#define FAKE_PLANE_OFFSET	(1 << 16)
+
+struct fake_buffer {
+	int fds[VIDEO_MAX_PLANES];	/* memfds for MMAP, the imported fds for DMABUF */
+	bool queued;
+	bool done;
+	uint32_t order;
+	uint32_t sequence;
+};
+
+static struct {
+	bool mplane;
+	bool can_export;
+	struct v4l2_format fmt;
+	uint32_t n_planes;
+
+	enum v4l2_memory memory;
+	struct fake_buffer buffers[FAKE_MAX_BUFFERS];
+	uint32_t n_buffers;
+	uint32_t n_queued;
+	uint32_t sequence;
+	bool streaming;
+} fake;
+
+static void fake_init(bool mplane, bool can_export)
+{
+	struct v4l2_format *f = &fake.fmt;
+
+	spa_zero(fake);
+	fake.mplane = mplane;
+	fake.can_export = can_export;
+
+	if (mplane) {
+		f->type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+		f->fmt.pix_mp.pixelformat = V4L2_PIX_FMT_NV12M;
+		f->fmt.pix_mp.width = FAKE_WIDTH;
+		f->fmt.pix_mp.height = FAKE_HEIGHT;
+		f->fmt.pix_mp.field = V4L2_FIELD_NONE;
+		f->fmt.pix_mp.num_planes = 2;
+		f->fmt.pix_mp.plane_fmt[0].bytesperline = FAKE_WIDTH;
+		f->fmt.pix_mp.plane_fmt[0].sizeimage = FAKE_WIDTH * FAKE_HEIGHT;
+		f->fmt.pix_mp.plane_fmt[1].bytesperline = FAKE_WIDTH;
+		f->fmt.pix_mp.plane_fmt[1].sizeimage = FAKE_WIDTH * FAKE_HEIGHT / 2;
+		fake.n_planes = 2;
+	} else {
+		f->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		f->fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+		f->fmt.pix.width = FAKE_WIDTH;
+		f->fmt.pix.height = FAKE_HEIGHT;
+		f->fmt.pix.field = V4L2_FIELD_NONE;
+		f->fmt.pix.bytesperline = FAKE_WIDTH * 2;
+		f->fmt.pix.sizeimage = FAKE_WIDTH * FAKE_HEIGHT * 2;
+		fake.n_planes = 1;
+	}
+}
+
+static uint32_t fake_plane_size(uint32_t plane)
+{
+	if (fake.mplane)
+		return fake.fmt.fmt.pix_mp.plane_fmt[plane].sizeimage;
+	return fake.fmt.fmt.pix.sizeimage;
+}
+
+static uint32_t fake_plane_stride(uint32_t plane)
+{
+	if (fake.mplane)
+		return fake.fmt.fmt.pix_mp.plane_fmt[plane].bytesperline;
+	return fake.fmt.fmt.pix.bytesperline;
+}
+
+static uint32_t fake_pixelformat(void)
+{
+	return fake.mplane ? fake.fmt.fmt.pix_mp.pixelformat : fake.fmt.fmt.pix.pixelformat;
+}
+
+static void fake_free_buffers(void)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < fake.n_buffers; i++) {
+		for (j = 0; j < fake.n_planes; j++) {
+			if (fake.memory == V4L2_MEMORY_MMAP)
+				close(fake.buffers[i].fds[j]);
+		}
+	}
+	spa_zero(fake.buffers);
+	fake.n_buffers = 0;
+}
+
+static int fake_alloc_buffers(uint32_t count)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < fake.n_planes; j++) {
+			int fd = syscall(SYS_memfd_create, "fake-v4l2", 0);
+
+			if (fd < 0 || ftruncate(fd, fake_plane_size(j)) < 0)
+				return -1;
+			fake.buffers[i].fds[j] = fd;
+		}
+	}
+	return 0;
+}
+
+/* the device fills the oldest queued buffer, each plane with its own value */
+static int fake_capture(uint8_t value)
+{
+	struct fake_buffer *b = NULL;
+	uint32_t i, j;
+
+	for (i = 0; i < fake.n_buffers; i++) {
+		struct fake_buffer *fb = &fake.buffers[i];
+
+		if (fb->queued && !fb->done && (b == NULL || fb->order < b->order))
+			b = fb;
+	}
+	if (b == NULL || !fake.streaming)
+		return -1;
+
+	for (j = 0; j < fake.n_planes; j++) {
+		uint32_t size = fake_plane_size(j);
+		void *p;
+
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, b->fds[j], 0);
+		spa_assert_se(p != MAP_FAILED);
+		memset(p, value + j, size);
+		munmap(p, size);
+	}
+	b->done = true;
+	b->sequence = fake.sequence++;
+
+	return b - fake.buffers;
+}
+
+static int fake_dqbuf(struct v4l2_buffer *buf)
+{
+	struct fake_buffer *b = NULL;
+	uint32_t i, j;
+
+	for (i = 0; i < fake.n_buffers; i++) {
+		struct fake_buffer *fb = &fake.buffers[i];
+
+		if (fb->done && (b == NULL || fb->sequence < b->sequence))
+			b = fb;
+	}
+	if (b == NULL) {
+		errno = EAGAIN;
+		return -1;
+	}
+	buf->index = b - fake.buffers;
+	buf->sequence = b->sequence;
+	buf->flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+	buf->timestamp.tv_sec = b->sequence;
+
+	if (fake.mplane) {
+		if (buf->length < fake.n_planes) {
+			errno = EINVAL;
+			return -1;
+		}
+		for (j = 0; j < fake.n_planes; j++) {
+			buf->m.planes[j].bytesused = fake_plane_size(j);
+			buf->m.planes[j].data_offset = 0;
+		}
+	} else
+		buf->bytesused = fake_plane_size(0);
+
+	b->queued = b->done = false;
+
+	return 0;
+}
+
+static int fake_qbuf(struct v4l2_buffer *buf)
+{
+	struct fake_buffer *b;
+	uint32_t j;
+
+	if (buf->memory != fake.memory || buf->index >= fake.n_buffers)
+		return -1;
+
+	b = &fake.buffers[buf->index];
+	if (b->queued)
+		return -1;
+
+	if (fake.memory == V4L2_MEMORY_DMABUF) {
+		for (j = 0; j < fake.n_planes; j++)
+			b->fds[j] = fake.mplane ? buf->m.planes[j].m.fd : buf->m.fd;
+	}
+	b->queued = true;
+	b->done = false;
+	b->order = fake.n_queued++;
+
+	return 0;
+}
+
+static int fake_ioctl(int fd, unsigned long request, void *arg)
+{
+	uint32_t type = fake.fmt.type, j;
+
+	/* the plugin passes the request as an int */
+	switch ((uint32_t) request) {
+	case VIDIOC_QUERYCAP:
+	{
+		struct v4l2_capability *cap = arg;
+
+		spa_zero(*cap);
+		snprintf((char *) cap->driver, sizeof(cap->driver), "fake");
+		cap->capabilities = V4L2_CAP_STREAMING |
+		    (fake.mplane ? V4L2_CAP_VIDEO_CAPTURE_MPLANE : V4L2_CAP_VIDEO_CAPTURE);
+		return 0;
+	}
+	case VIDIOC_ENUM_FMT:
+	{
+		struct v4l2_fmtdesc *desc = arg;
+
+		if (desc->type != type || desc->index > 0)
+			break;
+		desc->pixelformat = fake_pixelformat();
+		return 0;
+	}
+	case VIDIOC_ENUM_FRAMESIZES:
+	{
+		struct v4l2_frmsizeenum *size = arg;
+
+		if (size->index > 0 || size->pixel_format != fake_pixelformat())
+			break;
+		size->type = V4L2_FRMSIZE_TYPE_DISCRETE;
+		size->discrete.width = FAKE_WIDTH;
+		size->discrete.height = FAKE_HEIGHT;
+		return 0;
+	}
+	case VIDIOC_ENUM_FRAMEINTERVALS:
+	{
+		struct v4l2_frmivalenum *ival = arg;
+
+		if (ival->index > 0 || ival->pixel_format != fake_pixelformat())
+			break;
+		ival->type = V4L2_FRMIVAL_TYPE_DISCRETE;
+		ival->discrete.numerator = 1;
+		ival->discrete.denominator = 30;
+		return 0;
+	}
+	case VIDIOC_TRY_FMT:
+	case VIDIOC_S_FMT:
+	{
+		struct v4l2_format *f = arg;
+
+		if (f->type != type)
+			break;
+		/* there is only one format */
+		*f = fake.fmt;
+		return 0;
+	}
+	case VIDIOC_S_PARM:
+		return 0;
+	case VIDIOC_REQBUFS:
+	{
+		struct v4l2_requestbuffers *req = arg;
+
+		if (req->type != type || fake.streaming)
+			break;
+		fake_free_buffers();
+		fake.memory = req->memory;
+		req->count = SPA_MIN(req->count, FAKE_MAX_BUFFERS);
+		if (req->memory == V4L2_MEMORY_MMAP && fake_alloc_buffers(req->count) < 0)
+			break;
+		fake.n_buffers = req->count;
+		return 0;
+	}
+	case VIDIOC_QUERYBUF:
+	{
+		struct v4l2_buffer *buf = arg;
+
+		if (buf->type != type || buf->index >= fake.n_buffers ||
+		    fake.memory != V4L2_MEMORY_MMAP)
+			break;
+		if (fake.mplane) {
+			if (buf->length < fake.n_planes)
+				break;
+			for (j = 0; j < fake.n_planes; j++) {
+				buf->m.planes[j].length = fake_plane_size(j);
+				buf->m.planes[j].m.mem_offset =
+					(buf->index * VIDEO_MAX_PLANES + j) * FAKE_PLANE_OFFSET;
+			}
+			buf->length = fake.n_planes;
+		} else {
+			buf->length = fake_plane_size(0);
+			buf->m.offset = buf->index * VIDEO_MAX_PLANES * FAKE_PLANE_OFFSET;
+		}
+		return 0;
+	}
+	case VIDIOC_EXPBUF:
+	{
+		struct v4l2_exportbuffer *exp = arg;
+
+		if (!fake.can_export || exp->type != type ||
+		    exp->index >= fake.n_buffers || exp->plane >= fake.n_planes ||
+		    fake.memory != V4L2_MEMORY_MMAP)
+			break;
+		exp->fd = fcntl(fake.buffers[exp->index].fds[exp->plane], F_DUPFD_CLOEXEC, 0);
+		return 0;
+	}
+	case VIDIOC_QBUF:
+		if (((struct v4l2_buffer *) arg)->type != type || fake_qbuf(arg) < 0)
+			break;
+		return 0;
+	case VIDIOC_DQBUF:
+		if (((struct v4l2_buffer *) arg)->type != type)
+			break;
+		return fake_dqbuf(arg);
+	case VIDIOC_STREAMON:
+		fake.streaming = true;
+		return 0;
+	case VIDIOC_STREAMOFF:
+		/* all buffers are dequeued */
+		for (j = 0; j < fake.n_buffers; j++)
+			fake.buffers[j].queued = fake.buffers[j].done = false;
+		fake.streaming = false;
+		return 0;
+	default:
+		break;
+	}
+	errno = EINVAL;
+	return -1;
+}
+
+/* the offset of QUERYBUF selects the memfd to map */
+static void *fake_mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+	uint32_t index = offset / FAKE_PLANE_OFFSET / VIDEO_MAX_PLANES;
+	uint32_t plane = offset / FAKE_PLANE_OFFSET % VIDEO_MAX_PLANES;
+
+	if (fake.memory != V4L2_MEMORY_MMAP || index >= fake.n_buffers ||
+	    plane >= fake.n_planes || length > fake_plane_size(plane)) {
+		errno = EINVAL;
+		return MAP_FAILED;
+	}
+	return mmap(addr, length, prot, flags, fake.buffers[index].fds[plane], 0);
+}
+
+#define ioctl(fd,request,arg)			fake_ioctl(fd,request,arg)
+#define mmap(addr,length,prot,flags,fd,offset)	fake_mmap(addr,length,prot,flags,fd,offset)
+
+#include "../plugins/v4l2/v4l2-source.c"
+
+#undef ioctl
+#undef mmap
+
+static SPA_TYPE_MAP_IMPL(default_map, 4096);
+static SPA_LOG_IMPL(default_log);
+
+static struct type type;
+
+struct test_buffer {
+	struct spa_buffer buffer;
+	struct spa_meta metas[1];
+	struct spa_meta_header header;
+	struct spa_data datas[VIDEO_MAX_PLANES];
+	struct spa_chunk chunks[VIDEO_MAX_PLANES];
+};
+
+struct data {
+	struct spa_loop loop;
+	struct spa_support support[4];
+	struct spa_source *source;
+
+	struct spa_handle *handle;
+	struct spa_node *node;
+	struct spa_io_buffers io;
+
+	struct test_buffer buffers[FAKE_MAX_BUFFERS];
+	struct spa_buffer *bufs[FAKE_MAX_BUFFERS];
+	uint32_t n_buffers;
+	int import_fds[FAKE_MAX_BUFFERS][VIDEO_MAX_PLANES];
+
+	uint32_t n_have_output;
+	uint32_t n_xruns;
+};
+
+static int do_add_source(struct spa_loop *loop, struct spa_source *source)
+{
+	struct data *data = SPA_CONTAINER_OF(loop, struct data, loop);
+	source->loop = loop;
+	data->source = source;
+	return 0;
+}
+
+static int do_update_source(struct spa_source *source)
+{
+	return 0;
+}
+
+static void do_remove_source(struct spa_source *source)
+{
+	struct data *data = SPA_CONTAINER_OF(source->loop, struct data, loop);
+	data->source = NULL;
+}
+
+static int
+do_invoke(struct spa_loop *loop,
+	  spa_invoke_func_t func, uint32_t seq, const void *data, size_t size, bool block, void *user_data)
+{
+	return func(loop, false, seq, data, size, user_data);
+}
+
+static void on_done(void *_data, int seq, int res)
+{
+}
+
+static void on_event(void *_data, struct spa_event *event)
+{
+	struct data *data = _data;
+
+	if (SPA_EVENT_TYPE(event) == type.event_node.Xrun)
+		data->n_xruns++;
+}
+
+static void on_have_output(void *_data)
+{
+	struct data *data = _data;
+	data->n_have_output++;
+}
+
+static const struct spa_node_callbacks node_callbacks = {
+	SPA_VERSION_NODE_CALLBACKS,
+	.done = on_done,
+	.event = on_event,
+	.have_output = on_have_output,
+};
+
+static void make_source(struct data *data)
+{
+	const struct spa_dict_item items[] = {
+		/* a character device that can be opened, all ioctls go to the fake */
+		{ "device.path", "/dev/null" },
+	};
+	const struct spa_dict info = SPA_DICT_INIT(items, SPA_N_ELEMENTS(items));
+	void *iface;
+
+	spa_zero(*data);
+	data->loop.version = SPA_VERSION_LOOP;
+	data->loop.add_source = do_add_source;
+	data->loop.update_source = do_update_source;
+	data->loop.remove_source = do_remove_source;
+	data->loop.invoke = do_invoke;
+
+	data->support[0] = SPA_SUPPORT_INIT(SPA_TYPE__TypeMap, &default_map.map);
+	data->support[1] = SPA_SUPPORT_INIT(SPA_TYPE__Log, &default_log.log);
+	data->support[2] = SPA_SUPPORT_INIT(SPA_TYPE_LOOP__MainLoop, &data->loop);
+	data->support[3] = SPA_SUPPORT_INIT(SPA_TYPE_LOOP__DataLoop, &data->loop);
+
+	data->handle = calloc(1, spa_v4l2_source_factory.size);
+	spa_assert_se(spa_handle_factory_init(&spa_v4l2_source_factory, data->handle,
+					      &info, data->support, 4) == 0);
+	spa_assert_se(spa_handle_get_interface(data->handle, type.node, &iface) == 0);
+	data->node = iface;
+
+	spa_assert_se(spa_node_set_callbacks(data->node, &node_callbacks, data) == 0);
+	data->io = SPA_IO_BUFFERS_INIT;
+	spa_assert_se(spa_node_port_set_io(data->node, SPA_DIRECTION_OUTPUT, 0,
+					   type.io.Buffers, &data->io, sizeof(data->io)) == 0);
+}
+
+static void free_source(struct data *data)
+{
+	uint32_t i, j;
+
+	/* clears the buffers and closes the device */
+	spa_assert_se(spa_node_port_set_param(data->node, SPA_DIRECTION_OUTPUT, 0,
+					      type.param.idFormat, 0, NULL) == 0);
+	spa_assert_se(fake.n_buffers == 0);
+	spa_assert_se(!fake.streaming);
+
+	spa_handle_clear(data->handle);
+	free(data->handle);
+
+	for (i = 0; i < data->n_buffers; i++) {
+		for (j = 0; j < fake.n_planes; j++) {
+			if (data->import_fds[i][j] > 0)
+				close(data->import_fds[i][j]);
+		}
+	}
+}
+
+/* the device format is enumerated and set as it is */
+static void negotiate_format(struct data *data)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *format;
+	struct spa_video_info_raw info;
+	uint32_t index = 0, media_type, media_subtype;
+
+	spa_assert_se(spa_node_port_enum_params(data->node, SPA_DIRECTION_OUTPUT, 0,
+						type.param.idEnumFormat, &index,
+						NULL, &format, &b) == 1);
+	spa_assert_se(spa_pod_object_parse(format,
+				"I", &media_type, "I", &media_subtype) >= 0);
+	spa_assert_se(media_type == type.media_type.video);
+	spa_assert_se(media_subtype == type.media_subtype.raw);
+	spa_assert_se(spa_format_video_raw_parse(format, &info, &type.format_video) >= 0);
+	spa_assert_se(info.format == (fake.mplane ? type.video_format.NV12 : type.video_format.YUY2));
+	spa_assert_se(info.size.width == FAKE_WIDTH);
+	spa_assert_se(info.size.height == FAKE_HEIGHT);
+
+	spa_assert_se(spa_node_port_set_param(data->node, SPA_DIRECTION_OUTPUT, 0,
+					      type.param.idFormat, 0, format) == 0);
+}
+
+/* the Buffers param has a block per plane and offers dmabuf when the device
+ * can export */
+static struct spa_pod *get_buffers_param(struct data *data, struct spa_pod_builder *b)
+{
+	struct spa_pod *param;
+	struct spa_pod_prop *prop;
+	const uint32_t *values;
+	uint32_t index = 0;
+	int32_t size, stride, blocks;
+
+	spa_assert_se(spa_node_port_enum_params(data->node, SPA_DIRECTION_OUTPUT, 0,
+						type.param.idBuffers, &index,
+						NULL, &param, b) == 1);
+	spa_assert_se(spa_pod_object_parse(param,
+			":", type.param_buffers.size,     "i", &size,
+			":", type.param_buffers.stride,   "i", &stride,
+			":", type.param_buffers.blocks,   "i", &blocks, NULL) >= 0);
+	spa_assert_se(blocks == fake.n_planes);
+	spa_assert_se(size == fake_plane_size(0));
+	spa_assert_se(stride == fake_plane_stride(0));
+
+	prop = spa_pod_find_prop(param, type.param_buffers.dataType);
+	spa_assert_se(prop != NULL);
+	spa_assert_se((prop->body.flags & SPA_POD_PROP_RANGE_MASK) == SPA_POD_PROP_RANGE_ENUM);
+	spa_assert_se(SPA_POD_PROP_N_VALUES(prop) == 3);
+	values = SPA_POD_BODY_CONST(&prop->body.value);
+	spa_assert_se(values[0] == type.data.DmaBuf);
+	spa_assert_se(values[1] == type.data.DmaBuf);
+	spa_assert_se(values[2] == type.data.MemPtr);
+
+	return param;
+}
+
+static void init_buffers(struct data *data, uint32_t n_buffers)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < n_buffers; i++) {
+		struct test_buffer *b = &data->buffers[i];
+
+		data->bufs[i] = &b->buffer;
+		b->buffer.id = i;
+		b->buffer.metas = b->metas;
+		b->buffer.n_metas = 1;
+		b->buffer.datas = b->datas;
+		b->buffer.n_datas = fake.n_planes;
+
+		b->metas[0].type = type.meta.Header;
+		b->metas[0].data = &b->header;
+		b->metas[0].size = sizeof(b->header);
+
+		for (j = 0; j < fake.n_planes; j++) {
+			b->datas[j].type = SPA_ID_INVALID;
+			b->datas[j].flags = 0;
+			b->datas[j].fd = -1;
+			b->datas[j].mapoffset = 0;
+			b->datas[j].maxsize = 0;
+			b->datas[j].data = NULL;
+			b->datas[j].chunk = &b->chunks[j];
+		}
+	}
+	data->n_buffers = n_buffers;
+}
+
+static void start(struct data *data)
+{
+	struct spa_command cmd = SPA_COMMAND_INIT(type.command_node.Start);
+
+	spa_assert_se(spa_node_send_command(data->node, &cmd) == 0);
+	spa_assert_se(fake.streaming);
+	spa_assert_se(data->source != NULL);
+}
+
+/* the device captures a frame and the data loop wakes up the source */
+static struct test_buffer *capture(struct data *data, uint8_t value)
+{
+	uint32_t n_have_output = data->n_have_output;
+	int index;
+
+	spa_assert_se((index = fake_capture(value)) >= 0);
+
+	data->source->rmask = SPA_IO_IN;
+	data->source->func(data->source);
+
+	spa_assert_se(data->n_have_output == n_have_output + 1);
+	spa_assert_se(data->io.status == SPA_STATUS_HAVE_BUFFER);
+	spa_assert_se(data->io.buffer_id == index);
+
+	return &data->buffers[data->io.buffer_id];
+}
+
+/* the consumer is done with the buffer, the source queues it again */
+static void recycle(struct data *data)
+{
+	uint32_t id = data->io.buffer_id;
+
+	data->io.status = SPA_STATUS_NEED_BUFFER;
+	spa_assert_se(spa_node_process_output(data->node) == SPA_STATUS_OK);
+	spa_assert_se(data->io.buffer_id == SPA_ID_INVALID);
+	spa_assert_se(fake.buffers[id].queued);
+}
+
+/* check the planes of a captured buffer through the memory the consumer gets */
+static void check_frame(struct test_buffer *b, uint8_t value, bool dmabuf)
+{
+	uint32_t j;
+
+	spa_assert_se(b->header.seq == fake.sequence - 1);
+
+	for (j = 0; j < fake.n_planes; j++) {
+		struct spa_data *d = &b->datas[j];
+		uint32_t size = fake_plane_size(j);
+		uint8_t *p;
+
+		spa_assert_se(d->chunk->offset == 0);
+		spa_assert_se(d->chunk->size == size);
+		spa_assert_se(d->chunk->stride == fake_plane_stride(j));
+		spa_assert_se(d->maxsize >= size);
+
+		if (dmabuf) {
+			spa_assert_se(d->type == type.data.DmaBuf);
+			spa_assert_se(d->fd >= 0);
+			spa_assert_se(d->data == NULL);
+			p = mmap(NULL, size, PROT_READ, MAP_SHARED, d->fd, 0);
+			spa_assert_se(p != MAP_FAILED);
+		} else {
+			spa_assert_se(d->type == type.data.MemPtr);
+			spa_assert_se(d->data != NULL);
+			p = d->data;
+		}
+		spa_assert_se(p[0] == (uint8_t)(value + j));
+		spa_assert_se(p[size - 1] == (uint8_t)(value + j));
+
+		if (dmabuf)
+			munmap(p, size);
+	}
+}
+
+/* capture more frames than there are buffers so that every buffer is
+ * recycled at least once */
+static void run_frames(struct data *data, bool dmabuf)
+{
+	uint32_t i;
+
+	start(data);
+	for (i = 0; i < 2 * data->n_buffers; i++) {
+		check_frame(capture(data, i * 4), i * 4, dmabuf);
+		recycle(data);
+	}
+}
+
+/* the source allocates the buffers and exports the device memory, with the
+ * Buffers param as the link would pass it */
+static void test_export(bool mplane)
+{
+	struct data data;
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *params[1];
+	uint32_t n_buffers = 4;
+
+	fake_init(mplane, true);
+	make_source(&data);
+	negotiate_format(&data);
+
+	params[0] = get_buffers_param(&data, &b);
+	init_buffers(&data, n_buffers);
+	spa_assert_se(spa_node_port_alloc_buffers(data.node, SPA_DIRECTION_OUTPUT, 0,
+						  params, 1, data.bufs, &n_buffers) == 0);
+	spa_assert_se(n_buffers == 4);
+	spa_assert_se(fake.memory == V4L2_MEMORY_MMAP);
+
+	run_frames(&data, true);
+	free_source(&data);
+}
+
+/* a peer that can only map memory gets the mmaped device memory */
+static void test_export_memptr(bool mplane)
+{
+	struct data data;
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *params[1];
+	uint32_t n_buffers = 4;
+
+	fake_init(mplane, true);
+	make_source(&data);
+	negotiate_format(&data);
+
+	params[0] = spa_pod_builder_object(&b,
+			type.param.idBuffers, type.param_buffers.Buffers,
+			":", type.param_buffers.dataType, "I", type.data.MemPtr);
+	init_buffers(&data, n_buffers);
+	spa_assert_se(spa_node_port_alloc_buffers(data.node, SPA_DIRECTION_OUTPUT, 0,
+						  params, 1, data.bufs, &n_buffers) == 0);
+
+	run_frames(&data, false);
+	free_source(&data);
+}
+
+/* the device can't export, the buffers are mapped instead */
+static void test_export_fail(bool mplane)
+{
+	struct data data;
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *params[1];
+	uint32_t n_buffers = 4;
+
+	fake_init(mplane, false);
+	make_source(&data);
+	negotiate_format(&data);
+
+	params[0] = get_buffers_param(&data, &b);
+	init_buffers(&data, n_buffers);
+	spa_assert_se(spa_node_port_alloc_buffers(data.node, SPA_DIRECTION_OUTPUT, 0,
+						  params, 1, data.bufs, &n_buffers) == 0);
+
+	run_frames(&data, false);
+	free_source(&data);
+}
+
+/* the peer allocated dmabufs and the device captures into them */
+static void test_import(bool mplane)
+{
+	struct data data;
+	uint32_t i, j, n_buffers = 4;
+
+	fake_init(mplane, true);
+	make_source(&data);
+	negotiate_format(&data);
+
+	init_buffers(&data, n_buffers);
+	for (i = 0; i < n_buffers; i++) {
+		for (j = 0; j < fake.n_planes; j++) {
+			struct spa_data *d = &data.buffers[i].datas[j];
+			int fd = syscall(SYS_memfd_create, "test-v4l2", 0);
+
+			spa_assert_se(fd >= 0);
+			spa_assert_se(ftruncate(fd, fake_plane_size(j)) == 0);
+			data.import_fds[i][j] = fd;
+			d->type = type.data.DmaBuf;
+			d->fd = fd;
+			d->maxsize = fake_plane_size(j);
+		}
+	}
+	spa_assert_se(spa_node_port_use_buffers(data.node, SPA_DIRECTION_OUTPUT, 0,
+						data.bufs, n_buffers) == 0);
+	spa_assert_se(fake.memory == V4L2_MEMORY_DMABUF);
+	for (i = 0; i < n_buffers; i++) {
+		spa_assert_se(fake.buffers[i].queued);
+		for (j = 0; j < fake.n_planes; j++)
+			spa_assert_se(fake.buffers[i].fds[j] == data.import_fds[i][j]);
+	}
+
+	run_frames(&data, true);
+	free_source(&data);
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	init_type(&type, &default_map.map);
+	default_log.log.level = SPA_LOG_LEVEL_ERROR;
+
+	for (i = 0; i < 2; i++) {
+		test_export(i == 1);
+		test_export_memptr(i == 1);
+		test_export_fail(i == 1);
+		test_import(i == 1);
+	}
+	return 0;
+}
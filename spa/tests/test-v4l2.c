@@ -36,6 +36,7 @@
 #include <spa/node/io.h>
 #include <spa/param/param.h>
 #include <spa/param/props.h>
+#include <spa/param/buffers.h>
 #include <spa/param/video/format-utils.h>
 #include <spa/param/format-utils.h>
 
@@ -52,6 +53,7 @@ struct type {
 	uint32_t SDL_Texture;
 	struct spa_type_io io;
 	struct spa_type_param param;
+	struct spa_type_param_buffers param_buffers;
 	struct spa_type_meta meta;
 	struct spa_type_data data;
 	struct spa_type_media_type media_type;
@@ -71,6 +73,7 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 	type->SDL_Texture = spa_type_map_get_id(map, SPA_TYPE_POINTER_BASE "SDL_Texture");
 	spa_type_io_map(map, &type->io);
 	spa_type_param_map(map, &type->param);
+	spa_type_param_buffers_map(map, &type->param_buffers);
 	spa_type_meta_map(map, &type->meta);
 	spa_type_data_map(map, &type->data);
 	spa_type_media_type_map(map, &type->media_type);
@@ -419,7 +422,7 @@ static int negotiate_formats(struct data *data)
 	int res;
 	const struct spa_port_info *info;
 	struct spa_pod *format;
-	uint8_t buffer[256];
+	uint8_t buffer[512];
 	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
 
 	data->source_output[0] = SPA_IO_BUFFERS_INIT;
@@ -461,7 +464,8 @@ static int negotiate_formats(struct data *data)
 			return -1;
 		}
 	} else {
-		unsigned int n_buffers;
+		unsigned int i, n_buffers;
+		struct spa_pod *params[1];
 
 		data->texture = SDL_CreateTexture(data->renderer,
 						  SDL_PIXELFORMAT_YUY2,
@@ -470,14 +474,25 @@ static int negotiate_formats(struct data *data)
 			printf("can't create texture: %s\n", SDL_GetError());
 			return -1;
 		}
+		/* ask for the device memory, exported as dmabuf */
+		params[0] = spa_pod_builder_object(&b,
+				data->type.param.idBuffers, data->type.param_buffers.Buffers,
+				":", data->type.param_buffers.dataType, "I", data->type.data.DmaBuf);
+
 		n_buffers = MAX_BUFFERS;
 		if ((res =
-		     spa_node_port_alloc_buffers(data->source, SPA_DIRECTION_OUTPUT, 0, NULL, 0,
+		     spa_node_port_alloc_buffers(data->source, SPA_DIRECTION_OUTPUT, 0, params, 1,
 						 data->bp, &n_buffers)) < 0) {
 			printf("can't allocate buffers: %s\n", spa_strerror(res));
 			return -1;
 		}
 		data->n_buffers = n_buffers;
+
+		for (i = 0; i < n_buffers; i++) {
+			struct spa_data *d = &data->bp[i]->datas[0];
+			printf("buffer %d: %s fd %d\n", i,
+				spa_type_map_get_type(data->map, d->type), d->fd);
+		}
 	}
 	return 0;
 }
@@ -572,7 +587,8 @@ int main(int argc, char *argv[])
 	int res;
 	const char *str;
 
-	data.use_buffer = true;
+	/* SPA_TEST_DMABUF=1 lets the source allocate and export its buffers */
+	data.use_buffer = getenv("SPA_TEST_DMABUF") == NULL;
 
 	data.map = &default_map.map;
 	data.log = &default_log.log;
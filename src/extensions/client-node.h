@@ -44,6 +44,10 @@ struct pw_client_node_area {
 	uint32_t n_input_ports;		/**< number of input ports of the node */
 	uint32_t max_output_ports;	/**< max output ports of the node */
 	uint32_t n_output_ports;	/**< number of output ports of the node */
+	uint64_t awake_time;		/**< time the client woke up to process, written
+					  *  by the client for the profiler */
+	uint64_t finish_time;		/**< time the client signaled that it was done,
+					  *  written by the client for the profiler */
 };
 
 /** \class pw_client_node_transport
@@ -0,0 +1,97 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PIPEWIRE_EXT_PROFILER_H__
+#define __PIPEWIRE_EXT_PROFILER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <time.h>
+
+#include <spa/utils/defs.h>
+
+/** \page page_profiler Profiler
+ *
+ * When the pipewire.profiler property of the core is set, the data loops
+ * write the timing of every node in every graph cycle to a shared memory
+ * segment named PW_PROFILER_SHM_PREFIX followed by the name of the core.
+ *
+ * There is a ring of records for each data loop. The data loop is the only
+ * writer of its ring, it fills the record and then increments the write
+ * index. Readers keep their own read index and check that the write index
+ * did not move more than PW_PROFILER_N_RECORDS past a record after they
+ * copied it.
+ *
+ * All times are in nanoseconds of CLOCK_MONOTONIC.
+ */
+
+#define PW_PROFILER_SHM_PREFIX	"/pipewire-profiler-"
+
+#define PW_PROFILER_VERSION	0
+#define PW_PROFILER_MAX_LOOPS	16
+#define PW_PROFILER_N_RECORDS	1024	/**< records in a ring, a power of 2 */
+#define PW_PROFILER_MAX_NAME	32	/**< size of the node name in a record */
+
+/** The timing of a node in a cycle \memberof pw_profiler */
+struct pw_profiler_record {
+#define PW_PROFILER_RECORD_FLAG_DRIVER	(1 << 0)	/**< the node started the cycle */
+#define PW_PROFILER_RECORD_FLAG_REMOTE	(1 << 1)	/**< the node ran in a client, start and end
+							  *  are the times the client woke up and
+							  *  signaled the server */
+#define PW_PROFILER_RECORD_FLAG_XRUN	(1 << 2)	/**< the node was the first to finish after
+							  *  the end of the cycle */
+	uint32_t flags;
+	uint32_t node_id;		/**< global id of the node */
+	uint64_t cycle;			/**< cycle of the data loop */
+	uint64_t signal;		/**< time the driver started the cycle */
+	uint64_t start;			/**< time the node started processing */
+	uint64_t end;			/**< time the node finished processing */
+	uint64_t period;		/**< time between the last two cycles, 0 when unknown */
+	char name[PW_PROFILER_MAX_NAME];	/**< name of the node, maybe truncated */
+};
+
+/** The records of a data loop \memberof pw_profiler */
+struct pw_profiler_ring {
+	uint32_t write_index;		/**< number of records written, wraps around */
+	uint32_t padding;
+	struct pw_profiler_record records[PW_PROFILER_N_RECORDS];
+};
+
+/** The shared memory of the profiler \memberof pw_profiler */
+struct pw_profiler_area {
+	uint32_t version;		/**< PW_PROFILER_VERSION */
+	uint32_t n_rings;		/**< number of rings in use */
+	struct pw_profiler_ring rings[PW_PROFILER_MAX_LOOPS];
+};
+
+/** The current time, like the times in the records */
+static inline uint64_t pw_profiler_get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __PIPEWIRE_EXT_PROFILER_H__ */
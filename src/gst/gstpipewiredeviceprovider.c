@@ -336,6 +336,8 @@ struct node_data {
   uint32_t id;
   uint32_t parent_id;
   struct spa_hook node_listener;
+  struct spa_hook proxy_listener;
+  struct pw_node_info *info;
 };
 
 struct registry_data {
@@ -344,19 +346,44 @@ struct registry_data {
   struct spa_hook registry_listener;
 };
 
+/* the fields that are used to make the device */
+#define DEVICE_CHANGE_MASK	(PW_NODE_CHANGE_MASK_NAME |		\
+				 PW_NODE_CHANGE_MASK_INPUT_PORTS |	\
+				 PW_NODE_CHANGE_MASK_INPUT_PARAMS |	\
+				 PW_NODE_CHANGE_MASK_OUTPUT_PORTS |	\
+				 PW_NODE_CHANGE_MASK_OUTPUT_PARAMS |	\
+				 PW_NODE_CHANGE_MASK_PROPS)
+
 static void node_event_info(void *data, struct pw_node_info *info)
 {
   struct node_data *node_data = data;
   GstPipeWireDeviceProvider *self = node_data->self;
+  GstDeviceProvider *provider = GST_DEVICE_PROVIDER (self);
+  GstPipeWireDevice *old;
   GstDevice *dev;
+  gboolean first = node_data->info == NULL;
+
+  node_data->info = pw_node_info_update (node_data->info, info);
+
+  /* state changes don't change the device, the list of a probe is
+   * only made once */
+  if (!first && ((info->change_mask & DEVICE_CHANGE_MASK) == 0 || self->list_only))
+    return;
+
+  dev = new_node (self, node_data->info, node_data->id);
 
-  dev = new_node (self, info, node_data->id);
-  if (dev) {
-    if(self->list_only)
+  if (self->list_only) {
+    if (dev)
       *self->devices = g_list_prepend (*self->devices, gst_object_ref_sink (dev));
-    else
-      gst_device_provider_device_add (GST_DEVICE_PROVIDER (self), dev);
+    return;
   }
+
+  if (!first && (old = find_device (provider, node_data->id)) != NULL) {
+    gst_device_provider_device_remove (provider, GST_DEVICE (old));
+    gst_object_unref (old);
+  }
+  if (dev)
+    gst_device_provider_device_add (provider, dev);
 }
 
 static const struct pw_node_proxy_events node_events = {
@@ -364,6 +391,19 @@ static const struct pw_node_proxy_events node_events = {
   .info = node_event_info
 };
 
+static void node_proxy_destroy(void *data)
+{
+  struct node_data *nd = data;
+
+  if (nd->info)
+    pw_node_info_free (nd->info);
+}
+
+static const struct pw_proxy_events proxy_node_events = {
+  PW_VERSION_PROXY_EVENTS,
+  .destroy = node_proxy_destroy,
+};
+
 
 static void registry_event_global(void *data, uint32_t id, uint32_t parent_id, uint32_t permissions,
 				  uint32_t type, uint32_t version)
@@ -376,7 +416,8 @@ static void registry_event_global(void *data, uint32_t id, uint32_t parent_id, u
   if (type != self->type->node)
     return;
 
-  node = pw_registry_proxy_bind(rd->registry, id, self->type->node, PW_VERSION_NODE, sizeof(*nd));
+  node = pw_registry_proxy_bind(rd->registry, id, self->type->node,
+      SPA_MIN(version, PW_VERSION_NODE), sizeof(*nd));
   if (node == NULL)
     goto no_mem;
 
@@ -385,7 +426,9 @@ static void registry_event_global(void *data, uint32_t id, uint32_t parent_id, u
   nd->node = node;
   nd->id = id;
   nd->parent_id = parent_id;
+  nd->info = NULL;
   pw_node_proxy_add_listener(node, &nd->node_listener, &node_events, nd);
+  pw_proxy_add_listener((struct pw_proxy*)node, &nd->proxy_listener, &proxy_node_events, nd);
 
   return;
 
@@ -21,7 +21,10 @@
 #include "config.h"
 #endif
 
+#include <sys/stat.h>
+
 #include <gst/gst.h>
+#include <gst/allocators/gstfdmemory.h>
 
 #include "gstpipewirepool.h"
 
@@ -40,6 +43,18 @@ enum
 
 static guint pool_signals[LAST_SIGNAL] = { 0 };
 
+/* the memory of the pool buffers points to the buffer that owns it */
+static GQuark pool_owner_quark;
+/* the file of the fd memory of the pool buffers */
+static GQuark pool_file_quark;
+
+typedef struct {
+  dev_t dev;
+  ino_t ino;
+} FileData;
+
+#define GST_PIPEWIRE_POOL_ACQUIRE_FLAG_OWNER GST_BUFFER_POOL_ACQUIRE_FLAG_LAST
+
 GstPipeWirePool *
 gst_pipewire_pool_new (void)
 {
@@ -50,33 +65,323 @@ gst_pipewire_pool_new (void)
   return pool;
 }
 
+static gboolean
+get_file (GstMemory *mem, FileData *file)
+{
+  struct stat st;
+
+  if (!gst_is_fd_memory (mem) || fstat (gst_fd_memory_get_fd (mem), &st) < 0)
+    return FALSE;
+
+  file->dev = st.st_dev;
+  file->ino = st.st_ino;
+  return TRUE;
+}
+
+static void
+file_data_free (gpointer data)
+{
+  g_slice_free (FileData, data);
+}
+
+static void
+set_owner (GstBuffer *buffer, GstBuffer *owner)
+{
+  guint i;
+
+  for (i = 0; i < gst_buffer_n_memory (buffer); i++) {
+    GstMiniObject *mem = GST_MINI_OBJECT_CAST (gst_buffer_peek_memory (buffer, i));
+    FileData file;
+
+    gst_mini_object_set_qdata (mem, pool_owner_quark, owner, NULL);
+
+    if (owner && get_file (GST_MEMORY_CAST (mem), &file))
+      gst_mini_object_set_qdata (mem, pool_file_quark,
+                                 g_slice_dup (FileData, &file), file_data_free);
+    else
+      gst_mini_object_set_qdata (mem, pool_file_quark, NULL, NULL);
+  }
+}
+
+enum {
+  SLOT_EMPTY,
+  SLOT_FREE,
+  SLOT_USED,
+  SLOT_REMOVED,
+};
+
+static gint
+find_slot (GstPipeWirePool *pool, GstBuffer *buffer)
+{
+  gint i;
+
+  for (i = 0; i < GST_PIPEWIRE_POOL_MAX_BUFFERS; i++) {
+    if (g_atomic_pointer_get (&pool->buffers[i]) == buffer)
+      return i;
+  }
+  return -1;
+}
+
+static void
+wakeup (GstPipeWirePool *pool)
+{
+  if (g_atomic_int_get (&pool->waiting) > 0)
+    gst_poll_write_control (pool->poll);
+}
+
+static void
+clear_slot (GstPipeWirePool *pool, gint i)
+{
+  g_atomic_pointer_set (&pool->buffers[i], NULL);
+  g_atomic_int_set (&pool->state[i], SLOT_EMPTY);
+}
+
+/* give back slot @i, a buffer that was removed while in use is freed */
+static void
+put_slot (GstPipeWirePool *pool, gint i)
+{
+  GstBuffer *buffer = g_atomic_pointer_get (&pool->buffers[i]);
+
+  if (g_atomic_int_compare_and_exchange (&pool->state[i], SLOT_USED, SLOT_FREE)) {
+    wakeup (pool);
+    return;
+  }
+  GST_DEBUG ("buffer %p was removed", buffer);
+  set_owner (buffer, NULL);
+  clear_slot (pool, i);
+  gst_buffer_unref (buffer);
+}
+
+/* claim slot @i when it holds @buffer */
+static gboolean
+take_slot (GstPipeWirePool *pool, gint i, GstBuffer *buffer)
+{
+  if (!g_atomic_int_compare_and_exchange (&pool->state[i], SLOT_FREE, SLOT_USED))
+    return FALSE;
+
+  /* the slot was reused for another buffer */
+  if (g_atomic_pointer_get (&pool->buffers[i]) != buffer) {
+    put_slot (pool, i);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static GstBuffer *
+take_free (GstPipeWirePool *pool)
+{
+  gint i;
+
+  for (i = 0; i < GST_PIPEWIRE_POOL_MAX_BUFFERS; i++) {
+    if (g_atomic_int_get (&pool->state[i]) == SLOT_FREE &&
+        g_atomic_int_compare_and_exchange (&pool->state[i], SLOT_FREE, SLOT_USED))
+      return g_atomic_pointer_get (&pool->buffers[i]);
+  }
+  return NULL;
+}
+
 gboolean
 gst_pipewire_pool_add_buffer (GstPipeWirePool *pool, GstBuffer *buffer)
 {
+  gint i;
+
   g_return_val_if_fail (GST_IS_PIPEWIRE_POOL (pool), FALSE);
   g_return_val_if_fail (GST_IS_BUFFER (buffer), FALSE);
 
-  GST_OBJECT_LOCK (pool);
-  g_queue_push_tail (&pool->available, buffer);
-  g_cond_signal (&pool->cond);
-  GST_OBJECT_UNLOCK (pool);
+  for (i = 0; i < GST_PIPEWIRE_POOL_MAX_BUFFERS; i++) {
+    if (g_atomic_int_get (&pool->state[i]) == SLOT_EMPTY)
+      break;
+  }
+  if (i == GST_PIPEWIRE_POOL_MAX_BUFFERS) {
+    GST_WARNING ("no free slot for buffer %p", buffer);
+    return FALSE;
+  }
+
+  set_owner (buffer, buffer);
+  g_atomic_pointer_set (&pool->buffers[i], buffer);
+  g_atomic_int_set (&pool->state[i], SLOT_FREE);
+  wakeup (pool);
 
   return TRUE;
 }
 
+/**
+ * gst_pipewire_pool_remove_buffer:
+ * @pool: a #GstPipeWirePool
+ * @buffer: a #GstBuffer
+ *
+ * Remove @buffer from @pool. A buffer that is in use is kept alive with
+ * an extra ref, it is unreffed when it is released.
+ *
+ * Returns: %TRUE when the buffer was available, %FALSE when it is in use.
+ */
 gboolean
 gst_pipewire_pool_remove_buffer (GstPipeWirePool *pool, GstBuffer *buffer)
 {
-  gboolean res;
+  gint i;
 
   g_return_val_if_fail (GST_IS_PIPEWIRE_POOL (pool), FALSE);
   g_return_val_if_fail (GST_IS_BUFFER (buffer), FALSE);
 
-  GST_OBJECT_LOCK (pool);
-  res = g_queue_remove (&pool->available, buffer);
-  GST_OBJECT_UNLOCK (pool);
+  if ((i = find_slot (pool, buffer)) < 0)
+    return FALSE;
+
+  /* for put_slot when the buffer is in use */
+  gst_buffer_ref (buffer);
+
+  while (TRUE) {
+    switch (g_atomic_int_get (&pool->state[i])) {
+    case SLOT_FREE:
+      if (!g_atomic_int_compare_and_exchange (&pool->state[i], SLOT_FREE, SLOT_REMOVED))
+        break;
+      set_owner (buffer, NULL);
+      clear_slot (pool, i);
+      gst_buffer_unref (buffer);
+      return TRUE;
+    case SLOT_USED:
+      if (!g_atomic_int_compare_and_exchange (&pool->state[i], SLOT_USED, SLOT_REMOVED))
+        break;
+      return FALSE;
+    default:
+      gst_buffer_unref (buffer);
+      return FALSE;
+    }
+  }
+}
+
+/* the pool buffer with exactly the memory of @buffer, the memory points
+ * to its owner but that can be freed, only the pointer is compared until
+ * the slot is claimed */
+static GstBuffer *
+take_owner (GstPipeWirePool *pool, GstBuffer *buffer)
+{
+  GstBuffer *owner;
+  guint i, n_mem;
+  gint slot;
+
+  n_mem = gst_buffer_n_memory (buffer);
+  if (n_mem == 0)
+    return NULL;
+
+  owner = gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (gst_buffer_peek_memory (buffer, 0)),
+                                     pool_owner_quark);
+  if (owner == NULL || (slot = find_slot (pool, owner)) < 0 ||
+      !take_slot (pool, slot, owner))
+    return NULL;
+
+  if (gst_buffer_n_memory (owner) != n_mem)
+    goto mismatch;
+
+  for (i = 0; i < n_mem; i++) {
+    if (gst_buffer_peek_memory (owner, i) != gst_buffer_peek_memory (buffer, i))
+      goto mismatch;
+  }
+  return owner;
+
+mismatch:
+  put_slot (pool, slot);
+  return NULL;
+}
+
+/* an available pool buffer with the same part of the same files as the
+ * fd memory of @buffer. This is our memory that was exported and imported
+ * again upstream, as a dmabuf or a memfd, in a new GstMemory. */
+static GstBuffer *
+take_file_owner (GstPipeWirePool *pool, GstBuffer *buffer)
+{
+  FileData *files;
+  guint i, n_mem;
+  gint slot;
+
+  n_mem = gst_buffer_n_memory (buffer);
+  if (n_mem == 0)
+    return NULL;
+
+  files = g_newa (FileData, n_mem);
+  for (i = 0; i < n_mem; i++) {
+    if (!get_file (gst_buffer_peek_memory (buffer, i), &files[i]))
+      return NULL;
+  }
+
+  for (slot = 0; slot < GST_PIPEWIRE_POOL_MAX_BUFFERS; slot++) {
+    GstBuffer *b = g_atomic_pointer_get (&pool->buffers[slot]);
+
+    if (b == NULL || !take_slot (pool, slot, b))
+      continue;
+
+    if (gst_buffer_n_memory (b) == n_mem) {
+      for (i = 0; i < n_mem; i++) {
+        GstMemory *m1 = gst_buffer_peek_memory (b, i);
+        GstMemory *m2 = gst_buffer_peek_memory (buffer, i);
+        FileData *file = gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (m1),
+                                                    pool_file_quark);
+
+        if (file == NULL || file->dev != files[i].dev || file->ino != files[i].ino ||
+            m1->offset != m2->offset || m2->offset + m2->size > m1->maxsize)
+          break;
+      }
+      if (i == n_mem)
+        return b;
+    }
+    put_slot (pool, slot);
+  }
+  return NULL;
+}
 
-  return res;
+/**
+ * gst_pipewire_pool_acquire_owner:
+ * @pool: a #GstPipeWirePool
+ * @buffer: a #GstBuffer
+ * @owner: the pool buffer that owns the memory of @buffer
+ *
+ * Upstream elements that wrap or copy our buffers make new buffers with
+ * the memory of the pool buffers. Elements that import our buffers by
+ * their fd, as a dmabuf or a memfd, make new memory for the same file.
+ * This acquires the pool buffer with the memory of @buffer so that it can
+ * be sent without copying the data.
+ *
+ * This must be called from the thread that acquires the buffers.
+ *
+ * Returns: %GST_FLOW_OK when the pool buffer was acquired, %GST_FLOW_EOS
+ * when @buffer does not use the memory of an available pool buffer.
+ */
+GstFlowReturn
+gst_pipewire_pool_acquire_owner (GstPipeWirePool *pool, GstBuffer *buffer,
+                                 GstBuffer **owner)
+{
+  GstBufferPoolAcquireParams params = { 0, };
+  GstFlowReturn res;
+  GstBuffer *b;
+  guint i;
+
+  g_return_val_if_fail (GST_IS_PIPEWIRE_POOL (pool), GST_FLOW_ERROR);
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), GST_FLOW_ERROR);
+
+  if ((b = take_owner (pool, buffer)) == NULL &&
+      (b = take_file_owner (pool, buffer)) == NULL)
+    return GST_FLOW_EOS;
+
+  /* the slot is ours, acquire_buffer hands it out */
+  pool->owner = b;
+  params.flags = GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT | GST_PIPEWIRE_POOL_ACQUIRE_FLAG_OWNER;
+
+  res = gst_buffer_pool_acquire_buffer (GST_BUFFER_POOL_CAST (pool), owner, &params);
+  if (pool->owner) {
+    put_slot (pool, find_slot (pool, pool->owner));
+    pool->owner = NULL;
+  }
+  if (res != GST_FLOW_OK)
+    return res;
+
+  /* imported memory can use less of the file than our memory */
+  for (i = 0; i < gst_buffer_n_memory (b); i++) {
+    GstMemory *mem = gst_buffer_peek_memory (b, i);
+    GstMemory *umem = gst_buffer_peek_memory (buffer, i);
+
+    if (mem != umem && mem->size != umem->size)
+      gst_memory_resize (mem, 0, umem->size);
+  }
+  return GST_FLOW_OK;
 }
 
 static GstFlowReturn
@@ -85,28 +390,38 @@ acquire_buffer (GstBufferPool * pool, GstBuffer ** buffer,
 {
   GstPipeWirePool *p = GST_PIPEWIRE_POOL (pool);
 
-  GST_OBJECT_LOCK (pool);
+  if (params && (params->flags & GST_PIPEWIRE_POOL_ACQUIRE_FLAG_OWNER)) {
+    *buffer = p->owner;
+    p->owner = NULL;
+    GST_DEBUG ("acquire owner %p", *buffer);
+    return *buffer ? GST_FLOW_OK : GST_FLOW_EOS;
+  }
+
   while (TRUE) {
     if (G_UNLIKELY (GST_BUFFER_POOL_IS_FLUSHING (pool)))
-      goto flushing;
+      return GST_FLOW_FLUSHING;
 
-    if (p->available.length > 0)
+    if ((*buffer = take_free (p)))
       break;
 
+    if (params && (params->flags & GST_BUFFER_POOL_ACQUIRE_FLAG_DONTWAIT))
+      return GST_FLOW_EOS;
+
     GST_WARNING ("queue empty");
-    g_cond_wait (&p->cond, GST_OBJECT_GET_LOCK (pool));
+    /* a buffer that is released after this sees the waiter and wakes us up */
+    g_atomic_int_inc (&p->waiting);
+    if ((*buffer = take_free (p)) == NULL && !GST_BUFFER_POOL_IS_FLUSHING (pool)) {
+      gst_poll_wait (p->poll, GST_CLOCK_TIME_NONE);
+      gst_poll_read_control (p->poll);
+    }
+    g_atomic_int_add (&p->waiting, -1);
+
+    if (*buffer)
+      break;
   }
-  *buffer = g_queue_pop_head (&p->available);
-  GST_OBJECT_UNLOCK (pool);
   GST_DEBUG ("acquire buffer %p", *buffer);
 
   return GST_FLOW_OK;
-
-flushing:
-  {
-    GST_OBJECT_UNLOCK (pool);
-    return GST_FLOW_FLUSHING;
-  }
 }
 
 static void
@@ -115,21 +430,30 @@ flush_start (GstBufferPool * pool)
   GstPipeWirePool *p = GST_PIPEWIRE_POOL (pool);
 
   GST_DEBUG ("flush start");
-  GST_OBJECT_LOCK (pool);
-  g_cond_signal (&p->cond);
-  GST_OBJECT_UNLOCK (pool);
+  gst_poll_write_control (p->poll);
+}
+
+static void
+flush_stop (GstBufferPool * pool)
+{
+  GstPipeWirePool *p = GST_PIPEWIRE_POOL (pool);
+
+  GST_DEBUG ("flush stop");
+  while (gst_poll_read_control (p->poll));
 }
 
 static void
 release_buffer (GstBufferPool * pool, GstBuffer *buffer)
 {
   GstPipeWirePool *p = GST_PIPEWIRE_POOL (pool);
+  gint i;
 
   GST_DEBUG ("release buffer %p", buffer);
-  GST_OBJECT_LOCK (pool);
-  g_queue_push_tail (&p->available, buffer);
-  g_cond_signal (&p->cond);
-  GST_OBJECT_UNLOCK (pool);
+  if ((i = find_slot (p, buffer)) < 0) {
+    gst_buffer_unref (buffer);
+    return;
+  }
+  put_slot (p, i);
 }
 
 static gboolean
@@ -145,6 +469,7 @@ gst_pipewire_pool_finalize (GObject * object)
   GstPipeWirePool *pool = GST_PIPEWIRE_POOL (object);
 
   GST_DEBUG_OBJECT (pool, "finalize");
+  gst_poll_free (pool->poll);
 
   G_OBJECT_CLASS (gst_pipewire_pool_parent_class)->finalize (object);
 }
@@ -159,6 +484,7 @@ gst_pipewire_pool_class_init (GstPipeWirePoolClass * klass)
 
   bufferpool_class->start = do_start;
   bufferpool_class->flush_start = flush_start;
+  bufferpool_class->flush_stop = flush_stop;
   bufferpool_class->acquire_buffer = acquire_buffer;
   bufferpool_class->release_buffer = release_buffer;
 
@@ -168,11 +494,13 @@ gst_pipewire_pool_class_init (GstPipeWirePoolClass * klass)
 
   GST_DEBUG_CATEGORY_INIT (gst_pipewire_pool_debug_category, "pipewirepool", 0,
       "debug category for pipewirepool object");
+
+  pool_owner_quark = g_quark_from_static_string ("GstPipeWirePoolOwnerQuark");
+  pool_file_quark = g_quark_from_static_string ("GstPipeWirePoolFileQuark");
 }
 
 static void
 gst_pipewire_pool_init (GstPipeWirePool * pool)
 {
-  g_cond_init (&pool->cond);
-  g_queue_init (&pool->available);
+  pool->poll = gst_poll_new_timer ();
 }
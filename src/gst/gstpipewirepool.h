@@ -39,6 +39,8 @@ G_BEGIN_DECLS
 #define GST_PIPEWIRE_POOL_GET_CLASS(klass) \
   (G_TYPE_INSTANCE_GET_CLASS ((klass), GST_TYPE_PIPEWIRE_POOL, GstPipeWirePoolClass))
 
+#define GST_PIPEWIRE_POOL_MAX_BUFFERS 64
+
 typedef struct _GstPipeWirePool GstPipeWirePool;
 typedef struct _GstPipeWirePoolClass GstPipeWirePoolClass;
 
@@ -46,8 +48,14 @@ struct _GstPipeWirePool {
   GstBufferPool parent;
 
   struct pw_stream *stream;
-  GQueue available;
-  GCond cond;
+
+  /* buffers are added and removed in the pipewire thread and acquired and
+   * released in any thread, the slots are claimed with atomic operations */
+  GstBuffer *buffers[GST_PIPEWIRE_POOL_MAX_BUFFERS];
+  gint state[GST_PIPEWIRE_POOL_MAX_BUFFERS];
+  gint waiting;
+  GstPoll *poll;
+  GstBuffer *owner;
 };
 
 struct _GstPipeWirePoolClass {
@@ -61,6 +69,9 @@ GstPipeWirePool *  gst_pipewire_pool_new           (void);
 gboolean        gst_pipewire_pool_add_buffer    (GstPipeWirePool *pool, GstBuffer *buffer);
 gboolean        gst_pipewire_pool_remove_buffer (GstPipeWirePool *pool, GstBuffer *buffer);
 
+GstFlowReturn   gst_pipewire_pool_acquire_owner (GstPipeWirePool *pool, GstBuffer *buffer,
+                                                 GstBuffer **owner);
+
 G_END_DECLS
 
 #endif /* __GST_PIPEWIRE_POOL_H__ */
@@ -0,0 +1,93 @@
+/* GStreamer
+ * Copyright (C) <2018> Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_PIPEWIRE_RING_H__
+#define __GST_PIPEWIRE_RING_H__
+
+#include <glib.h>
+
+#include <spa/utils/ringbuffer.h>
+
+G_BEGIN_DECLS
+
+/* enough for all the buffers of a stream */
+#define GST_PIPEWIRE_RING_SIZE	64
+
+/**
+ * GstPipeWireRing:
+ *
+ * A ring of pointers with one producer and one consumer thread that
+ * does not lock.
+ */
+typedef struct {
+  struct spa_ringbuffer ring;
+  gpointer items[GST_PIPEWIRE_RING_SIZE];
+} GstPipeWireRing;
+
+static inline void
+gst_pipewire_ring_init (GstPipeWireRing *ring)
+{
+  spa_ringbuffer_init (&ring->ring);
+}
+
+static inline gboolean
+gst_pipewire_ring_is_empty (GstPipeWireRing *ring)
+{
+  uint32_t index;
+
+  return spa_ringbuffer_get_read_index (&ring->ring, &index) <= 0;
+}
+
+/* only called from the producer thread. Returns the number of items in
+ * the ring after the push, 0 when the ring is full */
+static inline gint
+gst_pipewire_ring_push (GstPipeWireRing *ring, gpointer item)
+{
+  uint32_t index;
+  int32_t filled;
+
+  filled = spa_ringbuffer_get_write_index (&ring->ring, &index);
+  if (filled >= GST_PIPEWIRE_RING_SIZE)
+    return 0;
+
+  ring->items[index & (GST_PIPEWIRE_RING_SIZE - 1)] = item;
+  spa_ringbuffer_write_update (&ring->ring, index + 1);
+
+  return spa_ringbuffer_get_write_index (&ring->ring, &index);
+}
+
+/* only called from the consumer thread, NULL when the ring is empty */
+static inline gpointer
+gst_pipewire_ring_pop (GstPipeWireRing *ring)
+{
+  uint32_t index;
+  gpointer item;
+
+  if (spa_ringbuffer_get_read_index (&ring->ring, &index) <= 0)
+    return NULL;
+
+  item = ring->items[index & (GST_PIPEWIRE_RING_SIZE - 1)];
+  spa_ringbuffer_read_update (&ring->ring, index + 1);
+
+  return item;
+}
+
+G_END_DECLS
+
+#endif /* __GST_PIPEWIRE_RING_H__ */
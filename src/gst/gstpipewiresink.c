@@ -107,6 +107,17 @@ static GstFlowReturn gst_pipewire_sink_render (GstBaseSink * psink,
 static gboolean gst_pipewire_sink_start (GstBaseSink * basesink);
 static gboolean gst_pipewire_sink_stop (GstBaseSink * basesink);
 
+static void on_send_event (void *data, uint64_t count);
+
+static void
+clear_queue (GstPipeWireSink *pwsink)
+{
+  GstBuffer *buffer;
+
+  while ((buffer = gst_pipewire_ring_pop (&pwsink->queue)))
+    gst_buffer_unref (buffer);
+}
+
 static void
 gst_pipewire_sink_finalize (GObject * object)
 {
@@ -114,9 +125,12 @@ gst_pipewire_sink_finalize (GObject * object)
 
   g_object_unref (pwsink->pool);
 
+  clear_queue (pwsink);
+
   pw_thread_loop_destroy (pwsink->main_loop);
   pwsink->main_loop = NULL;
 
+  pw_loop_destroy_source (pwsink->loop, pwsink->send_event);
   pw_loop_destroy (pwsink->loop);
   pwsink->loop = NULL;
 
@@ -273,9 +287,10 @@ gst_pipewire_sink_init (GstPipeWireSink * sink)
   sink->buf_ids = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
       (GDestroyNotify) gst_buffer_unref);
 
-  g_queue_init (&sink->queue);
+  gst_pipewire_ring_init (&sink->queue);
 
   sink->loop = pw_loop_new (NULL);
+  sink->send_event = pw_loop_add_event (sink->loop, on_send_event, sink);
   sink->main_loop = pw_thread_loop_new (sink->loop, "pipewire-sink-loop");
   sink->core = pw_core_new (sink->loop, NULL);
   sink->type = pw_core_get_type (sink->core);
@@ -395,6 +410,7 @@ typedef struct {
   struct spa_meta_header *header;
   guint flags;
   goffset offset;
+  gint removed;
 } ProcessMemData;
 
 static void
@@ -430,6 +446,7 @@ on_add_buffer (void     *_data,
   data.id = id;
   data.buf = b;
   data.header = spa_buffer_find_meta (b, t->meta.Header);
+  data.removed = FALSE;
 
   for (i = 0; i < b->n_datas; i++) {
     struct spa_data *d = &b->datas[i];
@@ -472,11 +489,14 @@ on_remove_buffer (void     *data,
   GST_LOG_OBJECT (pwsink, "remove buffer");
   buf = g_hash_table_lookup (pwsink->buf_ids, GINT_TO_POINTER (id));
   if (buf) {
-    GST_MINI_OBJECT_CAST (buf)->dispose = NULL;
-    if (!gst_pipewire_pool_remove_buffer (pwsink->pool, buf))
-      gst_buffer_ref (buf);
-    if (g_queue_remove (&pwsink->queue, buf))
-      gst_buffer_unref (buf);
+    ProcessMemData *pdata;
+
+    /* a buffer in use is freed when it is released */
+    gst_pipewire_pool_remove_buffer (pwsink->pool, buf);
+    /* the buffer is dropped when it is still in the queue */
+    pdata = gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buf),
+                                       process_mem_data_quark);
+    g_atomic_int_set (&pdata->removed, TRUE);
     g_hash_table_remove (pwsink->buf_ids, GINT_TO_POINTER (id));
   }
 }
@@ -509,14 +529,19 @@ do_send_buffer (GstPipeWireSink *pwsink)
   gboolean res;
   guint i;
 
-  buffer = g_queue_pop_head (&pwsink->queue);
-  if (buffer == NULL) {
-    GST_WARNING ("out of buffers");
-    return;
-  }
+  while (TRUE) {
+    buffer = gst_pipewire_ring_pop (&pwsink->queue);
+    if (buffer == NULL) {
+      GST_LOG ("out of buffers");
+      return;
+    }
+    data = gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buffer),
+                                      process_mem_data_quark);
+    if (!g_atomic_int_get (&data->removed))
+      break;
 
-  data = gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buffer),
-                                    process_mem_data_quark);
+    gst_buffer_unref (buffer);
+  }
 
   if (data->header) {
     data->header->seq = GST_BUFFER_OFFSET (buffer);
@@ -534,7 +559,7 @@ do_send_buffer (GstPipeWireSink *pwsink)
     g_warning ("can't send buffer");
     pw_thread_loop_signal (pwsink->main_loop, FALSE);
   } else
-    pwsink->need_ready--;
+    g_atomic_int_add (&pwsink->need_ready, -1);
 }
 
 
@@ -542,11 +567,25 @@ static void
 on_need_buffer (void *data)
 {
   GstPipeWireSink *pwsink = data;
-  pwsink->need_ready++;
-  GST_DEBUG ("need buffer %u", pwsink->need_ready);
+  g_atomic_int_inc (&pwsink->need_ready);
+  GST_DEBUG ("need buffer %u", g_atomic_int_get (&pwsink->need_ready));
   do_send_buffer (pwsink);
 }
 
+/* render queued a buffer while the stream was waiting for one */
+static void
+on_send_event (void *data, uint64_t count)
+{
+  GstPipeWireSink *pwsink = data;
+
+  if (pwsink->stream == NULL)
+    return;
+
+  while (g_atomic_int_get (&pwsink->need_ready) > 0 &&
+         !gst_pipewire_ring_is_empty (&pwsink->queue))
+    do_send_buffer (pwsink);
+}
+
 static void
 on_state_changed (void *data, enum pw_stream_state old, enum pw_stream_state state, const char *error)
 {
@@ -554,6 +593,8 @@ on_state_changed (void *data, enum pw_stream_state old, enum pw_stream_state sta
 
   GST_DEBUG ("got stream state %d", state);
 
+  g_atomic_int_set (&pwsink->streaming, state == PW_STREAM_STATE_STREAMING);
+
   switch (state) {
     case PW_STREAM_STATE_UNCONNECTED:
     case PW_STREAM_STATE_CONNECTING:
@@ -647,15 +688,14 @@ gst_pipewire_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
 {
   GstPipeWireSink *pwsink;
   GstFlowReturn res = GST_FLOW_OK;
-  const char *error = NULL;
 
   pwsink = GST_PIPEWIRE_SINK (bsink);
 
   if (!pwsink->negotiated)
     goto not_negotiated;
 
-  pw_thread_loop_lock (pwsink->main_loop);
-  if (pw_stream_get_state (pwsink->stream, &error) != PW_STREAM_STATE_STREAMING)
+  /* the loop is not locked, buffers are handed over in the queue */
+  if (!g_atomic_int_get (&pwsink->streaming))
     goto done;
 
   if (buffer->pool != GST_BUFFER_POOL_CAST (pwsink->pool)) {
@@ -665,27 +705,40 @@ gst_pipewire_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
     if (!gst_buffer_pool_is_active (GST_BUFFER_POOL_CAST (pwsink->pool)))
       gst_buffer_pool_set_active (GST_BUFFER_POOL_CAST (pwsink->pool), TRUE);
 
-    if ((res = gst_buffer_pool_acquire_buffer (GST_BUFFER_POOL_CAST (pwsink->pool), &b, NULL)) != GST_FLOW_OK)
-      goto done;
-
-    gst_buffer_map (b, &info, GST_MAP_WRITE);
-    gst_buffer_extract (buffer, 0, info.data, info.size);
-    gst_buffer_unmap (b, &info);
-    gst_buffer_resize (b, 0, gst_buffer_get_size (buffer));
+    if (gst_pipewire_pool_acquire_owner (pwsink->pool, buffer, &b) == GST_FLOW_OK) {
+      /* made from the memory of one of our buffers, send that one */
+      GST_LOG_OBJECT (pwsink, "import buffer %p from %p", b, buffer);
+      GST_BUFFER_PTS (b) = GST_BUFFER_PTS (buffer);
+      GST_BUFFER_DTS (b) = GST_BUFFER_DTS (buffer);
+      GST_BUFFER_OFFSET (b) = GST_BUFFER_OFFSET (buffer);
+    } else {
+      if ((res = gst_buffer_pool_acquire_buffer (GST_BUFFER_POOL_CAST (pwsink->pool), &b, NULL)) != GST_FLOW_OK)
+        goto done;
+
+      gst_buffer_map (b, &info, GST_MAP_WRITE);
+      gst_buffer_extract (buffer, 0, info.data, info.size);
+      gst_buffer_unmap (b, &info);
+      gst_buffer_resize (b, 0, gst_buffer_get_size (buffer));
+    }
     buffer = b;
   } else {
     gst_buffer_ref (buffer);
   }
 
   GST_DEBUG ("push buffer in queue");
-  g_queue_push_tail (&pwsink->queue, buffer);
+  if (!gst_pipewire_ring_push (&pwsink->queue, buffer)) {
+    GST_WARNING_OBJECT (pwsink, "queue full");
+    gst_buffer_unref (buffer);
+    goto done;
+  }
 
-  if (pwsink->need_ready && pwsink->mode == GST_PIPEWIRE_SINK_MODE_PROVIDE)
-    do_send_buffer (pwsink);
+  /* only wake up the loop when the stream is waiting for a buffer,
+   * the push must be visible before need_ready is checked */
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  if (g_atomic_int_get (&pwsink->need_ready) > 0 && pwsink->mode == GST_PIPEWIRE_SINK_MODE_PROVIDE)
+    pw_loop_signal_event (pwsink->loop, pwsink->send_event);
 
 done:
-  pw_thread_loop_unlock (pwsink->main_loop);
-
   return res;
 
 not_negotiated:
@@ -759,6 +812,9 @@ gst_pipewire_sink_stop (GstBaseSink * basesink)
     pwsink->stream = NULL;
     pwsink->pool->stream = NULL;
   }
+  clear_queue (pwsink);
+  g_atomic_int_set (&pwsink->need_ready, 0);
+  g_atomic_int_set (&pwsink->streaming, FALSE);
   pw_thread_loop_unlock (pwsink->main_loop);
 
   pwsink->negotiated = FALSE;
@@ -25,6 +25,7 @@
 
 #include <pipewire/pipewire.h>
 #include <gst/gstpipewirepool.h>
+#include <gst/gstpipewirering.h>
 
 G_BEGIN_DECLS
 
@@ -94,8 +95,10 @@ struct _GstPipeWireSink {
 
   GstPipeWirePool *pool;
   GHashTable *buf_ids;
-  GQueue queue;
-  guint need_ready;
+  GstPipeWireRing queue;	/* from the streaming thread to the loop */
+  gint need_ready;
+  gint streaming;
+  struct spa_source *send_event;
 };
 
 struct _GstPipeWireSinkClass {
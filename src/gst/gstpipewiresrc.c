@@ -42,6 +42,7 @@
 
 #include <gst/net/gstnetclientclock.h>
 #include <gst/allocators/gstfdmemory.h>
+#include <gst/allocators/gstdmabuf.h>
 #include <gst/video/video.h>
 
 #include "gstpipewireclock.h"
@@ -87,6 +88,8 @@ static gboolean gst_pipewire_src_stop (GstBaseSrc * basesrc);
 static gboolean gst_pipewire_src_event (GstBaseSrc * src, GstEvent * event);
 static gboolean gst_pipewire_src_query (GstBaseSrc * src, GstQuery * query);
 
+static void on_recycle_event (void *data, uint64_t count);
+
 static void
 gst_pipewire_src_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec)
@@ -180,8 +183,10 @@ clock_disabled:
 static void
 clear_queue (GstPipeWireSrc *pwsrc)
 {
-  g_queue_foreach (&pwsrc->queue, (GFunc) gst_mini_object_unref, NULL);
-  g_queue_clear (&pwsrc->queue);
+  GstBuffer *buffer;
+
+  while ((buffer = gst_pipewire_ring_pop (&pwsrc->queue)))
+    gst_buffer_unref (buffer);
 }
 
 static void
@@ -196,12 +201,14 @@ gst_pipewire_src_finalize (GObject * object)
   pwsrc->type = NULL;
   pw_thread_loop_destroy (pwsrc->main_loop);
   pwsrc->main_loop = NULL;
+  pw_loop_destroy_source (pwsrc->loop, pwsrc->recycle_event);
   pw_loop_destroy (pwsrc->loop);
   pwsrc->loop = NULL;
 
   if (pwsrc->properties)
     gst_structure_free (pwsrc->properties);
   g_object_unref (pwsrc->fd_allocator);
+  g_object_unref (pwsrc->dmabuf_allocator);
   if (pwsrc->clock)
     gst_object_unref (pwsrc->clock);
   g_free (pwsrc->path);
@@ -299,13 +306,15 @@ gst_pipewire_src_init (GstPipeWireSrc * src)
 
   src->always_copy = DEFAULT_ALWAYS_COPY;
 
-  g_queue_init (&src->queue);
+  gst_pipewire_ring_init (&src->queue);
 
   src->fd_allocator = gst_fd_allocator_new ();
+  src->dmabuf_allocator = gst_dmabuf_allocator_new ();
   src->client_name = pw_get_client_name ();
   src->buf_ids = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) gst_buffer_unref);
 
   src->loop = pw_loop_new (NULL);
+  src->recycle_event = pw_loop_add_event (src->loop, on_recycle_event, src);
   src->main_loop = pw_thread_loop_new (src->loop, "pipewire-main-loop");
   src->core = pw_core_new (src->loop, NULL);
   src->type = pw_core_get_type (src->core);
@@ -320,6 +329,7 @@ typedef struct {
   struct spa_meta_header *header;
   guint flags;
   goffset offset;
+  gint removed;
 } ProcessMemData;
 
 static void
@@ -336,6 +346,7 @@ buffer_recycle (GstMiniObject *obj)
 {
   ProcessMemData *data;
   GstPipeWireSrc *src;
+  guint64 pending;
 
   gst_mini_object_ref (obj);
   data = gst_mini_object_get_qdata (obj,
@@ -344,13 +355,40 @@ buffer_recycle (GstMiniObject *obj)
   src = data->src;
 
   GST_LOG_OBJECT (obj, "recycle buffer");
-  pw_thread_loop_lock (src->main_loop);
-  pw_stream_recycle_buffer (src->stream, data->id);
-  pw_thread_loop_unlock (src->main_loop);
+
+  if (data->id >= GST_PIPEWIRE_SRC_MAX_BUFFERS) {
+    GST_WARNING_OBJECT (src, "can't recycle buffer %u", data->id);
+    return FALSE;
+  }
+
+  /* buffers are freed from any thread, with other ids pending the loop
+   * was not done with them yet */
+  pending = __atomic_fetch_or (&src->recycle, 1ULL << data->id, __ATOMIC_SEQ_CST);
+  if (pending == 0)
+    pw_loop_signal_event (src->loop, src->recycle_event);
 
   return FALSE;
 }
 
+static void
+do_recycle (GstPipeWireSrc *pwsrc)
+{
+  guint64 pending;
+  guint id;
+
+  pending = __atomic_exchange_n (&pwsrc->recycle, 0, __ATOMIC_SEQ_CST);
+  for (id = 0; pending; id++, pending >>= 1) {
+    if ((pending & 1) && pwsrc->stream)
+      pw_stream_recycle_buffer (pwsrc->stream, id);
+  }
+}
+
+static void
+on_recycle_event (void *data, uint64_t count)
+{
+  do_recycle (data);
+}
+
 static void
 on_add_buffer (void *_data, guint id)
 {
@@ -376,17 +414,25 @@ on_add_buffer (void *_data, guint id)
   data.id = id;
   data.buf = b;
   data.header = spa_buffer_find_meta (b, t->meta.Header);
+  data.removed = FALSE;
 
   for (i = 0; i < b->n_datas; i++) {
     struct spa_data *d = &b->datas[i];
     GstMemory *gmem = NULL;
 
-    if (d->type == t->data.MemFd || d->type == t->data.DmaBuf) {
+    if (d->type == t->data.MemFd) {
       gmem = gst_fd_allocator_alloc (pwsrc->fd_allocator, dup (d->fd),
                 d->mapoffset + d->maxsize, GST_FD_MEMORY_FLAG_NONE);
       gst_memory_resize (gmem, d->mapoffset, d->maxsize);
       data.offset = d->mapoffset;
     }
+    else if (d->type == t->data.DmaBuf) {
+      /* downstream can import the dmabuf without touching the data */
+      gmem = gst_dmabuf_allocator_alloc (pwsrc->dmabuf_allocator, dup (d->fd),
+                d->mapoffset + d->maxsize);
+      gst_memory_resize (gmem, d->mapoffset, d->maxsize);
+      data.offset = d->mapoffset;
+    }
     else if (d->type == t->data.MemPtr) {
       gmem = gst_memory_new_wrapped (0, d->data, d->maxsize, 0,
                 d->maxsize, NULL, NULL);
@@ -413,21 +459,18 @@ on_remove_buffer (void *data,
 
   GST_LOG_OBJECT (pwsrc, "remove buffer");
   buf = g_hash_table_lookup (pwsrc->buf_ids, GINT_TO_POINTER (id));
+  /* the pending ids are for the old buffers */
+  do_recycle (pwsrc);
+
   if (buf) {
-    GList *walk;
+    ProcessMemData *pdata;
 
     GST_MINI_OBJECT_CAST (buf)->dispose = NULL;
 
-    walk = pwsrc->queue.head;
-    while (walk) {
-      GList *next = walk->next;
-
-      if (walk->data == buf) {
-        gst_buffer_unref (buf);
-        g_queue_delete_link (&pwsrc->queue, walk);
-      }
-      walk = next;
-    }
+    /* the buffer is dropped when it is still in the queue */
+    pdata = gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buf),
+                                       process_mem_data_quark);
+    g_atomic_int_set (&pdata->removed, TRUE);
     g_hash_table_remove (pwsrc->buf_ids, GINT_TO_POINTER (id));
   }
 }
@@ -475,9 +518,15 @@ on_new_buffer (void *_data,
   else
     gst_buffer_ref (buf);
 
-  g_queue_push_tail (&pwsrc->queue, buf);
+  if (!gst_pipewire_ring_push (&pwsrc->queue, buf)) {
+    GST_WARNING_OBJECT (pwsrc, "queue full");
+    gst_buffer_unref (buf);
+    return;
+  }
 
-  pw_thread_loop_signal (pwsrc->main_loop, FALSE);
+  /* the streaming thread sets waiting with the lock we hold */
+  if (g_atomic_int_get (&pwsrc->waiting))
+    pw_thread_loop_signal (pwsrc->main_loop, FALSE);
   return;
 }
 
@@ -757,7 +806,11 @@ on_format_changed (void           *data,
 	":", t->param_buffers.size,    "ir", 0,  SPA_PROP_RANGE(0, INT32_MAX),
 	":", t->param_buffers.stride,  "ir", 0,  SPA_PROP_RANGE(0, INT32_MAX),
 	":", t->param_buffers.buffers, "ir", 16, SPA_PROP_RANGE(1, INT32_MAX),
-	":", t->param_buffers.align,   "i", 16);
+	":", t->param_buffers.align,   "i", 16,
+	":", t->param_buffers.dataType, "Ieu", t->data.DmaBuf,
+						3, t->data.DmaBuf,
+						   t->data.MemFd,
+						   t->data.MemPtr);
 
     params[1] = spa_pod_builder_object (&b,
 	t->param.idMeta, t->param_meta.Meta,
@@ -779,7 +832,7 @@ gst_pipewire_src_unlock (GstBaseSrc * basesrc)
 
   pw_thread_loop_lock (pwsrc->main_loop);
   GST_DEBUG_OBJECT (pwsrc, "setting flushing");
-  pwsrc->flushing = TRUE;
+  g_atomic_int_set (&pwsrc->flushing, TRUE);
   pw_thread_loop_signal (pwsrc->main_loop, FALSE);
   pw_thread_loop_unlock (pwsrc->main_loop);
 
@@ -793,7 +846,7 @@ gst_pipewire_src_unlock_stop (GstBaseSrc * basesrc)
 
   pw_thread_loop_lock (pwsrc->main_loop);
   GST_DEBUG_OBJECT (pwsrc, "unsetting flushing");
-  pwsrc->flushing = FALSE;
+  g_atomic_int_set (&pwsrc->flushing, FALSE);
   pw_thread_loop_unlock (pwsrc->main_loop);
 
   return TRUE;
@@ -881,13 +934,25 @@ gst_pipewire_src_create (GstPushSrc * psrc, GstBuffer ** buffer)
   if (!pwsrc->negotiated)
     goto not_negotiated;
 
-  pw_thread_loop_lock (pwsrc->main_loop);
   while (TRUE) {
     enum pw_stream_state state;
+    ProcessMemData *data;
 
-    if (pwsrc->flushing)
+    if (g_atomic_int_get (&pwsrc->flushing))
       goto streaming_stopped;
 
+    /* take the buffers from the queue without locking the loop */
+    if ((*buffer = gst_pipewire_ring_pop (&pwsrc->queue)) != NULL) {
+      data = gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (*buffer),
+                                        process_mem_data_quark);
+      if (!g_atomic_int_get (&data->removed))
+        break;
+
+      gst_buffer_unref (*buffer);
+      continue;
+    }
+
+    pw_thread_loop_lock (pwsrc->main_loop);
     if (pwsrc->stream == NULL)
       goto streaming_error;
 
@@ -896,16 +961,15 @@ gst_pipewire_src_create (GstPushSrc * psrc, GstBuffer ** buffer)
       goto streaming_error;
 
     if (state != PW_STREAM_STATE_STREAMING)
-      goto streaming_stopped;
+      goto streaming_stopped_locked;
 
-    *buffer = g_queue_pop_head (&pwsrc->queue);
-    GST_DEBUG ("popped buffer %p", *buffer);
-    if (*buffer != NULL)
-      break;
-
-    pw_thread_loop_wait (pwsrc->main_loop);
+    g_atomic_int_set (&pwsrc->waiting, TRUE);
+    if (gst_pipewire_ring_is_empty (&pwsrc->queue) && !pwsrc->flushing)
+      pw_thread_loop_wait (pwsrc->main_loop);
+    g_atomic_int_set (&pwsrc->waiting, FALSE);
+    pw_thread_loop_unlock (pwsrc->main_loop);
   }
-  pw_thread_loop_unlock (pwsrc->main_loop);
+  GST_DEBUG ("popped buffer %p", *buffer);
 
   if (pwsrc->is_live)
     base_time = GST_ELEMENT_CAST (psrc)->base_time;
@@ -941,11 +1005,15 @@ streaming_error:
     pw_thread_loop_unlock (pwsrc->main_loop);
     return GST_FLOW_ERROR;
   }
-streaming_stopped:
+streaming_stopped_locked:
   {
     pw_thread_loop_unlock (pwsrc->main_loop);
     return GST_FLOW_FLUSHING;
   }
+streaming_stopped:
+  {
+    return GST_FLOW_FLUSHING;
+  }
 }
 
 static gboolean
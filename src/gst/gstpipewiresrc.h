@@ -24,6 +24,7 @@
 #include <gst/base/gstpushsrc.h>
 
 #include <pipewire/pipewire.h>
+#include <gst/gstpipewirering.h>
 
 G_BEGIN_DECLS
 
@@ -37,6 +38,10 @@ G_BEGIN_DECLS
   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_PIPEWIRE_SRC))
 #define GST_IS_PIPEWIRE_SRC_CLASS(klass) \
   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_PIPEWIRE_SRC))
+
+/* the ids of the buffers that are recycled with one bit each */
+#define GST_PIPEWIRE_SRC_MAX_BUFFERS 64
+
 #define GST_PIPEWIRE_SRC_CAST(obj) \
   ((GstPipeWireSrc *) (obj))
 
@@ -76,10 +81,15 @@ struct _GstPipeWireSrc {
   struct spa_hook stream_listener;
 
   GstAllocator *fd_allocator;
+  GstAllocator *dmabuf_allocator;
   GstStructure *properties;
 
   GHashTable *buf_ids;
-  GQueue queue;
+  GstPipeWireRing queue;	/* from the loop to the streaming thread */
+  gint waiting;
+
+  guint64 recycle;		/* mask of the ids to recycle, to the loop */
+  struct spa_source *recycle_event;
   GstClock *clock;
 };
 
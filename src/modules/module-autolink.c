@@ -31,6 +31,17 @@
 #include "pipewire/control.h"
 #include "pipewire/private.h"
 
+#include <spa/clock/clock.h>
+#include <spa/param/props.h>
+#include <spa/param/format-utils.h>
+
+#include "modules/spa/spa-node.h"
+
+#define AUDIOCONVERT_LIB "audioconvert/libspa-audioconvert"
+
+/* interval in seconds for updating the rate of adaptive converters */
+#define RATE_UPDATE_INTERVAL	1
+
 struct impl {
 	struct pw_core *core;
 	struct pw_type *t;
@@ -41,6 +52,12 @@ struct impl {
 	struct spa_hook module_listener;
 
 	struct spa_list node_list;
+
+	uint32_t prop_rate;
+	uint32_t prop_adaptive;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_source *rate_timer;
 };
 
 struct node_info {
@@ -51,6 +68,18 @@ struct node_info {
 	struct spa_hook node_listener;
 
 	struct spa_list links;
+	struct spa_list converters;
+};
+
+struct convert_data {
+	struct spa_list l;
+
+	struct pw_node *node;
+
+	/* the nodes that drive both sides of an adaptive converter */
+	bool adaptive;
+	struct pw_node *producer;
+	struct pw_node *consumer;
 };
 
 struct link_data {
@@ -84,11 +113,17 @@ static void link_data_remove(struct link_data *data)
 static void node_info_free(struct node_info *info)
 {
 	struct link_data *ld, *t;
+	struct convert_data *cd, *ct;
 
 	spa_list_remove(&info->l);
 	spa_hook_remove(&info->node_listener);
 	spa_list_for_each_safe(ld, t, &info->links, l)
 		link_data_remove(ld);
+	spa_list_for_each_safe(cd, ct, &info->converters, l) {
+		spa_list_remove(&cd->l);
+		pw_node_destroy(cd->node);
+		free(cd);
+	}
 	free(info);
 }
 
@@ -175,6 +210,249 @@ static const struct pw_link_events link_events = {
 	.state_changed = link_state_changed,
 };
 
+static bool can_link(struct impl *impl, struct pw_port *port, struct pw_port *target)
+{
+	uint8_t buf[4096];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buf, sizeof(buf));
+	struct spa_pod *format;
+	char *error = NULL;
+	struct pw_port *output, *input;
+
+	if (pw_port_get_direction(port) == PW_DIRECTION_OUTPUT) {
+		output = port;
+		input = target;
+	} else {
+		output = target;
+		input = port;
+	}
+	if (pw_core_find_format(impl->core, output, input, NULL, 0, NULL,
+				&format, &b, &error) < 0) {
+		pw_log_debug("module %p: %s", impl, error);
+		free(error);
+		return false;
+	}
+	return true;
+}
+
+/* the converter only takes raw audio, a port that can be converted
+ * enumerates it first */
+static bool is_audio_port(struct impl *impl, struct pw_port *port)
+{
+	uint8_t buf[4096];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buf, sizeof(buf));
+	struct spa_pod *format;
+	uint32_t index = 0, media_type, media_subtype;
+
+	if (spa_node_port_enum_params(port->node->node,
+				      port->direction, port->port_id,
+				      impl->t->param.idEnumFormat, &index,
+				      NULL, &format, &b) <= 0)
+		return false;
+
+	if (spa_pod_object_parse(format, "I", &media_type, "I", &media_subtype) < 0)
+		return false;
+
+	return media_type == impl->media_type.audio &&
+	    media_subtype == impl->media_subtype.raw;
+}
+
+static int link_ports(struct impl *impl, struct node_info *info,
+		      struct pw_port *port, struct pw_port *target, char **error)
+{
+	struct pw_link *link;
+	struct link_data *ld;
+
+	if (pw_port_get_direction(port) == PW_DIRECTION_INPUT) {
+	        struct pw_port *tmp = target;
+		target = port;
+		port = tmp;
+	}
+
+	link = pw_link_new(impl->core,
+			   port, target,
+			   NULL, NULL,
+			   error,
+			   sizeof(struct link_data));
+	if (link == NULL)
+		return -EINVAL;
+
+	ld = pw_link_get_user_data(link);
+	ld->link = link;
+	ld->node_info = info;
+	pw_link_add_listener(link, &ld->link_listener, &link_events, ld);
+
+	spa_list_append(&info->links, &ld->l);
+	pw_link_register(link, NULL, pw_module_get_global(impl->module));
+
+	try_link_controls(impl, port, target);
+
+	return 0;
+}
+
+static void set_converter_props(struct impl *impl, struct convert_data *cd, double rate)
+{
+	uint8_t buf[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buf, sizeof(buf));
+	struct spa_pod *props;
+	int res;
+
+	props = spa_pod_builder_object(&b,
+			impl->t->param.idProps, impl->t->spa_props,
+			":", impl->prop_rate,     "d", rate,
+			":", impl->prop_adaptive, "b", cd->adaptive);
+
+	if ((res = spa_node_set_param(cd->node->node, impl->t->param.idProps, 0, props)) < 0)
+		pw_log_warn("module %p: can't set converter props: %s", impl, spa_strerror(res));
+}
+
+static bool same_clock_domain(struct spa_clock *a, struct spa_clock *b)
+{
+	const char *da, *db;
+
+	if (a == b)
+		return true;
+	if (a->info == NULL || b->info == NULL)
+		return false;
+
+	da = spa_dict_lookup(a->info, SPA_CLOCK_INFO_DOMAIN);
+	db = spa_dict_lookup(b->info, SPA_CLOCK_INFO_DOMAIN);
+
+	return da != NULL && db != NULL && strcmp(da, db) == 0;
+}
+
+/* Nodes with their own clock, such as devices, drift relative to each other.
+ * When the consumer has a clock that is not in the domain of the clock that
+ * drives the producer, a converter between them resamples to follow the
+ * measured drift. */
+static bool needs_adaptive(struct pw_node *producer, struct pw_node *consumer)
+{
+	return producer->driver_clock != NULL && consumer->clock != NULL &&
+	    !same_clock_domain(producer->driver_clock, consumer->clock);
+}
+
+static double get_rate_diff(struct spa_clock *clock)
+{
+	double rate_diff;
+
+	if (clock == NULL || clock->get_rate_diff == NULL ||
+	    spa_clock_get_rate_diff(clock, &rate_diff) < 0)
+		return 1.0;
+
+	return rate_diff;
+}
+
+static void update_rates(void *data, uint64_t expirations)
+{
+	struct impl *impl = data;
+	struct node_info *info;
+	struct convert_data *cd;
+
+	spa_list_for_each(info, &impl->node_list, l) {
+		spa_list_for_each(cd, &info->converters, l) {
+			double rate;
+
+			if (!cd->adaptive)
+				continue;
+
+			/* the resampler consumes input at the rate of the driver
+			 * of the producer and makes output at the rate of the
+			 * clock of the consumer */
+			rate = get_rate_diff(cd->producer ? cd->producer->driver_clock : NULL) /
+				get_rate_diff(cd->consumer ? cd->consumer->clock : NULL);
+			pw_log_trace("module %p: converter %p rate %f", impl, cd->node, rate);
+			set_converter_props(impl, cd, rate);
+		}
+	}
+}
+
+static void converters_node_removed(struct impl *impl, struct pw_node *node)
+{
+	struct node_info *info;
+	struct convert_data *cd;
+
+	spa_list_for_each(info, &impl->node_list, l) {
+		spa_list_for_each(cd, &info->converters, l) {
+			if (cd->producer == node)
+				cd->producer = NULL;
+			if (cd->consumer == node)
+				cd->consumer = NULL;
+		}
+	}
+}
+
+/* Put an audioconvert node between the port and the target, both must be
+ * audio ports. When the target is NULL, a target is searched for the
+ * converter. */
+static int link_with_converter(struct impl *impl, struct node_info *info,
+			       struct pw_port *port, struct pw_port *target,
+			       uint32_t path_id, char **error)
+{
+	struct pw_node *node;
+	struct pw_port *cport, *cother;
+	struct convert_data *cd;
+	enum pw_direction direction = pw_port_get_direction(port);
+
+	if (!is_audio_port(impl, port)) {
+		asprintf(error, "port can't be converted");
+		return -EINVAL;
+	}
+
+	node = pw_spa_node_load(impl->core, NULL,
+				pw_module_get_global(impl->module),
+				AUDIOCONVERT_LIB, "audioconvert", "audioconvert",
+				PW_SPA_NODE_FLAG_ACTIVATE, NULL, 0);
+	if (node == NULL) {
+		asprintf(error, "can't load converter");
+		return -ENOMEM;
+	}
+
+	cport = pw_node_get_free_port(node, pw_direction_reverse(direction));
+	cother = pw_node_get_free_port(node, direction);
+	if (cport == NULL || cother == NULL || !can_link(impl, port, cport)) {
+		asprintf(error, "port can't be converted");
+		goto error;
+	}
+
+	if (target == NULL) {
+		target = pw_core_find_port(impl->core, cother, path_id, NULL, 0, NULL, error);
+		if (target == NULL)
+			goto error;
+	}
+	if (!is_audio_port(impl, target) || !can_link(impl, cother, target)) {
+		asprintf(error, "target can't be converted");
+		goto error;
+	}
+
+	cd = calloc(1, sizeof(struct convert_data));
+	cd->node = node;
+	if (direction == PW_DIRECTION_OUTPUT) {
+		cd->producer = pw_port_get_node(port);
+		cd->consumer = pw_port_get_node(target);
+	} else {
+		cd->producer = pw_port_get_node(target);
+		cd->consumer = pw_port_get_node(port);
+	}
+	cd->adaptive = needs_adaptive(cd->producer, cd->consumer);
+	if (cd->adaptive)
+		set_converter_props(impl, cd, 1.0);
+
+	pw_log_debug("module %p: linking with converter %p adaptive:%d", impl, node, cd->adaptive);
+
+	if (link_ports(impl, info, port, cport, error) < 0 ||
+	    link_ports(impl, info, cother, target, error) < 0) {
+		free(cd);
+		goto error;
+	}
+
+	spa_list_append(&info->converters, &cd->l);
+
+	return 0;
+
+      error:
+	pw_node_destroy(node);
+	return -EINVAL;
+}
+
 static void try_link_port(struct pw_node *node, struct pw_port *port, struct node_info *info)
 {
 	struct impl *impl = info->impl;
@@ -182,9 +460,7 @@ static void try_link_port(struct pw_node *node, struct pw_port *port, struct nod
 	const char *str;
 	uint32_t path_id;
 	char *error = NULL;
-	struct pw_link *link;
 	struct pw_port *target;
-	struct link_data *ld;
 
 	props = pw_node_get_properties(node);
 
@@ -203,33 +479,25 @@ static void try_link_port(struct pw_node *node, struct pw_port *port, struct nod
 	pw_log_debug("module %p: try to find and link to node '%d'", impl, path_id);
 
 	target = pw_core_find_port(impl->core, port, path_id, NULL, 0, NULL, &error);
-	if (target == NULL)
-		goto error;
-
-	if (pw_port_get_direction(port) == PW_DIRECTION_INPUT) {
-	        struct pw_port *tmp = target;
-		target = port;
-		port = tmp;
+	if (target == NULL || !can_link(impl, port, target)) {
+		free(error);
+		error = NULL;
+		if (link_with_converter(impl, info, port, NULL, path_id, &error) < 0)
+			goto error;
+		return;
+	}
+	if (is_audio_port(impl, port) && is_audio_port(impl, target) &&
+	    (pw_port_get_direction(port) == PW_DIRECTION_OUTPUT ?
+	     needs_adaptive(node, pw_port_get_node(target)) :
+	     needs_adaptive(pw_port_get_node(target), node))) {
+		if (link_with_converter(impl, info, port, target, path_id, &error) < 0)
+			goto error;
+		return;
 	}
 
-	link = pw_link_new(impl->core,
-			   port, target,
-			   NULL, NULL,
-			   &error,
-			   sizeof(struct link_data));
-	if (link == NULL)
+	if (link_ports(impl, info, port, target, &error) < 0)
 		goto error;
 
-	ld = pw_link_get_user_data(link);
-	ld->link = link;
-	ld->node_info = info;
-	pw_link_add_listener(link, &ld->link_listener, &link_events, ld);
-
-	spa_list_append(&info->links, &ld->l);
-	pw_link_register(link, NULL, pw_module_get_global(impl->module));
-
-	try_link_controls(impl, port, target);
-
 	return;
 
       error:
@@ -295,6 +563,7 @@ core_global_added(void *data, struct pw_global *global)
 		ninfo->impl = impl;
 		ninfo->node = node;
 		spa_list_init(&ninfo->links);
+		spa_list_init(&ninfo->converters);
 
 		spa_list_append(&impl->node_list, &ninfo->l);
 		pw_node_add_listener(node, &ninfo->node_listener, &node_events, ninfo);
@@ -318,6 +587,8 @@ core_global_removed(void *data, struct pw_global *global)
 		if ((ninfo = find_node_info(impl, node)))
 			node_info_free(ninfo);
 
+		converters_node_removed(impl, node);
+
 		pw_log_debug("module %p: node %p removed", impl, node);
 	}
 }
@@ -330,6 +601,8 @@ static void module_destroy(void *data)
 	spa_list_for_each_safe(info, t, &impl->node_list, l)
 		node_info_free(info);
 
+	pw_loop_destroy_source(pw_core_get_main_loop(impl->core), impl->rate_timer);
+
 	spa_hook_remove(&impl->core_listener);
 	spa_hook_remove(&impl->module_listener);
 
@@ -362,6 +635,8 @@ static const struct pw_core_events core_events = {
 static bool module_init(struct pw_module *module, struct pw_properties *properties)
 {
 	struct pw_core *core = pw_module_get_core(module);
+	struct pw_loop *main_loop;
+	struct timespec value;
 	struct impl *impl;
 
 	impl = calloc(1, sizeof(struct impl));
@@ -374,6 +649,17 @@ static bool module_init(struct pw_module *module, struct pw_properties *properti
 
 	spa_list_init(&impl->node_list);
 
+	impl->prop_rate = spa_type_map_get_id(impl->t->map, SPA_TYPE_PROPS__rate);
+	impl->prop_adaptive = spa_type_map_get_id(impl->t->map, SPA_TYPE_PROPS__adaptive);
+	spa_type_media_type_map(impl->t->map, &impl->media_type);
+	spa_type_media_subtype_map(impl->t->map, &impl->media_subtype);
+
+	main_loop = pw_core_get_main_loop(core);
+	impl->rate_timer = pw_loop_add_timer(main_loop, update_rates, impl);
+	value.tv_sec = RATE_UPDATE_INTERVAL;
+	value.tv_nsec = 0;
+	pw_loop_update_timer(main_loop, impl->rate_timer, &value, &value, false);
+
 	pw_core_add_listener(core, &impl->core_listener, &core_events, impl);
 	pw_module_add_listener(module, &impl->module_listener, &module_events, impl);
 
@@ -620,7 +620,7 @@ spa_proxy_node_port_use_buffers(struct spa_node *node,
 			data_size += buffers[i]->metas[j].size;
 		}
 		for (j = 0; j < buffers[i]->n_datas; j++) {
-			struct spa_data *d = buffers[i]->datas;
+			struct spa_data *d = &buffers[i]->datas[j];
 			data_size += sizeof(struct spa_chunk);
 			if (d->type == t->data.MemPtr)
 				data_size += d->maxsize;
@@ -838,6 +838,8 @@ static int handle_node_message(struct proxy *this, struct pw_client_node_message
 			pw_log_trace("have output %d %d", p->io->status, p->io->buffer_id);
 		}
 		impl->out_pending = false;
+		pw_profiler_remote(impl->this.node, impl->transport->area->awake_time,
+				   impl->transport->area->finish_time);
 		this->callbacks->have_output(this->callbacks_data);
 		break;
 
@@ -847,6 +849,8 @@ static int handle_node_message(struct proxy *this, struct pw_client_node_message
 			pw_log_trace("need input %d %d", p->io->status, p->io->buffer_id);
 		}
 		impl->input_ready++;
+		pw_profiler_remote(impl->this.node, impl->transport->area->awake_time,
+				   impl->transport->area->finish_time);
 		this->callbacks->need_input(this->callbacks_data);
 		break;
 
@@ -947,6 +951,8 @@ client_node_port_update(void *data,
 			       port_id,
 			       change_mask,
 			       n_params, params, info);
+		if (change_mask & PW_CLIENT_NODE_PORT_UPDATE_PARAMS)
+			pw_node_params_changed(impl->this.node);
 	}
 }
 
@@ -1080,6 +1086,16 @@ static int proxy_clear(struct proxy *this)
 	return 0;
 }
 
+static int
+do_remove_source(struct spa_loop *loop,
+		 bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct proxy *proxy = user_data;
+
+	spa_loop_remove_source(proxy->data_loop, &proxy->data_source);
+	return 0;
+}
+
 static void client_node_resource_destroy(void *data)
 {
 	struct impl *impl = data;
@@ -1090,8 +1106,10 @@ static void client_node_resource_destroy(void *data)
 
 	impl->proxy.resource = this->resource = NULL;
 
+	/* the data loop can be dispatching the source */
 	if (proxy->data_source.fd != -1)
-		spa_loop_remove_source(proxy->data_loop, &proxy->data_source);
+		spa_loop_invoke(proxy->data_loop, do_remove_source, SPA_ID_INVALID, NULL, 0,
+				true, proxy);
 
 	pw_node_destroy(this->node);
 }
@@ -458,10 +458,28 @@ do_create_link(void *data,
 			      new_id);
 }
 
+static void do_set_log_level(void *data, const char *topic, int32_t level)
+{
+	struct resource *resource = data;
+	struct client_info *cinfo = resource->cinfo;
+
+	if (cinfo->is_sandboxed) {
+		pw_resource_error(resource->resource, -EPERM, "not allowed");
+		return;
+	}
+	pw_resource_do_parent(resource->resource,
+			      &resource->override,
+			      struct pw_core_proxy_methods,
+			      set_log_level,
+			      topic,
+			      level);
+}
+
 static const struct pw_core_proxy_methods core_override = {
 	PW_VERSION_CORE_PROXY_METHODS,
 	.create_object = do_create_object,
 	.create_link = do_create_link,
+	.set_log_level = do_set_log_level,
 };
 
 static void client_resource_impl(void *data, struct pw_resource *resource)
@@ -1135,6 +1135,8 @@ static void jack_node_push(void *data)
 	struct impl *impl = jc->data;
 	struct jack_server *server = &impl->server;
 	struct jack_graph_manager *mgr = server->graph_manager;
+	struct jack_engine_control *ctrl = server->engine_control;
+	struct jack_client_control *fw_control;
 	struct jack_connection_manager *conn;
 	int activation;
 	struct pw_jack_node *node;
@@ -1142,15 +1144,7 @@ static void jack_node_push(void *data)
 	struct spa_graph_port *p, *pp;
 
 	conn = jack_graph_manager_get_current(mgr);
-
-	activation = jack_connection_manager_get_activation(conn, server->freewheel_ref_num);
-	if (activation != 0)
-		pw_log_warn("resume %d, some client did not complete", activation);
-
-	jack_connection_manager_reset(conn, mgr->client_timing);
-
-        jack_activation_count_signal(&conn->input_counter[server->freewheel_ref_num],
-                                    &server->synchro_table[server->freewheel_ref_num]);
+	fw_control = server->client_table[server->freewheel_ref_num]->node->control;
 
 	spa_list_for_each(p, &n->ports[SPA_DIRECTION_INPUT], link) {
 		if ((pp = p->peer) == NULL || ((pn = pp->node) == NULL))
@@ -1158,6 +1152,7 @@ static void jack_node_push(void *data)
 		pn->state = spa_node_process_output(pn->implementation);
 	}
 
+	/* collect the input of the clients */
 	spa_list_for_each(node, &impl->rt.nodes, graph_link) {
 		n = &node->node->rt.node;
 
@@ -1175,32 +1170,52 @@ static void jack_node_push(void *data)
 			pn->state = spa_node_process_output(pn->implementation);
 			pn->state = spa_node_process_input(pn->implementation);
 		}
+	}
+
+	/* every client signals the freewheel client when it completed, don't
+	 * start a new cycle while some are still running */
+	activation = jack_connection_manager_get_activation(conn, server->freewheel_ref_num);
+	if (activation != 0) {
+		pw_log_warn("resume %d, some client did not complete", activation);
+	}
+	else {
+		jack_connection_manager_reset(conn, mgr->client_timing);
+
+		/* wake up the clients connected to the drivers, they wake up the
+		 * clients after them without going through us */
+		jack_connection_manager_resume_ref_num(conn,
+						       jc->node->control,
+						       server->synchro_table,
+						       mgr->client_timing);
+		jack_connection_manager_resume_ref_num(conn,
+						       fw_control,
+						       server->synchro_table,
+						       mgr->client_timing);
+
+		if (ctrl->sync_mode) {
+			pw_log_trace("suspend");
+			if (jack_connection_manager_suspend_ref_num(conn,
+							fw_control,
+							server->synchro_table,
+							mgr->client_timing,
+							ctrl->timeout_usecs ?
+							ctrl->timeout_usecs : ctrl->period_usecs) < 0)
+				pw_log_warn("suspend timeout, some client did not complete");
+		}
+	}
+
+	/* tee the output of the clients */
+	spa_list_for_each(node, &impl->rt.nodes, graph_link) {
+		n = &node->node->rt.node;
 
 		n->state = spa_node_process_input(n->implementation);
 
-		/* tee outputs */
 		spa_list_for_each(p, &n->ports[SPA_DIRECTION_OUTPUT], link) {
 			if ((pp = p->peer) == NULL || ((pn = pp->node) == NULL))
 				continue;
 			pn->state = spa_node_process_input(pn->implementation);
 		}
 	}
-
-
-#if 0
-	jack_connection_manager_resume_ref_num(conn,
-					       client->control,
-					       server->synchro_table,
-					       mgr->client_timing);
-
-	if (server->engine_control->sync_mode) {
-		pw_log_trace("suspend");
-		jack_connection_manager_suspend_ref_num(conn,
-						        client->control,
-						        server->synchro_table,
-						        mgr->client_timing);
-	}
-#endif
 }
 
 static const struct pw_jack_node_events jack_node_events = {
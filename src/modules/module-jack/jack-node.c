@@ -70,6 +70,8 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
         spa_type_media_subtype_audio_map(map, &type->media_subtype_audio);
 }
 
+typedef void (*add_f32_func_t) (float *out, const float *in, int n_samples);
+
 struct node_data {
 	struct pw_jack_node node;
 	struct spa_hook node_listener;
@@ -79,6 +81,9 @@ struct node_data {
 	int n_capture_channels;
 	int n_playback_channels;
 
+	uint32_t mix_size;		/**< buffer size of mix_func */
+	add_f32_func_t mix_func;
+
 	struct spa_hook_list listener_list;
 
 	struct spa_node node_impl;
@@ -249,13 +254,60 @@ static void fill_s16(int16_t *out, int n_samples, int stride)
 		out += stride;
 	}
 }
-static void add_f32(float *out, float *in, int n_samples)
+static void add_f32(float * __restrict out, const float * __restrict in, int n_samples)
 {
 	int i;
 	for (i = 0; i < n_samples; i++)
 		out[i] += in[i];
 }
 
+/* the port buffers in shm are aligned to 32 bytes, with a buffer size known
+ * at compile time the compiler unrolls and vectorizes the loop */
+#define MAKE_ADD_F32(n)								\
+static void add_f32_##n(float * __restrict out, const float * __restrict in,	\
+		int n_samples)							\
+{										\
+	float *o = __builtin_assume_aligned(out, 32);				\
+	int i;									\
+	for (i = 0; i < n; i++)							\
+		o[i] += in[i];							\
+}
+
+MAKE_ADD_F32(32)
+MAKE_ADD_F32(64)
+MAKE_ADD_F32(128)
+MAKE_ADD_F32(256)
+MAKE_ADD_F32(512)
+MAKE_ADD_F32(1024)
+MAKE_ADD_F32(2048)
+MAKE_ADD_F32(4096)
+
+#undef MAKE_ADD_F32
+
+static const struct {
+	uint32_t n_samples;
+	add_f32_func_t func;
+} add_f32_funcs[] = {
+	{ 32, add_f32_32 },
+	{ 64, add_f32_64 },
+	{ 128, add_f32_128 },
+	{ 256, add_f32_256 },
+	{ 512, add_f32_512 },
+	{ 1024, add_f32_1024 },
+	{ 2048, add_f32_2048 },
+	{ 4096, add_f32_4096 },
+};
+
+static add_f32_func_t find_add_f32(uint32_t n_samples)
+{
+	int i;
+	for (i = 0; i < SPA_N_ELEMENTS(add_f32_funcs); i++) {
+		if (add_f32_funcs[i].n_samples == n_samples)
+			return add_f32_funcs[i].func;
+	}
+	return add_f32;
+}
+
 static int driver_process_output(struct spa_node *node)
 {
 	struct node_data *nd = SPA_CONTAINER_OF(node, struct node_data, node_impl);
@@ -323,24 +375,13 @@ static int node_process_input(struct spa_node *node)
 	struct pw_jack_node *this = &nd->node;
 	struct spa_graph_node *gn = &this->node->rt.node;
 	struct spa_graph_port *p;
-        struct jack_server *server = this->server;
-        struct jack_graph_manager *mgr = server->graph_manager;
-	struct jack_connection_manager *conn;
-	jack_time_t current_date = 0;
-	int ref_num = this->control->ref_num;
 
 	pw_log_trace(NAME " %p: process input", nd);
 	if (nd->status == SPA_STATUS_HAVE_BUFFER)
                 return SPA_STATUS_HAVE_BUFFER;
 
-	mgr->client_timing[ref_num].status = Triggered;
-	mgr->client_timing[ref_num].signaled_at = current_date;
-
-	conn = jack_graph_manager_get_current(mgr);
-
-	jack_activation_count_signal(&conn->input_counter[ref_num],
-				     &server->synchro_table[ref_num]);
-
+	/* the client was woken up by the server or the clients before it,
+	 * its output is in the port buffers */
 	spa_list_for_each(p, &gn->ports[SPA_DIRECTION_OUTPUT], link) {
 		struct pw_port *port = p->scheduler_data;
 		struct port_data *opd = pw_port_get_user_data(port);
@@ -625,13 +666,20 @@ static const struct spa_node node_impl = {
 static int schedule_mix_input(struct spa_node *_node)
 {
 	struct port_data *pd = SPA_CONTAINER_OF(_node, struct port_data, mix_node);
+	struct node_data *nd = pd->node;
 	struct pw_jack_port *this = &pd->port;
 	struct spa_graph_node *node = &this->port->rt.mix_node;
 	struct spa_graph_port *p;
 	struct spa_io_buffers *io = this->port->rt.mix_port.io;
-	size_t buffer_size = pd->node->node.server->engine_control->buffer_size;
+	uint32_t buffer_size = nd->node.server->engine_control->buffer_size;
+	float *first = NULL;
 	int layer = 0;
 
+	if (nd->mix_size != buffer_size) {
+		nd->mix_func = find_add_f32(buffer_size);
+		nd->mix_size = buffer_size;
+	}
+
 	spa_list_for_each(p, &node->ports[SPA_DIRECTION_INPUT], link) {
 		struct pw_link *link = p->scheduler_data;
 		struct spa_buffer *inbuf;
@@ -641,12 +689,21 @@ static int schedule_mix_input(struct spa_node *_node)
 		if (!(p->io->buffer_id < link->output->n_buffers && p->io->status == SPA_STATUS_HAVE_BUFFER))
 			continue;
 
-		inbuf = link->output->buffers[p->io->buffer_id];
-
-		if (layer++ == 0)
-			memcpy(pd->buffers[0].ptr, inbuf->datas[0].data, buffer_size * sizeof(float));
-		else
-			add_f32(pd->buffers[0].ptr, inbuf->datas[0].data, buffer_size);
+		/* the links of the client ports are jack connections, libjack
+		 * takes the buffer of a single output or mixes them itself */
+		if (pd->driver_port) {
+			inbuf = link->output->buffers[p->io->buffer_id];
+
+			/* keep the first buffer, only copy when there is a second one */
+			if (layer == 0)
+				first = inbuf->datas[0].data;
+			else {
+				if (layer == 1)
+					memcpy(pd->port.ptr, first, buffer_size * sizeof(float));
+				nd->mix_func(pd->port.ptr, inbuf->datas[0].data, buffer_size);
+			}
+		}
+		layer++;
 
 		pw_log_trace("mix %p: input %p %p->%p %d %d", node,
 				p, p->io, io, p->io->status, p->io->buffer_id);
@@ -655,6 +712,10 @@ static int schedule_mix_input(struct spa_node *_node)
 		p->io->status = SPA_STATUS_OK;
 		p->io->buffer_id = SPA_ID_INVALID;
 	}
+	/* the driver reads a single input from the output buffer */
+	if (pd->driver_port)
+		pd->buffers[0].ptr = layer == 1 ? first : pd->port.ptr;
+
 	return SPA_STATUS_HAVE_BUFFER;
 }
 
@@ -964,6 +1025,7 @@ pw_jack_driver_new(struct pw_core *core,
 	int ref_num, i;
 	struct pw_node *node;
 	struct pw_jack_node *this;
+	struct pw_jack_port *port;
 	struct jack_graph_manager *mgr = server->graph_manager;
         struct jack_connection_manager *conn;
         char n[REAL_JACK_PORT_NAME_SIZE];
@@ -1026,10 +1088,14 @@ pw_jack_driver_new(struct pw_core *core,
 
 	for (i = 0; i < n_playback_channels; i++) {
 		snprintf(n, sizeof(n), "%s:playback_%d", name, i);
-		pw_jack_node_add_port(this, n, JACK_DEFAULT_AUDIO_TYPE,
+		port = pw_jack_node_add_port(this, n, JACK_DEFAULT_AUDIO_TYPE,
 				      JackPortIsInput |
 				      JackPortIsPhysical |
 				      JackPortIsTerminal, 0);
+		if (port) {
+			struct port_data *pd = SPA_CONTAINER_OF(port, struct port_data, port);
+			pd->driver_port = true;
+		}
 	}
         jack_graph_manager_next_stop(mgr);
 
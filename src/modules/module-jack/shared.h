@@ -618,20 +618,24 @@ jack_connection_manager_get_activation(struct jack_connection_manager *conn, int
 	return jack_activation_count_get_value(&conn->input_counter[ref_num]);
 }
 
+/* wait until all the clients that are connected to \a control completed,
+ * at most \a usec microseconds */
 static inline int
 jack_connection_manager_suspend_ref_num(struct jack_connection_manager *conn,
 					struct jack_client_control *control,
 					struct jack_synchro *synchro,
-					struct jack_client_timing *timing)
+					struct jack_client_timing *timing,
+					jack_time_t usec)
 {
-	int res = 0, ref_num = control->ref_num;
+	int ref_num = control->ref_num;
 	jack_time_t current_date = 0;
 
-	if (jack_synchro_wait(&synchro[ref_num])) {
-		timing[ref_num].status = Finished;
-		timing[ref_num].awake_at = current_date;
-	}
-	return res ? 0 : -1;
+	if (!jack_synchro_timed_wait(&synchro[ref_num], usec))
+		return -1;
+
+	timing[ref_num].status = Finished;
+	timing[ref_num].awake_at = current_date;
+	return 0;
 }
 
 
@@ -17,16 +17,38 @@
  * Boston, MA 02110-1301, USA.
  */
 
-#include <semaphore.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/* shared with the clients in the shm segment of the synchro, laid out
+ * like the futex of the jackd2 linux build */
+struct jack_futex {
+	int futex;		/* 1 when signaled, 0 otherwise */
+	bool internal;		/* only used inside one process */
+	bool was_internal;
+	bool needs_change;
+	int external_count;
+};
 
 struct jack_synchro {
 	char name[SYNC_MAX_NAME_SIZE];
         bool flush;
-	sem_t *semaphore;
+	struct jack_futex *futex;
 };
 
 #define JACK_SYNCHRO_INIT	(struct jack_synchro) { { 0, }, false, NULL }
 
+static inline int jack_futex(int *uaddr, int op, int val, const struct timespec *timeout)
+{
+	return syscall(SYS_futex, uaddr, op, val, timeout, NULL, 0);
+}
+
 static inline int
 jack_synchro_init(struct jack_synchro *synchro,
 		  const char *client_name,
@@ -35,7 +57,9 @@ jack_synchro_init(struct jack_synchro *synchro,
 		  bool promiscuous)
 {
 	char cname[SYNC_MAX_NAME_SIZE+1];
-	int i;
+	int i, fd;
+	void *ptr;
+
 	for (i = 0; client_name[i] != '\0'; i++) {
 		if (client_name[i] == '/' || client_name[i] == '\\')
 			cname[i] = '_';
@@ -52,48 +76,98 @@ jack_synchro_init(struct jack_synchro *synchro,
 				"jack_sem.%d_%s_%s", getuid(), server_name, cname);
 
 	synchro->flush = false;
-	if ((synchro->semaphore = sem_open(synchro->name, O_CREAT | O_RDWR, 0777, value)) == (sem_t*)SEM_FAILED) {
-		pw_log_error("can't check semaphore %s: %s", synchro->name, strerror(errno));
+	if ((fd = shm_open(synchro->name, O_CREAT | O_RDWR, 0777)) < 0) {
+		pw_log_error("can't check futex %s: %s", synchro->name, strerror(errno));
 		return -1;
 	}
+	if (ftruncate(fd, sizeof(struct jack_futex)) < 0) {
+		pw_log_error("can't size futex %s: %s", synchro->name, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	ptr = mmap(NULL, sizeof(struct jack_futex), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED) {
+		pw_log_error("can't map futex %s: %s", synchro->name, strerror(errno));
+		return -1;
+	}
+	synchro->futex = ptr;
+	synchro->futex->futex = value > 0 ? 1 : 0;
+	synchro->futex->internal = false;
+	synchro->futex->was_internal = false;
+	synchro->futex->needs_change = false;
+	synchro->futex->external_count = 0;
+
 	return 0;
 }
 
 static inline bool
 jack_synchro_close(struct jack_synchro *synchro)
 {
-	if (synchro->semaphore == NULL)
+	if (synchro->futex == NULL)
 		return true;
 
-	if (sem_close(synchro->semaphore) < 0) {
-		pw_log_warn("can't close semaphore %s: %s", synchro->name, strerror(errno));
+	if (munmap(synchro->futex, sizeof(struct jack_futex)) < 0) {
+		pw_log_warn("can't close futex %s: %s", synchro->name, strerror(errno));
 	}
-	synchro->semaphore = NULL;
+	/* we created it, the clients keep their mapping */
+	shm_unlink(synchro->name);
+	synchro->futex = NULL;
 	return true;
 }
 
 static inline bool
 jack_synchro_signal(struct jack_synchro *synchro)
 {
-	int res;
+	if (synchro->futex == NULL)
+		return false;
 	if (synchro->flush)
 		return true;
-	if ((res = sem_post(synchro->semaphore)) < 0)
-		pw_log_error("semaphore %s post err = %s", synchro->name, strerror(errno));
 
-	return res == 0;
+	/* only wake up when there was no pending signal */
+	if (__atomic_exchange_n(&synchro->futex->futex, 1, __ATOMIC_SEQ_CST) == 0) {
+		if (jack_futex(&synchro->futex->futex, FUTEX_WAKE, 1, NULL) < 0) {
+			pw_log_error("futex %s wake err = %s", synchro->name, strerror(errno));
+			return false;
+		}
+	}
+	return true;
 }
 
+/* wait for a signal, at most \a usec microseconds when not 0 */
 static inline bool
-jack_synchro_wait(struct jack_synchro *synchro)
+jack_synchro_timed_wait(struct jack_synchro *synchro, uint64_t usec)
 {
-	int res;
-	while ((res = sem_wait(synchro->semaphore)) < 0) {
-		if (errno != EINTR)
-			continue;
+	struct timespec timeout, *tp = NULL;
+	int expected;
+
+	if (synchro->futex == NULL)
+		return false;
+
+	if (usec > 0) {
+		timeout.tv_sec = usec / 1000000;
+		timeout.tv_nsec = (usec % 1000000) * 1000;
+		tp = &timeout;
+	}
+	while (true) {
+		expected = 1;
+		if (__atomic_compare_exchange_n(&synchro->futex->futex, &expected, 0, false,
+						__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+			return true;
+
+		if (jack_futex(&synchro->futex->futex, FUTEX_WAIT, 0, tp) < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
 
-		pw_log_error("semaphore %s wait err = %s", synchro->name, strerror(errno));
-		break;
+			if (errno != ETIMEDOUT)
+				pw_log_error("futex %s wait err = %s", synchro->name, strerror(errno));
+			return false;
+		}
 	}
-	return res == 0;
+}
+
+static inline bool
+jack_synchro_wait(struct jack_synchro *synchro)
+{
+	return jack_synchro_timed_wait(synchro, 0);
 }
@@ -48,6 +48,10 @@
 #include "extensions/protocol-native.h"
 #include "modules/module-protocol-native/connection.h"
 
+PW_LOG_TOPIC_STATIC(log_protocol, "protocol");
+#undef PW_LOG_TOPIC_DEFAULT
+#define PW_LOG_TOPIC_DEFAULT (&log_protocol)
+
 #ifndef UNIX_PATH_MAX
 #define UNIX_PATH_MAX   108
 #endif
@@ -32,6 +32,10 @@
 
 #include "connection.h"
 
+PW_LOG_TOPIC_STATIC(log_protocol, "protocol");
+#undef PW_LOG_TOPIC_DEFAULT
+#define PW_LOG_TOPIC_DEFAULT (&log_protocol)
+
 #define MAX_BUFFER_SIZE (1024 * 32)
 #define MAX_FDS 28
 
@@ -30,6 +30,10 @@
 
 #include "connection.h"
 
+PW_LOG_TOPIC_STATIC(log_protocol, "protocol");
+#undef PW_LOG_TOPIC_DEFAULT
+#define PW_LOG_TOPIC_DEFAULT (&log_protocol)
+
 static void core_marshal_client_update(void *object, const struct spa_dict *props)
 {
 	struct pw_proxy *proxy = object;
@@ -172,6 +176,20 @@ core_marshal_create_link(void *object,
 	pw_protocol_native_end_proxy(proxy, b);
 }
 
+static void core_marshal_set_log_level(void *object, const char *topic, int32_t level)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_builder *b;
+
+	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_PROXY_METHOD_SET_LOG_LEVEL);
+
+	spa_pod_builder_struct(b,
+			       "s", topic,
+			       "i", level);
+
+	pw_protocol_native_end_proxy(proxy, b);
+}
+
 static void
 core_marshal_update_types_client(void *object, uint32_t first_id, const char **types, uint32_t n_types)
 {
@@ -194,35 +212,96 @@ core_marshal_update_types_client(void *object, uint32_t first_id, const char **t
 	pw_protocol_native_end_proxy(proxy, b);
 }
 
+static void marshal_dict(struct spa_pod_builder *b, const struct spa_dict *dict)
+{
+	uint32_t i, n_items;
+
+	n_items = dict ? dict->n_items : 0;
+
+	spa_pod_builder_add(b, "i", n_items, NULL);
+	for (i = 0; i < n_items; i++) {
+		spa_pod_builder_add(b,
+				    "s", dict->items[i].key,
+				    "s", dict->items[i].value, NULL);
+	}
+}
+
+/* the items are allocated on the stack of the caller */
+#define demarshal_dict(prs,dict)						\
+({										\
+	struct spa_pod_parser *_prs = (prs);					\
+	struct spa_dict *_dict = (dict);					\
+	uint32_t _i;								\
+	bool _ok = spa_pod_parser_get(_prs, "i", &_dict->n_items, NULL) >= 0;	\
+	if (_ok) {								\
+		_dict->items = alloca(_dict->n_items * sizeof(struct spa_dict_item));	\
+		for (_i = 0; _ok && _i < _dict->n_items; _i++)			\
+			_ok = spa_pod_parser_get(_prs,				\
+				       "s", &_dict->items[_i].key,		\
+				       "s", &_dict->items[_i].value, NULL) >= 0;	\
+	}									\
+	_ok;									\
+})
+
+static void marshal_params(struct spa_pod_builder *b, struct spa_pod **params, uint32_t n_params)
+{
+	uint32_t i;
+
+	spa_pod_builder_add(b, "i", n_params, NULL);
+	for (i = 0; i < n_params; i++)
+		spa_pod_builder_add(b, "P", params[i], NULL);
+}
+
+/* the params are allocated on the stack of the caller */
+#define demarshal_params(prs,params,n_params)					\
+({										\
+	struct spa_pod_parser *_prs = (prs);					\
+	uint32_t _i;								\
+	bool _ok = spa_pod_parser_get(_prs, "i", (n_params), NULL) >= 0;	\
+	if (_ok) {								\
+		*(params) = alloca(*(n_params) * sizeof(struct spa_pod *));	\
+		for (_i = 0; _ok && _i < *(n_params); _i++)			\
+			_ok = spa_pod_parser_get(_prs, "P", &(*(params))[_i], NULL) >= 0;	\
+	}									\
+	_ok;									\
+})
+
 static bool core_demarshal_info(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
 	struct spa_dict props;
-	struct pw_core_info info;
+	struct pw_core_info info = { 0, };
 	struct spa_pod_parser prs;
-	int i;
+	uint64_t fields;
 
 	spa_pod_parser_init(&prs, data, size, 0);
 	if (spa_pod_parser_get(&prs,
 			"["
 			 "i", &info.id,
-			 "l", &info.change_mask,
-			 "s", &info.user_name,
-			 "s", &info.host_name,
-			 "s", &info.version,
-			 "s", &info.name,
-			 "i", &info.cookie,
-			 "i", &props.n_items, NULL) < 0)
+			 "l", &info.change_mask, NULL) < 0)
 		return false;
 
-	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
-	for (i = 0; i < props.n_items; i++) {
-		if (spa_pod_parser_get(&prs,
-				       "s", &props.items[i].key,
-				       "s", &props.items[i].value,
-				       NULL) < 0)
+	fields = pw_proxy_get_version(proxy) < 1 ? ~0 : info.change_mask;
+
+	if (fields & PW_CORE_CHANGE_MASK_USER_NAME &&
+	    spa_pod_parser_get(&prs, "s", &info.user_name, NULL) < 0)
+		return false;
+	if (fields & PW_CORE_CHANGE_MASK_HOST_NAME &&
+	    spa_pod_parser_get(&prs, "s", &info.host_name, NULL) < 0)
+		return false;
+	if (fields & PW_CORE_CHANGE_MASK_VERSION &&
+	    spa_pod_parser_get(&prs, "s", &info.version, NULL) < 0)
+		return false;
+	if (fields & PW_CORE_CHANGE_MASK_NAME &&
+	    spa_pod_parser_get(&prs, "s", &info.name, NULL) < 0)
+		return false;
+	if (fields & PW_CORE_CHANGE_MASK_COOKIE &&
+	    spa_pod_parser_get(&prs, "i", &info.cookie, NULL) < 0)
+		return false;
+	if (fields & PW_CORE_CHANGE_MASK_PROPS) {
+		if (!demarshal_dict(&prs, &props))
 			return false;
+		info.props = &props;
 	}
 	pw_proxy_notify(proxy, struct pw_core_proxy_events, info, &info);
 	return true;
@@ -302,28 +381,31 @@ static void core_marshal_info(void *object, struct pw_core_info *info)
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	uint32_t i, n_items;
+	uint64_t fields;
 
 	b = pw_protocol_native_begin_resource(resource, PW_CORE_PROXY_EVENT_INFO);
 
-	n_items = info->props ? info->props->n_items : 0;
+	/* only the changed fields are sent, version 0 clients expect all of them */
+	fields = pw_resource_get_version(resource) < 1 ? ~0 : info->change_mask;
 
 	spa_pod_builder_add(b,
 			    "[",
 			    "i", info->id,
-			    "l", info->change_mask,
-			    "s", info->user_name,
-			    "s", info->host_name,
-			    "s", info->version,
-			    "s", info->name,
-			    "i", info->cookie,
-			    "i", n_items, NULL);
+			    "l", info->change_mask, NULL);
+
+	if (fields & PW_CORE_CHANGE_MASK_USER_NAME)
+		spa_pod_builder_add(b, "s", info->user_name, NULL);
+	if (fields & PW_CORE_CHANGE_MASK_HOST_NAME)
+		spa_pod_builder_add(b, "s", info->host_name, NULL);
+	if (fields & PW_CORE_CHANGE_MASK_VERSION)
+		spa_pod_builder_add(b, "s", info->version, NULL);
+	if (fields & PW_CORE_CHANGE_MASK_NAME)
+		spa_pod_builder_add(b, "s", info->name, NULL);
+	if (fields & PW_CORE_CHANGE_MASK_COOKIE)
+		spa_pod_builder_add(b, "i", info->cookie, NULL);
+	if (fields & PW_CORE_CHANGE_MASK_PROPS)
+		marshal_dict(b, info->props);
 
-	for (i = 0; i < n_items; i++) {
-		spa_pod_builder_add(b,
-				    "s", info->props->items[i].key,
-				    "s", info->props->items[i].value, NULL);
-	}
 	spa_pod_builder_add(b, "]", NULL);
 
 	pw_protocol_native_end_resource(resource, b);
@@ -541,6 +623,24 @@ static bool core_demarshal_create_link(void *object, void *data, size_t size)
 	return true;
 }
 
+static bool core_demarshal_set_log_level(void *object, void *data, size_t size)
+{
+	struct pw_resource *resource = object;
+	struct spa_pod_parser prs;
+	const char *topic;
+	int32_t level;
+
+	spa_pod_parser_init(&prs, data, size, 0);
+	if (spa_pod_parser_get(&prs,
+			"["
+			"s", &topic,
+			"i", &level, NULL) < 0)
+		return false;
+
+	pw_resource_do(resource, struct pw_core_proxy_methods, set_log_level, topic, level);
+	return true;
+}
+
 static bool core_demarshal_update_types_server(void *object, void *data, size_t size)
 {
 	struct pw_resource *resource = object;
@@ -618,26 +718,27 @@ static void module_marshal_info(void *object, struct pw_module_info *info)
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	uint32_t i, n_items;
+	uint64_t fields;
 
 	b = pw_protocol_native_begin_resource(resource, PW_MODULE_PROXY_EVENT_INFO);
 
-	n_items = info->props ? info->props->n_items : 0;
+	/* version 0 clients expect all the fields */
+	fields = pw_resource_get_version(resource) < 1 ? ~0 : info->change_mask;
 
 	spa_pod_builder_add(b,
 			    "[",
 			    "i", info->id,
-			    "l", info->change_mask,
-			    "s", info->name,
-			    "s", info->filename,
-			    "s", info->args,
-			    "i", n_items, NULL);
+			    "l", info->change_mask, NULL);
+
+	if (fields & PW_MODULE_CHANGE_MASK_NAME)
+		spa_pod_builder_add(b, "s", info->name, NULL);
+	if (fields & PW_MODULE_CHANGE_MASK_FILENAME)
+		spa_pod_builder_add(b, "s", info->filename, NULL);
+	if (fields & PW_MODULE_CHANGE_MASK_ARGS)
+		spa_pod_builder_add(b, "s", info->args, NULL);
+	if (fields & PW_MODULE_CHANGE_MASK_PROPS)
+		marshal_dict(b, info->props);
 
-	for (i = 0; i < n_items; i++) {
-		spa_pod_builder_add(b,
-				    "s", info->props->items[i].key,
-				    "s", info->props->items[i].value, NULL);
-	}
 	spa_pod_builder_add(b, "]", NULL);
 
 	pw_protocol_native_end_resource(resource, b);
@@ -647,27 +748,32 @@ static bool module_demarshal_info(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_parser prs;
+	uint64_t fields;
 	struct spa_dict props;
-	struct pw_module_info info;
-	int i;
+	struct pw_module_info info = { 0, };
 
 	spa_pod_parser_init(&prs, data, size, 0);
 	if (spa_pod_parser_get(&prs,
 			"["
 			"i", &info.id,
-			"l", &info.change_mask,
-			"s", &info.name,
-			"s", &info.filename,
-			"s", &info.args,
-			"i", &props.n_items, NULL) < 0)
+			"l", &info.change_mask, NULL) < 0)
 		return false;
 
-	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
-	for (i = 0; i < props.n_items; i++) {
-		if (spa_pod_parser_get(&prs, "ss",
-					&props.items[i].key, &props.items[i].value, NULL) < 0)
+	fields = pw_proxy_get_version(proxy) < 1 ? ~0 : info.change_mask;
+
+	if (fields & PW_MODULE_CHANGE_MASK_NAME &&
+	    spa_pod_parser_get(&prs, "s", &info.name, NULL) < 0)
+		return false;
+	if (fields & PW_MODULE_CHANGE_MASK_FILENAME &&
+	    spa_pod_parser_get(&prs, "s", &info.filename, NULL) < 0)
+		return false;
+	if (fields & PW_MODULE_CHANGE_MASK_ARGS &&
+	    spa_pod_parser_get(&prs, "s", &info.args, NULL) < 0)
+		return false;
+	if (fields & PW_MODULE_CHANGE_MASK_PROPS) {
+		if (!demarshal_dict(&prs, &props))
 			return false;
+		info.props = &props;
 	}
 	pw_proxy_notify(proxy, struct pw_module_proxy_events, info, &info);
 	return true;
@@ -677,26 +783,25 @@ static void factory_marshal_info(void *object, struct pw_factory_info *info)
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	uint32_t i, n_items;
+	uint64_t fields;
 
 	b = pw_protocol_native_begin_resource(resource, PW_FACTORY_PROXY_EVENT_INFO);
 
-	n_items = info->props ? info->props->n_items : 0;
+	/* version 0 clients expect all the fields */
+	fields = pw_resource_get_version(resource) < 1 ? ~0 : info->change_mask;
 
+	/* name, type and version don't change */
 	spa_pod_builder_add(b,
 			    "[",
 			    "i", info->id,
 			    "l", info->change_mask,
 			    "s", info->name,
 			    "I", info->type,
-			    "i", info->version,
-			    "i", n_items, NULL);
+			    "i", info->version, NULL);
+
+	if (fields & PW_FACTORY_CHANGE_MASK_PROPS)
+		marshal_dict(b, info->props);
 
-	for (i = 0; i < n_items; i++) {
-		spa_pod_builder_add(b,
-				    "s", info->props->items[i].key,
-				    "s", info->props->items[i].value, NULL);
-	}
 	spa_pod_builder_add(b, "]", NULL);
 
 	pw_protocol_native_end_resource(resource, b);
@@ -706,9 +811,9 @@ static bool factory_demarshal_info(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_parser prs;
+	uint64_t fields;
 	struct spa_dict props;
-	struct pw_factory_info info;
-	int i;
+	struct pw_factory_info info = { 0, };
 
 	spa_pod_parser_init(&prs, data, size, 0);
 	if (spa_pod_parser_get(&prs,
@@ -717,17 +822,15 @@ static bool factory_demarshal_info(void *object, void *data, size_t size)
 			"l", &info.change_mask,
 			"s", &info.name,
 			"I", &info.type,
-			"i", &info.version,
-			"i", &props.n_items, NULL) < 0)
+			"i", &info.version, NULL) < 0)
 		return false;
 
-	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
-	for (i = 0; i < props.n_items; i++) {
-		if (spa_pod_parser_get(&prs,
-				       "s", &props.items[i].key,
-				       "s", &props.items[i].value, NULL) < 0)
+	fields = pw_proxy_get_version(proxy) < 1 ? ~0 : info.change_mask;
+
+	if (fields & PW_FACTORY_CHANGE_MASK_PROPS) {
+		if (!demarshal_dict(&prs, &props))
 			return false;
+		info.props = &props;
 	}
 	pw_proxy_notify(proxy, struct pw_factory_proxy_events, info, &info);
 	return true;
@@ -737,41 +840,44 @@ static void node_marshal_info(void *object, struct pw_node_info *info)
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	uint32_t i, n_items;
+	uint64_t fields;
 
 	b = pw_protocol_native_begin_resource(resource, PW_NODE_PROXY_EVENT_INFO);
 
+	/* only the changed fields are sent, a state change does not send
+	 * the params again. Version 0 clients expect all the fields except
+	 * the xruns. */
+	fields = pw_resource_get_version(resource) < 1 ?
+		~PW_NODE_CHANGE_MASK_XRUNS : info->change_mask;
+
 	spa_pod_builder_add(b,
 			    "[",
 			    "i", info->id,
-			    "l", info->change_mask,
-			    "s", info->name,
-			    "i", info->max_input_ports,
-			    "i", info->n_input_ports,
-			    "i", info->n_input_params, NULL);
-
-	for (i = 0; i < info->n_input_params; i++)
-		spa_pod_builder_add(b, "P", info->input_params[i], NULL);
-
-	spa_pod_builder_add(b,
-			    "i", info->max_output_ports,
-			    "i", info->n_output_ports,
-			    "i", info->n_output_params, 0);
+			    "l", info->change_mask, NULL);
 
-	for (i = 0; i < info->n_output_params; i++)
-		spa_pod_builder_add(b, "P", info->output_params[i], NULL);
-
-	n_items = info->props ? info->props->n_items : 0;
-
-	spa_pod_builder_add(b,
-			    "i", info->state,
-			    "s", info->error, "i", n_items, NULL);
-
-	for (i = 0; i < n_items; i++) {
+	if (fields & PW_NODE_CHANGE_MASK_NAME)
+		spa_pod_builder_add(b, "s", info->name, NULL);
+	if (fields & PW_NODE_CHANGE_MASK_INPUT_PORTS)
 		spa_pod_builder_add(b,
-				    "s", info->props->items[i].key,
-				    "s", info->props->items[i].value, NULL);
-	}
+				    "i", info->max_input_ports,
+				    "i", info->n_input_ports, NULL);
+	if (fields & PW_NODE_CHANGE_MASK_INPUT_PARAMS)
+		marshal_params(b, info->input_params, info->n_input_params);
+	if (fields & PW_NODE_CHANGE_MASK_OUTPUT_PORTS)
+		spa_pod_builder_add(b,
+				    "i", info->max_output_ports,
+				    "i", info->n_output_ports, NULL);
+	if (fields & PW_NODE_CHANGE_MASK_OUTPUT_PARAMS)
+		marshal_params(b, info->output_params, info->n_output_params);
+	if (fields & PW_NODE_CHANGE_MASK_STATE)
+		spa_pod_builder_add(b,
+				    "i", info->state,
+				    "s", info->error, NULL);
+	if (fields & PW_NODE_CHANGE_MASK_PROPS)
+		marshal_dict(b, info->props);
+	if (fields & PW_NODE_CHANGE_MASK_XRUNS)
+		spa_pod_builder_add(b, "i", info->n_xruns, NULL);
+
 	spa_pod_builder_add(b, "]", NULL);
 
 	pw_protocol_native_end_resource(resource, b);
@@ -781,52 +887,90 @@ static bool node_demarshal_info(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_parser prs;
+	uint64_t fields;
 	struct spa_dict props;
-	struct pw_node_info info;
-	int i;
+	struct pw_node_info info = { 0, };
 
 	spa_pod_parser_init(&prs, data, size, 0);
 	if (spa_pod_parser_get(&prs,
 			"["
 			"i", &info.id,
-			"l", &info.change_mask,
-			"s", &info.name,
-			"i", &info.max_input_ports,
-			"i", &info.n_input_ports,
-			"i", &info.n_input_params, NULL) < 0)
+			"l", &info.change_mask, NULL) < 0)
 		return false;
 
-	info.input_params = alloca(info.n_input_params * sizeof(struct spa_pod *));
-	for (i = 0; i < info.n_input_params; i++)
-		if (spa_pod_parser_get(&prs, "P", &info.input_params[i], NULL) < 0)
-			return false;
+	fields = pw_proxy_get_version(proxy) < 1 ?
+		~PW_NODE_CHANGE_MASK_XRUNS : info.change_mask;
 
-	if (spa_pod_parser_get(&prs,
-			      "i", &info.max_output_ports,
-			      "i", &info.n_output_ports,
-			      "i", &info.n_output_params, NULL) < 0)
+	if (fields & PW_NODE_CHANGE_MASK_NAME &&
+	    spa_pod_parser_get(&prs, "s", &info.name, NULL) < 0)
 		return false;
-
-	info.output_params = alloca(info.n_output_params * sizeof(struct spa_pod *));
-	for (i = 0; i < info.n_output_params; i++)
-		if (spa_pod_parser_get(&prs, "P", &info.output_params[i], NULL) < 0)
+	if (fields & PW_NODE_CHANGE_MASK_INPUT_PORTS &&
+	    spa_pod_parser_get(&prs,
+			       "i", &info.max_input_ports,
+			       "i", &info.n_input_ports, NULL) < 0)
+		return false;
+	if (fields & PW_NODE_CHANGE_MASK_INPUT_PARAMS &&
+	    !demarshal_params(&prs, &info.input_params, &info.n_input_params))
+		return false;
+	if (fields & PW_NODE_CHANGE_MASK_OUTPUT_PORTS &&
+	    spa_pod_parser_get(&prs,
+			       "i", &info.max_output_ports,
+			       "i", &info.n_output_ports, NULL) < 0)
+		return false;
+	if (fields & PW_NODE_CHANGE_MASK_OUTPUT_PARAMS &&
+	    !demarshal_params(&prs, &info.output_params, &info.n_output_params))
+		return false;
+	if (fields & PW_NODE_CHANGE_MASK_STATE &&
+	    spa_pod_parser_get(&prs,
+			       "i", &info.state,
+			       "s", &info.error, NULL) < 0)
+		return false;
+	if (fields & PW_NODE_CHANGE_MASK_PROPS) {
+		if (!demarshal_dict(&prs, &props))
 			return false;
+		info.props = &props;
+	}
+	if (fields & PW_NODE_CHANGE_MASK_XRUNS &&
+	    spa_pod_parser_get(&prs, "i", &info.n_xruns, NULL) < 0)
+		return false;
+
+	pw_proxy_notify(proxy, struct pw_node_proxy_events, info, &info);
+	return true;
+}
+
+static void node_marshal_xrun(void *object, uint64_t cycle, uint64_t missing)
+{
+	struct pw_resource *resource = object;
+	struct spa_pod_builder *b;
+
+	if (pw_resource_get_version(resource) < 1)
+		return;
+
+	b = pw_protocol_native_begin_resource(resource, PW_NODE_PROXY_EVENT_XRUN);
+
+	spa_pod_builder_add(b,
+			    "[",
+			    "l", cycle,
+			    "l", missing,
+			    "]", NULL);
+
+	pw_protocol_native_end_resource(resource, b);
+}
+
+static bool node_demarshal_xrun(void *object, void *data, size_t size)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_parser prs;
+	uint64_t cycle, missing;
 
+	spa_pod_parser_init(&prs, data, size, 0);
 	if (spa_pod_parser_get(&prs,
-			      "i", &info.state,
-			      "s", &info.error,
-			      "i", &props.n_items, NULL) < 0)
+			"["
+			"l", &cycle,
+			"l", &missing, NULL) < 0)
 		return false;
 
-	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
-	for (i = 0; i < props.n_items; i++) {
-		if (spa_pod_parser_get(&prs,
-				       "s", &props.items[i].key,
-				       "s", &props.items[i].value, NULL) < 0)
-			return false;
-	}
-	pw_proxy_notify(proxy, struct pw_node_proxy_events, info, &info);
+	pw_proxy_notify(proxy, struct pw_node_proxy_events, xrun, cycle, missing);
 	return true;
 }
 
@@ -834,23 +978,21 @@ static void client_marshal_info(void *object, struct pw_client_info *info)
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	uint32_t i, n_items;
+	uint64_t fields;
 
 	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_PROXY_EVENT_INFO);
 
-	n_items = info->props ? info->props->n_items : 0;
+	/* version 0 clients expect all the fields */
+	fields = pw_resource_get_version(resource) < 1 ? ~0 : info->change_mask;
 
 	spa_pod_builder_add(b,
 			    "[",
 			    "i", info->id,
-			    "l", info->change_mask,
-			    "i", n_items, NULL);
+			    "l", info->change_mask, NULL);
+
+	if (fields & PW_CLIENT_CHANGE_MASK_PROPS)
+		marshal_dict(b, info->props);
 
-	for (i = 0; i < n_items; i++) {
-		spa_pod_builder_add(b,
-				    "s", info->props->items[i].key,
-				    "s", info->props->items[i].value, NULL);
-	}
 	spa_pod_builder_add(b, "]", NULL);
 
 	pw_protocol_native_end_resource(resource, b);
@@ -860,25 +1002,23 @@ static bool client_demarshal_info(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_parser prs;
+	uint64_t fields;
 	struct spa_dict props;
-	struct pw_client_info info;
-	uint32_t i;
+	struct pw_client_info info = { 0, };
 
 	spa_pod_parser_init(&prs, data, size, 0);
 	if (spa_pod_parser_get(&prs,
 			"["
 			"i", &info.id,
-			"l", &info.change_mask,
-			"i", &props.n_items, NULL) < 0)
+			"l", &info.change_mask, NULL) < 0)
 		return false;
 
-	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
-	for (i = 0; i < props.n_items; i++) {
-		if (spa_pod_parser_get(&prs,
-				       "s", &props.items[i].key,
-				       "s", &props.items[i].value, NULL) < 0)
+	fields = pw_proxy_get_version(proxy) < 1 ? ~0 : info.change_mask;
+
+	if (fields & PW_CLIENT_CHANGE_MASK_PROPS) {
+		if (!demarshal_dict(&prs, &props))
 			return false;
+		info.props = &props;
 	}
 	pw_proxy_notify(proxy, struct pw_client_proxy_events, info, &info);
 	return true;
@@ -888,28 +1028,31 @@ static void link_marshal_info(void *object, struct pw_link_info *info)
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
-	uint32_t i, n_items;
+	uint64_t fields;
 
 	b = pw_protocol_native_begin_resource(resource, PW_LINK_PROXY_EVENT_INFO);
 
-	n_items = info->props ? info->props->n_items : 0;
+	/* version 0 clients expect all the fields */
+	fields = pw_resource_get_version(resource) < 1 ? ~0 : info->change_mask;
 
 	spa_pod_builder_add(b,
 			    "[",
 			    "i", info->id,
-			    "l", info->change_mask,
-			    "i", info->output_node_id,
-			    "i", info->output_port_id,
-			    "i", info->input_node_id,
-			    "i", info->input_port_id,
-			    "P", info->format,
-			    "i", n_items, NULL);
+			    "l", info->change_mask, NULL);
 
-	for (i = 0; i < n_items; i++) {
+	if (fields & PW_LINK_CHANGE_MASK_OUTPUT)
 		spa_pod_builder_add(b,
-				    "s", info->props->items[i].key,
-				    "s", info->props->items[i].value, NULL);
-	}
+				    "i", info->output_node_id,
+				    "i", info->output_port_id, NULL);
+	if (fields & PW_LINK_CHANGE_MASK_INPUT)
+		spa_pod_builder_add(b,
+				    "i", info->input_node_id,
+				    "i", info->input_port_id, NULL);
+	if (fields & PW_LINK_CHANGE_MASK_FORMAT)
+		spa_pod_builder_add(b, "P", info->format, NULL);
+	if (fields & PW_LINK_CHANGE_MASK_PROPS)
+		marshal_dict(b, info->props);
+
 	spa_pod_builder_add(b, "]", NULL);
 
 	pw_protocol_native_end_resource(resource, b);
@@ -919,30 +1062,36 @@ static bool link_demarshal_info(void *object, void *data, size_t size)
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_parser prs;
+	uint64_t fields;
 	struct spa_dict props;
 	struct pw_link_info info = { 0, };
-	int i;
 
 	spa_pod_parser_init(&prs, data, size, 0);
 	if (spa_pod_parser_get(&prs,
 			"["
 			"i", &info.id,
-			"l", &info.change_mask,
-			"i", &info.output_node_id,
-			"i", &info.output_port_id,
-			"i", &info.input_node_id,
-			"i", &info.input_port_id,
-			"P", &info.format,
-			"i", &props.n_items, NULL) < 0)
+			"l", &info.change_mask, NULL) < 0)
 		return false;
 
-	info.props = &props;
-	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
-	for (i = 0; i < props.n_items; i++) {
-		if (spa_pod_parser_get(&prs,
-				       "s", &props.items[i].key,
-				       "s", &props.items[i].value, NULL) < 0)
+	fields = pw_proxy_get_version(proxy) < 1 ? ~0 : info.change_mask;
+
+	if (fields & PW_LINK_CHANGE_MASK_OUTPUT &&
+	    spa_pod_parser_get(&prs,
+			       "i", &info.output_node_id,
+			       "i", &info.output_port_id, NULL) < 0)
+		return false;
+	if (fields & PW_LINK_CHANGE_MASK_INPUT &&
+	    spa_pod_parser_get(&prs,
+			       "i", &info.input_node_id,
+			       "i", &info.input_port_id, NULL) < 0)
+		return false;
+	if (fields & PW_LINK_CHANGE_MASK_FORMAT &&
+	    spa_pod_parser_get(&prs, "P", &info.format, NULL) < 0)
+		return false;
+	if (fields & PW_LINK_CHANGE_MASK_PROPS) {
+		if (!demarshal_dict(&prs, &props))
 			return false;
+		info.props = &props;
 	}
 	pw_proxy_notify(proxy, struct pw_link_proxy_events, info, &info);
 	return true;
@@ -1007,7 +1156,8 @@ static const struct pw_core_proxy_methods pw_protocol_native_core_method_marshal
 	&core_marshal_client_update,
 	&core_marshal_permissions,
 	&core_marshal_create_object,
-	&core_marshal_create_link
+	&core_marshal_create_link,
+	&core_marshal_set_log_level
 };
 
 static const struct pw_protocol_native_demarshal pw_protocol_native_core_method_demarshal[PW_CORE_PROXY_METHOD_NUM] = {
@@ -1017,7 +1167,8 @@ static const struct pw_protocol_native_demarshal pw_protocol_native_core_method_
 	{ &core_demarshal_client_update, 0, },
 	{ &core_demarshal_permissions, 0, },
 	{ &core_demarshal_create_object, PW_PROTOCOL_NATIVE_REMAP, },
-	{ &core_demarshal_create_link, PW_PROTOCOL_NATIVE_REMAP, }
+	{ &core_demarshal_create_link, PW_PROTOCOL_NATIVE_REMAP, },
+	{ &core_demarshal_set_log_level, 0, }
 };
 
 static const struct pw_core_proxy_events pw_protocol_native_core_event_marshal = {
@@ -1118,10 +1269,12 @@ const struct pw_protocol_marshal pw_protocol_native_factory_marshal = {
 static const struct pw_node_proxy_events pw_protocol_native_node_event_marshal = {
 	PW_VERSION_NODE_PROXY_EVENTS,
 	&node_marshal_info,
+	&node_marshal_xrun,
 };
 
 static const struct pw_protocol_native_demarshal pw_protocol_native_node_event_demarshal[] = {
-	{ &node_demarshal_info, PW_PROTOCOL_NATIVE_REMAP, }
+	{ &node_demarshal_info, PW_PROTOCOL_NATIVE_REMAP, },
+	{ &node_demarshal_xrun, 0, },
 };
 
 static const struct pw_protocol_marshal pw_protocol_native_node_marshal = {
@@ -70,7 +70,7 @@ static void add_item(struct pw_spa_monitor *this, struct spa_pod *item)
 	struct spa_pod *info = NULL;
 	struct pw_type *t = pw_core_get_type(impl->core);
 	const struct spa_support *support;
-	uint32_t n_support;
+	uint32_t n_support, loop_index;
 
 	if (spa_pod_object_parse(item,
 			":",t->monitor.name,    "s", &name,
@@ -98,7 +98,8 @@ static void add_item(struct pw_spa_monitor *this, struct spa_pod *item)
 		}
 	}
 
-	support = pw_core_get_support(impl->core, &n_support);
+	loop_index = pw_core_select_data_loop(impl->core, props);
+	support = pw_core_get_data_loop_support(impl->core, loop_index, &n_support);
 
 	handle = calloc(1, factory->size);
 	if ((res = spa_handle_factory_init(factory,
@@ -118,7 +119,7 @@ static void add_item(struct pw_spa_monitor *this, struct spa_pod *item)
 	mitem->id = strdup(id);
 	mitem->handle = handle;
 	mitem->node = pw_spa_node_new(impl->core, NULL, impl->parent, name,
-				      PW_SPA_NODE_FLAG_ACTIVATE,
+				      PW_SPA_NODE_FLAG_ACTIVATE | PW_SPA_NODE_FLAG_DATA_LOOP,
 				      node_iface, handle, props, 0);
 
 	spa_list_append(&impl->item_list, &mitem->link);
@@ -239,6 +240,7 @@ struct pw_spa_monitor *pw_spa_monitor_load(struct pw_core *core,
 	const struct spa_handle_factory *factory;
 	char *filename;
 	const struct spa_support *support;
+	struct spa_support plugin_support[PW_SPA_MAX_SUPPORT];
 	uint32_t n_support;
 	struct pw_type *t = pw_core_get_type(core);
 
@@ -263,9 +265,11 @@ struct pw_spa_monitor *pw_spa_monitor_load(struct pw_core *core,
 			break;
 	}
 	support = pw_core_get_support(core, &n_support);
+	n_support = pw_spa_support_for_lib(lib, support,
+			SPA_MIN(n_support, PW_SPA_MAX_SUPPORT), plugin_support);
 	handle = calloc(1, factory->size);
 	if ((res = spa_handle_factory_init(factory,
-					   handle, NULL, support, n_support)) < 0) {
+					   handle, NULL, plugin_support, n_support)) < 0) {
 		pw_log_error("can't make factory instance: %d", res);
 		goto init_failed;
 	}
@@ -119,10 +119,14 @@ pw_spa_node_new(struct pw_core *core,
 	if (this == NULL)
 		return NULL;
 
+	if (flags & PW_SPA_NODE_FLAG_DATA_LOOP)
+		pw_node_set_data_loop(this, pw_core_select_data_loop(core, this->properties));
+
 	if (handle) {
 		if ((res = spa_handle_get_interface(handle, t->spa_clock, &iface)) < 0)
 			iface = NULL;
 		this->clock = iface;
+		this->driver_clock = iface;
 	}
 
 	impl = this->user_data;
@@ -224,6 +228,38 @@ setup_props(struct pw_core *core, struct spa_node *spa_node, struct pw_propertie
 	return 0;
 }
 
+/** Copy the support items for a plugin
+ * \param lib the library of the plugin, relative to the plugin dir
+ * \param support the support items to copy
+ * \param n_support the number of items in \a support
+ * \param copy the destination, it should have room for \a n_support items
+ * \return the number of items in \a copy
+ *
+ * The log is replaced by the log topic named after the directory of the
+ * plugin, alsa/libspa-alsa logs with the "alsa" topic.
+ */
+uint32_t pw_spa_support_for_lib(const char *lib,
+				const struct spa_support *support, uint32_t n_support,
+				struct spa_support *copy)
+{
+	struct pw_log_topic *topic;
+	const char *sep;
+	char name[64];
+	uint32_t i;
+
+	if ((sep = strchr(lib, '/')) == NULL)
+		sep = lib + strlen(lib);
+	snprintf(name, sizeof(name), "%.*s", (int)(sep - lib), lib);
+
+	topic = pw_log_topic_get(name);
+
+	for (i = 0; i < n_support; i++) {
+		copy[i] = support[i];
+		if (topic && strcmp(support[i].type, SPA_TYPE__Log) == 0)
+			copy[i].data = &topic->log;
+	}
+	return n_support;
+}
 
 struct pw_node *pw_spa_node_load(struct pw_core *core,
 				 struct pw_client *owner,
@@ -248,7 +284,8 @@ struct pw_node *pw_spa_node_load(struct pw_core *core,
 	char *filename;
 	const char *dir;
 	const struct spa_support *support;
-	uint32_t n_support;
+	struct spa_support plugin_support[PW_SPA_MAX_SUPPORT];
+	uint32_t n_support, loop_index;
 	struct pw_type *t = pw_core_get_type(core);
 
 	if ((dir = getenv("SPA_PLUGIN_DIR")) == NULL)
@@ -275,11 +312,18 @@ struct pw_node *pw_spa_node_load(struct pw_core *core,
 			break;
 	}
 
-	support = pw_core_get_support(core, &n_support);
+	if (properties == NULL)
+		properties = pw_properties_new(NULL, NULL);
+
+	loop_index = pw_core_select_data_loop(core, properties);
+	support = pw_core_get_data_loop_support(core, loop_index, &n_support);
+	n_support = pw_spa_support_for_lib(lib, support,
+			SPA_MIN(n_support, PW_SPA_MAX_SUPPORT), plugin_support);
+	flags |= PW_SPA_NODE_FLAG_DATA_LOOP;
 
 	handle = calloc(1, factory->size);
 	if ((res = spa_handle_factory_init(factory,
-					   handle, NULL, support, n_support)) < 0) {
+					   handle, NULL, plugin_support, n_support)) < 0) {
 		pw_log_error("can't make factory instance: %d", res);
 		goto init_failed;
 	}
@@ -33,6 +33,8 @@ extern "C" {
 enum pw_spa_node_flags {
 	PW_SPA_NODE_FLAG_ASYNC		= (1 << 0),
 	PW_SPA_NODE_FLAG_ACTIVATE	= (1 << 1),
+	PW_SPA_NODE_FLAG_DATA_LOOP	= (1 << 2),	/**< run in the data loop selected
+							  *  from the properties */
 };
 
 struct pw_node *
@@ -59,6 +61,12 @@ pw_spa_node_load(struct pw_core *core,
 
 void *pw_spa_node_get_user_data(struct pw_node *node);
 
+#define PW_SPA_MAX_SUPPORT	8
+
+uint32_t pw_spa_support_for_lib(const char *lib,
+				const struct spa_support *support, uint32_t n_support,
+				struct spa_support *copy);
+
 #ifdef __cplusplus
 }
 #endif
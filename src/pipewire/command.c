@@ -32,6 +32,8 @@
 
 static struct pw_command *parse_command_help(const char *line, char **err);
 static struct pw_command *parse_command_module_load(const char *line, char **err);
+static struct pw_command *parse_command_set_prop(const char *line, char **err);
+static struct pw_command *parse_command_set_log_level(const char *line, char **err);
 
 struct impl {
 	struct pw_command this;
@@ -48,6 +50,8 @@ struct command_parse {
 static const struct command_parse parsers[] = {
 	{"help", "Show this help", parse_command_help},
 	{"load-module", "Load a module", parse_command_module_load},
+	{"set-prop", "Set a core property", parse_command_set_prop},
+	{"set-log-level", "Set the log level of all or one topic", parse_command_set_log_level},
 	{NULL, NULL, NULL }
 };
 
@@ -126,6 +130,87 @@ static struct pw_command *parse_command_module_load(const char *line, char **err
 	return NULL;
 }
 
+static bool
+execute_command_set_prop(struct pw_command *command, struct pw_core *core, char **err)
+{
+	struct spa_dict_item items[1];
+
+	items[0].key = command->args[1];
+	items[0].value = command->args[2];
+	pw_core_update_properties(core, &SPA_DICT_INIT(items, SPA_N_ELEMENTS(items)));
+
+	return true;
+}
+
+static struct pw_command *parse_command_set_prop(const char *line, char **err)
+{
+	struct impl *impl;
+	struct pw_command *this;
+
+	impl = calloc(1, sizeof(struct impl));
+	if (impl == NULL)
+		goto no_mem;
+
+	this = &impl->this;
+	this->func = execute_command_set_prop;
+	this->args = pw_split_strv(line, whitespace, 3, &this->n_args);
+
+	if (this->n_args < 3)
+		goto no_value;
+
+	return this;
+
+      no_value:
+	asprintf(err, "%s requires a property name and value", this->args[0]);
+	pw_free_strv(this->args);
+	free(impl);
+	return NULL;
+      no_mem:
+	asprintf(err, "no memory");
+	return NULL;
+}
+
+static bool
+execute_command_set_log_level(struct pw_command *command, struct pw_core *core, char **err)
+{
+	int level = atoi(command->args[1]);
+
+	if (command->n_args > 2)
+		pw_log_set_topic_level(command->args[2], level);
+	else
+		pw_log_set_level(level);
+
+	return true;
+}
+
+static struct pw_command *parse_command_set_log_level(const char *line, char **err)
+{
+	struct impl *impl;
+	struct pw_command *this;
+
+	impl = calloc(1, sizeof(struct impl));
+	if (impl == NULL)
+		goto no_mem;
+
+	this = &impl->this;
+	this->func = execute_command_set_log_level;
+	this->args = pw_split_strv(line, whitespace, 3, &this->n_args);
+
+	if (this->n_args < 2)
+		goto no_level;
+
+	return this;
+
+      no_level:
+	asprintf(err, "%s requires a level and an optional topic", this->args[0]);
+	pw_free_strv(this->args);
+	free(impl);
+	return NULL;
+      no_mem:
+	asprintf(err, "no memory");
+	return NULL;
+}
+
 /** Free command
  *
  * \param command a command to free
@@ -21,7 +21,7 @@
 #include <time.h>
 #include <stdio.h>
 
-#define spa_debug pw_log_trace
+#define spa_debug(...) pw_log_topic_trace(&pw_log_topic_graph,__VA_ARGS__)
 
 #include <spa/lib/debug.h>
 
@@ -31,6 +31,22 @@
 #include <pipewire/protocol.h>
 #include <pipewire/core.h>
 #include <pipewire/data-loop.h>
+#include <pipewire/work-queue.h>
+
+static inline int process_node(struct spa_graph_node *node, enum spa_direction direction)
+{
+	struct pw_core_data_loop *dl = SPA_CONTAINER_OF(node->graph, struct pw_core_data_loop, graph);
+
+	if (SPA_UNLIKELY(dl->profiler != NULL))
+		return pw_profiler_process(dl, node, direction);
+	else if (direction == SPA_DIRECTION_INPUT)
+		return spa_node_process_input(node->implementation);
+	else
+		return spa_node_process_output(node->implementation);
+}
+
+#define spa_graph_node_process_input(n)		process_node(n, SPA_DIRECTION_INPUT)
+#define spa_graph_node_process_output(n)	process_node(n, SPA_DIRECTION_OUTPUT)
 
 #include <spa/graph/graph-scheduler6.h>
 
@@ -316,6 +332,35 @@ core_create_link(void *object,
 
 }
 
+static void core_set_log_level(void *object, const char *topic, int32_t level)
+{
+	struct pw_resource *resource = object;
+	struct pw_client *client = resource->client;
+
+	if (!PW_PERM_IS_W(resource->permissions))
+		goto not_allowed;
+	if (level < (topic ? -1 : 0) || level > SPA_LOG_LEVEL_TRACE)
+		goto invalid_level;
+
+	pw_log_info("core %p: client %p sets log level of %s to %d", resource->core,
+		    client, topic ? topic : "all topics", level);
+
+	if (topic)
+		pw_log_set_topic_level(topic, level);
+	else
+		pw_log_set_level(level);
+	return;
+
+      not_allowed:
+	pw_core_resource_error(client->core_resource,
+			       resource->id, -EPERM, "not allowed");
+	return;
+      invalid_level:
+	pw_core_resource_error(client->core_resource,
+			       resource->id, -EINVAL, "invalid log level %d", level);
+	return;
+}
+
 static void core_update_types(void *object, uint32_t first_id, const char **types, uint32_t n_types)
 {
 	struct pw_resource *resource = object;
@@ -338,7 +383,8 @@ static const struct pw_core_proxy_methods core_methods = {
 	.client_update = core_client_update,
 	.permissions = core_permissions,
 	.create_object = core_create_object,
-	.create_link = core_create_link
+	.create_link = core_create_link,
+	.set_log_level = core_set_log_level
 };
 
 static void core_unbind_func(void *data)
@@ -390,6 +436,54 @@ core_bind_func(struct pw_global *global,
 	return -ENOMEM;
 }
 
+static int add_data_loop(struct pw_core *core)
+{
+	struct pw_core_data_loop *dl;
+	struct pw_loop *loop;
+
+	if (core->n_data_loops >= PW_MAX_DATA_LOOPS)
+		return -ENOSPC;
+
+	dl = &core->data_loops[core->n_data_loops];
+
+	dl->impl = pw_data_loop_new(core->properties);
+	if (dl->impl == NULL)
+		return -ENOMEM;
+
+	loop = pw_data_loop_get_loop(dl->impl);
+
+	spa_graph_init(&dl->graph);
+	spa_graph_set_callbacks(&dl->graph, &spa_graph_impl_default, NULL);
+
+	dl->support[0] = SPA_SUPPORT_INIT(SPA_TYPE__TypeMap, core->type.map);
+	dl->support[1] = SPA_SUPPORT_INIT(SPA_TYPE_LOOP__DataLoop, loop->loop);
+	dl->support[2] = SPA_SUPPORT_INIT(SPA_TYPE_LOOP__MainLoop, core->main_loop->loop);
+	dl->support[3] = SPA_SUPPORT_INIT(SPA_TYPE__Log, pw_log_get());
+
+	pw_data_loop_start(dl->impl);
+
+	pw_log_debug("core %p: added data loop %d %p", core, core->n_data_loops, dl->impl);
+
+	return core->n_data_loops++;
+}
+
+/* start the number of data loops in the properties, loops are never removed
+ * because nodes could be running in them */
+static void update_data_loops(struct pw_core *core)
+{
+	const char *str;
+	uint32_t n_loops;
+
+	if ((str = pw_properties_get(core->properties, PW_CORE_PROP_DATA_LOOPS)) == NULL)
+		return;
+
+	n_loops = SPA_CLAMP(atoi(str), 1, PW_MAX_DATA_LOOPS);
+	while (core->n_data_loops < n_loops) {
+		if (add_data_loop(core) < 0)
+			break;
+	}
+}
+
 /** Create a new core object
  *
  * \param main_loop the main loop to use
@@ -413,29 +507,23 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop, struct pw_properties *pro
 		goto no_mem;
 
 	this->properties = properties;
-
-	this->data_loop_impl = pw_data_loop_new(properties);
-	if (this->data_loop_impl == NULL)
-		goto no_data_loop;
-
-	this->data_loop = pw_data_loop_get_loop(this->data_loop_impl);
 	this->main_loop = main_loop;
 
 	pw_type_init(&this->type);
 	pw_map_init(&this->globals, 128, 32);
 
-	spa_graph_init(&this->rt.graph);
-	spa_graph_set_callbacks(&this->rt.graph, &spa_graph_impl_default, NULL);
-
 	spa_debug_set_type_map(this->type.map);
 
-	this->support[0] = SPA_SUPPORT_INIT(SPA_TYPE__TypeMap, this->type.map);
-	this->support[1] = SPA_SUPPORT_INIT(SPA_TYPE_LOOP__DataLoop, this->data_loop->loop);
-	this->support[2] = SPA_SUPPORT_INIT(SPA_TYPE_LOOP__MainLoop, this->main_loop->loop);
-	this->support[3] = SPA_SUPPORT_INIT(SPA_TYPE__Log, pw_log_get());
+	if (add_data_loop(this) < 0)
+		goto no_data_loop;
+
+	this->data_loop_impl = this->data_loops[0].impl;
+	this->data_loop = pw_data_loop_get_loop(this->data_loop_impl);
+
+	memcpy(this->support, this->data_loops[0].support, sizeof(this->support));
 	this->n_support = 4;
 
-	pw_data_loop_start(this->data_loop_impl);
+	update_data_loops(this);
 
 	spa_list_init(&this->protocol_list);
 	spa_list_init(&this->remote_list);
@@ -467,6 +555,8 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop, struct pw_properties *pro
 	this->info.props = &properties->dict;
 	this->info.name = name;
 
+	pw_profiler_update(this);
+
 	this->sc_pagesize = sysconf(_SC_PAGESIZE);
 
 	this->global = pw_core_add_global(this,
@@ -499,6 +589,7 @@ void pw_core_destroy(struct pw_core *core)
 	struct pw_module *module, *tm;
 	struct pw_remote *remote, *tr;
 	struct pw_node *node, *tn;
+	uint32_t i;
 
 	pw_log_debug("core %p: destroy", core);
 	spa_hook_list_call(&core->listener_list, struct pw_core_events, destroy);
@@ -517,7 +608,13 @@ void pw_core_destroy(struct pw_core *core)
 
 	spa_hook_list_call(&core->listener_list, struct pw_core_events, free);
 
-	pw_data_loop_destroy(core->data_loop_impl);
+	if (core->link_work)
+		pw_work_queue_destroy(core->link_work);
+
+	pw_profiler_stop(core);
+
+	for (i = 0; i < core->n_data_loops; i++)
+		pw_data_loop_destroy(core->data_loops[i].impl);
 
 	pw_properties_free(core->properties);
 
@@ -564,6 +661,71 @@ const struct spa_support *pw_core_get_support(struct pw_core *core, uint32_t *n_
 	return core->support;
 }
 
+const struct spa_support *pw_core_get_data_loop_support(struct pw_core *core, uint32_t index,
+							uint32_t *n_support)
+{
+	if (index >= core->n_data_loops)
+		index = 0;
+
+	*n_support = SPA_N_ELEMENTS(core->data_loops[index].support);
+	return core->data_loops[index].support;
+}
+
+/** Select a data loop for a node
+ * \param core a core
+ * \param properties the node properties
+ * \return the index of the data loop
+ *
+ * Nodes that name a data loop in their properties are placed in that loop.
+ * Nodes of the same device share a data loop and devices are spread over
+ * the extra loops so that they run in parallel. All other nodes run in the
+ * first data loop.
+ *
+ * \memberof pw_core
+ */
+uint32_t pw_core_select_data_loop(struct pw_core *core, struct pw_properties *properties)
+{
+	const char *str, *device;
+	struct pw_node *n;
+	uint32_t i, index, n_nodes[PW_MAX_DATA_LOOPS] = { 0, };
+
+	if ((str = pw_properties_get(properties, PW_NODE_PROP_DATA_LOOP)))
+		return atoi(str) % core->n_data_loops;
+
+	index = 0;
+	device = pw_properties_get(properties, PW_NODE_PROP_DEVICE);
+
+	if (device == NULL || core->n_data_loops < 2)
+		goto done;
+
+	spa_list_for_each(n, &core->node_list, link) {
+		for (i = 0; i < core->n_data_loops; i++) {
+			if (n->data_loop == pw_data_loop_get_loop(core->data_loops[i].impl))
+				break;
+		}
+		if (i == core->n_data_loops)
+			continue;
+
+		if ((str = pw_properties_get(n->properties, PW_NODE_PROP_DEVICE)) &&
+		    strcmp(str, device) == 0) {
+			index = i;
+			goto done;
+		}
+		n_nodes[i]++;
+	}
+
+	/* the least used extra loop */
+	index = 1;
+	for (i = 2; i < core->n_data_loops; i++) {
+		if (n_nodes[i] < n_nodes[index])
+			index = i;
+	}
+
+      done:
+	pw_properties_setf(properties, PW_NODE_PROP_DATA_LOOP, "%u", index);
+	return index;
+}
+
 struct pw_loop *pw_core_get_main_loop(struct pw_core *core)
 {
 	return core->main_loop;
@@ -591,6 +753,11 @@ void pw_core_update_properties(struct pw_core *core, const struct spa_dict *dict
 	for (i = 0; i < dict->n_items; i++)
 		pw_properties_set(core->properties, dict->items[i].key, dict->items[i].value);
 
+	update_data_loops(core);
+	for (i = 0; i < core->n_data_loops; i++)
+		pw_data_loop_update_properties(core->data_loops[i].impl, dict);
+	pw_profiler_update(core);
+
 	core->info.change_mask = PW_CORE_CHANGE_MASK_PROPS;
 	core->info.props = &core->properties->dict;
 
@@ -111,6 +111,14 @@ struct pw_core_events {
 #define PW_CORE_PROP_VERSION	"pipewire.core.version"
 /** If the core should listen for connections, boolean default false */
 #define PW_CORE_PROP_DAEMON	"pipewire.daemon"
+/** The number of data loops, default 1 */
+#define PW_CORE_PROP_DATA_LOOPS	"pipewire.data-loops"
+/** If links are activated together, each step is done on all pending links
+ *  before waiting for the results, boolean default false */
+#define PW_CORE_PROP_LINK_BATCH	"pipewire.link.batch"
+/** If the timing of the nodes is written to shared memory for a profiler,
+ *  boolean default false */
+#define PW_CORE_PROP_PROFILER	"pipewire.profiler"
 
 /** Make a new core object for a given main_loop. Ownership of the properties is taken */
 struct pw_core * pw_core_new(struct pw_loop *main_loop, struct pw_properties *props);
@@ -148,6 +156,14 @@ void pw_core_update_properties(struct pw_core *core, const struct spa_dict *dict
 /** Get the core support objects */
 const struct spa_support *pw_core_get_support(struct pw_core *core, uint32_t *n_support);
 
+/** Select the data loop for a node with \a properties. The index of the
+ * loop is stored in the properties. */
+uint32_t pw_core_select_data_loop(struct pw_core *core, struct pw_properties *properties);
+
+/** Get the support objects for plugins that run in data loop \a index */
+const struct spa_support *pw_core_get_data_loop_support(struct pw_core *core, uint32_t index,
+							uint32_t *n_support);
+
 /** get the core main loop */
 struct pw_loop *pw_core_get_main_loop(struct pw_core *core);
 
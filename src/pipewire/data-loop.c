@@ -19,6 +19,10 @@
 
 #include <pthread.h>
 #include <errno.h>
+#include <alloca.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
 
 #include "pipewire/log.h"
@@ -26,29 +30,71 @@
 #include "pipewire/data-loop.h"
 #include "pipewire/private.h"
 
-static void make_realtime(struct pw_data_loop *this)
-{
-	struct sched_param sp;
-	struct pw_rtkit_bus *system_bus;
-	struct rlimit rl;
-	int r, rtprio;
-	long long rttime;
+PW_LOG_TOPIC_STATIC(log_loop, "loop");
+#undef PW_LOG_TOPIC_DEFAULT
+#define PW_LOG_TOPIC_DEFAULT (&log_loop)
 
-	rtprio = 20;
-	rttime = 20000;
+#define DEFAULT_POLICY		SCHED_FIFO
+#define DEFAULT_PRIORITY	20
+#define DEFAULT_RTTIME		20000
 
-	spa_zero(sp);
-	sp.sched_priority = rtprio;
+static int parse_policy(const char *str)
+{
+	if (str == NULL)
+		return DEFAULT_POLICY;
+	if (strcmp(str, "fifo") == 0)
+		return SCHED_FIFO;
+	if (strcmp(str, "rr") == 0)
+		return SCHED_RR;
+	if (strcmp(str, "other") == 0)
+		return SCHED_OTHER;
+
+	pw_log_warn("unknown scheduling policy \"%s\"", str);
+	return DEFAULT_POLICY;
+}
 
-	if (pthread_setschedparam(pthread_self(), SCHED_OTHER | SCHED_RESET_ON_FORK, &sp) == 0) {
-		pw_log_debug("SCHED_OTHER|SCHED_RESET_ON_FORK worked.");
-		return;
+/* parse a cpu list like "2,4-7" */
+static int parse_cpu_set(const char *str, cpu_set_t *set)
+{
+	char *end;
+	long first, last;
+
+	CPU_ZERO(set);
+
+	while (*str) {
+		first = strtol(str, &end, 10);
+		if (end == str || first < 0)
+			return -EINVAL;
+		last = first;
+		str = end;
+		if (*str == '-') {
+			str++;
+			last = strtol(str, &end, 10);
+			if (end == str || last < first)
+				return -EINVAL;
+			str = end;
+		}
+		if (last >= CPU_SETSIZE)
+			return -EINVAL;
+		for (; first <= last; first++)
+			CPU_SET(first, set);
+		if (*str == ',')
+			str++;
+		else if (*str != '\0')
+			return -EINVAL;
 	}
-	system_bus = pw_rtkit_bus_get_system();
+	return CPU_COUNT(set) > 0 ? 0 : -EINVAL;
+}
 
-	rl.rlim_cur = rl.rlim_max = rttime;
-	if ((r = setrlimit(RLIMIT_RTTIME, &rl)) < 0)
-		pw_log_debug("setrlimit() failed: %s", strerror(errno));
+static int make_realtime_rtkit(int rtprio, long long rttime)
+{
+	struct pw_rtkit_bus *system_bus;
+	struct rlimit rl;
+	int r, max;
+
+	system_bus = pw_rtkit_bus_get_system();
+	if (system_bus == NULL)
+		return -ENOTSUP;
 
 	if (rttime >= 0) {
 		r = getrlimit(RLIMIT_RTTIME, &rl);
@@ -61,12 +107,155 @@ static void make_realtime(struct pw_data_loop *this)
 		}
 	}
 
-	if ((r = pw_rtkit_make_realtime(system_bus, 0, rtprio)) < 0) {
-		pw_log_debug("could not make thread realtime: %s", strerror(r));
+	max = pw_rtkit_get_max_realtime_priority(system_bus);
+	if (max > 0 && rtprio > max) {
+		pw_log_debug("Clamping priority to %d for RealtimeKit", max);
+		rtprio = max;
+	}
+
+	r = pw_rtkit_make_realtime(system_bus, 0, rtprio);
+	pw_rtkit_bus_free(system_bus);
+
+	return r;
+}
+
+static void make_realtime(struct pw_data_loop *this)
+{
+	struct pw_properties *props = this->properties;
+	struct sched_param sp;
+	const char *str;
+	int r, policy, rtprio;
+	long long rttime;
+
+	policy = parse_policy(pw_properties_get(props, PW_DATA_LOOP_PROP_POLICY));
+
+	if ((str = pw_properties_get(props, PW_DATA_LOOP_PROP_PRIORITY)))
+		rtprio = atoi(str);
+	else
+		rtprio = DEFAULT_PRIORITY;
+
+	if ((str = pw_properties_get(props, PW_DATA_LOOP_PROP_RTTIME)))
+		rttime = atoll(str);
+	else
+		rttime = DEFAULT_RTTIME;
+
+	if (policy == SCHED_OTHER)
+		rtprio = 0;
+	else
+		rtprio = SPA_CLAMP(rtprio, sched_get_priority_min(policy),
+				   sched_get_priority_max(policy));
+
+	spa_zero(sp);
+	sp.sched_priority = rtprio;
+
+	if ((r = pthread_setschedparam(pthread_self(), policy | SCHED_RESET_ON_FORK, &sp)) == 0) {
+		pw_log_debug("data-loop %p: policy %d priority %d", this, policy, rtprio);
+		return;
+	}
+	if (policy == SCHED_OTHER) {
+		pw_log_warn("data-loop %p: could not set policy: %s", this, strerror(r));
+		return;
+	}
+
+	/* no permission for realtime, ask RealtimeKit */
+	if ((r = make_realtime_rtkit(rtprio, rttime)) < 0) {
+		pw_log_debug("could not make thread realtime: %s", strerror(-r));
 	} else {
 		pw_log_debug("thread made realtime");
 	}
-	pw_rtkit_bus_free(system_bus);
+}
+
+static void set_affinity(struct pw_data_loop *this)
+{
+	const char *str;
+	cpu_set_t set;
+	int r;
+
+	if ((str = pw_properties_get(this->properties, PW_DATA_LOOP_PROP_AFFINITY)) == NULL)
+		return;
+
+	if (parse_cpu_set(str, &set) < 0) {
+		pw_log_warn("data-loop %p: invalid affinity \"%s\"", this, str);
+		return;
+	}
+	if ((r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) != 0) {
+		pw_log_warn("data-loop %p: could not set affinity: %s", this, strerror(r));
+	} else {
+		pw_log_debug("data-loop %p: affinity %s", this, str);
+	}
+}
+
+/* room left on the stack below the prefaulted part */
+#define PREFAULT_MARGIN	(64 * 1024)
+
+/* touch the stack so that the processing never page faults on it. The size
+ * comes from the configuration, never touch more than what is left of the
+ * stack of the thread. */
+static void __attribute__((noinline)) prefault_stack(struct pw_data_loop *this, size_t size)
+{
+	pthread_attr_t attr;
+	void *addr;
+	size_t stack_size, avail, i;
+	long page_size = sysconf(_SC_PAGESIZE);
+	volatile char *stack;
+
+	if (pthread_getattr_np(pthread_self(), &attr) != 0)
+		return;
+	if (pthread_attr_getstack(&attr, &addr, &stack_size) != 0) {
+		pthread_attr_destroy(&attr);
+		return;
+	}
+	pthread_attr_destroy(&attr);
+
+	/* the stack grows down to addr, we are somewhere above it */
+	avail = (char *) &attr - (char *) addr;
+	if (avail <= PREFAULT_MARGIN)
+		return;
+	avail -= PREFAULT_MARGIN;
+
+	if (size > avail) {
+		pw_log_warn("data-loop %p: prefault %zd bytes of stack, only %zd available",
+			    this, size, avail);
+		size = avail;
+	}
+
+	stack = alloca(size);
+	for (i = 0; i < size; i += page_size)
+		stack[i] = 0;
+}
+
+static void lock_memory(struct pw_data_loop *this)
+{
+	const char *str;
+
+	/* with MCL_FUTURE, the buffer memory that is mapped later is locked and
+	 * populated when it is mapped */
+	if ((str = pw_properties_get(this->properties, PW_DATA_LOOP_PROP_MLOCK)) &&
+	    pw_properties_parse_bool(str)) {
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+			pw_log_warn("data-loop %p: mlockall failed: %s", this, strerror(errno));
+		} else {
+			pw_log_debug("data-loop %p: memory locked", this);
+		}
+	}
+
+	if ((str = pw_properties_get(this->properties, PW_DATA_LOOP_PROP_PREFAULT)) &&
+	    atoi(str) > 0)
+		prefault_stack(this, atoi(str));
+}
+
+static void configure(struct pw_data_loop *this)
+{
+	set_affinity(this);
+	lock_memory(this);
+	make_realtime(this);
+}
+
+static int do_configure(struct spa_loop *loop, bool async, uint32_t seq,
+			const void *data, size_t size, void *user_data)
+{
+	configure(user_data);
+	return 0;
 }
 
 static void *do_loop(void *user_data)
@@ -74,7 +263,7 @@ static void *do_loop(void *user_data)
 	struct pw_data_loop *this = user_data;
 	int res;
 
-	make_realtime(this);
+	configure(this);
 
 	pw_log_debug("data-loop %p: enter thread", this);
 	pw_loop_enter(this->loop);
@@ -111,6 +300,13 @@ struct pw_data_loop *pw_data_loop_new(struct pw_properties *properties)
 
 	pw_log_debug("data-loop %p: new", this);
 
+	if (properties)
+		this->properties = pw_properties_copy(properties);
+	else
+		this->properties = pw_properties_new(NULL, NULL);
+	if (this->properties == NULL)
+		goto no_properties;
+
 	this->loop = pw_loop_new(properties);
 	if (this->loop == NULL)
 		goto no_loop;
@@ -122,6 +318,8 @@ struct pw_data_loop *pw_data_loop_new(struct pw_properties *properties)
 	return this;
 
       no_loop:
+	pw_properties_free(this->properties);
+      no_properties:
 	free(this);
 	return NULL;
 }
@@ -140,9 +338,35 @@ void pw_data_loop_destroy(struct pw_data_loop *loop)
 
 	pw_loop_destroy_source(loop->loop, loop->event);
 	pw_loop_destroy(loop->loop);
+	pw_properties_free(loop->properties);
 	free(loop);
 }
 
+/** Update the data loop properties
+ * \param loop the data loop
+ * \param dict new properties
+ *
+ * Changes to the scheduling, affinity and memory locking properties are
+ * applied to a running thread.
+ *
+ * \memberof pw_data_loop
+ */
+void pw_data_loop_update_properties(struct pw_data_loop *loop, const struct spa_dict *dict)
+{
+	uint32_t i;
+	bool changed = false;
+
+	for (i = 0; i < dict->n_items; i++) {
+		if (strncmp(dict->items[i].key, PW_DATA_LOOP_PROP_BASE,
+			    strlen(PW_DATA_LOOP_PROP_BASE)) != 0)
+			continue;
+		pw_properties_set(loop->properties, dict->items[i].key, dict->items[i].value);
+		changed = true;
+	}
+	if (changed && loop->running)
+		pw_loop_invoke(loop->loop, do_configure, 0, NULL, 0, true, loop);
+}
+
 void pw_data_loop_add_listener(struct pw_data_loop *loop,
 			       struct spa_hook *listener,
 			       const struct pw_data_loop_events *events,
@@ -44,6 +44,21 @@ struct pw_data_loop_events {
 	void (*destroy) (void *data);
 };
 
+#define PW_DATA_LOOP_PROP_BASE		"pipewire.data-loop."
+/** Scheduling policy of the thread: fifo (default), rr or other */
+#define PW_DATA_LOOP_PROP_POLICY	PW_DATA_LOOP_PROP_BASE "policy"
+/** Realtime priority of the thread, default 20 */
+#define PW_DATA_LOOP_PROP_PRIORITY	PW_DATA_LOOP_PROP_BASE "priority"
+/** RLIMIT_RTTIME in microseconds when realtime is requested from RealtimeKit */
+#define PW_DATA_LOOP_PROP_RTTIME	PW_DATA_LOOP_PROP_BASE "rttime"
+/** List of CPUs to run the thread on, like "2,4-7" */
+#define PW_DATA_LOOP_PROP_AFFINITY	PW_DATA_LOOP_PROP_BASE "affinity"
+/** Lock all current and future memory, including the buffers */
+#define PW_DATA_LOOP_PROP_MLOCK		PW_DATA_LOOP_PROP_BASE "mlock"
+/** Number of bytes of the thread stack to prefault, at most the stack size
+ * minus a margin */
+#define PW_DATA_LOOP_PROP_PREFAULT	PW_DATA_LOOP_PROP_BASE "prefault"
+
 /** Make a new loop */
 struct pw_data_loop *
 pw_data_loop_new(struct pw_properties *properties);
@@ -58,6 +73,9 @@ void pw_data_loop_add_listener(struct pw_data_loop *loop,
 struct pw_loop *
 pw_data_loop_get_loop(struct pw_data_loop *loop);
 
+/** Update the loop properties, the thread is reconfigured */
+void pw_data_loop_update_properties(struct pw_data_loop *loop, const struct spa_dict *dict);
+
 /** Destroy the loop */
 void pw_data_loop_destroy(struct pw_data_loop *loop);
 
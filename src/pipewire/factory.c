@@ -123,7 +123,7 @@ void pw_factory_register(struct pw_factory *factory,
 	struct pw_core *core = factory->core;
 	spa_list_append(&core->factory_list, &factory->link);
         factory->global = pw_core_add_global(core, owner, parent,
-					     core->type.factory, 0, factory_bind_func, factory);
+					     core->type.factory, PW_VERSION_FACTORY, factory_bind_func, factory);
 	if (factory->global != NULL)
 		factory->info.id = factory->global->id;
 }
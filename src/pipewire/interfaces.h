@@ -64,7 +64,8 @@ struct pw_link_proxy;
 #define PW_TYPE_INTERFACE__Client	PW_TYPE_INTERFACE_BASE "Client"
 #define PW_TYPE_INTERFACE__Link		PW_TYPE_INTERFACE_BASE "Link"
 
-#define PW_VERSION_CORE				0
+#define PW_VERSION_CORE				2
+#define PW_VERSION_LINK				1	/* used by create_link */
 
 #define PW_CORE_PROXY_METHOD_UPDATE_TYPES	0
 #define PW_CORE_PROXY_METHOD_SYNC		1
@@ -73,7 +74,8 @@ struct pw_link_proxy;
 #define PW_CORE_PROXY_METHOD_PERMISSIONS	4
 #define PW_CORE_PROXY_METHOD_CREATE_OBJECT	5
 #define PW_CORE_PROXY_METHOD_CREATE_LINK	6
-#define PW_CORE_PROXY_METHOD_NUM		7
+#define PW_CORE_PROXY_METHOD_SET_LOG_LEVEL	7	/* since version 2 */
+#define PW_CORE_PROXY_METHOD_NUM		8
 
 /**
  * Key to update default permissions of globals without specific
@@ -192,6 +194,15 @@ struct pw_core_proxy_methods {
 			     const struct spa_pod *filter,
 			     const struct spa_dict *props,
 			     uint32_t new_id);
+	/**
+	 * Set the log level of the PipeWire server
+	 *
+	 * Only available when the version of the core is at least 2.
+	 *
+	 * \param topic the log topic or NULL for all topics
+	 * \param level the new log level
+	 */
+	void (*set_log_level) (void *object, const char *topic, int32_t level);
 };
 
 static inline void
@@ -209,7 +220,7 @@ pw_core_proxy_sync(struct pw_core_proxy *core, uint32_t seq)
 static inline struct pw_registry_proxy *
 pw_core_proxy_get_registry(struct pw_core_proxy *core, uint32_t type, uint32_t version, size_t user_data_size)
 {
-	struct pw_proxy *p = pw_proxy_new((struct pw_proxy*)core, type, user_data_size);
+	struct pw_proxy *p = pw_proxy_new((struct pw_proxy*)core, type, version, user_data_size);
 	pw_proxy_do((struct pw_proxy*)core, struct pw_core_proxy_methods, get_registry, version, pw_proxy_get_id(p));
 	return (struct pw_registry_proxy *) p;
 }
@@ -234,7 +245,7 @@ pw_core_proxy_create_object(struct pw_core_proxy *core,
 			    const struct spa_dict *props,
 			    size_t user_data_size)
 {
-	struct pw_proxy *p = pw_proxy_new((struct pw_proxy*)core, type, user_data_size);
+	struct pw_proxy *p = pw_proxy_new((struct pw_proxy*)core, type, version, user_data_size);
 	pw_proxy_do((struct pw_proxy*)core, struct pw_core_proxy_methods, create_object, factory_name,
 			type, version, props, pw_proxy_get_id(p));
 	return p;
@@ -251,12 +262,18 @@ pw_core_proxy_create_link(struct pw_core_proxy *core,
                           const struct spa_dict *prop,
 			  size_t user_data_size)
 {
-	struct pw_proxy *p = pw_proxy_new((struct pw_proxy*)core, type, user_data_size);
+	struct pw_proxy *p = pw_proxy_new((struct pw_proxy*)core, type, PW_VERSION_LINK, user_data_size);
 	pw_proxy_do((struct pw_proxy*)core, struct pw_core_proxy_methods, create_link, output_node_id, output_port_id,
 			input_node_id, input_port_id, filter, prop, pw_proxy_get_id(p));
 	return (struct pw_link_proxy*) p;
 }
 
+static inline void
+pw_core_proxy_set_log_level(struct pw_core_proxy *core, const char *topic, int32_t level)
+{
+	pw_proxy_do((struct pw_proxy*)core, struct pw_core_proxy_methods, set_log_level, topic, level);
+}
+
 
 #define PW_CORE_PROXY_EVENT_UPDATE_TYPES 0
 #define PW_CORE_PROXY_EVENT_DONE         1
@@ -404,7 +421,7 @@ pw_registry_proxy_bind(struct pw_registry_proxy *registry,
 		       size_t user_data_size)
 {
 	struct pw_proxy *reg = (struct pw_proxy*)registry;
-	struct pw_proxy *p = pw_proxy_new(reg, type, user_data_size);
+	struct pw_proxy *p = pw_proxy_new(reg, type, version, user_data_size);
 	pw_proxy_do(reg, struct pw_registry_proxy_methods, bind, id, type, version, pw_proxy_get_id(p));
 	return p;
 }
@@ -456,7 +473,7 @@ pw_registry_proxy_add_listener(struct pw_registry_proxy *registry,
 #define pw_registry_resource_global_remove(r,...) pw_resource_notify(r,struct pw_registry_proxy_events,global_remove,__VA_ARGS__)
 
 
-#define PW_VERSION_MODULE			0
+#define PW_VERSION_MODULE			1
 
 #define PW_MODULE_PROXY_EVENT_INFO		0
 #define PW_MODULE_PROXY_EVENT_NUM		1
@@ -484,10 +501,11 @@ pw_module_proxy_add_listener(struct pw_module_proxy *module,
 
 #define pw_module_resource_info(r,...)	pw_resource_notify(r,struct pw_module_proxy_events,info,__VA_ARGS__)
 
-#define PW_VERSION_NODE			0
+#define PW_VERSION_NODE			1
 
 #define PW_NODE_PROXY_EVENT_INFO	0
-#define PW_NODE_PROXY_EVENT_NUM	1
+#define PW_NODE_PROXY_EVENT_XRUN	1
+#define PW_NODE_PROXY_EVENT_NUM	2
 
 /** Node events */
 struct pw_node_proxy_events {
@@ -499,6 +517,16 @@ struct pw_node_proxy_events {
 	 * \param info info about the node
 	 */
 	void (*info) (void *object, struct pw_node_info *info);
+	/**
+	 * Notify xruns of the node
+	 *
+	 * Xruns that happen close together are reported once, the
+	 * n_xruns field of the info has the total.
+	 *
+	 * \param cycle the graph cycle of the last xrun
+	 * \param missing samples or frames lost, 0 when unknown
+	 */
+	void (*xrun) (void *object, uint64_t cycle, uint64_t missing);
 };
 
 static inline void
@@ -511,8 +539,9 @@ pw_node_proxy_add_listener(struct pw_node_proxy *node,
 }
 
 #define pw_node_resource_info(r,...) pw_resource_notify(r,struct pw_node_proxy_events,info,__VA_ARGS__)
+#define pw_node_resource_xrun(r,...) pw_resource_notify(r,struct pw_node_proxy_events,xrun,__VA_ARGS__)
 
-#define PW_VERSION_FACTORY			0
+#define PW_VERSION_FACTORY			1
 
 #define PW_FACTORY_PROXY_EVENT_INFO		0
 #define PW_FACTORY_PROXY_EVENT_NUM		1
@@ -541,7 +570,7 @@ pw_factory_proxy_add_listener(struct pw_factory_proxy *factory,
 
 #define pw_factory_resource_info(r,...) pw_resource_notify(r,struct pw_factory_proxy_events,info,__VA_ARGS__)
 
-#define PW_VERSION_CLIENT			0
+#define PW_VERSION_CLIENT			1
 
 #define PW_CLIENT_PROXY_EVENT_INFO		0
 #define PW_CLIENT_PROXY_EVENT_NUM		1
@@ -571,8 +600,6 @@ pw_client_proxy_add_listener(struct pw_client_proxy *client,
 #define pw_client_resource_info(r,...) pw_resource_notify(r,struct pw_client_proxy_events,info,__VA_ARGS__)
 
 
-#define PW_VERSION_LINK			0
-
 #define PW_LINK_PROXY_EVENT_INFO	0
 #define PW_LINK_PROXY_EVENT_NUM	1
 
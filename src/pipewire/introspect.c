@@ -247,6 +247,9 @@ struct pw_node_info *pw_node_info_update(struct pw_node_info *info,
 			pw_spa_dict_destroy(info->props);
 		info->props = pw_spa_dict_copy(update->props);
 	}
+	if (update->change_mask & PW_NODE_CHANGE_MASK_XRUNS)
+		info->n_xruns = update->n_xruns;
+
 	return info;
 }
 
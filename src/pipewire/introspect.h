@@ -148,6 +148,7 @@ struct pw_node_info {
 #define PW_NODE_CHANGE_MASK_OUTPUT_PARAMS	(1 << 4)
 #define PW_NODE_CHANGE_MASK_STATE		(1 << 5)
 #define PW_NODE_CHANGE_MASK_PROPS		(1 << 6)
+#define PW_NODE_CHANGE_MASK_XRUNS		(1 << 7)
 	uint64_t change_mask;			/**< bitfield of changed fields since last call */
 	const char *name;                       /**< name the node, suitable for display */
 	uint32_t max_input_ports;		/**< maximum number of inputs */
@@ -161,6 +162,7 @@ struct pw_node_info {
 	enum pw_node_state state;		/**< the current state of the node */
 	const char *error;			/**< an error reason if \a state is error */
 	struct spa_dict *props;			/**< the properties of the node */
+	uint32_t n_xruns;			/**< number of xruns of the node */
 };
 
 struct pw_node_info *
@@ -23,6 +23,7 @@
 
 #include <spa/pod/parser.h>
 #include <spa/param/param.h>
+#include <spa/utils/ringbuffer.h>
 
 #include <spa/lib/debug.h>
 #include <spa/lib/pod.h>
@@ -33,7 +34,18 @@
 #include "link.h"
 #include "work-queue.h"
 
+PW_LOG_TOPIC_STATIC(log_link, "link");
+#undef PW_LOG_TOPIC_DEFAULT
+#define PW_LOG_TOPIC_DEFAULT (&log_link)
+
 #define MAX_BUFFERS     16
+#define MAX_BLOCKS      8
+/* max work items a link has in the queue, see queue_work() */
+#define MAX_WORK_IDS	16
+/* seconds a link in batch mode waits for the async results of its nodes */
+#define BATCH_TIMEOUT	5
+/* size of the queues between data loops, must be a power of 2 */
+#define BRIDGE_SIZE	64
 
 /** \cond */
 struct impl {
@@ -42,6 +54,14 @@ struct impl {
 	bool active;
 
 	struct pw_work_queue *work;
+	bool shared_work;		/**< work is the queue of the core */
+	struct {
+		uint32_t id;
+		void *obj;
+		int res;
+	} work_items[MAX_WORK_IDS];	/**< items queued since the last check */
+	uint32_t n_work_ids;
+	struct spa_source *work_timeout;	/**< fails the async items in batch mode */
 
 	struct spa_pod *format_filter;
 	struct pw_properties *properties;
@@ -50,6 +70,31 @@ struct impl {
 	struct spa_hook input_node_listener;
 	struct spa_hook output_port_listener;
 	struct spa_hook output_node_listener;
+
+	/* when the nodes run in different data loops, the link hands the
+	 * buffers over to the other loop */
+	bool bridged;
+	struct pw_loop *out_loop;
+	struct pw_loop *in_loop;
+
+	struct spa_source *out_event;	/**< wakes up the output loop */
+	struct spa_source *in_event;	/**< wakes up the input loop */
+
+	struct spa_ringbuffer queue;	/**< buffers for the input loop */
+	uint32_t queue_ids[BRIDGE_SIZE];
+	struct spa_ringbuffer reuse;	/**< buffers to recycle in the output loop */
+	uint32_t reuse_ids[BRIDGE_SIZE];
+	int need_input;			/**< the input loop wants a buffer */
+
+	struct spa_io_buffers in_io;	/**< io area in the input loop */
+
+	struct spa_node out_bridge;
+	struct spa_graph_node out_node;
+	struct spa_graph_port out_peer;
+
+	struct spa_node in_bridge;
+	struct spa_graph_node in_node;
+	struct spa_graph_port in_peer;
 };
 
 struct resource_data {
@@ -58,6 +103,188 @@ struct resource_data {
 
 /** \endcond */
 
+static inline bool bridge_push(struct spa_ringbuffer *ring, uint32_t *ids, uint32_t id)
+{
+	uint32_t index;
+
+	if (spa_ringbuffer_get_write_index(ring, &index) >= BRIDGE_SIZE)
+		return false;
+
+	ids[index & (BRIDGE_SIZE - 1)] = id;
+	spa_ringbuffer_write_update(ring, index + 1);
+	return true;
+}
+
+static inline bool bridge_pop(struct spa_ringbuffer *ring, uint32_t *ids, uint32_t *id)
+{
+	uint32_t index;
+
+	if (spa_ringbuffer_get_read_index(ring, &index) <= 0)
+		return false;
+
+	*id = ids[index & (BRIDGE_SIZE - 1)];
+	spa_ringbuffer_read_update(ring, index + 1);
+	return true;
+}
+
+/* give a buffer back to the output port, in the output loop */
+static void bridge_reuse_output(struct impl *impl, uint32_t buffer_id)
+{
+	struct spa_graph_port *p = impl->out_peer.peer;
+
+	if (p != NULL)
+		spa_node_port_reuse_buffer(p->node->implementation, p->port_id, buffer_id);
+}
+
+/* the output port pushed a buffer, queue it for the input loop */
+static int bridge_out_process_input(struct spa_node *node)
+{
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, out_bridge);
+	struct spa_io_buffers *io = &impl->this.io;
+
+	impl->out_node.ready[SPA_DIRECTION_INPUT] = 0;
+	impl->out_node.required[SPA_DIRECTION_INPUT] = 1;
+
+	if (io->status == SPA_STATUS_HAVE_BUFFER && io->buffer_id != SPA_ID_INVALID) {
+		pw_log_trace("link %p: queue buffer %d", impl, io->buffer_id);
+		if (bridge_push(&impl->queue, impl->queue_ids, io->buffer_id)) {
+			pw_loop_signal_event(impl->in_loop, impl->in_event);
+		} else {
+			pw_log_warn("link %p: queue full, drop buffer %d", impl, io->buffer_id);
+			bridge_reuse_output(impl, io->buffer_id);
+		}
+	}
+	io->status = SPA_STATUS_NEED_BUFFER;
+	io->buffer_id = SPA_ID_INVALID;
+
+	return SPA_STATUS_OK;
+}
+
+static const struct spa_node bridge_out_node = {
+	SPA_VERSION_NODE,
+	NULL,
+	.process_input = bridge_out_process_input,
+};
+
+/* the input port gives consumed buffers back in the io area, recycle them
+ * in the output loop */
+static void bridge_in_recycle(struct impl *impl)
+{
+	struct spa_io_buffers *io = &impl->in_io;
+
+	if (io->status == SPA_STATUS_HAVE_BUFFER || io->buffer_id == SPA_ID_INVALID)
+		return;
+
+	pw_log_trace("link %p: recycle buffer %d", impl, io->buffer_id);
+	if (bridge_push(&impl->reuse, impl->reuse_ids, io->buffer_id))
+		pw_loop_signal_event(impl->out_loop, impl->out_event);
+	else
+		pw_log_warn("link %p: reuse queue full, lost buffer %d", impl, io->buffer_id);
+	io->buffer_id = SPA_ID_INVALID;
+}
+
+/* the input port pulls, take a queued buffer or ask the output loop */
+static int bridge_in_process_output(struct spa_node *node)
+{
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, in_bridge);
+	struct spa_io_buffers *io = &impl->in_io;
+	uint32_t id;
+
+	impl->in_node.ready[SPA_DIRECTION_OUTPUT] = 0;
+
+	if (io->status == SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_HAVE_BUFFER;
+
+	bridge_in_recycle(impl);
+
+	if (bridge_pop(&impl->queue, impl->queue_ids, &id)) {
+		io->status = SPA_STATUS_HAVE_BUFFER;
+		io->buffer_id = id;
+	} else {
+		io->status = SPA_STATUS_NEED_BUFFER;
+		io->buffer_id = SPA_ID_INVALID;
+		__atomic_store_n(&impl->need_input, true, __ATOMIC_SEQ_CST);
+		pw_loop_signal_event(impl->out_loop, impl->out_event);
+	}
+	return io->status;
+}
+
+static int bridge_in_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+{
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, in_bridge);
+
+	pw_log_trace("link %p: reuse buffer %d", impl, buffer_id);
+	if (!bridge_push(&impl->reuse, impl->reuse_ids, buffer_id))
+		return -ENOSPC;
+
+	pw_loop_signal_event(impl->out_loop, impl->out_event);
+	return 0;
+}
+
+static const struct spa_node bridge_in_node = {
+	SPA_VERSION_NODE,
+	NULL,
+	.process_output = bridge_in_process_output,
+	.port_reuse_buffer = bridge_in_reuse_buffer,
+};
+
+/* in the output loop: recycle buffers and pull when the input loop asked */
+static void on_out_event(void *data, uint64_t count)
+{
+	struct impl *impl = data;
+	uint32_t id;
+
+	while (bridge_pop(&impl->reuse, impl->reuse_ids, &id))
+		bridge_reuse_output(impl, id);
+
+	if (__atomic_exchange_n(&impl->need_input, false, __ATOMIC_SEQ_CST) &&
+	    impl->out_peer.peer != NULL) {
+		spa_graph_need_input(impl->out_node.graph, &impl->out_node);
+		/* the queue takes every buffer that is pushed */
+		impl->out_node.required[SPA_DIRECTION_INPUT] = 1;
+	}
+}
+
+/* in the input loop: push the queued buffers to the input port */
+static void on_in_event(void *data, uint64_t count)
+{
+	struct impl *impl = data;
+	uint32_t id;
+
+	while (impl->in_peer.peer != NULL &&
+	       impl->in_io.status != SPA_STATUS_HAVE_BUFFER &&
+	       bridge_pop(&impl->queue, impl->queue_ids, &id)) {
+		bridge_in_recycle(impl);
+		impl->in_io.status = SPA_STATUS_HAVE_BUFFER;
+		impl->in_io.buffer_id = id;
+		spa_graph_have_output(impl->in_node.graph, &impl->in_node);
+	}
+}
+
+static void setup_bridge(struct impl *impl)
+{
+	struct pw_link *this = &impl->this;
+
+	pw_log_debug("link %p: bridge data loops %p -> %p", impl, impl->out_loop, impl->in_loop);
+
+	impl->bridged = true;
+	spa_ringbuffer_init(&impl->queue);
+	spa_ringbuffer_init(&impl->reuse);
+	impl->in_io = SPA_IO_BUFFERS_INIT;
+	this->rt.in_port.io = &impl->in_io;
+
+	impl->out_bridge = bridge_out_node;
+	spa_graph_node_init(&impl->out_node);
+	spa_graph_node_set_implementation(&impl->out_node, &impl->out_bridge);
+	impl->out_node.required[SPA_DIRECTION_INPUT] = 1;
+	spa_graph_port_init(&impl->out_peer, SPA_DIRECTION_INPUT, 0, 0, &this->io);
+
+	impl->in_bridge = bridge_in_node;
+	spa_graph_node_init(&impl->in_node);
+	spa_graph_node_set_implementation(&impl->in_node, &impl->in_bridge);
+	spa_graph_port_init(&impl->in_peer, SPA_DIRECTION_OUTPUT, 0, 0, &impl->in_io);
+}
+
 static void pw_link_update_state(struct pw_link *link, enum pw_link_state state, char *error)
 {
 	enum pw_link_state old = link->state;
@@ -75,6 +302,54 @@ static void pw_link_update_state(struct pw_link *link, enum pw_link_state state,
 	}
 }
 
+/* check_states() runs when everything queued before it is done, so the items
+ * of the link are the ones queued since it last ran. They are remembered to
+ * cancel them when the queue is shared with other links. */
+static void queue_work(struct impl *impl, void *obj, int res, pw_work_func_t func, void *data)
+{
+	uint32_t id;
+
+	id = pw_work_queue_add(impl->work, obj, res, func, data);
+	if (id != SPA_ID_INVALID && impl->n_work_ids < MAX_WORK_IDS) {
+		impl->work_items[impl->n_work_ids].id = id;
+		impl->work_items[impl->n_work_ids].obj = obj;
+		impl->work_items[impl->n_work_ids].res = res;
+		impl->n_work_ids++;
+	}
+
+	/* a node that never completes would stall the links that share the
+	 * queue, give up on it after a while */
+	if (impl->work_timeout && SPA_RESULT_IS_ASYNC(res)) {
+		struct timespec value;
+
+		value.tv_sec = BATCH_TIMEOUT;
+		value.tv_nsec = 0;
+		pw_loop_update_timer(impl->this.core->main_loop, impl->work_timeout,
+				     &value, NULL, false);
+	}
+}
+
+/* the async items that are still pending fail, the ports go to the error
+ * state and the next check of the link fails it. The other links of the
+ * queue go on. */
+static void on_work_timeout(void *data, uint64_t expirations)
+{
+	struct impl *impl = data;
+	uint32_t i;
+
+	for (i = 0; i < impl->n_work_ids; i++) {
+		uint32_t seq;
+
+		if (!SPA_RESULT_IS_ASYNC(impl->work_items[i].res))
+			continue;
+
+		seq = SPA_RESULT_ASYNC_SEQ(impl->work_items[i].res);
+		if (pw_work_queue_complete(impl->work, impl->work_items[i].obj, seq, -ETIMEDOUT))
+			pw_log_warn("link %p: node %p did not complete %d", impl,
+				    impl->work_items[i].obj, seq);
+	}
+}
+
 static void complete_ready(void *obj, void *data, int res, uint32_t id)
 {
 	struct pw_port *port = data;
@@ -197,8 +472,7 @@ static int do_negotiate(struct pw_link *this, uint32_t in_state, uint32_t out_st
 			goto error;
 		}
 		if (SPA_RESULT_IS_ASYNC(res))
-			pw_work_queue_add(impl->work, output->node, res, complete_ready,
-					  output);
+			queue_work(impl, output->node, res, complete_ready, output);
 	}
 	if (in_state == PW_PORT_STATE_CONFIGURE) {
 		pw_log_debug("link %p: doing set format on input", this);
@@ -209,7 +483,7 @@ static int do_negotiate(struct pw_link *this, uint32_t in_state, uint32_t out_st
 			goto error;
 		}
 		if (SPA_RESULT_IS_ASYNC(res2))
-			pw_work_queue_add(impl->work, input->node, res2, complete_ready, input);
+			queue_work(impl, input->node, res2, complete_ready, input);
 	}
 
 
@@ -557,7 +831,7 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 		uint8_t buffer[4096];
 		struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
 		int i, offset, n_params;
-		uint32_t max_buffers;
+		uint32_t max_buffers, blocks;
 		size_t minsize = 1024, stride = 0;
 
 		n_params = param_filter(this, input, output, t->param.idBuffers, &b);
@@ -575,6 +849,7 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 
 		max_buffers = MAX_BUFFERS;
 		minsize = stride = 0;
+		blocks = 1;
 		param = find_param(params, n_params, t->param_buffers.Buffers);
 		if (param) {
 			uint32_t qmax_buffers = max_buffers,
@@ -583,7 +858,10 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 			spa_pod_object_parse(param,
 				":", t->param_buffers.size, "i", &qminsize,
 				":", t->param_buffers.stride, "i", &qstride,
-				":", t->param_buffers.buffers, "i", &qmax_buffers, NULL);
+				":", t->param_buffers.buffers, "i", &qmax_buffers,
+				":", t->param_buffers.blocks, "?i", &blocks, NULL);
+
+			blocks = SPA_CLAMP(blocks, 1, MAX_BLOCKS);
 
 			max_buffers =
 			    qmax_buffers == 0 ? max_buffers : SPA_MIN(qmax_buffers,
@@ -621,11 +899,13 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 			pw_log_debug("link %p: reusing %d input buffers %p", this, this->n_buffers,
 				     this->buffers);
 		} else {
-			size_t data_sizes[1];
-			ssize_t data_strides[1];
+			size_t data_sizes[MAX_BLOCKS];
+			ssize_t data_strides[MAX_BLOCKS];
 
-			data_sizes[0] = minsize;
-			data_strides[0] = stride;
+			for (i = 0; i < blocks; i++) {
+				data_sizes[i] = minsize;
+				data_strides[i] = stride;
+			}
 
 			this->buffer_owner = this;
 			this->n_buffers = max_buffers;
@@ -633,7 +913,7 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 						      this->n_buffers,
 						      n_params,
 						      params,
-						      1,
+						      blocks,
 						      data_sizes, data_strides,
 						      &this->buffer_mem);
 
@@ -649,7 +929,7 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 				goto error;
 			}
 			if (SPA_RESULT_IS_ASYNC(res))
-				pw_work_queue_add(impl->work, output->node, res, complete_paused, output);
+				queue_work(impl, output->node, res, complete_paused, output);
 			output->buffer_mem = this->buffer_mem;
 			this->buffer_owner = output;
 			pw_log_debug("link %p: allocated %d buffers %p from output port", this,
@@ -662,7 +942,7 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 				goto error;
 			}
 			if (SPA_RESULT_IS_ASYNC(res))
-				pw_work_queue_add(impl->work, input->node, res, complete_paused, input);
+				queue_work(impl, input->node, res, complete_paused, input);
 			input->buffer_mem = this->buffer_mem;
 			this->buffer_owner = input;
 			pw_log_debug("link %p: allocated %d buffers %p from input port", this,
@@ -678,7 +958,7 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 			goto error;
 		}
 		if (SPA_RESULT_IS_ASYNC(res))
-			pw_work_queue_add(impl->work, input->node, res, complete_paused, input);
+			queue_work(impl, input->node, res, complete_paused, input);
 	} else if (out_flags & SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS) {
 		pw_log_debug("link %p: using %d buffers %p on output port", this,
 			     this->n_buffers, this->buffers);
@@ -687,7 +967,7 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 			goto error;
 		}
 		if (SPA_RESULT_IS_ASYNC(res))
-			pw_work_queue_add(impl->work, output->node, res, complete_paused, output);
+			queue_work(impl, output->node, res, complete_paused, output);
 	} else {
 		asprintf(&error, "no common buffer alloc found");
 		goto error;
@@ -711,7 +991,23 @@ do_activate_link(struct spa_loop *loop,
 		 bool async, uint32_t seq, const void *data, size_t size, void *user_data)
 {
         struct pw_link *this = user_data;
-	spa_graph_port_link(&this->rt.out_port, &this->rt.in_port);
+	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
+
+	if (impl->bridged)
+		spa_graph_port_link(&this->rt.out_port, &impl->out_peer);
+	else
+		spa_graph_port_link(&this->rt.out_port, &this->rt.in_port);
+	return 0;
+}
+
+static int
+do_activate_bridge(struct spa_loop *loop,
+		   bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+        struct pw_link *this = user_data;
+	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
+
+	spa_graph_port_link(&impl->in_peer, &this->rt.in_port);
 	return 0;
 }
 
@@ -732,6 +1028,9 @@ static int do_start(struct pw_link *this, uint32_t in_state, uint32_t out_state)
 
 	pw_loop_invoke(output->node->data_loop,
 		       do_activate_link, SPA_ID_INVALID, NULL, 0, false, this);
+	if (impl->bridged)
+		pw_loop_invoke(input->node->data_loop,
+			       do_activate_bridge, SPA_ID_INVALID, NULL, 0, false, this);
 
 	if (in_state == PW_PORT_STATE_PAUSED) {
 		if  ((res = pw_node_set_state(input->node, PW_NODE_STATE_RUNNING)) < 0) {
@@ -740,7 +1039,7 @@ static int do_start(struct pw_link *this, uint32_t in_state, uint32_t out_state)
 		}
 
 		if (SPA_RESULT_IS_ASYNC(res))
-			pw_work_queue_add(impl->work, input->node, res, complete_streaming, input);
+			queue_work(impl, input->node, res, complete_streaming, input);
 		else
 			complete_streaming(input->node, input, res, 0);
 	}
@@ -751,7 +1050,7 @@ static int do_start(struct pw_link *this, uint32_t in_state, uint32_t out_state)
 		}
 
 		if (SPA_RESULT_IS_ASYNC(res))
-			pw_work_queue_add(impl->work, output->node, res, complete_streaming, output);
+			queue_work(impl, output->node, res, complete_streaming, output);
 		else
 			complete_streaming(output->node, output, res, 0);
 	}
@@ -765,9 +1064,14 @@ static int do_start(struct pw_link *this, uint32_t in_state, uint32_t out_state)
 static int check_states(struct pw_link *this, void *user_data, int res)
 {
 	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
-	uint32_t in_state, out_state;
+	uint32_t in_state, out_state, n_work_ids;
 	struct pw_port *input, *output;
 
+	impl->n_work_ids = 0;
+	if (impl->work_timeout)
+		pw_loop_update_timer(this->core->main_loop, impl->work_timeout,
+				     NULL, NULL, false);
+
 	if (this->state == PW_LINK_STATE_ERROR)
 		return -EIO;
 
@@ -777,33 +1081,41 @@ static int check_states(struct pw_link *this, void *user_data, int res)
 	if (input == NULL || output == NULL)
 		return 0;
 
-	if (input->node->info.state == PW_NODE_STATE_ERROR ||
-	    output->node->info.state == PW_NODE_STATE_ERROR)
-		return -EIO;
+	/* when the ports complete a step synchronously, go on with the next step
+	 * right away, else wait for the async results */
+	do {
+		if (input->node->info.state == PW_NODE_STATE_ERROR ||
+		    output->node->info.state == PW_NODE_STATE_ERROR)
+			return -EIO;
 
-	in_state = input->state;
-	out_state = output->state;
+		in_state = input->state;
+		out_state = output->state;
 
-	pw_log_debug("link %p: input state %d, output state %d", this, in_state, out_state);
+		pw_log_debug("link %p: input state %d, output state %d", this, in_state, out_state);
 
-	if (in_state == PW_PORT_STATE_ERROR || out_state == PW_PORT_STATE_ERROR) {
-		pw_link_update_state(this, PW_LINK_STATE_ERROR, NULL);
-		return -EIO;
-	}
+		if (in_state == PW_PORT_STATE_ERROR || out_state == PW_PORT_STATE_ERROR) {
+			pw_link_update_state(this, PW_LINK_STATE_ERROR, NULL);
+			return -EIO;
+		}
 
-	if (in_state == PW_PORT_STATE_STREAMING && out_state == PW_PORT_STATE_STREAMING) {
-		pw_link_update_state(this, PW_LINK_STATE_RUNNING, NULL);
-		return 0;
-	}
+		if (in_state == PW_PORT_STATE_STREAMING && out_state == PW_PORT_STATE_STREAMING) {
+			pw_link_update_state(this, PW_LINK_STATE_RUNNING, NULL);
+			return 0;
+		}
+
+		n_work_ids = impl->n_work_ids;
+
+		if ((res = do_negotiate(this, in_state, out_state)) != 0)
+			goto exit;
 
-	if ((res = do_negotiate(this, in_state, out_state)) != 0)
-		goto exit;
+		if ((res = do_allocation(this, in_state, out_state)) != 0)
+			goto exit;
 
-	if ((res = do_allocation(this, in_state, out_state)) != 0)
-		goto exit;
+		if ((res = do_start(this, in_state, out_state)) != 0)
+			goto exit;
 
-	if ((res = do_start(this, in_state, out_state)) != 0)
-		goto exit;
+	} while (impl->n_work_ids == n_work_ids &&
+		 (input->state != in_state || output->state != out_state));
 
       exit:
 	if (SPA_RESULT_IS_ERROR(res)) {
@@ -811,8 +1123,7 @@ static int check_states(struct pw_link *this, void *user_data, int res)
 		return res;
 	}
 
-	pw_work_queue_add(impl->work,
-			  this, -EBUSY, (pw_work_func_t) check_states, this);
+	queue_work(impl, this, -EBUSY, (pw_work_func_t) check_states, this);
 	return res;
 }
 
@@ -847,7 +1158,16 @@ do_remove_input(struct spa_loop *loop,
 	        bool async, uint32_t seq, const void *data, size_t size, void *user_data)
 {
 	struct pw_link *this = user_data;
+	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
+
 	spa_graph_port_remove(&this->rt.in_port);
+
+	if (impl->in_event) {
+		spa_graph_port_remove(&impl->in_peer);
+		spa_graph_node_remove(&impl->in_node);
+		pw_loop_destroy_source(impl->in_loop, impl->in_event);
+		impl->in_event = NULL;
+	}
 	return 0;
 }
 
@@ -870,7 +1190,16 @@ do_remove_output(struct spa_loop *loop,
 	         bool async, uint32_t seq, const void *data, size_t size, void *user_data)
 {
 	struct pw_link *this = user_data;
+	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
+
 	spa_graph_port_remove(&this->rt.out_port);
+
+	if (impl->out_event) {
+		spa_graph_port_remove(&impl->out_peer);
+		spa_graph_node_remove(&impl->out_node);
+		pw_loop_destroy_source(impl->out_loop, impl->out_event);
+		impl->out_event = NULL;
+	}
 	return 0;
 }
 
@@ -941,8 +1270,7 @@ bool pw_link_activate(struct pw_link *this)
 	this->output->node->n_used_output_links++;
 	this->input->node->n_used_input_links++;
 
-	pw_work_queue_add(impl->work,
-			  this, -EBUSY, (pw_work_func_t) check_states, this);
+	queue_work(impl, this, -EBUSY, (pw_work_func_t) check_states, this);
 
 	return true;
 }
@@ -956,6 +1284,15 @@ do_deactivate_link(struct spa_loop *loop,
 	return 0;
 }
 
+static int
+do_deactivate_bridge(struct spa_loop *loop,
+		     bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+        struct pw_link *this = user_data;
+	spa_graph_port_unlink(&this->rt.in_port);
+	return 0;
+}
+
 bool pw_link_deactivate(struct pw_link *this)
 {
 	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
@@ -968,6 +1305,9 @@ bool pw_link_deactivate(struct pw_link *this)
 	pw_log_debug("link %p: deactivate", this);
 	pw_loop_invoke(this->output->node->data_loop,
 		       do_deactivate_link, SPA_ID_INVALID, NULL, 0, true, this);
+	if (impl->bridged)
+		pw_loop_invoke(this->input->node->data_loop,
+			       do_deactivate_bridge, SPA_ID_INVALID, NULL, 0, true, this);
 
 	input_node = this->input->node;
 	output_node = this->output->node;
@@ -1051,12 +1391,23 @@ do_add_link(struct spa_loop *loop,
             bool async, uint32_t seq, const void *data, size_t size, void *user_data)
 {
         struct pw_link *this = user_data;
+	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
         struct pw_port *port = ((struct pw_port **) data)[0];
 
         if (port->direction == PW_DIRECTION_OUTPUT) {
                 spa_graph_port_add(&port->rt.mix_node, &this->rt.out_port);
+		if (impl->bridged) {
+			impl->out_event = pw_loop_add_event(impl->out_loop, on_out_event, impl);
+			spa_graph_node_add(port->node->rt.graph, &impl->out_node);
+			spa_graph_port_add(&impl->out_node, &impl->out_peer);
+		}
         } else {
                 spa_graph_port_add(&port->rt.mix_node, &this->rt.in_port);
+		if (impl->bridged) {
+			impl->in_event = pw_loop_add_event(impl->in_loop, on_in_event, impl);
+			spa_graph_node_add(port->node->rt.graph, &impl->in_node);
+			spa_graph_port_add(&impl->in_node, &impl->in_peer);
+		}
         }
 
         return 0;
@@ -1093,6 +1444,7 @@ struct pw_link *pw_link_new(struct pw_core *core,
 	struct impl *impl;
 	struct pw_link *this;
 	struct pw_node *input_node, *output_node;
+	const char *str;
 
 	if (output == input)
 		goto same_ports;
@@ -1110,7 +1462,23 @@ struct pw_link *pw_link_new(struct pw_core *core,
 	if (user_data_size > 0)
                 this->user_data = SPA_MEMBER(impl, sizeof(struct impl), void);
 
-	impl->work = pw_work_queue_new(core->main_loop);
+	/* in batch mode, the links share the queue of the core. The next step
+	 * of a link then waits for the pending steps of all links, so that the
+	 * commands of a step go out to all nodes before waiting for them */
+	if ((str = pw_properties_get(core->properties, PW_CORE_PROP_LINK_BATCH)) &&
+	    pw_properties_parse_bool(str)) {
+		if (core->link_work == NULL)
+			core->link_work = pw_work_queue_new(core->main_loop);
+		impl->work = core->link_work;
+		impl->shared_work = true;
+		impl->work_timeout = pw_loop_add_timer(core->main_loop, on_work_timeout, impl);
+	} else {
+		impl->work = pw_work_queue_new(core->main_loop);
+	}
+	if (impl->work == NULL) {
+		free(impl);
+		goto no_mem;
+	}
 
 	this->core = core;
 	this->properties = properties;
@@ -1123,7 +1491,7 @@ struct pw_link *pw_link_new(struct pw_core *core,
 	output_node = output->node;
 
 	if (properties) {
-		const char *str = pw_properties_get(properties, PW_LINK_PROP_PASSIVE);
+		str = pw_properties_get(properties, PW_LINK_PROP_PASSIVE);
 		if (str && pw_properties_parse_bool(str)) {
 			input_node->idle_used_input_links++;
 			output_node->idle_used_output_links++;
@@ -1142,12 +1510,14 @@ struct pw_link *pw_link_new(struct pw_core *core,
 	pw_log_debug("link %p: constructed %p:%d -> %p:%d", impl,
 		     output_node, output->port_id, input_node, input->port_id);
 
+	/* the input node follows the clock of the output node, it keeps its
+	 * own clock to measure the drift against the driver */
 	input_node->live = output_node->live;
-	if (output_node->clock)
-		input_node->clock = output_node->clock;
+	if (output_node->driver_clock)
+		input_node->driver_clock = output_node->driver_clock;
 
-	pw_log_debug("link %p: output node %p clock %p, live %d", this, output_node, output_node->clock,
-                             output_node->live);
+	pw_log_debug("link %p: output node %p clock %p, live %d", this, output_node,
+		     output_node->driver_clock, output_node->live);
 
 	spa_list_append(&output->links, &this->output_link);
 	spa_list_append(&input->links, &this->input_link);
@@ -1162,12 +1532,12 @@ struct pw_link *pw_link_new(struct pw_core *core,
 	this->io = SPA_IO_BUFFERS_INIT;
 
 	spa_graph_port_init(&this->rt.out_port,
-			    PW_DIRECTION_OUTPUT,
+			    SPA_DIRECTION_OUTPUT,
 			    this->rt.out_port.port_id,
 			    0,
 			    &this->io);
 	spa_graph_port_init(&this->rt.in_port,
-			    PW_DIRECTION_INPUT,
+			    SPA_DIRECTION_INPUT,
 			    this->rt.in_port.port_id,
 			    0,
 			    &this->io);
@@ -1175,11 +1545,18 @@ struct pw_link *pw_link_new(struct pw_core *core,
 	this->rt.in_port.scheduler_data = this;
 	this->rt.out_port.scheduler_data = this;
 
-	/* nodes can be in different data loops so we do this twice */
+	impl->out_loop = output_node->data_loop;
+	impl->in_loop = input_node->data_loop;
+	if (impl->out_loop != impl->in_loop)
+		setup_bridge(impl);
+
+	/* nodes can be in different data loops so we do this twice. The sources
+	 * of a bridge are added in their running loops, wait for both of them
+	 * before either side can signal the other */
 	pw_loop_invoke(output_node->data_loop, do_add_link,
-		       SPA_ID_INVALID, &output, sizeof(struct pw_port *), false, this);
+		       SPA_ID_INVALID, &output, sizeof(struct pw_port *), impl->bridged, this);
 	pw_loop_invoke(input_node->data_loop, do_add_link,
-		       SPA_ID_INVALID, &input, sizeof(struct pw_port *), false, this);
+		       SPA_ID_INVALID, &input, sizeof(struct pw_port *), impl->bridged, this);
 
 	spa_hook_list_call(&output->listener_list, struct pw_port_events, link_added, this);
 	spa_hook_list_call(&input->listener_list, struct pw_port_events, link_added, this);
@@ -1261,7 +1638,15 @@ void pw_link_destroy(struct pw_link *link)
 
 	spa_hook_list_call(&link->listener_list, struct pw_link_events, free);
 
-	pw_work_queue_destroy(impl->work);
+	if (impl->shared_work) {
+		uint32_t i;
+		for (i = 0; i < impl->n_work_ids; i++)
+			pw_work_queue_cancel(impl->work, NULL, impl->work_items[i].id);
+		if (impl->work_timeout)
+			pw_loop_destroy_source(link->core->main_loop, impl->work_timeout);
+	} else {
+		pw_work_queue_destroy(impl->work);
+	}
 
 	if (link->properties)
 		pw_properties_free(link->properties);
@@ -17,6 +17,10 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
 #include <pipewire/log.h>
 
 #define DEFAULT_LOG_LEVEL SPA_LOG_LEVEL_ERROR
@@ -25,6 +29,30 @@ enum spa_log_level pw_log_level = DEFAULT_LOG_LEVEL;
 
 static struct spa_log *global_log = NULL;
 
+/** \cond */
+struct topic_level {
+	struct spa_list link;
+	int level;
+	char name[1];
+};
+
+/* the topics and the levels that were set for them, also for the topics
+ * that are not registered yet */
+static pthread_mutex_t topics_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct spa_list topics = { &topics, &topics };
+static struct spa_list topic_levels = { &topic_levels, &topic_levels };
+/** \endcond */
+
+struct pw_log_topic pw_log_topic_default = PW_LOG_TOPIC_INIT("default");
+struct pw_log_topic pw_log_topic_graph = PW_LOG_TOPIC_INIT("graph");
+
+static void register_topics(void) __attribute__((constructor));
+static void register_topics(void)
+{
+	pw_log_topic_register(&pw_log_topic_default);
+	pw_log_topic_register(&pw_log_topic_graph);
+}
+
 /** Set the global log interface
  * \param log the global log to set
  * \memberof pw_log
@@ -51,9 +79,168 @@ struct spa_log *pw_log_get(void)
  */
 void pw_log_set_level(enum spa_log_level level)
 {
+	struct pw_log_topic *t;
+
 	pw_log_level = level;
 	if (global_log)
 		global_log->level = level;
+
+	pthread_mutex_lock(&topics_lock);
+	spa_list_for_each(t, &topics, link) {
+		if (!t->has_level)
+			t->log.level = level;
+	}
+	pthread_mutex_unlock(&topics_lock);
+}
+
+static void
+topic_logv(struct spa_log *log,
+	   enum spa_log_level level,
+	   const char *file,
+	   int line,
+	   const char *func,
+	   const char *fmt,
+	   va_list args)
+{
+	if (SPA_LIKELY(global_log != NULL))
+		global_log->logv(global_log, level, file, line, func, fmt, args);
+}
+
+static void
+topic_log(struct spa_log *log,
+	  enum spa_log_level level,
+	  const char *file,
+	  int line,
+	  const char *func,
+	  const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	topic_logv(log, level, file, line, func, fmt, args);
+	va_end(args);
+}
+
+static void update_topic(struct pw_log_topic *topic)
+{
+	struct topic_level *l;
+
+	topic->has_level = false;
+	spa_list_for_each(l, &topic_levels, link) {
+		if (strcmp(l->name, topic->name) == 0) {
+			topic->log.level = l->level;
+			topic->has_level = true;
+			return;
+		}
+	}
+	topic->log.level = pw_log_level;
+}
+
+/** Register a log topic
+ * \param topic the topic to register
+ *
+ * After this, the level of \a topic can be changed with
+ * \ref pw_log_set_topic_level().
+ *
+ * \memberof pw_log
+ */
+void pw_log_topic_register(struct pw_log_topic *topic)
+{
+	topic->log.log = topic_log;
+	topic->log.logv = topic_logv;
+
+	pthread_mutex_lock(&topics_lock);
+	update_topic(topic);
+	spa_list_append(&topics, &topic->link);
+	pthread_mutex_unlock(&topics_lock);
+}
+
+/** Unregister a log topic
+ * \param topic the topic to unregister
+ * \memberof pw_log
+ */
+void pw_log_topic_unregister(struct pw_log_topic *topic)
+{
+	pthread_mutex_lock(&topics_lock);
+	spa_list_remove(&topic->link);
+	pthread_mutex_unlock(&topics_lock);
+}
+
+/** Get a log topic
+ * \param name the name of the topic
+ * \return the first topic with \a name or a new topic
+ *
+ * This is used for the plugins, which log with the spa_log of the topic.
+ * Topics made here are never freed.
+ *
+ * \memberof pw_log
+ */
+struct pw_log_topic *pw_log_topic_get(const char *name)
+{
+	struct pw_log_topic *t;
+	char *n;
+
+	pthread_mutex_lock(&topics_lock);
+	spa_list_for_each(t, &topics, link) {
+		if (strcmp(t->name, name) == 0)
+			goto done;
+	}
+	if ((t = calloc(1, sizeof(struct pw_log_topic) + strlen(name) + 1)) == NULL)
+		goto done;
+
+	n = SPA_MEMBER(t, sizeof(struct pw_log_topic), char);
+	strcpy(n, name);
+	t->name = n;
+	t->log.version = SPA_VERSION_LOG;
+	t->log.log = topic_log;
+	t->log.logv = topic_logv;
+	update_topic(t);
+	spa_list_append(&topics, &t->link);
+      done:
+	pthread_mutex_unlock(&topics_lock);
+	return t;
+}
+
+/** Set the level of a log topic
+ * \param name the name of the topic
+ * \param level the new level or -1 to use the global level
+ *
+ * The level is also used for topics with \a name that are registered
+ * later.
+ *
+ * \memberof pw_log
+ */
+void pw_log_set_topic_level(const char *name, int level)
+{
+	struct topic_level *l, *found = NULL;
+	struct pw_log_topic *t;
+
+	pthread_mutex_lock(&topics_lock);
+	spa_list_for_each(l, &topic_levels, link) {
+		if (strcmp(l->name, name) == 0) {
+			found = l;
+			break;
+		}
+	}
+	if (level < 0) {
+		if (found) {
+			spa_list_remove(&found->link);
+			free(found);
+		}
+	}
+	else if (found) {
+		found->level = level;
+	}
+	else if ((found = malloc(sizeof(struct topic_level) + strlen(name))) != NULL) {
+		strcpy(found->name, name);
+		found->level = level;
+		spa_list_append(&topic_levels, &found->link);
+	}
+
+	spa_list_for_each(t, &topics, link) {
+		if (strcmp(t->name, name) == 0)
+			update_topic(t);
+	}
+	pthread_mutex_unlock(&topics_lock);
 }
 
 /** Log a message
@@ -81,6 +268,33 @@ pw_log_log(enum spa_log_level level,
 	}
 }
 
+/** Log a message of a topic
+ * \param topic the topic
+ * \param level the log level
+ * \param file the file this message originated from
+ * \param line the line number
+ * \param func the function
+ * \param fmt the printf style format
+ * \param ... printf style arguments to log
+ *
+ * \memberof pw_log
+ */
+void
+pw_log_logt(struct pw_log_topic *topic,
+	    enum spa_log_level level,
+	    const char *file,
+	    int line,
+	    const char *func,
+	    const char *fmt, ...)
+{
+	if (SPA_UNLIKELY(pw_log_topic_enabled(topic, level) && global_log)) {
+		va_list args;
+		va_start(args, fmt);
+		global_log->logv(global_log, level, file, line, func, fmt, args);
+		va_end(args);
+	}
+}
+
 /** Log a message with va_list
  * \param level the log level
  * \param file the file this message originated from
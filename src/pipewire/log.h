@@ -21,6 +21,7 @@
 #define __PIPEWIRE_LOG_H__
 
 #include <spa/support/log.h>
+#include <spa/utils/list.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -61,17 +62,91 @@ pw_log_logv(enum spa_log_level level,
 /** Check if a loglevel is enabled \memberof pw_log */
 #define pw_log_level_enabled(lev) (pw_log_level >= (lev))
 
+/** A log topic
+ *
+ * The level of a topic follows the global level until a level is set for
+ * it with \ref pw_log_set_topic_level(). The topic is also a spa_log with
+ * the level of the topic for plugins.
+ */
+struct pw_log_topic {
+	struct spa_log log;	/**< level is the level of the topic */
+	const char *name;	/**< name of the topic */
+	bool has_level;		/**< a level was set for this topic */
+	struct spa_list link;
+};
+
+#define PW_LOG_TOPIC_INIT(n) { { SPA_VERSION_LOG, NULL, SPA_LOG_LEVEL_ERROR, }, n, }
+
+/** Define a topic \a var that is registered while the library or module is
+ * loaded. Make it the topic of pw_log_error() and the others in the file
+ * with:
+ *
+ *   #undef PW_LOG_TOPIC_DEFAULT
+ *   #define PW_LOG_TOPIC_DEFAULT (&var)
+ */
+#define PW_LOG_TOPIC_STATIC(var,name)						\
+static struct pw_log_topic var = PW_LOG_TOPIC_INIT(name);			\
+static void var##_register(void) __attribute__((constructor));			\
+static void var##_register(void) { pw_log_topic_register(&var); }		\
+static void var##_unregister(void) __attribute__((destructor));			\
+static void var##_unregister(void) { pw_log_topic_unregister(&var); }
+
+/** topic of the messages without topic */
+extern struct pw_log_topic pw_log_topic_default;
+/** topic of the graph scheduling */
+extern struct pw_log_topic pw_log_topic_graph;
+
+#ifndef PW_LOG_TOPIC_DEFAULT
+#define PW_LOG_TOPIC_DEFAULT (&pw_log_topic_default)
+#endif
+
+void pw_log_topic_register(struct pw_log_topic *topic);
+void pw_log_topic_unregister(struct pw_log_topic *topic);
+
+/** Get the topic with \a name, it is made when there is none */
+struct pw_log_topic *pw_log_topic_get(const char *name);
+
+/** Set the level of the topics with \a name, a negative level makes
+ * them follow the global level again */
+void pw_log_set_topic_level(const char *name, int level);
+
+void
+pw_log_logt(struct pw_log_topic *topic,
+	    enum spa_log_level level,
+	    const char *file,
+	    int line, const char *func,
+	    const char *fmt, ...) SPA_PRINTF_FUNC(6, 7);
+
+/** Check if a loglevel is enabled for \a topic \memberof pw_log */
+#define pw_log_topic_enabled(topic,lev) ((topic)->log.level >= (lev))
+
 #if __STDC_VERSION__ >= 199901L
 
 #define pw_log_logc(lev,...)				\
 	if (SPA_UNLIKELY(pw_log_level_enabled (lev)))	\
 		pw_log_log(lev,__VA_ARGS__)
 
-#define pw_log_error(...)   pw_log_logc(SPA_LOG_LEVEL_ERROR,__FILE__,__LINE__,__func__,__VA_ARGS__)
-#define pw_log_warn(...)    pw_log_logc(SPA_LOG_LEVEL_WARN,__FILE__,__LINE__,__func__,__VA_ARGS__)
-#define pw_log_info(...)    pw_log_logc(SPA_LOG_LEVEL_INFO,__FILE__,__LINE__,__func__,__VA_ARGS__)
-#define pw_log_debug(...)   pw_log_logc(SPA_LOG_LEVEL_DEBUG,__FILE__,__LINE__,__func__,__VA_ARGS__)
-#define pw_log_trace(...)   pw_log_logc(SPA_LOG_LEVEL_TRACE,__FILE__,__LINE__,__func__,__VA_ARGS__)
+#define pw_log_logtc(topic,lev,...)				\
+	if (SPA_UNLIKELY(pw_log_topic_enabled (topic,lev)))	\
+		pw_log_logt(topic,lev,__VA_ARGS__)
+
+#define pw_log_topic_error(t,...)   pw_log_logtc(t,SPA_LOG_LEVEL_ERROR,__FILE__,__LINE__,__func__,__VA_ARGS__)
+#define pw_log_topic_warn(t,...)    pw_log_logtc(t,SPA_LOG_LEVEL_WARN,__FILE__,__LINE__,__func__,__VA_ARGS__)
+#define pw_log_topic_info(t,...)    pw_log_logtc(t,SPA_LOG_LEVEL_INFO,__FILE__,__LINE__,__func__,__VA_ARGS__)
+#define pw_log_topic_debug(t,...)   pw_log_logtc(t,SPA_LOG_LEVEL_DEBUG,__FILE__,__LINE__,__func__,__VA_ARGS__)
+#ifdef SPA_LOG_NO_TRACE
+/* the compiler removes the message but still checks the arguments */
+#define pw_log_topic_trace(t,...)						\
+	do { if (0) pw_log_logt(t,SPA_LOG_LEVEL_TRACE,__FILE__,__LINE__,__func__,__VA_ARGS__); } while (0)
+#else
+#define pw_log_topic_trace(t,...)   pw_log_logtc(t,SPA_LOG_LEVEL_TRACE,__FILE__,__LINE__,__func__,__VA_ARGS__)
+#endif
+
+#define pw_log_error(...)   pw_log_topic_error(PW_LOG_TOPIC_DEFAULT,__VA_ARGS__)
+#define pw_log_warn(...)    pw_log_topic_warn(PW_LOG_TOPIC_DEFAULT,__VA_ARGS__)
+#define pw_log_info(...)    pw_log_topic_info(PW_LOG_TOPIC_DEFAULT,__VA_ARGS__)
+#define pw_log_debug(...)   pw_log_topic_debug(PW_LOG_TOPIC_DEFAULT,__VA_ARGS__)
+#define pw_log_trace(...)   pw_log_topic_trace(PW_LOG_TOPIC_DEFAULT,__VA_ARGS__)
 
 #else
 
@@ -26,6 +26,10 @@
 #include <pipewire/loop.h>
 #include <pipewire/log.h>
 
+PW_LOG_TOPIC_STATIC(log_loop, "loop");
+#undef PW_LOG_TOPIC_DEFAULT
+#define PW_LOG_TOPIC_DEFAULT (&log_loop)
+
 #define DATAS_SIZE (4096 * 8)
 
 /** \cond */
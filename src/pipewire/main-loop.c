@@ -21,6 +21,10 @@
 #include "pipewire/main-loop.h"
 #include "pipewire/private.h"
 
+PW_LOG_TOPIC_STATIC(log_loop, "loop");
+#undef PW_LOG_TOPIC_DEFAULT
+#define PW_LOG_TOPIC_DEFAULT (&log_loop)
+
 static void do_stop(void *data, uint64_t count)
 {
 	struct pw_main_loop *this = data;
@@ -21,8 +21,10 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <inttypes.h>
 
 #include <spa/clock/clock.h>
+#include <spa/param/props.h>
 #include <spa/lib/debug.h>
 
 #include "pipewire/pipewire.h"
@@ -34,11 +36,30 @@
 #include "pipewire/main-loop.h"
 #include "pipewire/work-queue.h"
 
+PW_LOG_TOPIC_STATIC(log_node, "node");
+#undef PW_LOG_TOPIC_DEFAULT
+#define PW_LOG_TOPIC_DEFAULT (&log_node)
+
 /** \cond */
+struct param_cache {
+	bool valid;		/**< the params were put in the info */
+	uint32_t hash;		/**< hash of the serialized params */
+	size_t size;		/**< size of the serialized params */
+};
+
 struct impl {
 	struct pw_node this;
 
 	struct pw_work_queue *work;
+
+	struct param_cache input_params;	/**< cache of the input params in info */
+	struct param_cache output_params;	/**< cache of the output params in info */
+	bool params_dirty;			/**< params need to be enumerated again */
+
+	struct spa_source *xrun_event;		/**< signals the xruns to the main thread */
+	uint32_t xruns;				/**< xruns since the last signal, data thread */
+	uint64_t xrun_cycle;			/**< cycle of the last xrun, data thread */
+	uint64_t xrun_missing;			/**< missing samples, data thread */
 };
 
 struct resource_data {
@@ -117,9 +138,9 @@ static void send_clock_update(struct pw_node *this)
 						0,       /* flags */
 						0);      /* latency */
 
-	if (this->clock && this->live) {
+	if (this->driver_clock && this->live) {
 		cu.body.flags.value = SPA_COMMAND_NODE_CLOCK_UPDATE_FLAG_LIVE;
-		res = spa_clock_get_time(this->clock,
+		res = spa_clock_get_time(this->driver_clock,
 					 &cu.body.rate.value,
 					 &cu.body.ticks.value,
 					 &cu.body.monotonic_time.value);
@@ -129,6 +150,57 @@ static void send_clock_update(struct pw_node *this)
 		pw_log_debug("node %p: send clock update error %s", this, spa_strerror(res));
 }
 
+static void check_properties(struct pw_node *node)
+{
+	const char *str;
+
+	if ((str = pw_properties_get(node->properties, PW_NODE_PROP_LATENCY)))
+		node->quantum = atoi(str);
+	else
+		node->quantum = 0;
+}
+
+static int set_quantum(struct pw_node *node, uint32_t quantum)
+{
+	struct pw_type *t = &node->core->type;
+	uint8_t buffer[256];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *props;
+
+	props = spa_pod_builder_object(&b,
+			t->param.idProps, t->spa_props,
+			":", spa_type_map_get_id(t->map, SPA_TYPE_PROPS__quantum), "i", quantum);
+
+	return spa_node_set_param(node->node, t->param.idProps, 0, props);
+}
+
+/* The graph runs with the smallest quantum requested by the active nodes.
+ * The nodes with a clock drive the graph and reconfigure their wakeups
+ * while running. */
+static void update_quantum(struct pw_core *core)
+{
+	struct pw_node *n;
+	uint32_t quantum = 0;
+	int res;
+
+	spa_list_for_each(n, &core->node_list, link) {
+		if (n->active && n->quantum > 0 && (quantum == 0 || n->quantum < quantum))
+			quantum = n->quantum;
+	}
+	if (quantum == core->quantum)
+		return;
+
+	pw_log_debug("core %p: quantum %u -> %u", core, core->quantum, quantum);
+	core->quantum = quantum;
+
+	spa_list_for_each(n, &core->node_list, link) {
+		if (n->clock == NULL)
+			continue;
+		if ((res = set_quantum(n, quantum)) < 0)
+			pw_log_debug("node %p: can't set quantum: %s", n, spa_strerror(res));
+	}
+}
+
 static void node_unbind_func(void *data)
 {
 	struct pw_resource *resource = data;
@@ -221,61 +293,170 @@ static int update_port_ids(struct pw_node *node)
 }
 
 struct param_array {
-	struct spa_pod **params;
+	void *data;		/**< the params, serialized after each other */
+	size_t size;
 	uint32_t n_params;
 };
 
 static int add_param(void *data, struct spa_pod *param)
 {
 	struct param_array *arr = data;
-	uint32_t idx = arr->n_params++;
-
-	arr->params = realloc(arr->params, sizeof(struct spa_pod *) * arr->n_params);
-	arr->params[idx] = pw_spa_pod_copy(param);
+	uint32_t size = SPA_POD_SIZE(param);
+	size_t offset = arr->size;
+	void *d;
+
+	if ((d = realloc(arr->data, offset + SPA_ROUND_UP_N(size, 8))) == NULL)
+		return -ENOMEM;
+	arr->data = d;
+	arr->size += SPA_ROUND_UP_N(size, 8);
+	memcpy(SPA_MEMBER(arr->data, offset, void), param, size);
+	memset(SPA_MEMBER(arr->data, offset + size, void), 0, arr->size - offset - size);
+	arr->n_params++;
 	return 0;
 }
 
-static void
-update_info(struct pw_node *this)
+/* FNV-1a over the serialized params */
+static uint32_t hash_params(const void *data, size_t size)
+{
+	const uint8_t *p = data;
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		hash = (hash ^ p[i]) * 16777619u;
+	return hash;
+}
+
+static int
+update_params(struct pw_node *this, struct pw_port *port,
+	      struct spa_pod ***params, uint32_t *n_params,
+	      struct param_cache *cache, uint32_t change)
 {
 	struct pw_type *t = &this->core->type;
-	struct param_array params;
-	struct pw_port *port;
+	struct param_array arr = { NULL, };
+	struct spa_pod **array;
+	void *p;
+	uint32_t i, hash;
 
-	params = (struct param_array) { NULL };
-	if (!spa_list_is_empty(&this->input_ports)) {
-		port = spa_list_first(&this->input_ports, struct pw_port, link);
-		pw_port_for_each_param(port, t->param.idEnumFormat, NULL, add_param, &params);
+	if (port && pw_port_for_each_param(port, t->param.idEnumFormat,
+					   NULL, add_param, &arr) == -ENOMEM)
+		goto no_mem;
+
+	/* unchanged params are not sent again to the clients, this includes
+	 * an empty list of params */
+	hash = hash_params(arr.data, arr.size);
+	if (cache->valid && hash == cache->hash && arr.size == cache->size &&
+	    arr.n_params == *n_params &&
+	    (arr.size == 0 || memcmp(arr.data, (*params)[0], arr.size) == 0)) {
+		free(arr.data);
+		return 0;
 	}
-	this->info.input_params = params.params;
-	this->info.n_input_params = params.n_params;
 
-	params = (struct param_array) { NULL };
-	if (!spa_list_is_empty(&this->output_ports)) {
-		port = spa_list_first(&this->output_ports, struct pw_port, link);
-		pw_port_for_each_param(port, t->param.idEnumFormat, NULL, add_param, &params);
+	/* one block with the array and the params after it, the marshal
+	 * of every resource reads from this copy */
+	array = malloc(arr.n_params * sizeof(struct spa_pod *) + arr.size + 1);
+	if (array == NULL)
+		goto no_mem;
+
+	p = SPA_MEMBER(array, arr.n_params * sizeof(struct spa_pod *), void);
+	if (arr.size > 0)
+		memcpy(p, arr.data, arr.size);
+	for (i = 0; i < arr.n_params; i++) {
+		array[i] = p;
+		p = SPA_MEMBER(p, SPA_ROUND_UP_N(SPA_POD_SIZE(p), 8), void);
 	}
-	this->info.output_params = params.params;
-	this->info.n_output_params = params.n_params;
+	free(arr.data);
+
+	free(*params);
+	*params = array;
+	*n_params = arr.n_params;
+	cache->valid = true;
+	cache->hash = hash;
+	cache->size = arr.size;
+	this->info.change_mask |= change;
+
+	return 0;
+
+      no_mem:
+	free(arr.data);
+	return -ENOMEM;
 }
 
 static void
-clear_info(struct pw_node *this)
+update_info(struct pw_node *this)
 {
-	int i;
+	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
+	int res;
 
-	free((char*)this->info.name);
-	if (this->info.input_params) {
-		for (i = 0; i < this->info.n_input_params; i++)
-			free(this->info.input_params[i]);
-		free(this->info.input_params);
+	if (!impl->params_dirty)
+		return;
+
+	if ((res = update_params(this,
+		      spa_list_is_empty(&this->input_ports) ? NULL :
+			spa_list_first(&this->input_ports, struct pw_port, link),
+		      &this->info.input_params, &this->info.n_input_params,
+		      &impl->input_params, PW_NODE_CHANGE_MASK_INPUT_PARAMS)) < 0 ||
+	    (res = update_params(this,
+		      spa_list_is_empty(&this->output_ports) ? NULL :
+			spa_list_first(&this->output_ports, struct pw_port, link),
+		      &this->info.output_params, &this->info.n_output_params,
+		      &impl->output_params, PW_NODE_CHANGE_MASK_OUTPUT_PARAMS)) < 0) {
+		/* the old params stay, the next update tries again */
+		pw_log_error("node %p: can't update params: %s", this, spa_strerror(res));
+		return;
 	}
 
-	if (this->info.output_params) {
-		for (i = 0; i < this->info.n_output_params; i++)
-			free(this->info.output_params[i]);
-		free(this->info.output_params);
-	}
+	impl->params_dirty = false;
+}
+
+static void emit_info_changed(struct pw_node *node)
+{
+	struct pw_resource *resource;
+
+	if (node->info.change_mask == 0)
+		return;
+
+	spa_hook_list_call(&node->listener_list, struct pw_node_events,
+			info_changed, &node->info);
+
+	spa_list_for_each(resource, &node->resource_list, link)
+		pw_node_resource_info(resource, &node->info);
+
+	node->info.change_mask = 0;
+}
+
+static void on_params_changed(void *obj, void *data, int res, uint32_t id)
+{
+	struct pw_node *node = obj;
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
+
+	/* already sent with another info */
+	if (!impl->params_dirty)
+		return;
+
+	update_info(node);
+	emit_info_changed(node);
+}
+
+void pw_node_params_changed(struct pw_node *node)
+{
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
+
+	if (impl->params_dirty)
+		return;
+
+	impl->params_dirty = true;
+	/* many ports are usually added or updated together, send the
+	 * info once when they are done */
+	pw_work_queue_add(impl->work, node, 0, on_params_changed, NULL);
+}
+
+static void
+clear_info(struct pw_node *this)
+{
+	free((char*)this->info.name);
+	free(this->info.input_params);
+	free(this->info.output_params);
 	free((char*)this->info.error);
 
 }
@@ -293,6 +474,7 @@ node_bind_func(struct pw_global *global,
 	struct pw_node *this = global->object;
 	struct pw_resource *resource;
 	struct resource_data *data;
+	uint64_t change_mask;
 
 	resource = pw_resource_new(client, id, permissions, global->type, version, sizeof(*data));
 	if (resource == NULL)
@@ -305,9 +487,12 @@ node_bind_func(struct pw_global *global,
 
 	spa_list_append(&this->resource_list, &resource->link);
 
+	/* pending changes are still sent to the other resources */
+	update_info(this);
+	change_mask = this->info.change_mask;
 	this->info.change_mask = ~0;
 	pw_node_resource_info(resource, &this->info);
-	this->info.change_mask = 0;
+	this->info.change_mask = change_mask;
 
 	return 0;
 
@@ -338,22 +523,63 @@ void pw_node_register(struct pw_node *this,
 	pw_log_debug("node %p: register", this);
 
 	update_port_ids(this);
+	pw_node_params_changed(this);
 	update_info(this);
 
 	pw_loop_invoke(this->data_loop, do_node_add, 1, NULL, 0, false, this);
 
 	spa_list_append(&core->node_list, &this->link);
+	if (this->clock != NULL && core->quantum > 0)
+		set_quantum(this, core->quantum);
+	update_quantum(core);
+
 	this->global = pw_core_add_global(core, owner, parent,
 					  core->type.node, PW_VERSION_NODE,
 					  node_bind_func, this);
-	if (this->global != NULL)
+	if (this->global != NULL) {
 		this->info.id = this->global->id;
+		__atomic_store_n(&this->rt.id, this->global->id, __ATOMIC_RELAXED);
+	}
 
 	spa_hook_list_call(&this->listener_list, struct pw_node_events, initialized);
 
 	pw_node_update_state(this, PW_NODE_STATE_SUSPENDED, NULL);
 }
 
+static void on_xrun(void *data, uint64_t count)
+{
+	struct pw_node *node = data;
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
+	struct pw_resource *resource;
+	uint32_t xruns;
+	uint64_t cycle, missing;
+
+	xruns = __atomic_exchange_n(&impl->xruns, 0, __ATOMIC_SEQ_CST);
+	if (xruns == 0)
+		return;
+	missing = __atomic_exchange_n(&impl->xrun_missing, 0, __ATOMIC_SEQ_CST);
+	cycle = __atomic_load_n(&impl->xrun_cycle, __ATOMIC_SEQ_CST);
+
+	pw_log_info("node %p: %u xruns, last in cycle %"PRIu64", %"PRIu64" missing",
+		    node, xruns, cycle, missing);
+
+	node->info.n_xruns += xruns;
+
+	spa_hook_list_call(&node->listener_list, struct pw_node_events, xrun, cycle, missing);
+
+	/* other changes can be pending, they stay pending */
+	node->info.change_mask |= PW_NODE_CHANGE_MASK_XRUNS;
+	spa_hook_list_call(&node->listener_list, struct pw_node_events,
+			info_changed, &node->info);
+
+	spa_list_for_each(resource, &node->resource_list, link) {
+		pw_node_resource_info(resource, &node->info);
+		pw_node_resource_xrun(resource, cycle, missing);
+	}
+
+	node->info.change_mask &= ~PW_NODE_CHANGE_MASK_XRUNS;
+}
+
 struct pw_node *pw_node_new(struct pw_core *core,
 			    const char *name,
 			    struct pw_properties *properties,
@@ -379,13 +605,18 @@ struct pw_node *pw_node_new(struct pw_core *core,
 		goto no_mem;
 
 	this->properties = properties;
+	check_properties(this);
 
 	impl->work = pw_work_queue_new(this->core->main_loop);
 	this->info.name = strdup(name);
 
+	/* the data loop writes them in the profiler records */
+	this->rt.id = SPA_ID_INVALID;
+	snprintf(this->rt.name, sizeof(this->rt.name), "%s", name);
+
 	this->data_loop = core->data_loop;
 
-	this->rt.graph = &core->rt.graph;
+	this->rt.graph = &core->data_loops[0].graph;
 
 	spa_list_init(&this->resource_list);
 
@@ -394,12 +625,15 @@ struct pw_node *pw_node_new(struct pw_core *core,
 	this->info.state = PW_NODE_STATE_CREATING;
 	this->info.props = &this->properties->dict;
 
+	impl->xrun_event = pw_loop_add_event(core->main_loop, on_xrun, this);
+
 	spa_list_init(&this->input_ports);
 	pw_map_init(&this->input_port_map, 64, 64);
 	spa_list_init(&this->output_ports);
 	pw_map_init(&this->output_port_map, 64, 64);
 
 	spa_graph_node_init(&this->rt.node);
+	this->rt.node.scheduler_data = this;
 
 	return this;
 
@@ -443,14 +677,18 @@ void pw_node_update_properties(struct pw_node *node, const struct spa_dict *dict
 
 	node->info.props = &node->properties->dict;
 
-	node->info.change_mask = PW_NODE_CHANGE_MASK_PROPS;
+	check_properties(node);
+	if (node->global)
+		update_quantum(node->core);
+
+	node->info.change_mask |= PW_NODE_CHANGE_MASK_PROPS;
 	spa_hook_list_call(&node->listener_list, struct pw_node_events,
 			info_changed, &node->info);
 
 	spa_list_for_each(resource, &node->resource_list, link)
 		pw_node_resource_info(resource, &node->info);
 
-	node->info.change_mask = 0;
+	node->info.change_mask &= ~PW_NODE_CHANGE_MASK_PROPS;
 }
 
 static void node_done(void *data, int seq, int res)
@@ -463,6 +701,22 @@ static void node_done(void *data, int seq, int res)
 	spa_hook_list_call(&node->listener_list, struct pw_node_events, async_complete, seq, res);
 }
 
+/* called from the data thread, the main thread is signaled to update the
+ * info and notify the clients. Xruns that happen before the main thread
+ * wakes up are collapsed into one notification. */
+static void handle_xrun(struct pw_node *node, struct spa_event_node_xrun *xrun)
+{
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
+	struct pw_core_data_loop *dl;
+
+	dl = SPA_CONTAINER_OF(node->rt.graph, struct pw_core_data_loop, graph);
+
+	__atomic_store_n(&impl->xrun_cycle, dl->cycle, __ATOMIC_SEQ_CST);
+	__atomic_fetch_add(&impl->xrun_missing, xrun->body.missing.value, __ATOMIC_SEQ_CST);
+	if (__atomic_fetch_add(&impl->xruns, 1, __ATOMIC_SEQ_CST) == 0)
+		pw_loop_signal_event(node->core->main_loop, impl->xrun_event);
+}
+
 static void node_event(void *data, struct spa_event *event)
 {
 	struct pw_node *node = data;
@@ -471,6 +725,9 @@ static void node_event(void *data, struct spa_event *event)
         if (SPA_EVENT_TYPE(event) == node->core->type.event_node.RequestClockUpdate) {
                 send_clock_update(node);
         }
+	else if (SPA_EVENT_TYPE(event) == node->core->type.event_node.Xrun) {
+		handle_xrun(node, (struct spa_event_node_xrun *) event);
+	}
 	spa_hook_list_call(&node->listener_list, struct pw_node_events, event, event);
 }
 
@@ -478,6 +735,8 @@ static void node_need_input(void *data)
 {
 	struct pw_node *node = data;
 	pw_log_trace("node %p: need input", node);
+	if (pw_node_is_driver(node))
+		pw_profiler_cycle(node);
 	spa_hook_list_call(&node->listener_list, struct pw_node_events, need_input);
 	spa_graph_need_input(node->rt.graph, &node->rt.node);
 }
@@ -486,6 +745,8 @@ static void node_have_output(void *data)
 {
 	struct pw_node *node = data;
 	pw_log_trace("node %p: have output", node);
+	if (pw_node_is_driver(node))
+		pw_profiler_cycle(node);
 	spa_graph_have_output(node->rt.graph, &node->rt.node);
 	spa_hook_list_call(&node->listener_list, struct pw_node_events, have_output);
 }
@@ -516,6 +777,18 @@ static const struct spa_node_callbacks node_callbacks = {
 };
 
 
+void pw_node_set_data_loop(struct pw_node *node, uint32_t index)
+{
+	struct pw_core *core = node->core;
+
+	if (index >= core->n_data_loops)
+		index = 0;
+
+	pw_log_debug("node %p: data loop %u", node, index);
+	node->data_loop = pw_data_loop_get_loop(core->data_loops[index].impl);
+	node->rt.graph = &core->data_loops[index].graph;
+}
+
 void pw_node_set_implementation(struct pw_node *node,
 				struct spa_node *spa_node)
 {
@@ -576,6 +849,7 @@ void pw_node_destroy(struct pw_node *node)
 		spa_list_remove(&node->link);
 		pw_global_destroy(node->global);
 		node->global = NULL;
+		update_quantum(node->core);
 	}
 
 	spa_list_for_each_safe(resource, tmp, &node->resource_list, link)
@@ -596,6 +870,7 @@ void pw_node_destroy(struct pw_node *node)
 	spa_hook_list_call(&node->listener_list, struct pw_node_events, free);
 
 	pw_work_queue_destroy(impl->work);
+	pw_loop_destroy_source(node->core->main_loop, impl->xrun_event);
 
 	pw_map_clear(&node->input_port_map);
 	pw_map_clear(&node->output_port_map);
@@ -829,8 +1104,6 @@ void pw_node_update_state(struct pw_node *node, enum pw_node_state state, char *
 
 	old = node->info.state;
 	if (old != state) {
-		struct pw_resource *resource;
-
 		pw_log_debug("node %p: update state from %s -> %s", node,
 			     pw_node_state_as_string(old), pw_node_state_as_string(state));
 
@@ -846,13 +1119,8 @@ void pw_node_update_state(struct pw_node *node, enum pw_node_state state, char *
 				 old, state, error);
 
 		node->info.change_mask |= PW_NODE_CHANGE_MASK_STATE;
-		spa_hook_list_call(&node->listener_list, struct pw_node_events,
-				info_changed, &node->info);
-
-		spa_list_for_each(resource, &node->resource_list, link)
-			pw_node_resource_info(resource, &node->info);
-
-		node->info.change_mask = 0;
+		update_info(node);
+		emit_info_changed(node);
 	}
 }
 
@@ -868,6 +1136,8 @@ bool pw_node_set_active(struct pw_node *node, bool active)
 			node_activate(node);
 		else
 			pw_node_set_state(node, PW_NODE_STATE_IDLE);
+		if (node->global)
+			update_quantum(node->core);
 	}
 	return true;
 }
@@ -87,12 +87,25 @@ struct pw_node_events {
 	void (*have_output) (void *data);
         /** the node has a buffer to reuse */
 	void (*reuse_buffer) (void *data, uint32_t port_id, uint32_t buffer_id);
+
+	/** the node had one or more xruns, emitted from the main thread
+	 * \param cycle the cycle of the data loop of the last xrun
+	 * \param missing the samples or frames lost since the last
+	 *      notification, 0 when unknown */
+	void (*xrun) (void *data, uint64_t cycle, uint64_t missing);
 };
 
 /** Automatically connect this node to a compatible node */
 #define PW_NODE_PROP_AUTOCONNECT	"pipewire.autoconnect"
 /** Try to connect the node to this node id */
 #define PW_NODE_PROP_TARGET_NODE	"pipewire.target.node"
+/** Request this quantum, in samples, for the graph. The graph runs with the
+ * smallest quantum requested by its active nodes. */
+#define PW_NODE_PROP_LATENCY		"pipewire.latency"
+/** The index of the data loop of the node */
+#define PW_NODE_PROP_DATA_LOOP		"pipewire.data-loop"
+/** Nodes of the same device are placed in the same data loop */
+#define PW_NODE_PROP_DEVICE		"device.bus_path"
 
 /** Create a new node \memberof pw_node */
 struct pw_node *
@@ -127,6 +140,9 @@ const struct pw_properties *pw_node_get_properties(struct pw_node *node);
 /** Update the node properties */
 void pw_node_update_properties(struct pw_node *node, const struct spa_dict *dict);
 
+/** Run the node in the data loop with \a index, before it is registered */
+void pw_node_set_data_loop(struct pw_node *node, uint32_t index);
+
 /** Set the node implementation */
 void pw_node_set_implementation(struct pw_node *node, struct spa_node *spa_node);
 /** Get the node implementation */
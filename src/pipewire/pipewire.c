@@ -74,7 +74,8 @@ open_support(const char *path,
 static void *
 load_interface(struct support_info *info,
 	       const char *factory_name,
-	       const char *type)
+	       const char *type,
+	       const struct spa_dict *dict)
 {
         int res;
         struct spa_handle *handle;
@@ -89,7 +90,7 @@ load_interface(struct support_info *info,
 
         handle = calloc(1, factory->size);
         if ((res = spa_handle_factory_init(factory,
-                                           handle, NULL, info->support, info->n_support)) < 0) {
+                                           handle, dict, info->support, info->n_support)) < 0) {
                 fprintf(stderr, "can't make factory instance: %d\n", res);
                 goto init_failed;
         }
@@ -114,26 +115,43 @@ load_interface(struct support_info *info,
 static void configure_debug(const char *str)
 {
 	char **level;
-	int n_tokens;
+	int i, n_tokens;
 
 	level = pw_split_strv(str, ":", INT_MAX, &n_tokens);
 	if (n_tokens > 0)
 		pw_log_set_level(atoi(level[0]));
 
-	if (n_tokens > 1)
+	if (n_tokens > 1) {
 		categories = pw_split_strv(level[1], ",", INT_MAX, &n_tokens);
+
+		/* <topic>=<level> sets the level of a log topic */
+		for (i = 0; i < n_tokens; i++) {
+			char *eq = strchr(categories[i], '=');
+			if (eq == NULL)
+				continue;
+			*eq = '\0';
+			pw_log_set_topic_level(categories[i], atoi(eq + 1));
+		}
+	}
 }
 
 static void configure_support(struct support_info *info)
 {
 	void *iface;
 
-	iface = load_interface(info, "mapper", SPA_TYPE__TypeMap);
+	struct spa_dict_item items[1];
+	uint32_t n_items = 0;
+	const char *str;
+
+	iface = load_interface(info, "mapper", SPA_TYPE__TypeMap, NULL);
 	if (iface != NULL) {
 		info->support[info->n_support++] = SPA_SUPPORT_INIT(SPA_TYPE__TypeMap, iface);
 	}
 
-	iface = load_interface(info, "logger", SPA_TYPE__Log);
+	if ((str = getenv("PIPEWIRE_LOG_BINARY")))
+		items[n_items++] = (struct spa_dict_item) { "log.binary", str };
+
+	iface = load_interface(info, "logger", SPA_TYPE__Log, &SPA_DICT_INIT(items, n_items));
 	if (iface != NULL) {
 		info->support[info->n_support++] = SPA_SUPPORT_INIT(SPA_TYPE__Log, iface);
 		pw_log_set(iface);
@@ -187,7 +205,9 @@ const struct spa_support *pw_get_support(uint32_t *n_support)
  * Initialize the PipeWire system, parse and modify any parameters given
  * by \a argc and \a argv and set up debugging.
  *
- * The environment variable \a PIPEWIRE_DEBUG
+ * The environment variable \a PIPEWIRE_DEBUG sets the log level and the
+ * debug categories. With \a PIPEWIRE_LOG_BINARY=1 the messages are
+ * formatted in a separate thread.
  *
  * \memberof pw_pipewire
  */
@@ -79,7 +79,7 @@ extern "C" {
  * The 'PIPEWIRE_DEBUG' environment variable can be used to enable
  * more debugging. The format is:
  *
- *    &lt;level&gt;[:&lt;category&gt;,...]
+ *    &lt;level&gt;[:&lt;category&gt;[=&lt;level&gt;],...]
  *
  * - &lt;level&gt;: specifies the log level:
  *   + `0`: no logging is enabled
@@ -93,6 +93,12 @@ extern "C" {
  * - &lt;category&gt;:  Specifies a string category to enable. Many categories
  *		  can be separated by commas. Current categories are:
  *   + `connection`: to log connection messages
+ *
+ *   A category with a level sets the level of the log topic with that
+ *   name, the other topics use the global level. Current topics are
+ *   `node`, `port`, `link`, `stream`, `loop`, `protocol`, `graph` and
+ *   the directory names of the spa plugins, like `alsa` or `v4l2`.
+ *   `0:alsa=5` only traces the alsa plugins, for example.
  */
 
 /** \class pw_pipewire
@@ -25,6 +25,10 @@
 #include "pipewire/private.h"
 #include "pipewire/port.h"
 
+PW_LOG_TOPIC_STATIC(log_port, "port");
+#undef PW_LOG_TOPIC_DEFAULT
+#define PW_LOG_TOPIC_DEFAULT (&log_port)
+
 /** \cond */
 struct impl {
 	struct pw_port this;
@@ -325,6 +329,7 @@ bool pw_port_add(struct pw_port *port, struct pw_node *node)
 	if (port->state <= PW_PORT_STATE_INIT)
 		port_update_state(port, PW_PORT_STATE_CONFIGURE);
 
+	pw_node_params_changed(node);
 	spa_hook_list_call(&node->listener_list, struct pw_node_events, port_added, port);
 	return true;
 }
@@ -363,12 +368,15 @@ void pw_port_destroy(struct pw_port *port)
 		if (port->direction == PW_DIRECTION_INPUT) {
 			pw_map_remove(&node->input_port_map, port->port_id);
 			node->info.n_input_ports--;
+			node->info.change_mask |= PW_NODE_CHANGE_MASK_INPUT_PORTS;
 		}
 		else {
 			pw_map_remove(&node->output_port_map, port->port_id);
 			node->info.n_output_ports--;
+			node->info.change_mask |= PW_NODE_CHANGE_MASK_OUTPUT_PORTS;
 		}
 		spa_list_remove(&port->link);
+		pw_node_params_changed(node);
 		spa_hook_list_call(&node->listener_list, struct pw_node_events, port_removed, port);
 	}
 
@@ -32,11 +32,13 @@ extern "C" {
 #include "pipewire/introspect.h"
 
 #ifndef spa_debug
-#define spa_debug pw_log_trace
+#define spa_debug(...) pw_log_topic_trace(&pw_log_topic_graph,__VA_ARGS__)
 #endif
 
 #include <spa/graph/graph.h>
 
+#include "extensions/profiler.h"
+
 struct pw_command;
 
 typedef bool (*pw_command_func_t) (struct pw_command *command, struct pw_core *core, char **err);
@@ -116,6 +118,22 @@ struct pw_global {
 	void *object;			/**< object associated with the interface */
 };
 
+#define PW_MAX_DATA_LOOPS	16
+
+struct pw_core_data_loop {
+	struct pw_data_loop *impl;	/**< the data loop */
+	struct spa_graph graph;		/**< graph of the nodes in the loop */
+	struct spa_support support[4];	/**< support for spa plugins in the loop */
+
+	/* only accessed from the data loop */
+	struct pw_profiler_ring *profiler;	/**< ring for the timing of the nodes,
+						  *  NULL when not profiling */
+	uint64_t cycle;			/**< number of cycles started by a driver */
+	uint64_t signal;		/**< time the current cycle started */
+	uint64_t period;		/**< time between the last two cycles */
+	bool xrun;			/**< the current cycle has an xrun */
+};
+
 struct pw_core {
 	struct pw_global *global;	/**< the global of the core */
 
@@ -148,19 +166,28 @@ struct pw_core {
 	struct pw_loop *data_loop;	/**< data loop for data passing */
         struct pw_data_loop *data_loop_impl;
 
+	struct pw_core_data_loop data_loops[PW_MAX_DATA_LOOPS];	/**< data loops, the first one
+								  *  is data_loop */
+	uint32_t n_data_loops;		/**< number of data loops */
+
 	struct spa_support support[4];	/**< support for spa plugins */
 	uint32_t n_support;		/**< number of support items */
 
 	long sc_pagesize;
 
-	struct {
-		struct spa_graph graph;
-	} rt;
+	uint32_t quantum;		/**< graph quantum in samples, 0 when not requested */
+
+	struct pw_work_queue *link_work;	/**< work queue of the links in batch mode */
+
+	struct pw_profiler_area *profiler;	/**< shared memory of the profiler */
+	char *profiler_name;			/**< name of the profiler shared memory */
 };
 
 struct pw_data_loop {
         struct pw_loop *loop;
 
+	struct pw_properties *properties;
+
 	struct spa_hook_list listener_list;
 
         struct spa_source *event;
@@ -239,7 +266,10 @@ struct pw_node {
 	bool active;			/**< if the node is active */
 	bool live;			/**< if the node is live */
 	struct spa_clock *clock;	/**< handle to SPA clock if any */
+	struct spa_clock *driver_clock;	/**< clock of the node that drives the graph
+					  *  of this node, our own clock for drivers */
 	struct spa_node *node;		/**< SPA node implementation */
+	uint32_t quantum;		/**< requested graph quantum, 0 when none */
 
 	struct spa_list resource_list;	/**< list of resources for this node */
 
@@ -260,6 +290,8 @@ struct pw_node {
 	struct {
 		struct spa_graph *graph;
 		struct spa_graph_node node;
+		uint32_t id;				/**< global id for the profiler */
+		char name[PW_PROFILER_MAX_NAME];	/**< name for the profiler */
 	} rt;
 
         void *user_data;                /**< extra user data */
@@ -330,6 +362,7 @@ struct pw_proxy {
 	struct spa_list link;		/**< link in the remote */
 
 	uint32_t id;			/**< client side id */
+	uint32_t version;		/**< version of the interface */
 
 	struct spa_hook_list listener_list;
 	struct spa_hook_list proxy_listener_list;
@@ -496,6 +529,11 @@ int pw_node_set_state(struct pw_node *node, enum pw_node_state state);
 /** Update the state of the node, mostly used by node implementations */
 void pw_node_update_state(struct pw_node *node, enum pw_node_state state, char *error);
 
+/** Mark the params of the node as changed. They are enumerated again
+ * and the info is sent from the main loop, unless another info is sent
+ * first */
+void pw_node_params_changed(struct pw_node *node);
+
 /** Activate a link \memberof pw_link
   * Starts the negotiation of formats and buffers on \a link and then
   * starts data streaming */
@@ -512,6 +550,28 @@ pw_control_new(struct pw_core *core,
 
 void pw_control_destroy(struct pw_control *control);
 
+/** Start or stop the profiler with the pipewire.profiler property */
+int pw_profiler_update(struct pw_core *core);
+
+/** Stop the profiler */
+void pw_profiler_stop(struct pw_core *core);
+
+/** If \a node drives the graph it is in, it starts the cycles */
+static inline bool pw_node_is_driver(struct pw_node *node)
+{
+	return node->clock != NULL && node->driver_clock == node->clock;
+}
+
+/** Start a new cycle, called by the driver of the graph in the data loop */
+void pw_profiler_cycle(struct pw_node *driver);
+
+/** Process \a node and record its timing */
+int pw_profiler_process(struct pw_core_data_loop *loop, struct spa_graph_node *node,
+			enum spa_direction direction);
+
+/** Record the times a remote node woke up and finished in its client */
+void pw_profiler_remote(struct pw_node *node, uint64_t awake, uint64_t finish);
+
 /** \endcond */
 
 #ifdef __cplusplus
@@ -0,0 +1,226 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "pipewire.h"
+#include "private.h"
+#include "data-loop.h"
+
+static int
+do_set_ring(struct spa_loop *loop,
+	    bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_core_data_loop *dl = user_data;
+
+	dl->profiler = *(struct pw_profiler_ring **) data;
+	dl->signal = 0;
+	dl->period = 0;
+	dl->xrun = false;
+
+	return 0;
+}
+
+/* the ring of a loop is only changed from the loop so that it is never
+ * removed while a node is being measured */
+static void set_ring(struct pw_core_data_loop *dl, struct pw_profiler_ring *ring)
+{
+	pw_loop_invoke(pw_data_loop_get_loop(dl->impl),
+		       do_set_ring, 1, &ring, sizeof(ring), true, dl);
+}
+
+static int start_profiler(struct pw_core *core)
+{
+	struct pw_profiler_area *area;
+	char *name;
+	int fd, res;
+
+	if (asprintf(&name, PW_PROFILER_SHM_PREFIX "%s", core->info.name) < 0)
+		return -ENOMEM;
+
+	if ((fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0) {
+		res = -errno;
+		pw_log_error("core %p: can't open profiler shm %s: %m", core, name);
+		goto error_free;
+	}
+	if (ftruncate(fd, sizeof(struct pw_profiler_area)) < 0) {
+		res = -errno;
+		pw_log_error("core %p: can't size profiler shm %s: %m", core, name);
+		goto error_close;
+	}
+	area = mmap(NULL, sizeof(struct pw_profiler_area),
+		    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (area == MAP_FAILED) {
+		res = -errno;
+		pw_log_error("core %p: can't map profiler shm %s: %m", core, name);
+		goto error_close;
+	}
+	close(fd);
+
+	area->version = PW_PROFILER_VERSION;
+	area->n_rings = 0;
+
+	core->profiler = area;
+	core->profiler_name = name;
+
+	pw_log_debug("core %p: profiler started in %s", core, name);
+
+	return 0;
+
+      error_close:
+	close(fd);
+	shm_unlink(name);
+      error_free:
+	free(name);
+	return res;
+}
+
+int pw_profiler_update(struct pw_core *core)
+{
+	struct pw_profiler_area *area;
+	const char *str;
+	uint32_t i, n_rings;
+	int res;
+
+	str = pw_properties_get(core->properties, PW_CORE_PROP_PROFILER);
+	if (str == NULL || !pw_properties_parse_bool(str)) {
+		pw_profiler_stop(core);
+		return 0;
+	}
+
+	if (core->profiler == NULL && (res = start_profiler(core)) < 0)
+		return res;
+
+	area = core->profiler;
+
+	/* give the new data loops a ring */
+	n_rings = SPA_MIN(core->n_data_loops, PW_PROFILER_MAX_LOOPS);
+	for (i = area->n_rings; i < n_rings; i++)
+		set_ring(&core->data_loops[i], &area->rings[i]);
+	area->n_rings = n_rings;
+
+	return 0;
+}
+
+void pw_profiler_stop(struct pw_core *core)
+{
+	struct pw_profiler_area *area = core->profiler;
+	uint32_t i;
+
+	if (area == NULL)
+		return;
+
+	for (i = 0; i < area->n_rings; i++)
+		set_ring(&core->data_loops[i], NULL);
+
+	pw_log_debug("core %p: profiler stopped", core);
+
+	munmap(area, sizeof(struct pw_profiler_area));
+	shm_unlink(core->profiler_name);
+	free(core->profiler_name);
+	core->profiler = NULL;
+	core->profiler_name = NULL;
+}
+
+static void
+write_record(struct pw_core_data_loop *dl, struct pw_node *node,
+	     uint32_t flags, uint64_t start, uint64_t end)
+{
+	struct pw_profiler_ring *ring = dl->profiler;
+	struct pw_profiler_record *r;
+	uint32_t index;
+
+	/* the first node that ends after the next cycle should have started
+	 * gets the xrun */
+	if (dl->period > 0 && end > dl->signal + dl->period && !dl->xrun) {
+		flags |= PW_PROFILER_RECORD_FLAG_XRUN;
+		dl->xrun = true;
+	}
+
+	index = ring->write_index;
+	r = &ring->records[index & (PW_PROFILER_N_RECORDS - 1)];
+
+	r->flags = flags;
+	r->node_id = __atomic_load_n(&node->rt.id, __ATOMIC_RELAXED);
+	r->cycle = dl->cycle;
+	r->signal = dl->signal;
+	r->start = start;
+	r->end = end;
+	r->period = dl->period;
+	memcpy(r->name, node->rt.name, sizeof(r->name));
+
+	__atomic_store_n(&ring->write_index, index + 1, __ATOMIC_RELEASE);
+}
+
+void pw_profiler_cycle(struct pw_node *driver)
+{
+	struct pw_core_data_loop *dl;
+	uint64_t now;
+
+	dl = SPA_CONTAINER_OF(driver->rt.graph, struct pw_core_data_loop, graph);
+
+	/* the cycle is also counted without profiler, the xruns refer to it */
+	dl->cycle++;
+	if (SPA_LIKELY(dl->profiler == NULL))
+		return;
+
+	now = pw_profiler_get_time();
+	if (dl->signal != 0)
+		dl->period = now - dl->signal;
+	dl->signal = now;
+	dl->xrun = false;
+}
+
+int pw_profiler_process(struct pw_core_data_loop *dl, struct spa_graph_node *node,
+			enum spa_direction direction)
+{
+	/* the port mixers have no node */
+	struct pw_node *n = node->scheduler_data;
+	uint64_t start;
+	int res;
+
+	start = pw_profiler_get_time();
+
+	if (direction == SPA_DIRECTION_INPUT)
+		res = spa_node_process_input(node->implementation);
+	else
+		res = spa_node_process_output(node->implementation);
+
+	if (n != NULL)
+		write_record(dl, n, pw_node_is_driver(n) ? PW_PROFILER_RECORD_FLAG_DRIVER : 0,
+			     start, pw_profiler_get_time());
+
+	return res;
+}
+
+void pw_profiler_remote(struct pw_node *node, uint64_t awake, uint64_t finish)
+{
+	struct pw_core_data_loop *dl;
+
+	dl = SPA_CONTAINER_OF(node->rt.graph, struct pw_core_data_loop, graph);
+	if (SPA_LIKELY(dl->profiler == NULL) || awake == 0)
+		return;
+
+	write_record(dl, node, PW_PROFILER_RECORD_FLAG_REMOTE, awake, finish);
+}
@@ -45,6 +45,7 @@ struct proxy {
  */
 struct pw_proxy *pw_proxy_new(struct pw_proxy *factory,
 			      uint32_t type,
+			      uint32_t version,
 			      size_t user_data_size)
 {
 	struct proxy *impl;
@@ -57,6 +58,7 @@ struct pw_proxy *pw_proxy_new(struct pw_proxy *factory,
 
 	this = &impl->this;
 	this->remote = remote;
+	this->version = version;
 
 	spa_hook_list_init(&this->listener_list);
 	spa_hook_list_init(&this->proxy_listener_list);
@@ -85,6 +87,11 @@ uint32_t pw_proxy_get_id(struct pw_proxy *proxy)
 	return proxy->id;
 }
 
+uint32_t pw_proxy_get_version(struct pw_proxy *proxy)
+{
+	return proxy->version;
+}
+
 struct pw_protocol *pw_proxy_get_protocol(struct pw_proxy *proxy)
 {
 	return proxy->remote->conn->protocol;
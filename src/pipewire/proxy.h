@@ -112,6 +112,7 @@ struct pw_proxy_events {
 struct pw_proxy *
 pw_proxy_new(struct pw_proxy *factory,	/**< factory */
 	     uint32_t type,		/**< interface type */
+	     uint32_t version,		/**< interface version */
 	     size_t user_data_size	/**< size of user data */);
 
 /** Add an event listener to proxy */
@@ -136,6 +137,9 @@ void *pw_proxy_get_user_data(struct pw_proxy *proxy);
 /** Get the local id of the proxy */
 uint32_t pw_proxy_get_id(struct pw_proxy *proxy);
 
+/** Get the interface version of the proxy */
+uint32_t pw_proxy_get_version(struct pw_proxy *proxy);
+
 /** Get the protocol used for the proxy */
 struct pw_protocol *pw_proxy_get_protocol(struct pw_proxy *proxy);
 
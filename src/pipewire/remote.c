@@ -343,7 +343,8 @@ static int do_connect(struct pw_remote *remote)
 
 	dummy.remote = remote;
 
-	remote->core_proxy = (struct pw_core_proxy*)pw_proxy_new(&dummy, remote->core->type.core, 0);
+	remote->core_proxy = (struct pw_core_proxy*)pw_proxy_new(&dummy, remote->core->type.core,
+								 PW_VERSION_CORE, 0);
 	if (remote->core_proxy == NULL)
 		goto no_proxy;
 
@@ -458,11 +459,13 @@ static void handle_rtnode_message(struct pw_proxy *proxy, struct pw_client_node_
 	switch (PW_CLIENT_NODE_MESSAGE_TYPE(message)) {
 	case PW_CLIENT_NODE_MESSAGE_PROCESS_INPUT:
 		pw_log_trace("remote %p: process input", data->remote);
+		data->trans->area->awake_time = pw_profiler_get_time();
 		spa_graph_have_output(data->node->rt.graph, &data->in_node);
 		break;
 
 	case PW_CLIENT_NODE_MESSAGE_PROCESS_OUTPUT:
 		pw_log_trace("remote %p: process output", data->remote);
+		data->trans->area->awake_time = pw_profiler_get_time();
 		spa_graph_need_input(data->node->rt.graph, &data->out_node);
 		break;
 
@@ -780,6 +783,7 @@ static void node_need_input(void *data)
 {
 	struct node_data *d = data;
         uint64_t cmd = 1;
+	d->trans->area->finish_time = pw_profiler_get_time();
 	pw_client_node_transport_add_message(d->trans,
 				&PW_CLIENT_NODE_MESSAGE_INIT(PW_CLIENT_NODE_MESSAGE_NEED_INPUT));
         write(d->rtwritefd, &cmd, 8);
@@ -789,6 +793,7 @@ static void node_have_output(void *data)
 {
 	struct node_data *d = data;
         uint64_t cmd = 1;
+	d->trans->area->finish_time = pw_profiler_get_time();
         pw_client_node_transport_add_message(d->trans,
                                &PW_CLIENT_NODE_MESSAGE_INIT(PW_CLIENT_NODE_MESSAGE_HAVE_OUTPUT));
         write(d->rtwritefd, &cmd, 8);
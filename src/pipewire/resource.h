@@ -91,6 +91,9 @@ uint32_t pw_resource_get_permissions(struct pw_resource *resource);
 /** Get the type of this resource */
 uint32_t pw_resource_get_type(struct pw_resource *resource);
 
+/** Get the interface version of this resource */
+uint32_t pw_resource_get_version(struct pw_resource *resource);
+
 /** Get the protocol used for this resource */
 struct pw_protocol *pw_resource_get_protocol(struct pw_resource *resource);
 
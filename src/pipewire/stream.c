@@ -35,6 +35,10 @@
 #include "pipewire/stream.h"
 #include "extensions/client-node.h"
 
+PW_LOG_TOPIC_STATIC(log_stream, "stream");
+#undef PW_LOG_TOPIC_DEFAULT
+#define PW_LOG_TOPIC_DEFAULT (&log_stream)
+
 /** \cond */
 
 #define MAX_BUFFER_SIZE 4096
@@ -438,6 +442,7 @@ static inline void send_need_input(struct pw_stream *stream)
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
 	uint64_t cmd = 1;
 
+	impl->trans->area->finish_time = pw_profiler_get_time();
 	pw_client_node_transport_add_message(impl->trans,
 			       &PW_CLIENT_NODE_MESSAGE_INIT(PW_CLIENT_NODE_MESSAGE_NEED_INPUT));
 	write(impl->rtwritefd, &cmd, 8);
@@ -448,11 +453,25 @@ static inline void send_have_output(struct pw_stream *stream)
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
 	uint64_t cmd = 1;
 
+	impl->trans->area->finish_time = pw_profiler_get_time();
 	pw_client_node_transport_add_message(impl->trans,
 			       &PW_CLIENT_NODE_MESSAGE_INIT(PW_CLIENT_NODE_MESSAGE_HAVE_OUTPUT));
 	write(impl->rtwritefd, &cmd, 8);
 }
 
+static void call_need_buffer(struct pw_stream *stream)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+
+	impl->in_need_buffer = true;
+	spa_hook_list_call(&stream->listener_list, struct pw_stream_events, need_buffer);
+	impl->in_need_buffer = false;
+
+	/* the buffers sent from need_buffer are signaled here, once */
+	if (impl->trans->outputs[0].buffer_id != SPA_ID_INVALID)
+		send_have_output(stream);
+}
+
 static inline void send_reuse_buffer(struct pw_stream *stream, uint32_t id)
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
@@ -558,6 +577,7 @@ static void handle_rtnode_message(struct pw_stream *stream, struct pw_client_nod
 	{
 		int i;
 
+		impl->trans->area->awake_time = pw_profiler_get_time();
 		for (i = 0; i < impl->trans->area->n_input_ports; i++) {
 			struct spa_io_buffers *input = &impl->trans->inputs[i];
 			struct buffer_id *bid;
@@ -591,6 +611,7 @@ static void handle_rtnode_message(struct pw_stream *stream, struct pw_client_nod
 	{
 		int i;
 
+		impl->trans->area->awake_time = pw_profiler_get_time();
 		for (i = 0; i < impl->trans->area->n_output_ports; i++) {
 			struct spa_io_buffers *output = &impl->trans->outputs[i];
 
@@ -601,9 +622,7 @@ static void handle_rtnode_message(struct pw_stream *stream, struct pw_client_nod
 			output->buffer_id = SPA_ID_INVALID;
 		}
 		pw_log_trace("stream %p: process output", stream);
-		impl->in_need_buffer = true;
-		spa_hook_list_call(&stream->listener_list, struct pw_stream_events, need_buffer);
-		impl->in_need_buffer = false;
+		call_need_buffer(stream);
 		break;
 	}
 	case PW_CLIENT_NODE_MESSAGE_PORT_REUSE_BUFFER:
@@ -719,10 +738,7 @@ static void client_node_command(void *data, uint32_t seq, const struct spa_comma
 				send_need_input(stream);
 			}
 			else {
-				impl->in_need_buffer = true;
-				spa_hook_list_call(&stream->listener_list, struct pw_stream_events,
-						    need_buffer);
-				impl->in_need_buffer = false;
+				call_need_buffer(stream);
 			}
 			stream_set_state(stream, PW_STREAM_STATE_STREAMING, NULL);
 		}
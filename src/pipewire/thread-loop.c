@@ -22,6 +22,10 @@
 #include "pipewire.h"
 #include "thread-loop.h"
 
+PW_LOG_TOPIC_STATIC(log_loop, "loop");
+#undef PW_LOG_TOPIC_DEFAULT
+#define PW_LOG_TOPIC_DEFAULT (&log_loop)
+
 /** \cond */
 struct pw_thread_loop {
 	struct pw_loop *loop;
@@ -20,11 +20,14 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "pipewire/log.h"
 #include "pipewire/work-queue.h"
 
 /** \cond */
+#define INITIAL_HASH_SIZE	64
+
 struct work_item {
 	uint32_t id;
 	void *obj;
@@ -32,7 +35,10 @@ struct work_item {
 	int res;
 	pw_work_func_t func;
 	void *data;
-	struct spa_list link;
+	struct spa_list link;		/* in work_list in submission order or in free_list */
+	struct spa_list hash_link;	/* in the hash while waiting for seq */
+	struct spa_list ready_link;	/* in ready_list when it can be processed */
+	bool ready;
 };
 
 struct pw_work_queue {
@@ -41,41 +47,120 @@ struct pw_work_queue {
 	struct spa_source *wakeup;
 	uint32_t counter;
 
+	/* items can be added and completed from the data threads */
+	pthread_mutex_t lock;
+
 	struct spa_list work_list;
 	struct spa_list free_list;
+	struct spa_list ready_list;
 	int n_queued;
+
+	/* async items by seq */
+	struct spa_list *hash;
+	uint32_t hash_size;
+	uint32_t n_waiting;
 };
 /** \endcond */
 
-static void process_work_queue(void *data, uint64_t count)
+static inline uint32_t hash_index(struct pw_work_queue *this, void *obj, uint32_t seq)
 {
-	struct pw_work_queue *this = data;
+	return (seq ^ (uint32_t) ((uintptr_t) obj >> 4)) & (this->hash_size - 1);
+}
+
+static void hash_grow(struct pw_work_queue *this)
+{
+	struct spa_list *hash;
 	struct work_item *item, *tmp;
+	uint32_t i, old_size = this->hash_size;
+	struct spa_list *old = this->hash;
 
-	spa_list_for_each_safe(item, tmp, &this->work_list, link) {
-		if (item->seq != SPA_ID_INVALID) {
-			pw_log_debug("work-queue %p: %d waiting for item %p %d", this,
-				     this->n_queued, item->obj, item->seq);
-			continue;
-		}
+	hash = malloc(old_size * 2 * sizeof(struct spa_list));
+	if (hash == NULL)
+		return;
 
-		if (item->res == -EBUSY &&
-		    item != spa_list_first(&this->work_list, struct work_item, link)) {
-			pw_log_debug("work-queue %p: %d sync item %p not head", this,
-				     this->n_queued, item->obj);
-			continue;
-		}
+	for (i = 0; i < old_size * 2; i++)
+		spa_list_init(&hash[i]);
+
+	this->hash = hash;
+	this->hash_size = old_size * 2;
+
+	for (i = 0; i < old_size; i++) {
+		spa_list_for_each_safe(item, tmp, &old[i], hash_link)
+			spa_list_append(&hash[hash_index(this, item->obj, item->seq)],
+					&item->hash_link);
+	}
+	free(old);
+}
+
+static void hash_add(struct pw_work_queue *this, struct work_item *item)
+{
+	if (++this->n_waiting > this->hash_size * 2)
+		hash_grow(this);
+	spa_list_append(&this->hash[hash_index(this, item->obj, item->seq)], &item->hash_link);
+}
+
+static void hash_remove(struct pw_work_queue *this, struct work_item *item)
+{
+	spa_list_remove(&item->hash_link);
+	this->n_waiting--;
+}
+
+static void make_ready(struct pw_work_queue *this, struct work_item *item)
+{
+	if (item->ready)
+		return;
+	item->ready = true;
+	spa_list_append(&this->ready_list, &item->ready_link);
+}
+
+/* a sync item runs when everything that was added before it is done */
+static void check_head(struct pw_work_queue *this)
+{
+	struct work_item *head;
+
+	if (spa_list_is_empty(&this->work_list))
+		return;
+
+	head = spa_list_first(&this->work_list, struct work_item, link);
+	if (head->res == -EBUSY && head->seq == SPA_ID_INVALID)
+		make_ready(this, head);
+}
+
+static void process_work_queue(void *data, uint64_t count)
+{
+	struct pw_work_queue *this = data;
+	struct work_item *item;
+	pw_work_func_t func;
+	void *obj, *user_data;
+	uint32_t id;
+	int res;
 
+	pthread_mutex_lock(&this->lock);
+	while (!spa_list_is_empty(&this->ready_list)) {
+		item = spa_list_first(&this->ready_list, struct work_item, ready_link);
+		spa_list_remove(&item->ready_link);
 		spa_list_remove(&item->link);
 		this->n_queued--;
 
-		if (item->func) {
-			pw_log_debug("work-queue %p: %d process work item %p %d %d", this,
-				     this->n_queued, item->obj, item->seq, item->res);
-			item->func(item->obj, item->data, item->res, item->id);
-		}
+		func = item->func;
+		obj = item->obj;
+		user_data = item->data;
+		res = item->res;
+		id = item->id;
+
 		spa_list_append(&this->free_list, &item->link);
+		check_head(this);
+
+		if (func) {
+			pw_log_debug("work-queue %p: %d process work item %p %d", this,
+				     this->n_queued, obj, res);
+			/* the function can add and complete items */
+			pthread_mutex_unlock(&this->lock);
+			func(obj, user_data, res, id);
+			pthread_mutex_lock(&this->lock);
+		}
 	}
+	pthread_mutex_unlock(&this->lock);
 }
 
 /** Create a new \ref pw_work_queue
@@ -88,16 +173,31 @@ static void process_work_queue(void *data, uint64_t count)
 struct pw_work_queue *pw_work_queue_new(struct pw_loop *loop)
 {
 	struct pw_work_queue *this;
+	uint32_t i;
 
 	this = calloc(1, sizeof(struct pw_work_queue));
+	if (this == NULL)
+		return NULL;
+
 	pw_log_debug("work-queue %p: new", this);
 
+	this->hash_size = INITIAL_HASH_SIZE;
+	this->hash = malloc(this->hash_size * sizeof(struct spa_list));
+	if (this->hash == NULL) {
+		free(this);
+		return NULL;
+	}
+	for (i = 0; i < this->hash_size; i++)
+		spa_list_init(&this->hash[i]);
+
 	this->loop = loop;
 
 	this->wakeup = pw_loop_add_event(this->loop, process_work_queue, this);
 
+	pthread_mutex_init(&this->lock, NULL);
 	spa_list_init(&this->work_list);
 	spa_list_init(&this->free_list);
+	spa_list_init(&this->ready_list);
 
 	return this;
 }
@@ -123,6 +223,8 @@ void pw_work_queue_destroy(struct pw_work_queue *queue)
 	spa_list_for_each_safe(item, tmp, &queue->free_list, link)
 		free(item);
 
+	pthread_mutex_destroy(&queue->lock);
+	free(queue->hash);
 	free(queue);
 }
 
@@ -134,6 +236,9 @@ void pw_work_queue_destroy(struct pw_work_queue *queue)
  * \param func a work function
  * \param data passed to \a func
  *
+ * This function can be called from any thread, \a func is called from
+ * the thread of the loop of \a queue.
+ *
  * \memberof pw_work_queue
  */
 uint32_t
@@ -141,42 +246,50 @@ pw_work_queue_add(struct pw_work_queue *queue, void *obj, int res, pw_work_func_
 {
 	struct work_item *item;
 	bool have_work = false;
+	uint32_t id;
 
+	pthread_mutex_lock(&queue->lock);
 	if (!spa_list_is_empty(&queue->free_list)) {
 		item = spa_list_first(&queue->free_list, struct work_item, link);
 		spa_list_remove(&item->link);
 	} else {
 		item = malloc(sizeof(struct work_item));
-		if (item == NULL)
+		if (item == NULL) {
+			pthread_mutex_unlock(&queue->lock);
 			return SPA_ID_INVALID;
+		}
 	}
-	item->id = ++queue->counter;
+	item->id = id = ++queue->counter;
 	item->obj = obj;
 	item->func = func;
 	item->data = data;
+	item->res = res;
+	item->ready = false;
+
+	spa_list_append(&queue->work_list, &item->link);
+	queue->n_queued++;
 
 	if (SPA_RESULT_IS_ASYNC(res)) {
 		item->seq = SPA_RESULT_ASYNC_SEQ(res);
-		item->res = res;
+		hash_add(queue, item);
 		pw_log_debug("work-queue %p: defer async %d for object %p", queue, item->seq, obj);
 	} else if (res == -EBUSY) {
 		pw_log_debug("work-queue %p: wait sync object %p", queue, obj);
 		item->seq = SPA_ID_INVALID;
-		item->res = res;
-		have_work = true;
+		check_head(queue);
+		have_work = item->ready;
 	} else {
 		item->seq = SPA_ID_INVALID;
-		item->res = res;
+		make_ready(queue, item);
 		have_work = true;
 		pw_log_debug("work-queue %p: defer object %p", queue, obj);
 	}
-	spa_list_append(&queue->work_list, &item->link);
-	queue->n_queued++;
+	pthread_mutex_unlock(&queue->lock);
 
 	if (have_work)
 		pw_loop_signal_event(queue->loop, queue->wakeup);
 
-	return item->id;
+	return id;
 }
 
 /** Cancel a work item
@@ -191,15 +304,21 @@ void pw_work_queue_cancel(struct pw_work_queue *queue, void *obj, uint32_t id)
 	bool have_work = false;
 	struct work_item *item;
 
+	pthread_mutex_lock(&queue->lock);
 	spa_list_for_each(item, &queue->work_list, link) {
 		if ((id == SPA_ID_INVALID || item->id == id) && (obj == NULL || item->obj == obj)) {
 			pw_log_debug("work-queue %p: cancel defer %d for object %p", queue,
 				     item->seq, item->obj);
+			if (item->seq != SPA_ID_INVALID)
+				hash_remove(queue, item);
 			item->seq = SPA_ID_INVALID;
 			item->func = NULL;
+			make_ready(queue, item);
 			have_work = true;
 		}
 	}
+	pthread_mutex_unlock(&queue->lock);
+
 	if (have_work)
 		pw_loop_signal_event(queue->loop, queue->wakeup);
 }
@@ -210,22 +329,31 @@ void pw_work_queue_cancel(struct pw_work_queue *queue, void *obj, uint32_t id)
  * \param seq the sequence number that completed
  * \param res the result of the completed work
  *
+ * This function can be called from any thread.
+ *
  * \memberof pw_work_queue
  */
 bool pw_work_queue_complete(struct pw_work_queue *queue, void *obj, uint32_t seq, int res)
 {
-	struct work_item *item;
+	struct work_item *item, *tmp;
+	struct spa_list *bucket;
 	bool have_work = false;
 
-	spa_list_for_each(item, &queue->work_list, link) {
+	pthread_mutex_lock(&queue->lock);
+	bucket = &queue->hash[hash_index(queue, obj, seq)];
+	spa_list_for_each_safe(item, tmp, bucket, hash_link) {
 		if (item->obj == obj && item->seq == seq) {
 			pw_log_debug("work-queue %p: found defered %d for object %p", queue, seq,
 				     obj);
+			hash_remove(queue, item);
 			item->seq = SPA_ID_INVALID;
 			item->res = res;
+			make_ready(queue, item);
 			have_work = true;
 		}
 	}
+	pthread_mutex_unlock(&queue->lock);
+
 	if (!have_work) {
 		pw_log_debug("work-queue %p: no defered %d found for object %p", queue, seq, obj);
 	} else {
@@ -0,0 +1,536 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include <spa/param/format-utils.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/factory.h>
+#include <pipewire/data-loop.h>
+
+#include "extensions/profiler.h"
+
+/* Round trip of the graph through clients. A core in this process runs
+ * module-protocol-native and module-client-node, the clients connect to it
+ * over the socket with a playback pw_stream each and are linked to a fakesink
+ * that drives the graph as fast as it can. The profiler of the core gives,
+ * for every cycle, the time from the server asking the client to process
+ * until the client woke up and until it signaled that it was done. The CPU
+ * time and the wakeups are those of the whole process, server and clients
+ * together.
+ *
+ * The profiler is read from the main loop, on a single CPU realtime data
+ * loops leave it no time and the records are lost. Pass "other" as the
+ * policy to run the data loops without realtime scheduling. */
+
+#define DEFAULT_CLIENTS	1
+#define DEFAULT_CYCLES	10000
+#define WARMUP_CYCLES	1000
+#define TIMEOUT		30	/* sec */
+
+struct sample {
+	uint64_t wakeup;
+	uint64_t finish;
+};
+
+struct request {
+	uint32_t node_id;
+	uint64_t time;
+};
+
+struct client {
+	struct data *data;
+	struct pw_remote *remote;
+	struct spa_hook remote_listener;
+	struct pw_stream *stream;
+	struct spa_hook stream_listener;
+	struct pw_node *sink;
+	char path[16];
+};
+
+struct usage {
+	uint64_t time;
+	uint64_t cpu;
+	uint64_t wakeups;
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_type *t;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+
+	struct pw_core *server;
+	struct pw_factory *factory;
+	struct pw_core *core;
+
+	uint32_t n_clients;
+	struct client *clients;
+
+	struct spa_source *done;
+	uint64_t n_cycles;
+	uint64_t cycles;
+	struct usage begin;
+	struct usage end;
+
+	struct pw_profiler_area *area;
+	uint32_t read_index[PW_PROFILER_MAX_LOOPS];
+	uint64_t lost;
+	uint64_t driver_cycles;
+	struct request *requests;
+	uint32_t n_requests;
+	struct sample *samples;
+	uint32_t n_samples;
+	uint32_t max_samples;
+
+	int res;
+};
+
+static void get_usage(struct usage *u)
+{
+	struct timespec now;
+	struct rusage ru;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	u->time = SPA_TIMESPEC_TO_TIME(&now);
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+	u->cpu = SPA_TIMESPEC_TO_TIME(&now);
+	getrusage(RUSAGE_SELF, &ru);
+	u->wakeups = ru.ru_nvcsw;
+}
+
+static struct request *find_request(struct data *data, uint32_t node_id, bool create)
+{
+	uint32_t i;
+
+	for (i = 0; i < data->n_requests; i++) {
+		if (data->requests[i].node_id == node_id)
+			return &data->requests[i];
+	}
+	if (!create || data->n_requests == data->n_clients)
+		return NULL;
+
+	data->requests[data->n_requests].node_id = node_id;
+	return &data->requests[data->n_requests++];
+}
+
+static void add_record(struct data *data, struct pw_profiler_record *r)
+{
+	struct request *q;
+	struct sample *s;
+
+	if (r->flags & PW_PROFILER_RECORD_FLAG_DRIVER) {
+		data->driver_cycles++;
+	}
+	else if (r->flags & PW_PROFILER_RECORD_FLAG_REMOTE) {
+		/* the drivers share the data loop, the start of the cycle in the
+		 * record can be of another driver, measure from the request */
+		if ((q = find_request(data, r->node_id, false)) == NULL ||
+		    q->time == 0 || r->start < q->time ||
+		    data->n_samples == data->max_samples)
+			return;
+
+		s = &data->samples[data->n_samples++];
+		s->wakeup = r->start - q->time;
+		s->finish = r->end - q->time;
+		q->time = 0;
+	}
+	else if ((q = find_request(data, r->node_id, true)) != NULL) {
+		/* the server side of the client node, it wakes up the client */
+		q->time = r->start;
+	}
+}
+
+static void read_ring(struct data *data, uint32_t index)
+{
+	struct pw_profiler_ring *ring = &data->area->rings[index];
+	struct pw_profiler_record r;
+	uint32_t write_index, read_index = data->read_index[index];
+	uint64_t begin = __atomic_load_n(&data->begin.time, __ATOMIC_ACQUIRE);
+
+	write_index = __atomic_load_n(&ring->write_index, __ATOMIC_ACQUIRE);
+
+	if (write_index - read_index > PW_PROFILER_N_RECORDS) {
+		data->lost += write_index - read_index - PW_PROFILER_N_RECORDS;
+		read_index = write_index - PW_PROFILER_N_RECORDS;
+	}
+	for (; read_index != write_index; read_index++) {
+		r = ring->records[read_index & (PW_PROFILER_N_RECORDS - 1)];
+
+		if (__atomic_load_n(&ring->write_index, __ATOMIC_ACQUIRE) - read_index >=
+		    PW_PROFILER_N_RECORDS) {
+			data->lost++;
+			continue;
+		}
+		/* only the cycles that started in the measurement */
+		if (begin == 0 || r.signal < begin)
+			continue;
+
+		add_record(data, &r);
+	}
+	data->read_index[index] = read_index;
+}
+
+static void do_read(void *_data, uint64_t expirations)
+{
+	struct data *data = _data;
+	uint32_t i, n_rings;
+
+	n_rings = SPA_MIN(data->area->n_rings, PW_PROFILER_MAX_LOOPS);
+	for (i = 0; i < n_rings; i++)
+		read_ring(data, i);
+}
+
+static void do_done(void *_data, uint64_t count)
+{
+	struct data *data = _data;
+	do_read(data, 0);
+	pw_main_loop_quit(data->loop);
+}
+
+static void do_timeout(void *_data, uint64_t expirations)
+{
+	struct data *data = _data;
+	fprintf(stderr, "timeout after %" PRIu64 " cycles\n",
+		__atomic_load_n(&data->n_cycles, __ATOMIC_RELAXED));
+	data->res = -ETIMEDOUT;
+	pw_main_loop_quit(data->loop);
+}
+
+/* called from the data loop of the clients */
+static void on_stream_need_buffer(void *_data)
+{
+	struct client *c = _data;
+	struct data *data = c->data;
+	uint64_t n;
+	uint32_t id;
+
+	if ((id = pw_stream_get_empty_buffer(c->stream)) != SPA_ID_INVALID)
+		pw_stream_send_buffer(c->stream, id);
+
+	n = __atomic_add_fetch(&data->n_cycles, 1, __ATOMIC_RELAXED);
+	if (n == WARMUP_CYCLES) {
+		struct usage u;
+		get_usage(&u);
+		data->begin.cpu = u.cpu;
+		data->begin.wakeups = u.wakeups;
+		__atomic_store_n(&data->begin.time, u.time, __ATOMIC_RELEASE);
+	}
+	else if (n == WARMUP_CYCLES + data->cycles) {
+		get_usage(&data->end);
+		pw_loop_signal_event(pw_main_loop_get_loop(data->loop), data->done);
+	}
+}
+
+static void on_stream_format_changed(void *_data, struct spa_pod *format)
+{
+	struct client *c = _data;
+	struct pw_type *t = c->data->t;
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *params[1];
+
+	if (format == NULL) {
+		pw_stream_finish_format(c->stream, 0, NULL, 0);
+		return;
+	}
+	params[0] = spa_pod_builder_object(&b,
+		t->param.idBuffers, t->param_buffers.Buffers,
+		":", t->param_buffers.size,    "i", 128,
+		":", t->param_buffers.stride,  "i", 1,
+		":", t->param_buffers.buffers, "iru", 2,
+							2, 1, 32,
+		":", t->param_buffers.align,   "i", 16);
+
+	pw_stream_finish_format(c->stream, 0, params, 1);
+}
+
+static void on_stream_state_changed(void *_data, enum pw_stream_state old,
+				    enum pw_stream_state state, const char *error)
+{
+	struct client *c = _data;
+	struct data *data = c->data;
+
+	if (state == PW_STREAM_STATE_ERROR) {
+		fprintf(stderr, "stream %p: error %s\n", c->stream, error);
+		data->res = -EIO;
+		pw_main_loop_quit(data->loop);
+	}
+}
+
+static const struct pw_stream_events stream_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = on_stream_state_changed,
+	.format_changed = on_stream_format_changed,
+	.need_buffer = on_stream_need_buffer,
+};
+
+static void on_remote_state_changed(void *_data, enum pw_remote_state old,
+				    enum pw_remote_state state, const char *error)
+{
+	struct client *c = _data;
+	struct data *data = c->data;
+	const struct spa_pod *params[1];
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+
+	switch (state) {
+	case PW_REMOTE_STATE_ERROR:
+		fprintf(stderr, "remote %p: error %s\n", c->remote, error);
+		data->res = -EIO;
+		pw_main_loop_quit(data->loop);
+		break;
+
+	case PW_REMOTE_STATE_CONNECTED:
+		c->stream = pw_stream_new(c->remote, "benchmark-client-node", NULL);
+		pw_stream_add_listener(c->stream, &c->stream_listener, &stream_events, c);
+
+		params[0] = spa_pod_builder_object(&b,
+			data->t->param.idEnumFormat, data->t->spa_format,
+			"I", data->media_type.binary,
+			"I", data->media_subtype.raw);
+
+		pw_stream_connect(c->stream, PW_DIRECTION_OUTPUT, c->path,
+				  PW_STREAM_FLAG_AUTOCONNECT, params, 1);
+		break;
+	default:
+		break;
+	}
+}
+
+static const struct pw_remote_events remote_events = {
+	PW_VERSION_REMOTE_EVENTS,
+	.state_changed = on_remote_state_changed,
+};
+
+static struct pw_node *make_sink(struct data *data)
+{
+	struct pw_node *node;
+	struct pw_properties *props;
+
+	props = pw_properties_new("spa.library.name", "test/libspa-test",
+				  "spa.factory.name", "fakesink",
+				  "name", "fakesink", NULL);
+
+	node = pw_factory_create_object(data->factory, NULL, data->t->node,
+					PW_VERSION_NODE, props, SPA_ID_INVALID);
+	if (node)
+		pw_node_set_active(node, true);
+	return node;
+}
+
+static int make_server(struct data *data, const char *name, const char *policy)
+{
+	struct pw_properties *props;
+	char shm_name[256];
+	int fd;
+
+	props = pw_properties_new(PW_CORE_PROP_NAME, name,
+				  PW_CORE_PROP_DAEMON, "1",
+				  PW_CORE_PROP_PROFILER, "1", NULL);
+	if (policy)
+		pw_properties_set(props, PW_DATA_LOOP_PROP_POLICY, policy);
+	data->server = pw_core_new(pw_main_loop_get_loop(data->loop), props);
+	data->t = pw_core_get_type(data->server);
+
+	if (pw_module_load(data->server, "libpipewire-module-protocol-native", NULL) == NULL ||
+	    pw_module_load(data->server, "libpipewire-module-client-node", NULL) == NULL ||
+	    pw_module_load(data->server, "libpipewire-module-autolink", NULL) == NULL ||
+	    pw_module_load(data->server, "libpipewire-module-spa-node-factory", NULL) == NULL ||
+	    (data->factory = pw_core_find_factory(data->server, "spa-node-factory")) == NULL) {
+		fprintf(stderr, "can't load modules\n");
+		return -ENOENT;
+	}
+
+	snprintf(shm_name, sizeof(shm_name), PW_PROFILER_SHM_PREFIX "%s", name);
+	if ((fd = shm_open(shm_name, O_RDONLY, 0)) < 0) {
+		fprintf(stderr, "can't open %s: %m\n", shm_name);
+		return -errno;
+	}
+	data->area = mmap(NULL, sizeof(struct pw_profiler_area), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data->area == MAP_FAILED) {
+		fprintf(stderr, "can't map %s: %m\n", shm_name);
+		return -errno;
+	}
+	return 0;
+}
+
+static int make_clients(struct data *data, const char *name, const char *policy)
+{
+	uint32_t i;
+
+	data->core = pw_core_new(pw_main_loop_get_loop(data->loop),
+			policy ? pw_properties_new(PW_DATA_LOOP_PROP_POLICY, policy, NULL) : NULL);
+
+	for (i = 0; i < data->n_clients; i++) {
+		struct client *c = &data->clients[i];
+
+		c->data = data;
+		if ((c->sink = make_sink(data)) == NULL) {
+			fprintf(stderr, "can't make fakesink\n");
+			return -ENOMEM;
+		}
+		snprintf(c->path, sizeof(c->path), "%u",
+			 pw_global_get_id(pw_node_get_global(c->sink)));
+
+		c->remote = pw_remote_new(data->core,
+				pw_properties_new(PW_REMOTE_PROP_REMOTE_NAME, name, NULL), 0);
+		pw_remote_add_listener(c->remote, &c->remote_listener, &remote_events, c);
+		if (pw_remote_connect(c->remote) < 0) {
+			fprintf(stderr, "can't connect to %s\n", name);
+			return -EIO;
+		}
+	}
+	return 0;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	const uint64_t *ua = a, *ub = b;
+	return *ua < *ub ? -1 : *ua > *ub;
+}
+
+static void print_latency(struct data *data, const char *label, size_t offset)
+{
+	uint64_t *v, sum = 0;
+	uint32_t i, n = data->n_samples;
+
+	v = malloc(n * sizeof(uint64_t));
+	for (i = 0; i < n; i++) {
+		v[i] = *SPA_MEMBER(&data->samples[i], offset, uint64_t);
+		sum += v[i];
+	}
+	qsort(v, n, sizeof(uint64_t), compare_u64);
+
+	printf("%s (us): avg %.1f p50 %.1f p99 %.1f max %.1f\n", label,
+	       (double) sum / n / SPA_NSEC_PER_USEC,
+	       (double) v[n / 2] / SPA_NSEC_PER_USEC,
+	       (double) v[n * 99 / 100] / SPA_NSEC_PER_USEC,
+	       (double) v[n - 1] / SPA_NSEC_PER_USEC);
+	free(v);
+}
+
+static void print_results(struct data *data)
+{
+	uint64_t elapsed = data->end.time - data->begin.time;
+	uint64_t cpu = data->end.cpu - data->begin.cpu;
+	uint64_t wakeups = data->end.wakeups - data->begin.wakeups;
+
+	printf("%u clients: %" PRIu64 " client cycles, %" PRIu64 " driver cycles in %.1f ms, "
+	       "%.0f cycles/s\n", data->n_clients, data->cycles, data->driver_cycles,
+	       (double) elapsed / SPA_NSEC_PER_MSEC,
+	       (double) data->cycles * SPA_NSEC_PER_SEC / elapsed);
+	printf("cpu %.1f us/cycle (%.1f%%), wakeups %.2f/cycle\n",
+	       (double) cpu / data->cycles / SPA_NSEC_PER_USEC,
+	       100.0 * cpu / elapsed, (double) wakeups / data->cycles);
+
+	if (data->n_samples == 0) {
+		printf("no profiler records, lost %" PRIu64 "\n", data->lost);
+		return;
+	}
+	print_latency(data, "wakeup", offsetof(struct sample, wakeup));
+	print_latency(data, "finish", offsetof(struct sample, finish));
+	printf("%u samples, lost %" PRIu64 "\n", data->n_samples, data->lost);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0, };
+	struct pw_loop *l;
+	struct spa_source *source;
+	struct timespec value, interval;
+	const char *policy;
+	char name[64];
+	uint32_t i;
+
+	pw_init(&argc, &argv);
+
+	data.n_clients = argc > 1 ? atoi(argv[1]) : DEFAULT_CLIENTS;
+	data.cycles = argc > 2 ? atoi(argv[2]) : DEFAULT_CYCLES;
+	policy = argc > 3 ? argv[3] : NULL;
+
+	if (data.n_clients == 0 || data.cycles == 0) {
+		fprintf(stderr, "usage: %s [clients] [cycles] [fifo|rr|other]\n", argv[0]);
+		return -1;
+	}
+	data.clients = calloc(data.n_clients, sizeof(struct client));
+	data.max_samples = data.cycles + data.n_clients;
+	data.samples = calloc(data.max_samples, sizeof(struct sample));
+	data.requests = calloc(data.n_clients, sizeof(struct request));
+
+	data.loop = pw_main_loop_new(NULL);
+	l = pw_main_loop_get_loop(data.loop);
+
+	snprintf(name, sizeof(name), "pipewire-benchmark-%d", getpid());
+	if ((data.res = make_server(&data, name, policy)) < 0)
+		goto exit;
+
+	spa_type_media_type_map(data.t->map, &data.media_type);
+	spa_type_media_subtype_map(data.t->map, &data.media_subtype);
+
+	data.done = pw_loop_add_event(l, do_done, &data);
+
+	/* the rings are small, read them often */
+	value.tv_sec = interval.tv_sec = 0;
+	value.tv_nsec = interval.tv_nsec = SPA_NSEC_PER_MSEC;
+	source = pw_loop_add_timer(l, do_read, &data);
+	pw_loop_update_timer(l, source, &value, &interval, false);
+
+	value.tv_sec = TIMEOUT;
+	value.tv_nsec = 0;
+	source = pw_loop_add_timer(l, do_timeout, &data);
+	pw_loop_update_timer(l, source, &value, NULL, false);
+
+	if ((data.res = make_clients(&data, name, policy)) < 0)
+		goto exit;
+
+	pw_main_loop_run(data.loop);
+
+	if (data.res == 0)
+		print_results(&data);
+
+      exit:
+	for (i = 0; i < data.n_clients; i++) {
+		if (data.clients[i].stream)
+			pw_stream_disconnect(data.clients[i].stream);
+	}
+	if (data.core)
+		pw_core_destroy(data.core);
+	if (data.area && data.area != MAP_FAILED)
+		munmap(data.area, sizeof(struct pw_profiler_area));
+	if (data.server)
+		pw_core_destroy(data.server);
+	pw_main_loop_destroy(data.loop);
+	free(data.samples);
+	free(data.requests);
+	free(data.clients);
+
+	return data.res;
+}
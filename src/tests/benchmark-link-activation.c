@@ -0,0 +1,413 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include <spa/param/format-utils.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/factory.h>
+
+/* Time to bring up the links of many client nodes. A core in this process
+ * runs module-protocol-native and module-client-node and the clients connect
+ * to it over the socket with a playback pw_stream each. When all the client
+ * nodes are there, the core links each of them to a fakesink and measures
+ * the time until all the links are running. Every format, buffer and start
+ * step of a client node is a round trip to the client. Run with "batch" to
+ * activate the links together. */
+
+#define DEFAULT_CLIENTS	50
+#define TIMEOUT		30	/* sec */
+
+struct client {
+	struct data *data;
+	struct pw_remote *remote;
+	struct spa_hook remote_listener;
+	struct pw_stream *stream;
+	struct spa_hook stream_listener;
+	bool configured;
+
+	struct pw_node *sink;
+	struct pw_link *link;
+	struct spa_hook link_listener;
+	char path[16];
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_type *t;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+
+	struct pw_core *server;
+	struct pw_module *module;
+	struct pw_factory *factory;
+	struct pw_core *core;
+
+	uint32_t n_clients;
+	struct client *clients;
+
+	struct spa_source *poll;
+	uint32_t n_configured;
+	uint32_t n_running;
+	uint64_t start;
+	uint64_t end;
+	int res;
+};
+
+static uint64_t get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
+static void link_state_changed(void *_data, enum pw_link_state old,
+			       enum pw_link_state state, const char *error)
+{
+	struct client *c = _data;
+	struct data *data = c->data;
+
+	switch (state) {
+	case PW_LINK_STATE_ERROR:
+		fprintf(stderr, "link %p: error %s\n", c->link, error);
+		data->res = -EIO;
+		pw_main_loop_quit(data->loop);
+		break;
+	case PW_LINK_STATE_RUNNING:
+		if (++data->n_running == data->n_clients) {
+			data->end = get_time();
+			pw_main_loop_quit(data->loop);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static const struct pw_link_events link_events = {
+	PW_VERSION_LINK_EVENTS,
+	.state_changed = link_state_changed,
+};
+
+/* the output port of the client node in the core, NULL when the client
+ * didn't make it yet */
+static struct pw_port *client_port(struct data *data, struct client *c)
+{
+	struct pw_global *global;
+
+	global = pw_core_find_global(data->server, pw_stream_get_node_id(c->stream));
+	if (global == NULL || pw_global_get_type(global) != data->t->node)
+		return NULL;
+
+	return pw_node_get_free_port(pw_global_get_object(global), PW_DIRECTION_OUTPUT);
+}
+
+static int link_clients(struct data *data)
+{
+	struct pw_port *out[data->n_clients];
+	uint32_t i;
+
+	for (i = 0; i < data->n_clients; i++) {
+		if ((out[i] = client_port(data, &data->clients[i])) == NULL)
+			return 0;
+	}
+
+	data->start = get_time();
+
+	for (i = 0; i < data->n_clients; i++) {
+		struct client *c = &data->clients[i];
+		struct pw_port *in;
+		char *error = NULL;
+
+		if ((in = pw_node_get_free_port(c->sink, PW_DIRECTION_INPUT)) == NULL) {
+			fprintf(stderr, "no free port on fakesink\n");
+			return -EIO;
+		}
+		c->link = pw_link_new(data->server, out[i], in, NULL, NULL, &error, 0);
+		if (c->link == NULL) {
+			fprintf(stderr, "can't link: %s\n", error);
+			free(error);
+			return -EIO;
+		}
+		pw_link_add_listener(c->link, &c->link_listener, &link_events, c);
+		pw_link_register(c->link, NULL, pw_module_get_global(data->module));
+	}
+	return 1;
+}
+
+/* the ports of the client nodes arrive after the streams are configured,
+ * check until all of them are there */
+static void do_poll(void *_data, uint64_t expirations)
+{
+	struct data *data = _data;
+	int res;
+
+	if ((res = link_clients(data)) == 0)
+		return;
+
+	pw_loop_update_timer(pw_main_loop_get_loop(data->loop), data->poll, NULL, NULL, false);
+	if (res < 0) {
+		data->res = res;
+		pw_main_loop_quit(data->loop);
+	}
+}
+
+static void do_timeout(void *_data, uint64_t expirations)
+{
+	struct data *data = _data;
+	fprintf(stderr, "timeout, %u of %u links running\n", data->n_running, data->n_clients);
+	data->res = -ETIMEDOUT;
+	pw_main_loop_quit(data->loop);
+}
+
+/* called from the data loop of the clients */
+static void on_stream_need_buffer(void *_data)
+{
+	struct client *c = _data;
+	uint32_t id;
+
+	if ((id = pw_stream_get_empty_buffer(c->stream)) != SPA_ID_INVALID)
+		pw_stream_send_buffer(c->stream, id);
+}
+
+static void on_stream_format_changed(void *_data, struct spa_pod *format)
+{
+	struct client *c = _data;
+	struct pw_type *t = c->data->t;
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *params[1];
+
+	if (format == NULL) {
+		pw_stream_finish_format(c->stream, 0, NULL, 0);
+		return;
+	}
+	params[0] = spa_pod_builder_object(&b,
+		t->param.idBuffers, t->param_buffers.Buffers,
+		":", t->param_buffers.size,    "i", 128,
+		":", t->param_buffers.stride,  "i", 1,
+		":", t->param_buffers.buffers, "iru", 2,
+							2, 1, 32,
+		":", t->param_buffers.align,   "i", 16);
+
+	pw_stream_finish_format(c->stream, 0, params, 1);
+}
+
+static void on_stream_state_changed(void *_data, enum pw_stream_state old,
+				    enum pw_stream_state state, const char *error)
+{
+	struct client *c = _data;
+	struct data *data = c->data;
+	struct timespec value = { 0, SPA_NSEC_PER_MSEC };
+
+	switch (state) {
+	case PW_STREAM_STATE_ERROR:
+		fprintf(stderr, "stream %p: error %s\n", c->stream, error);
+		data->res = -EIO;
+		pw_main_loop_quit(data->loop);
+		break;
+	case PW_STREAM_STATE_CONFIGURE:
+		if (c->configured)
+			break;
+		c->configured = true;
+		if (++data->n_configured == data->n_clients)
+			pw_loop_update_timer(pw_main_loop_get_loop(data->loop), data->poll,
+					     &value, &value, false);
+		break;
+	default:
+		break;
+	}
+}
+
+static const struct pw_stream_events stream_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = on_stream_state_changed,
+	.format_changed = on_stream_format_changed,
+	.need_buffer = on_stream_need_buffer,
+};
+
+static void on_remote_state_changed(void *_data, enum pw_remote_state old,
+				    enum pw_remote_state state, const char *error)
+{
+	struct client *c = _data;
+	struct data *data = c->data;
+	const struct spa_pod *params[1];
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+
+	switch (state) {
+	case PW_REMOTE_STATE_ERROR:
+		fprintf(stderr, "remote %p: error %s\n", c->remote, error);
+		data->res = -EIO;
+		pw_main_loop_quit(data->loop);
+		break;
+
+	case PW_REMOTE_STATE_CONNECTED:
+		c->stream = pw_stream_new(c->remote, "benchmark-link-activation", NULL);
+		pw_stream_add_listener(c->stream, &c->stream_listener, &stream_events, c);
+
+		params[0] = spa_pod_builder_object(&b,
+			data->t->param.idEnumFormat, data->t->spa_format,
+			"I", data->media_type.binary,
+			"I", data->media_subtype.raw);
+
+		/* not linked by the session, the benchmark links it */
+		pw_stream_connect(c->stream, PW_DIRECTION_OUTPUT, NULL, 0, params, 1);
+		break;
+	default:
+		break;
+	}
+}
+
+static const struct pw_remote_events remote_events = {
+	PW_VERSION_REMOTE_EVENTS,
+	.state_changed = on_remote_state_changed,
+};
+
+static struct pw_node *make_sink(struct data *data)
+{
+	struct pw_node *node;
+	struct pw_properties *props;
+
+	props = pw_properties_new("spa.library.name", "test/libspa-test",
+				  "spa.factory.name", "fakesink",
+				  "name", "fakesink", NULL);
+
+	node = pw_factory_create_object(data->factory, NULL, data->t->node,
+					PW_VERSION_NODE, props, SPA_ID_INVALID);
+	if (node)
+		pw_node_set_active(node, true);
+	return node;
+}
+
+static int make_server(struct data *data, const char *name, bool batch)
+{
+	struct pw_properties *props;
+
+	props = pw_properties_new(PW_CORE_PROP_NAME, name,
+				  PW_CORE_PROP_DAEMON, "1",
+				  PW_CORE_PROP_LINK_BATCH, batch ? "1" : "0", NULL);
+	data->server = pw_core_new(pw_main_loop_get_loop(data->loop), props);
+	data->t = pw_core_get_type(data->server);
+
+	if (pw_module_load(data->server, "libpipewire-module-protocol-native", NULL) == NULL ||
+	    pw_module_load(data->server, "libpipewire-module-client-node", NULL) == NULL ||
+	    (data->module = pw_module_load(data->server,
+					   "libpipewire-module-spa-node-factory", NULL)) == NULL ||
+	    (data->factory = pw_core_find_factory(data->server, "spa-node-factory")) == NULL) {
+		fprintf(stderr, "can't load modules\n");
+		return -ENOENT;
+	}
+	return 0;
+}
+
+static int make_clients(struct data *data, const char *name)
+{
+	uint32_t i;
+
+	data->core = pw_core_new(pw_main_loop_get_loop(data->loop), NULL);
+
+	for (i = 0; i < data->n_clients; i++) {
+		struct client *c = &data->clients[i];
+
+		c->data = data;
+		if ((c->sink = make_sink(data)) == NULL) {
+			fprintf(stderr, "can't make fakesink\n");
+			return -ENOMEM;
+		}
+
+		c->remote = pw_remote_new(data->core,
+				pw_properties_new(PW_REMOTE_PROP_REMOTE_NAME, name, NULL), 0);
+		pw_remote_add_listener(c->remote, &c->remote_listener, &remote_events, c);
+		if (pw_remote_connect(c->remote) < 0) {
+			fprintf(stderr, "can't connect to %s\n", name);
+			return -EIO;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0, };
+	struct pw_loop *l;
+	struct spa_source *source;
+	struct timespec value;
+	char name[64];
+	bool batch;
+	uint32_t i;
+
+	pw_init(&argc, &argv);
+
+	data.n_clients = argc > 1 ? atoi(argv[1]) : DEFAULT_CLIENTS;
+	batch = argc > 2 && strcmp(argv[2], "batch") == 0;
+
+	if (data.n_clients == 0) {
+		fprintf(stderr, "usage: %s [clients] [batch]\n", argv[0]);
+		return -1;
+	}
+	data.clients = calloc(data.n_clients, sizeof(struct client));
+
+	data.loop = pw_main_loop_new(NULL);
+	l = pw_main_loop_get_loop(data.loop);
+
+	snprintf(name, sizeof(name), "pipewire-benchmark-%d", getpid());
+	if ((data.res = make_server(&data, name, batch)) < 0)
+		goto exit;
+
+	spa_type_media_type_map(data.t->map, &data.media_type);
+	spa_type_media_subtype_map(data.t->map, &data.media_subtype);
+
+	data.poll = pw_loop_add_timer(l, do_poll, &data);
+
+	value.tv_sec = TIMEOUT;
+	value.tv_nsec = 0;
+	source = pw_loop_add_timer(l, do_timeout, &data);
+	pw_loop_update_timer(l, source, &value, NULL, false);
+
+	if ((data.res = make_clients(&data, name)) < 0)
+		goto exit;
+
+	pw_main_loop_run(data.loop);
+
+	if (data.res == 0)
+		printf("%u client nodes, batch %d: bring-up %" PRIu64 " us\n",
+		       data.n_clients, batch, (data.end - data.start) / 1000);
+
+      exit:
+	for (i = 0; i < data.n_clients; i++) {
+		if (data.clients[i].stream)
+			pw_stream_disconnect(data.clients[i].stream);
+	}
+	if (data.core)
+		pw_core_destroy(data.core);
+	if (data.server)
+		pw_core_destroy(data.server);
+	pw_main_loop_destroy(data.loop);
+	free(data.clients);
+
+	return data.res;
+}
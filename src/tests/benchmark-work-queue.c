@@ -0,0 +1,182 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <inttypes.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/work-queue.h>
+
+/* Many objects with async state changes in flight at the same time, the way
+ * nodes are when a large graph is started. The items are completed in the
+ * reverse order so that the completion of each item has to skip over all the
+ * others when the pending items are searched. */
+
+#define DEFAULT_ITEMS		10000
+#define DEFAULT_OBJECTS		100
+#define DEFAULT_THREADS		4
+
+struct data {
+	struct pw_loop *loop;
+	struct pw_work_queue *queue;
+
+	uint32_t n_items;
+	uint32_t n_objects;
+	uint32_t n_threads;
+	int *objects;
+
+	uint32_t done;
+};
+
+struct thread_data {
+	struct data *data;
+	pthread_t thread;
+	uint32_t first;
+	uint32_t step;
+};
+
+static uint64_t get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
+static void *item_object(struct data *data, uint32_t i)
+{
+	return &data->objects[i % data->n_objects];
+}
+
+static void on_done(void *obj, void *user_data, int res, uint32_t id)
+{
+	struct data *data = user_data;
+	__atomic_add_fetch(&data->done, 1, __ATOMIC_SEQ_CST);
+}
+
+static void run_loop(struct data *data, uint32_t target)
+{
+	while (__atomic_load_n(&data->done, __ATOMIC_SEQ_CST) < target)
+		pw_loop_iterate(data->loop, -1);
+}
+
+static void add_items(struct data *data)
+{
+	uint32_t i;
+
+	for (i = 0; i < data->n_items; i++)
+		pw_work_queue_add(data->queue, item_object(data, i),
+				  SPA_RESULT_RETURN_ASYNC(i), on_done, data);
+}
+
+static void bench_complete(struct data *data)
+{
+	uint64_t t1, t2, t3;
+	uint32_t i;
+
+	data->done = 0;
+
+	t1 = get_time();
+	add_items(data);
+	t2 = get_time();
+	for (i = data->n_items; i > 0; i--)
+		pw_work_queue_complete(data->queue, item_object(data, i - 1), i - 1, 0);
+	run_loop(data, data->n_items);
+	t3 = get_time();
+
+	printf("complete: %u items: add %" PRIu64 " ns/item, complete %" PRIu64 " ns/item\n",
+	       data->n_items, (t2 - t1) / data->n_items, (t3 - t2) / data->n_items);
+}
+
+static void *complete_thread(void *arg)
+{
+	struct thread_data *td = arg;
+	struct data *data = td->data;
+	uint32_t i;
+
+	for (i = td->first; i < data->n_items; i += td->step) {
+		uint32_t seq = data->n_items - 1 - i;
+		pw_work_queue_complete(data->queue, item_object(data, seq), seq, 0);
+		/* and something new from the data thread */
+		pw_work_queue_add(data->queue, item_object(data, i), 0, on_done, data);
+	}
+	return NULL;
+}
+
+static void bench_threads(struct data *data)
+{
+	struct thread_data td[data->n_threads];
+	uint64_t t1, t2;
+	uint32_t i;
+
+	data->done = 0;
+
+	add_items(data);
+
+	t1 = get_time();
+	for (i = 0; i < data->n_threads; i++) {
+		td[i].data = data;
+		td[i].first = i;
+		td[i].step = data->n_threads;
+		pthread_create(&td[i].thread, NULL, complete_thread, &td[i]);
+	}
+	run_loop(data, data->n_items * 2);
+	for (i = 0; i < data->n_threads; i++)
+		pthread_join(td[i].thread, NULL);
+	t2 = get_time();
+
+	printf("threads: %u items from %u threads: %" PRIu64 " ns/item\n",
+	       data->n_items * 2, data->n_threads, (t2 - t1) / (data->n_items * 2));
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0, };
+
+	pw_init(&argc, &argv);
+
+	data.n_items = argc > 1 ? atoi(argv[1]) : DEFAULT_ITEMS;
+	data.n_objects = argc > 2 ? atoi(argv[2]) : DEFAULT_OBJECTS;
+	data.n_threads = argc > 3 ? atoi(argv[3]) : DEFAULT_THREADS;
+
+	if (data.n_items == 0 || data.n_objects == 0) {
+		fprintf(stderr, "usage: %s [items] [objects] [threads]\n", argv[0]);
+		return -1;
+	}
+
+	data.objects = calloc(data.n_objects, sizeof(int));
+	data.loop = pw_loop_new(NULL);
+	data.queue = pw_work_queue_new(data.loop);
+
+	pw_loop_enter(data.loop);
+	bench_complete(&data);
+	if (data.n_threads > 0)
+		bench_threads(&data);
+	pw_loop_leave(data.loop);
+
+	pw_work_queue_destroy(data.queue);
+	pw_loop_destroy(data.loop);
+	free(data.objects);
+
+	return 0;
+}
@@ -0,0 +1,443 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+
+#include <spa/clock/clock.h>
+#include <spa/param/props.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/lib/pod.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/private.h>
+
+/* Two fake devices with clocks that run at a different speed are linked by
+ * module-autolink. It must put an adaptive converter between them and set
+ * the rate of the converter to the ratio of the two clocks. Devices with
+ * clocks of the same domain are linked without a converter. */
+
+#define RATE_A		1.001
+#define RATE_B		0.999
+
+struct type {
+	uint32_t format;
+	uint32_t prop_rate;
+	struct spa_type_param param;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	type->prop_rate = spa_type_map_get_id(map, SPA_TYPE_PROPS__rate);
+	spa_type_param_map(map, &type->param);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_format_audio_map(map, &type->format_audio);
+	spa_type_audio_format_map(map, &type->audio_format);
+}
+
+struct device {
+	struct spa_node node;
+	struct spa_clock clock;
+	struct spa_dict_item info_items[1];
+	struct spa_dict info;
+	double rate_diff;
+
+	struct type *t;
+	enum spa_direction direction;
+	struct spa_port_info port_info;
+	struct pw_node *pw_node;
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	struct pw_type *t;
+	struct type type;
+	struct spa_source *timeout;
+
+	struct pw_node *converter;
+};
+
+static int dev_enum_params(struct spa_node *node, uint32_t id, uint32_t *index,
+			   const struct spa_pod *filter, struct spa_pod **param,
+			   struct spa_pod_builder *builder)
+{
+	return -ENOTSUP;
+}
+
+static int dev_set_param(struct spa_node *node, uint32_t id, uint32_t flags,
+			 const struct spa_pod *param)
+{
+	return -ENOTSUP;
+}
+
+static int dev_send_command(struct spa_node *node, const struct spa_command *command)
+{
+	return 0;
+}
+
+static int dev_set_callbacks(struct spa_node *node,
+			     const struct spa_node_callbacks *callbacks, void *data)
+{
+	return 0;
+}
+
+static int dev_get_n_ports(struct spa_node *node,
+			   uint32_t *n_input_ports, uint32_t *max_input_ports,
+			   uint32_t *n_output_ports, uint32_t *max_output_ports)
+{
+	struct device *d = SPA_CONTAINER_OF(node, struct device, node);
+	bool input = d->direction == SPA_DIRECTION_INPUT;
+
+	if (n_input_ports)
+		*n_input_ports = input ? 1 : 0;
+	if (max_input_ports)
+		*max_input_ports = input ? 1 : 0;
+	if (n_output_ports)
+		*n_output_ports = input ? 0 : 1;
+	if (max_output_ports)
+		*max_output_ports = input ? 0 : 1;
+	return 0;
+}
+
+static int dev_get_port_ids(struct spa_node *node,
+			    uint32_t *input_ids, uint32_t n_input_ids,
+			    uint32_t *output_ids, uint32_t n_output_ids)
+{
+	struct device *d = SPA_CONTAINER_OF(node, struct device, node);
+
+	if (d->direction == SPA_DIRECTION_INPUT && n_input_ids > 0)
+		input_ids[0] = 0;
+	if (d->direction == SPA_DIRECTION_OUTPUT && n_output_ids > 0)
+		output_ids[0] = 0;
+	return 0;
+}
+
+static int dev_add_port(struct spa_node *node, enum spa_direction direction, uint32_t port_id)
+{
+	return -ENOTSUP;
+}
+
+static int dev_port_get_info(struct spa_node *node, enum spa_direction direction,
+			     uint32_t port_id, const struct spa_port_info **info)
+{
+	struct device *d = SPA_CONTAINER_OF(node, struct device, node);
+
+	*info = &d->port_info;
+	return 0;
+}
+
+static int dev_port_enum_params(struct spa_node *node,
+				enum spa_direction direction, uint32_t port_id,
+				uint32_t id, uint32_t *index,
+				const struct spa_pod *filter,
+				struct spa_pod **result,
+				struct spa_pod_builder *builder)
+{
+	struct device *d = SPA_CONTAINER_OF(node, struct device, node);
+	struct type *t = d->t;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_pod *param;
+
+	if (id != t->param.idEnumFormat && id != t->param.idFormat)
+		return 0;
+	if (*index > 0)
+		return 0;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	param = spa_pod_builder_object(&b,
+		id, t->format,
+		"I", t->media_type.audio,
+		"I", t->media_subtype.raw,
+		":", t->format_audio.format,   "I", t->audio_format.S16,
+		":", t->format_audio.layout,   "i", SPA_AUDIO_LAYOUT_INTERLEAVED,
+		":", t->format_audio.rate,     "i", 48000,
+		":", t->format_audio.channels, "i", 2);
+
+	(*index)++;
+
+	return spa_pod_filter(builder, result, param, filter) < 0 ? 0 : 1;
+}
+
+static int dev_port_set_param(struct spa_node *node,
+			      enum spa_direction direction, uint32_t port_id,
+			      uint32_t id, uint32_t flags, const struct spa_pod *param)
+{
+	return 0;
+}
+
+static int dev_port_use_buffers(struct spa_node *node,
+				enum spa_direction direction, uint32_t port_id,
+				struct spa_buffer **buffers, uint32_t n_buffers)
+{
+	return 0;
+}
+
+static int dev_port_alloc_buffers(struct spa_node *node,
+				  enum spa_direction direction, uint32_t port_id,
+				  struct spa_pod **params, uint32_t n_params,
+				  struct spa_buffer **buffers, uint32_t *n_buffers)
+{
+	return -ENOTSUP;
+}
+
+static int dev_port_set_io(struct spa_node *node,
+			   enum spa_direction direction, uint32_t port_id,
+			   uint32_t id, void *data, size_t size)
+{
+	return 0;
+}
+
+static int dev_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+{
+	return 0;
+}
+
+static int dev_port_send_command(struct spa_node *node,
+				 enum spa_direction direction, uint32_t port_id,
+				 const struct spa_command *command)
+{
+	return -ENOTSUP;
+}
+
+static int dev_process(struct spa_node *node)
+{
+	return SPA_STATUS_OK;
+}
+
+static const struct spa_node dev_node = {
+	SPA_VERSION_NODE,
+	NULL,
+	dev_enum_params,
+	dev_set_param,
+	dev_send_command,
+	dev_set_callbacks,
+	dev_get_n_ports,
+	dev_get_port_ids,
+	dev_add_port,
+	NULL,
+	dev_port_get_info,
+	dev_port_enum_params,
+	dev_port_set_param,
+	dev_port_use_buffers,
+	dev_port_alloc_buffers,
+	dev_port_set_io,
+	dev_port_reuse_buffer,
+	dev_port_send_command,
+	dev_process,
+	dev_process,
+};
+
+static int dev_clock_get_time(struct spa_clock *clock,
+			      int32_t *rate, int64_t *ticks, int64_t *monotonic_time)
+{
+	*rate = 48000;
+	*ticks = 0;
+	*monotonic_time = 0;
+	return 0;
+}
+
+static int dev_clock_get_rate_diff(struct spa_clock *clock, double *rate_diff)
+{
+	struct device *d = SPA_CONTAINER_OF(clock, struct device, clock);
+
+	*rate_diff = d->rate_diff;
+	return 0;
+}
+
+static const struct spa_clock dev_clock = {
+	SPA_VERSION_CLOCK,
+	NULL,
+	SPA_CLOCK_STATE_RUNNING,
+	NULL,
+	NULL,
+	dev_clock_get_time,
+	dev_clock_get_rate_diff,
+	NULL,
+};
+
+static struct device *make_device(struct data *data, const char *name,
+				  enum spa_direction direction, const char *domain,
+				  double rate_diff, struct pw_properties *props)
+{
+	struct device *d;
+
+	d = calloc(1, sizeof(struct device));
+	d->node = dev_node;
+	d->clock = dev_clock;
+	d->info_items[0].key = SPA_CLOCK_INFO_DOMAIN;
+	d->info_items[0].value = domain;
+	d->info = SPA_DICT_INIT(d->info_items, 1);
+	d->clock.info = &d->info;
+	d->rate_diff = rate_diff;
+	d->t = &data->type;
+	d->direction = direction;
+	d->port_info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+
+	d->pw_node = pw_node_new(data->core, name, props, 0);
+	pw_node_set_implementation(d->pw_node, &d->node);
+	d->pw_node->clock = &d->clock;
+	d->pw_node->driver_clock = &d->clock;
+	pw_node_register(d->pw_node, NULL, NULL);
+
+	return d;
+}
+
+static void destroy_device(struct device *d)
+{
+	pw_node_destroy(d->pw_node);
+	free(d);
+}
+
+static int find_converter(void *_data, struct pw_global *global)
+{
+	struct data *data = _data;
+	struct pw_node *node;
+
+	if (pw_global_get_type(global) != data->t->node)
+		return 0;
+
+	node = pw_global_get_object(global);
+	if (strcmp(pw_node_get_info(node)->name, "audioconvert") != 0)
+		return 0;
+
+	data->converter = node;
+	return 1;
+}
+
+static double get_converter_rate(struct data *data)
+{
+	struct pw_type *t = data->t;
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *props;
+	uint32_t index = 0;
+	double rate = 1.0;
+
+	if (spa_node_enum_params(data->converter->node, t->param.idProps,
+				 &index, NULL, &props, &b) <= 0)
+		return 1.0;
+
+	spa_pod_object_parse(props,
+		":", data->type.prop_rate, "d", &rate, NULL);
+
+	return rate;
+}
+
+static void on_timeout(void *_data, uint64_t expirations)
+{
+	struct data *data = _data;
+	pw_main_loop_quit(data->loop);
+}
+
+/* run the main loop long enough for the rate of the converters to be
+ * updated at least once */
+static void run(struct data *data)
+{
+	struct timespec value = { 1, 500000000 };
+
+	pw_loop_update_timer(pw_main_loop_get_loop(data->loop), data->timeout,
+			     &value, NULL, false);
+	pw_main_loop_run(data->loop);
+}
+
+static struct pw_properties *target_props(struct device *target)
+{
+	struct pw_properties *props = pw_properties_new(NULL, NULL);
+
+	pw_properties_setf(props, PW_NODE_PROP_TARGET_NODE, "%d",
+			   pw_global_get_id(pw_node_get_global(target->pw_node)));
+	return props;
+}
+
+static void test_different_domains(struct data *data)
+{
+	struct device *sink, *source;
+	double rate;
+
+	sink = make_device(data, "sink", SPA_DIRECTION_INPUT, "test:b", RATE_B, NULL);
+	source = make_device(data, "source", SPA_DIRECTION_OUTPUT, "test:a", RATE_A,
+			     target_props(sink));
+
+	data->converter = NULL;
+	pw_core_for_each_global(data->core, find_converter, data);
+	spa_assert_se(data->converter != NULL);
+
+	/* linking does not replace the clock of the sink, it follows the
+	 * clock of the source */
+	spa_assert_se(sink->pw_node->clock == &sink->clock);
+	spa_assert_se(sink->pw_node->driver_clock == &source->clock);
+	spa_assert_se(data->converter->driver_clock == &source->clock);
+
+	run(data);
+
+	rate = get_converter_rate(data);
+	spa_assert_se(fabs(rate - RATE_A / RATE_B) < 1e-9);
+
+	destroy_device(source);
+	destroy_device(sink);
+}
+
+static void test_same_domain(struct data *data)
+{
+	struct device *sink, *source;
+
+	sink = make_device(data, "sink", SPA_DIRECTION_INPUT, "test:a", RATE_A, NULL);
+	source = make_device(data, "source", SPA_DIRECTION_OUTPUT, "test:a", RATE_A,
+			     target_props(sink));
+
+	data->converter = NULL;
+	pw_core_for_each_global(data->core, find_converter, data);
+	spa_assert_se(data->converter == NULL);
+
+	destroy_device(source);
+	destroy_device(sink);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0, };
+
+	pw_init(&argc, &argv);
+
+	data.loop = pw_main_loop_new(NULL);
+	data.core = pw_core_new(pw_main_loop_get_loop(data.loop), NULL);
+	data.t = pw_core_get_type(data.core);
+	init_type(&data.type, data.t->map);
+	data.timeout = pw_loop_add_timer(pw_main_loop_get_loop(data.loop), on_timeout, &data);
+
+	spa_assert_se(pw_module_load(data.core, "libpipewire-module-autolink", NULL) != NULL);
+
+	test_different_domains(&data);
+	test_same_domain(&data);
+
+	pw_core_destroy(data.core);
+	pw_main_loop_destroy(data.loop);
+
+	return 0;
+}
@@ -0,0 +1,194 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+
+#include <spa/buffer/buffer.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/factory.h>
+#include <pipewire/private.h>
+
+/* A fakesrc and a fakesink in different data loops are linked. The link
+ * bridges the loops, the buffers of the source must reach the sink and be
+ * recycled back to the source many times over. The link is created and
+ * destroyed a few times while the loops are running. */
+
+#define N_ROUNDS	4
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	struct pw_type *t;
+	struct pw_module *module;
+	struct pw_factory *factory;
+	struct spa_source *timeout;
+
+	struct pw_node *src;
+	struct pw_node *sink;
+	struct pw_link *link;
+	struct spa_hook link_listener;
+
+	bool running;
+};
+
+static void link_state_changed(void *_data, enum pw_link_state old,
+			       enum pw_link_state state, const char *error)
+{
+	struct data *data = _data;
+
+	switch (state) {
+	case PW_LINK_STATE_ERROR:
+		fprintf(stderr, "link %p: error %s\n", data->link, error);
+		pw_main_loop_quit(data->loop);
+		break;
+	case PW_LINK_STATE_RUNNING:
+		data->running = true;
+		break;
+	default:
+		break;
+	}
+}
+
+static const struct pw_link_events link_events = {
+	PW_VERSION_LINK_EVENTS,
+	.state_changed = link_state_changed,
+};
+
+static void on_timeout(void *_data, uint64_t expirations)
+{
+	struct data *data = _data;
+	pw_main_loop_quit(data->loop);
+}
+
+static void run(struct data *data, long msec)
+{
+	struct timespec value = { msec / 1000, (msec % 1000) * 1000000 };
+
+	pw_loop_update_timer(pw_main_loop_get_loop(data->loop), data->timeout,
+			     &value, NULL, false);
+	pw_main_loop_run(data->loop);
+}
+
+static struct pw_node *make_node(struct data *data, const char *factory_name, int loop)
+{
+	struct pw_node *node;
+	struct pw_properties *props;
+
+	props = pw_properties_new("spa.library.name", "test/libspa-test",
+				  "spa.factory.name", factory_name,
+				  "name", factory_name, NULL);
+	pw_properties_setf(props, PW_NODE_PROP_DATA_LOOP, "%d", loop);
+
+	node = pw_factory_create_object(data->factory, NULL, data->t->node,
+					PW_VERSION_NODE, props, SPA_ID_INVALID);
+	if (node)
+		pw_node_set_active(node, true);
+	return node;
+}
+
+/* the sequence number of the last buffer the source made */
+static uint32_t max_seq(struct data *data)
+{
+	struct pw_link *link = data->link;
+	uint32_t i, seq = 0;
+
+	for (i = 0; i < link->n_buffers; i++) {
+		struct spa_meta_header *h;
+
+		h = spa_buffer_find_meta(link->buffers[i], data->t->meta.Header);
+		if (h && h->seq > seq)
+			seq = h->seq;
+	}
+	return seq;
+}
+
+static void test_round(struct data *data)
+{
+	struct pw_port *out, *in;
+	char *error = NULL;
+	uint32_t seq;
+
+	out = pw_node_get_free_port(data->src, PW_DIRECTION_OUTPUT);
+	in = pw_node_get_free_port(data->sink, PW_DIRECTION_INPUT);
+	spa_assert_se(out != NULL && in != NULL);
+
+	data->running = false;
+	data->link = pw_link_new(data->core, out, in, NULL, NULL, &error, 0);
+	if (data->link == NULL)
+		fprintf(stderr, "can't link: %s\n", error);
+	spa_assert_se(data->link != NULL);
+	pw_link_add_listener(data->link, &data->link_listener, &link_events, data);
+	pw_link_register(data->link, NULL, pw_module_get_global(data->module));
+
+	run(data, 500);
+
+	spa_assert_se(data->running);
+
+	/* every buffer went to the other loop and came back */
+	seq = max_seq(data);
+	spa_assert_se(data->link->n_buffers > 0);
+	spa_assert_se(seq > 4 * data->link->n_buffers);
+	printf("link %p: %d buffers, %u processed\n", data->link,
+	       data->link->n_buffers, seq);
+
+	pw_link_destroy(data->link);
+	data->link = NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0, };
+	struct pw_properties *props;
+	int i;
+
+	pw_init(&argc, &argv);
+
+	/* the free running fakesrc runs out of buffers all the time when the
+	 * sink is in another thread, don't log that */
+	if (getenv("PIPEWIRE_DEBUG") == NULL)
+		pw_log_set_level(SPA_LOG_LEVEL_NONE);
+
+	data.loop = pw_main_loop_new(NULL);
+	props = pw_properties_new(PW_CORE_PROP_DATA_LOOPS, "2", NULL);
+	data.core = pw_core_new(pw_main_loop_get_loop(data.loop), props);
+	data.t = pw_core_get_type(data.core);
+	data.timeout = pw_loop_add_timer(pw_main_loop_get_loop(data.loop), on_timeout, &data);
+
+	data.module = pw_module_load(data.core, "libpipewire-module-spa-node-factory", NULL);
+	spa_assert_se(data.module != NULL);
+	data.factory = pw_core_find_factory(data.core, "spa-node-factory");
+	spa_assert_se(data.factory != NULL);
+
+	data.src = make_node(&data, "fakesrc", 0);
+	data.sink = make_node(&data, "fakesink", 1);
+	spa_assert_se(data.src != NULL && data.sink != NULL);
+	spa_assert_se(data.src->data_loop != data.sink->data_loop);
+
+	for (i = 0; i < N_ROUNDS; i++)
+		test_round(&data);
+
+	pw_core_destroy(data.core);
+	pw_main_loop_destroy(data.loop);
+
+	return 0;
+}
@@ -0,0 +1,181 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <pipewire/pipewire.h>
+
+#include "modules/module-jack/jack.h"
+
+int segment_num = 0;
+
+/* Runs the activation of the jack server with fake clients in threads:
+ *
+ *   freewheel -> a -> b -> freewheel
+ *   freewheel -> c -> freewheel
+ *
+ * The server only wakes up a and c, b is woken up by a. Every cycle checks
+ * that all clients ran in order and prints the time of a cycle. */
+
+#define DEFAULT_CYCLES	10000
+#define TIMEOUT_USEC	1000000
+
+#define REF_FW	0
+#define REF_A	1
+#define REF_B	2
+#define REF_C	3
+#define N_REFS	4
+
+struct client {
+	struct data *data;
+	struct jack_client_control control;
+	pthread_t thread;
+	int cycle;
+};
+
+struct data {
+	struct jack_connection_manager *conn;
+	struct jack_synchro synchro[CLIENT_NUM];
+	struct jack_client_timing timing[CLIENT_NUM];
+	struct client clients[N_REFS];
+	int cycle;
+	bool quit;
+	int errors;
+};
+
+static uint64_t get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
+static void *client_thread(void *user_data)
+{
+	struct client *c = user_data;
+	struct data *d = c->data;
+	int cycle;
+
+	while (jack_synchro_wait(&d->synchro[c->control.ref_num])) {
+		if (__atomic_load_n(&d->quit, __ATOMIC_SEQ_CST))
+			break;
+
+		cycle = __atomic_load_n(&d->cycle, __ATOMIC_SEQ_CST);
+		/* b runs after a completed */
+		if (c->control.ref_num == REF_B &&
+		    __atomic_load_n(&d->clients[REF_A].cycle, __ATOMIC_SEQ_CST) != cycle)
+			__atomic_add_fetch(&d->errors, 1, __ATOMIC_SEQ_CST);
+
+		__atomic_store_n(&c->cycle, cycle, __ATOMIC_SEQ_CST);
+
+		jack_connection_manager_resume_ref_num(d->conn, &c->control,
+						       d->synchro, d->timing);
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0, };
+	struct jack_client_control *fw;
+	int i, n_cycles, res = 0;
+	uint64_t start, elapsed;
+	char name[64];
+
+	pw_init(&argc, &argv);
+
+	n_cycles = argc > 1 ? atoi(argv[1]) : DEFAULT_CYCLES;
+
+	data.conn = calloc(1, sizeof(struct jack_connection_manager));
+	if (data.conn == NULL)
+		return -1;
+	jack_connection_manager_init(data.conn);
+
+	for (i = 0; i < N_REFS; i++) {
+		struct client *c = &data.clients[i];
+
+		c->data = &data;
+		c->control.ref_num = i;
+		c->cycle = -1;
+
+		snprintf(name, sizeof(name), "test-activation-%d-%d", getpid(), i);
+		if (jack_synchro_init(&data.synchro[i], name, "default", 0, false) < 0)
+			return -1;
+	}
+
+	jack_connection_manager_direct_connect(data.conn, REF_FW, REF_A);
+	jack_connection_manager_direct_connect(data.conn, REF_A, REF_B);
+	jack_connection_manager_direct_connect(data.conn, REF_B, REF_FW);
+	jack_connection_manager_direct_connect(data.conn, REF_FW, REF_C);
+	jack_connection_manager_direct_connect(data.conn, REF_C, REF_FW);
+
+	for (i = REF_A; i < N_REFS; i++)
+		pthread_create(&data.clients[i].thread, NULL, client_thread, &data.clients[i]);
+
+	fw = &data.clients[REF_FW].control;
+
+	start = get_time();
+	for (i = 0; i < n_cycles; i++) {
+		if (jack_connection_manager_get_activation(data.conn, REF_FW) != 0) {
+			fprintf(stderr, "cycle %d: clients did not complete\n", i);
+			res = -1;
+			break;
+		}
+		__atomic_store_n(&data.cycle, i, __ATOMIC_SEQ_CST);
+
+		jack_connection_manager_reset(data.conn, data.timing);
+		jack_connection_manager_resume_ref_num(data.conn, fw, data.synchro, data.timing);
+
+		if (jack_connection_manager_suspend_ref_num(data.conn, fw, data.synchro,
+							    data.timing, TIMEOUT_USEC) < 0) {
+			fprintf(stderr, "cycle %d: timeout\n", i);
+			res = -1;
+			break;
+		}
+		if (data.clients[REF_B].cycle != i || data.clients[REF_C].cycle != i) {
+			fprintf(stderr, "cycle %d: client missed the cycle\n", i);
+			res = -1;
+			break;
+		}
+	}
+	elapsed = get_time() - start;
+
+	__atomic_store_n(&data.quit, true, __ATOMIC_SEQ_CST);
+	for (i = REF_A; i < N_REFS; i++) {
+		jack_synchro_signal(&data.synchro[i]);
+		pthread_join(data.clients[i].thread, NULL);
+	}
+	for (i = 0; i < N_REFS; i++)
+		jack_synchro_close(&data.synchro[i]);
+	free(data.conn);
+
+	if (data.errors > 0) {
+		fprintf(stderr, "%d clients ran out of order\n", data.errors);
+		res = -1;
+	}
+	if (res == 0)
+		printf("%d cycles: %f us per cycle\n", n_cycles,
+				(double) elapsed / n_cycles / 1000.0);
+
+	return res == 0 ? 0 : 1;
+}
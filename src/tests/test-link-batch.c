@@ -0,0 +1,184 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/factory.h>
+#include <pipewire/private.h>
+
+/* In batch mode the links share one work queue. A sink that never completes
+ * the format it was given must not keep another link, that was made after
+ * it, from running. The stalled link fails instead. */
+
+/* more than the batch timeout of the links */
+#define TIMEOUT		8000
+
+struct link {
+	struct data *data;
+	struct pw_link *link;
+	struct spa_hook listener;
+	enum pw_link_state state;
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	struct pw_type *t;
+	struct pw_module *module;
+	struct pw_factory *factory;
+	struct spa_source *timeout;
+
+	struct link stalled;
+	struct link good;
+};
+
+static int (*port_set_param) (struct spa_node *node,
+			      enum spa_direction direction, uint32_t port_id,
+			      uint32_t id, uint32_t flags,
+			      const struct spa_pod *param);
+
+/* accepts the format later, which never happens */
+static int stalled_port_set_param(struct spa_node *node,
+				  enum spa_direction direction, uint32_t port_id,
+				  uint32_t id, uint32_t flags,
+				  const struct spa_pod *param)
+{
+	if (param == NULL)
+		return port_set_param(node, direction, port_id, id, flags, param);
+	return SPA_RESULT_RETURN_ASYNC(1);
+}
+
+static void link_state_changed(void *_data, enum pw_link_state old,
+			       enum pw_link_state state, const char *error)
+{
+	struct link *l = _data;
+	struct data *data = l->data;
+
+	l->state = state;
+
+	if (data->stalled.state == PW_LINK_STATE_ERROR &&
+	    data->good.state == PW_LINK_STATE_RUNNING)
+		pw_main_loop_quit(data->loop);
+}
+
+static const struct pw_link_events link_events = {
+	PW_VERSION_LINK_EVENTS,
+	.state_changed = link_state_changed,
+};
+
+static void on_timeout(void *_data, uint64_t expirations)
+{
+	struct data *data = _data;
+	pw_main_loop_quit(data->loop);
+}
+
+static void run(struct data *data, long msec)
+{
+	struct timespec value = { msec / 1000, (msec % 1000) * 1000000 };
+
+	pw_loop_update_timer(pw_main_loop_get_loop(data->loop), data->timeout,
+			     &value, NULL, false);
+	pw_main_loop_run(data->loop);
+}
+
+static struct pw_node *make_node(struct data *data, const char *factory_name)
+{
+	struct pw_node *node;
+	struct pw_properties *props;
+
+	props = pw_properties_new("spa.library.name", "test/libspa-test",
+				  "spa.factory.name", factory_name,
+				  "name", factory_name, NULL);
+
+	node = pw_factory_create_object(data->factory, NULL, data->t->node,
+					PW_VERSION_NODE, props, SPA_ID_INVALID);
+	spa_assert_se(node != NULL);
+	pw_node_set_active(node, true);
+	return node;
+}
+
+static void make_link(struct data *data, struct link *l, struct pw_node *src, struct pw_node *sink)
+{
+	struct pw_port *out, *in;
+	char *error = NULL;
+
+	out = pw_node_get_free_port(src, PW_DIRECTION_OUTPUT);
+	in = pw_node_get_free_port(sink, PW_DIRECTION_INPUT);
+	spa_assert_se(out != NULL && in != NULL);
+
+	l->data = data;
+	l->state = PW_LINK_STATE_INIT;
+	l->link = pw_link_new(data->core, out, in, NULL, NULL, &error, 0);
+	if (l->link == NULL)
+		fprintf(stderr, "can't link: %s\n", error);
+	spa_assert_se(l->link != NULL);
+	pw_link_add_listener(l->link, &l->listener, &link_events, l);
+	pw_link_register(l->link, NULL, pw_module_get_global(data->module));
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0, };
+	struct pw_properties *props;
+	struct pw_node *sink;
+
+	pw_init(&argc, &argv);
+
+	/* the fakesrc of the running link runs out of buffers, don't log that */
+	if (getenv("PIPEWIRE_DEBUG") == NULL)
+		pw_log_set_level(SPA_LOG_LEVEL_NONE);
+
+	data.loop = pw_main_loop_new(NULL);
+	props = pw_properties_new(PW_CORE_PROP_LINK_BATCH, "1", NULL);
+	data.core = pw_core_new(pw_main_loop_get_loop(data.loop), props);
+	data.t = pw_core_get_type(data.core);
+	data.timeout = pw_loop_add_timer(pw_main_loop_get_loop(data.loop), on_timeout, &data);
+
+	data.module = pw_module_load(data.core, "libpipewire-module-spa-node-factory", NULL);
+	spa_assert_se(data.module != NULL);
+	data.factory = pw_core_find_factory(data.core, "spa-node-factory");
+	spa_assert_se(data.factory != NULL);
+
+	sink = make_node(&data, "fakesink");
+	port_set_param = sink->node->port_set_param;
+	sink->node->port_set_param = stalled_port_set_param;
+
+	make_link(&data, &data.stalled, make_node(&data, "fakesrc"), sink);
+	/* the format of the stalled link is pending in the queue now */
+	run(&data, 100);
+	spa_assert_se(data.stalled.state == PW_LINK_STATE_NEGOTIATING);
+
+	make_link(&data, &data.good, make_node(&data, "fakesrc"), make_node(&data, "fakesink"));
+	run(&data, TIMEOUT);
+
+	printf("stalled link: %s, other link: %s\n",
+	       pw_link_state_as_string(data.stalled.state),
+	       pw_link_state_as_string(data.good.state));
+	spa_assert_se(data.stalled.state == PW_LINK_STATE_ERROR);
+	spa_assert_se(data.good.state == PW_LINK_STATE_RUNNING);
+
+	pw_core_destroy(data.core);
+	pw_main_loop_destroy(data.loop);
+
+	return 0;
+}
@@ -0,0 +1,265 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/thread-loop.h>
+
+/* The sources of a loop are dispatched in batches. A callback can iterate
+ * the loop again and it can remove sources of the batch, another thread
+ * removes them with an invoke. A source is dispatched once for an event
+ * and never after it was removed. */
+
+#define N_EVENTS	4
+#define N_ROUNDS	2000
+
+struct data;
+
+struct event {
+	struct data *data;
+	struct spa_source *source;
+	int count;
+};
+
+struct data {
+	struct pw_loop *loop;
+
+	struct event events[N_EVENTS];
+	bool nested;
+
+	struct spa_source source;
+	int count;
+	bool removed;
+};
+
+static int make_ready_fd(void)
+{
+	uint64_t count = 1;
+	int fd;
+
+	fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	spa_assert_se(fd >= 0);
+	spa_assert_se(write(fd, &count, sizeof(count)) == sizeof(count));
+	return fd;
+}
+
+static void init_source(struct data *data, spa_source_func_t func, int fd)
+{
+	data->source.func = func;
+	data->source.data = data;
+	data->source.fd = fd;
+	data->source.mask = 0;
+	data->source.rmask = 0;
+	data->count = 0;
+	data->removed = false;
+}
+
+static void on_count(struct spa_source *source)
+{
+	struct data *data = source->data;
+	data->count++;
+}
+
+static void iterate(struct data *data)
+{
+	pw_loop_enter(data->loop);
+	pw_loop_iterate(data->loop, 0);
+	pw_loop_leave(data->loop);
+}
+
+static void test_update_remove(struct data *data)
+{
+	int fd = make_ready_fd();
+
+	init_source(data, on_count, fd);
+	pw_loop_add_source(data->loop, &data->source);
+	iterate(data);
+	spa_assert_se(data->count == 0);
+
+	data->source.mask = SPA_IO_IN;
+	pw_loop_update_source(data->loop, &data->source);
+	iterate(data);
+	spa_assert_se(data->count == 1);
+
+	pw_loop_remove_source(data->loop, &data->source);
+	iterate(data);
+	spa_assert_se(data->count == 1);
+
+	close(fd);
+}
+
+static void add_events(struct data *data, spa_source_event_func_t func)
+{
+	int i;
+
+	for (i = 0; i < N_EVENTS; i++) {
+		struct event *e = &data->events[i];
+
+		e->data = data;
+		e->count = 0;
+		e->source = pw_loop_add_event(data->loop, func, e);
+		pw_loop_signal_event(data->loop, e->source);
+	}
+}
+
+static void destroy_events(struct data *data)
+{
+	int i;
+
+	for (i = 0; i < N_EVENTS; i++) {
+		if (data->events[i].source)
+			pw_loop_destroy_source(data->loop, data->events[i].source);
+		data->events[i].source = NULL;
+	}
+}
+
+static void on_nested_event(void *_data, uint64_t count)
+{
+	struct event *e = _data;
+	struct data *data = e->data;
+
+	e->count++;
+
+	/* the other events are handled in a nested iteration, the outer
+	 * iteration must not dispatch them again */
+	if (data->nested) {
+		data->nested = false;
+		pw_loop_iterate(data->loop, 0);
+	}
+}
+
+static void test_nested(struct data *data)
+{
+	int i;
+
+	add_events(data, on_nested_event);
+	data->nested = true;
+
+	iterate(data);
+
+	for (i = 0; i < N_EVENTS; i++)
+		spa_assert_se(data->events[i].count == 1);
+
+	destroy_events(data);
+}
+
+static void on_destroy_event(void *_data, uint64_t count)
+{
+	struct event *e = _data;
+	struct data *data = e->data;
+	int i;
+
+	e->count++;
+
+	/* the first event destroys the others, they are in the same batch */
+	for (i = 0; i < N_EVENTS; i++) {
+		struct event *o = &data->events[i];
+		if (o != e && o->source) {
+			pw_loop_destroy_source(data->loop, o->source);
+			o->source = NULL;
+		}
+	}
+}
+
+static void test_destroy(struct data *data)
+{
+	int i, total = 0;
+
+	add_events(data, on_destroy_event);
+
+	iterate(data);
+
+	for (i = 0; i < N_EVENTS; i++)
+		total += data->events[i].count;
+	spa_assert_se(total == 1);
+
+	destroy_events(data);
+}
+
+static void on_ready(struct spa_source *source)
+{
+	struct data *data = source->data;
+
+	/* the eventfd is not read, the source is ready all the time */
+	spa_assert_se(!data->removed);
+}
+
+static int do_add_source(struct spa_loop *loop,
+			 bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct data *d = user_data;
+
+	d->removed = false;
+	pw_loop_add_source(d->loop, &d->source);
+	return 0;
+}
+
+static int do_remove_source(struct spa_loop *loop,
+			    bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct data *d = user_data;
+
+	pw_loop_remove_source(d->loop, &d->source);
+	d->removed = true;
+	return 0;
+}
+
+/* The thread loop iterates all the time, the source is in every batch. The
+ * invoke is dispatched in a batch with the source and removes it. */
+static void test_thread_remove(struct data *data)
+{
+	struct pw_thread_loop *thread_loop;
+	int i, fd = make_ready_fd();
+
+	init_source(data, on_ready, fd);
+	data->source.mask = SPA_IO_IN;
+
+	thread_loop = pw_thread_loop_new(data->loop, "test-loop");
+	pw_thread_loop_start(thread_loop);
+
+	for (i = 0; i < N_ROUNDS; i++) {
+		pw_loop_invoke(data->loop, do_add_source, 0, NULL, 0, true, data);
+		usleep(10);
+		pw_loop_invoke(data->loop, do_remove_source, 0, NULL, 0, true, data);
+	}
+	pw_thread_loop_stop(thread_loop);
+	pw_thread_loop_destroy(thread_loop);
+	close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0, };
+
+	pw_init(&argc, &argv);
+
+	data.loop = pw_loop_new(NULL);
+
+	test_update_remove(&data);
+	test_nested(&data);
+	test_destroy(&data);
+	test_thread_remove(&data);
+
+	pw_loop_destroy(data.loop);
+
+	return 0;
+}
@@ -0,0 +1,278 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <spa/param/format-utils.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/factory.h>
+
+/* A playback stream sends a buffer from need_buffer, when it is started and
+ * when the server asks for the next one. A core in this process runs
+ * module-client-node, the stream connects to it over the socket and is
+ * linked to a fakesink. The first buffer is sent when the stream is
+ * started, the server must see every buffer the stream sent, once. */
+
+#define N_BUFFERS	16
+#define TIMEOUT		5	/* sec */
+
+struct data {
+	struct pw_main_loop *loop;
+	pthread_t main_thread;
+	struct pw_type *t;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+
+	struct pw_core *server;
+	struct spa_hook server_listener;
+	struct pw_factory *factory;
+	struct pw_node *sink;
+	struct pw_node *client_node;
+	struct spa_hook node_listener;
+	int have_output;
+
+	struct pw_core *core;
+	struct pw_remote *remote;
+	struct spa_hook remote_listener;
+	struct pw_stream *stream;
+	struct spa_hook stream_listener;
+	int sent;
+
+	struct spa_source *check;
+	int timeout;
+};
+
+/* called from the data loop of the server */
+static void node_have_output(void *_data)
+{
+	struct data *data = _data;
+	__atomic_add_fetch(&data->have_output, 1, __ATOMIC_SEQ_CST);
+}
+
+static const struct pw_node_events node_events = {
+	PW_VERSION_NODE_EVENTS,
+	.have_output = node_have_output,
+};
+
+static void server_global_added(void *_data, struct pw_global *global)
+{
+	struct data *data = _data;
+	struct pw_node *node;
+
+	/* the sink is made before the client connects */
+	if (data->sink == NULL || data->client_node != NULL ||
+	    pw_global_get_type(global) != data->t->node)
+		return;
+
+	node = pw_global_get_object(global);
+
+	data->client_node = node;
+	pw_node_add_listener(node, &data->node_listener, &node_events, data);
+}
+
+static const struct pw_core_events server_events = {
+	PW_VERSION_CORE_EVENTS,
+	.global_added = server_global_added,
+};
+
+/* called from the main loop when the stream is started and from the data
+ * loop of the client after that */
+static void on_stream_need_buffer(void *_data)
+{
+	struct data *data = _data;
+	uint32_t id;
+	int sent = __atomic_load_n(&data->sent, __ATOMIC_SEQ_CST);
+
+	/* the server can ask for a buffer before the start command arrived */
+	if (sent == N_BUFFERS ||
+	    (sent == 0 && !pthread_equal(pthread_self(), data->main_thread)))
+		return;
+
+	if ((id = pw_stream_get_empty_buffer(data->stream)) != SPA_ID_INVALID &&
+	    pw_stream_send_buffer(data->stream, id))
+		__atomic_add_fetch(&data->sent, 1, __ATOMIC_SEQ_CST);
+}
+
+static void on_stream_format_changed(void *_data, struct spa_pod *format)
+{
+	struct data *data = _data;
+	struct pw_type *t = data->t;
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *params[1];
+
+	if (format == NULL) {
+		pw_stream_finish_format(data->stream, 0, NULL, 0);
+		return;
+	}
+	params[0] = spa_pod_builder_object(&b,
+		t->param.idBuffers, t->param_buffers.Buffers,
+		":", t->param_buffers.size,    "i", 128,
+		":", t->param_buffers.stride,  "i", 1,
+		":", t->param_buffers.buffers, "iru", 2,
+							2, 1, 32,
+		":", t->param_buffers.align,   "i", 16);
+
+	pw_stream_finish_format(data->stream, 0, params, 1);
+}
+
+static void on_stream_state_changed(void *_data, enum pw_stream_state old,
+				    enum pw_stream_state state, const char *error)
+{
+	struct data *data = _data;
+
+	if (state == PW_STREAM_STATE_ERROR) {
+		fprintf(stderr, "stream %p: error %s\n", data->stream, error);
+		pw_main_loop_quit(data->loop);
+	}
+}
+
+static const struct pw_stream_events stream_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = on_stream_state_changed,
+	.format_changed = on_stream_format_changed,
+	.need_buffer = on_stream_need_buffer,
+};
+
+static void on_remote_state_changed(void *_data, enum pw_remote_state old,
+				    enum pw_remote_state state, const char *error)
+{
+	struct data *data = _data;
+	const struct spa_pod *params[1];
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	char path[16];
+
+	switch (state) {
+	case PW_REMOTE_STATE_ERROR:
+		fprintf(stderr, "remote %p: error %s\n", data->remote, error);
+		pw_main_loop_quit(data->loop);
+		break;
+
+	case PW_REMOTE_STATE_CONNECTED:
+		data->stream = pw_stream_new(data->remote, "test-stream", NULL);
+		pw_stream_add_listener(data->stream, &data->stream_listener, &stream_events, data);
+
+		params[0] = spa_pod_builder_object(&b,
+			data->t->param.idEnumFormat, data->t->spa_format,
+			"I", data->media_type.binary,
+			"I", data->media_subtype.raw);
+
+		snprintf(path, sizeof(path), "%u",
+			 pw_global_get_id(pw_node_get_global(data->sink)));
+		pw_stream_connect(data->stream, PW_DIRECTION_OUTPUT, path,
+				  PW_STREAM_FLAG_AUTOCONNECT, params, 1);
+		break;
+	default:
+		break;
+	}
+}
+
+static const struct pw_remote_events remote_events = {
+	PW_VERSION_REMOTE_EVENTS,
+	.state_changed = on_remote_state_changed,
+};
+
+static void do_check(void *_data, uint64_t expirations)
+{
+	struct data *data = _data;
+
+	if (__atomic_load_n(&data->sent, __ATOMIC_SEQ_CST) == N_BUFFERS &&
+	    __atomic_load_n(&data->have_output, __ATOMIC_SEQ_CST) == N_BUFFERS)
+		pw_main_loop_quit(data->loop);
+	else if (--data->timeout == 0) {
+		fprintf(stderr, "sent %d buffers, the server got %d\n",
+			data->sent, data->have_output);
+		pw_main_loop_quit(data->loop);
+	}
+}
+
+static struct pw_node *make_sink(struct data *data)
+{
+	struct pw_node *node;
+	struct pw_properties *props;
+
+	props = pw_properties_new("spa.library.name", "test/libspa-test",
+				  "spa.factory.name", "fakesink",
+				  "name", "fakesink", NULL);
+
+	node = pw_factory_create_object(data->factory, NULL, data->t->node,
+					PW_VERSION_NODE, props, SPA_ID_INVALID);
+	if (node)
+		pw_node_set_active(node, true);
+	return node;
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0, };
+	struct pw_loop *l;
+	struct timespec value;
+	char name[64];
+
+	pw_init(&argc, &argv);
+
+	data.main_thread = pthread_self();
+	data.loop = pw_main_loop_new(NULL);
+	l = pw_main_loop_get_loop(data.loop);
+
+	snprintf(name, sizeof(name), "pipewire-test-stream-%d", getpid());
+	data.server = pw_core_new(l, pw_properties_new(PW_CORE_PROP_NAME, name,
+						       PW_CORE_PROP_DAEMON, "1", NULL));
+	data.t = pw_core_get_type(data.server);
+	spa_type_media_type_map(data.t->map, &data.media_type);
+	spa_type_media_subtype_map(data.t->map, &data.media_subtype);
+	pw_core_add_listener(data.server, &data.server_listener, &server_events, &data);
+
+	spa_assert_se(pw_module_load(data.server, "libpipewire-module-protocol-native", NULL));
+	spa_assert_se(pw_module_load(data.server, "libpipewire-module-client-node", NULL));
+	spa_assert_se(pw_module_load(data.server, "libpipewire-module-autolink", NULL));
+	spa_assert_se(pw_module_load(data.server, "libpipewire-module-spa-node-factory", NULL));
+	data.factory = pw_core_find_factory(data.server, "spa-node-factory");
+	spa_assert_se(data.factory != NULL);
+	data.sink = make_sink(&data);
+	spa_assert_se(data.sink != NULL);
+
+	data.core = pw_core_new(l, NULL);
+	data.remote = pw_remote_new(data.core,
+			pw_properties_new(PW_REMOTE_PROP_REMOTE_NAME, name, NULL), 0);
+	pw_remote_add_listener(data.remote, &data.remote_listener, &remote_events, &data);
+	spa_assert_se(pw_remote_connect(data.remote) >= 0);
+
+	data.timeout = TIMEOUT * 100;
+	value.tv_sec = 0;
+	value.tv_nsec = 10 * SPA_NSEC_PER_MSEC;
+	data.check = pw_loop_add_timer(l, do_check, &data);
+	pw_loop_update_timer(l, data.check, &value, &value, false);
+
+	pw_main_loop_run(data.loop);
+
+	spa_assert_se(data.sent == N_BUFFERS);
+	spa_assert_se(data.have_output == N_BUFFERS);
+
+	pw_stream_disconnect(data.stream);
+	pw_core_destroy(data.core);
+	pw_core_destroy(data.server);
+	pw_main_loop_destroy(data.loop);
+
+	return 0;
+}
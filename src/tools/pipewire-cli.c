@@ -64,6 +64,7 @@ struct remote_data {
 
 	const char *name;
 	uint32_t id;
+	uint32_t version;	/* of the remote core */
 
 	struct pw_remote *remote;
 	struct spa_hook remote_listener;
@@ -158,6 +159,8 @@ static bool do_destroy_node(struct data *data, const char *cmd, char *args, char
 static bool do_create_link(struct data *data, const char *cmd, char *args, char **error);
 static bool do_destroy_link(struct data *data, const char *cmd, char *args, char **error);
 static bool do_export_node(struct data *data, const char *cmd, char *args, char **error);
+static bool do_set_log_level(struct data *data, const char *cmd, char *args, char **error);
+static bool do_set_local_log_level(struct data *data, const char *cmd, char *args, char **error);
 
 static struct command command_list[] = {
 	{ "help", "Show this help", do_help },
@@ -174,6 +177,8 @@ static struct command command_list[] = {
 	{ "create-link", "Create a link between nodes. <node-id> <port-id> <node-id> <port-id> [<properties>]", do_create_link },
 	{ "destroy-link", "Destroy a link. <link-var>", do_destroy_link },
 	{ "export-node", "Export a local node to the current remote. <node-id> [remote-var]", do_export_node },
+	{ "set-log-level", "Set the log level of all or one topic of the current remote. <level> [<topic>]", do_set_log_level },
+	{ "set-local-log-level", "Set the local log level of all or one topic. <level> [<topic>]", do_set_local_log_level },
 };
 
 static bool do_help(struct data *data, const char *cmd, char *args, char **error)
@@ -212,10 +217,55 @@ static bool do_load_module(struct data *data, const char *cmd, char *args, char
 	return true;
 }
 
+static bool do_set_log_level(struct data *data, const char *cmd, char *args, char **error)
+{
+	struct remote_data *rd = data->current;
+	char *a[2];
+	int n;
+
+	n = pw_split_ip(args, WHITESPACE, 2, a);
+	if (n < 1) {
+		asprintf(error, "%s <level> [<topic>]", cmd);
+		return false;
+	}
+	if (rd->core_proxy == NULL) {
+		asprintf(error, "Remote %d is not connected", rd->id);
+		return false;
+	}
+	if (rd->version < 2) {
+		asprintf(error, "Remote %d can't set its log level", rd->id);
+		return false;
+	}
+
+	pw_core_proxy_set_log_level(rd->core_proxy, n == 2 ? a[1] : NULL, atoi(a[0]));
+
+	return true;
+}
+
+static bool do_set_local_log_level(struct data *data, const char *cmd, char *args, char **error)
+{
+	char *a[2];
+	int n;
+
+	n = pw_split_ip(args, WHITESPACE, 2, a);
+	if (n < 1) {
+		asprintf(error, "%s <level> [<topic>]", cmd);
+		return false;
+	}
+
+	if (n == 2)
+		pw_log_set_topic_level(a[1], atoi(a[0]));
+	else
+		pw_log_set_level(atoi(a[0]));
+
+	return true;
+}
+
 static void on_info_changed(void *_data, const struct pw_core_info *info)
 {
 	struct remote_data *rd = _data;
 	rd->name = info->name;
+	rd->version = info->version ? atoi(info->version) : 0;
 	fprintf(stdout, "remote %d is named '%s'\n", rd->id, rd->name);
 }
 
@@ -552,6 +602,7 @@ static void info_node(struct proxy_data *pd)
 	else
 		fprintf(stdout, "\n");
 	print_properties(info->props, MARK_CHANGE(6));
+	fprintf(stdout, "%c\txruns: %u\n", MARK_CHANGE(7), info->n_xruns);
 	info->change_mask = 0;
 }
 
@@ -798,7 +849,7 @@ static bool bind_global(struct remote_data *rd, struct global *global, char **er
 	proxy = pw_registry_proxy_bind(rd->registry_proxy,
 				       global->id,
 				       global->type,
-				       client_version,
+				       SPA_MIN(global->version, client_version),
 				       sizeof(struct proxy_data));
 
 	pd = pw_proxy_get_user_data(proxy);
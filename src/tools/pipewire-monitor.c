@@ -18,6 +18,7 @@
  */
 
 #include <stdio.h>
+#include <inttypes.h>
 #include <signal.h>
 
 #include <spa/lib/debug.h>
@@ -72,20 +73,26 @@ static void print_properties(struct spa_dict *props, char mark)
 }
 
 #define MARK_CHANGE(f) ((print_mark && ((info)->change_mask & (1 << (f)))) ? '*' : ' ')
+/* updates only carry the changed fields */
+#define PRINT(f) (print_all || ((info)->change_mask & (1 << (f))))
 
 static void on_info_changed(void *data, const struct pw_core_info *info)
 {
-	bool print_all = true, print_mark = false;
+	bool print_all = false, print_mark = false;
 
 	printf("\ttype: %s\n", PW_TYPE_INTERFACE__Core);
-	if (print_all) {
+	if (PRINT(0))
 		printf("%c\tuser-name: \"%s\"\n", MARK_CHANGE(0), info->user_name);
+	if (PRINT(1))
 		printf("%c\thost-name: \"%s\"\n", MARK_CHANGE(1), info->host_name);
+	if (PRINT(2))
 		printf("%c\tversion: \"%s\"\n", MARK_CHANGE(2), info->version);
+	if (PRINT(3))
 		printf("%c\tname: \"%s\"\n", MARK_CHANGE(3), info->name);
+	if (PRINT(4))
 		printf("%c\tcookie: %u\n", MARK_CHANGE(4), info->cookie);
+	if (PRINT(5))
 		print_properties(info->props, MARK_CHANGE(5));
-	}
 }
 
 static void module_event_info(void *object, struct pw_module_info *info)
@@ -93,13 +100,14 @@ static void module_event_info(void *object, struct pw_module_info *info)
         struct proxy_data *data = object;
 	bool print_all, print_mark;
 
-	print_all = true;
         if (data->info == NULL) {
 		printf("added:\n");
+		print_all = true;
 		print_mark = false;
 	}
         else {
 		printf("changed:\n");
+		print_all = false;
 		print_mark = true;
 	}
 
@@ -111,12 +119,14 @@ static void module_event_info(void *object, struct pw_module_info *info)
 					  data->permissions & PW_PERM_W ? 'w' : '-',
 					  data->permissions & PW_PERM_X ? 'x' : '-');
 	printf("\ttype: %s (version %d)\n", PW_TYPE_INTERFACE__Module, data->version);
-	if (print_all) {
+	if (PRINT(0))
 		printf("%c\tname: \"%s\"\n", MARK_CHANGE(0), info->name);
+	if (PRINT(1))
 		printf("%c\tfilename: \"%s\"\n", MARK_CHANGE(1), info->filename);
+	if (PRINT(2))
 		printf("%c\targs: \"%s\"\n", MARK_CHANGE(2), info->args);
+	if (PRINT(3))
 		print_properties(info->props, MARK_CHANGE(3));
-	}
 }
 
 static const struct pw_module_proxy_events module_events = {
@@ -129,14 +139,16 @@ static void node_event_info(void *object, struct pw_node_info *info)
         struct proxy_data *data = object;
 	bool print_all, print_mark;
 	struct pw_type *t = pw_core_get_type(data->data->core);
+	int i;
 
-	print_all = true;
         if (data->info == NULL) {
 		printf("added:\n");
+		print_all = true;
 		print_mark = false;
 	}
         else {
 		printf("changed:\n");
+		print_all = false;
 		print_mark = true;
 	}
 
@@ -148,11 +160,11 @@ static void node_event_info(void *object, struct pw_node_info *info)
 					  data->permissions & PW_PERM_W ? 'w' : '-',
 					  data->permissions & PW_PERM_X ? 'x' : '-');
 	printf("\ttype: %s (version %d)\n", PW_TYPE_INTERFACE__Node, data->version);
-	if (print_all) {
-		int i;
-
+	if (PRINT(0))
 		printf("%c\tname: \"%s\"\n", MARK_CHANGE(0), info->name);
+	if (PRINT(1))
 		printf("%c\tinput ports: %u/%u\n", MARK_CHANGE(1), info->n_input_ports, info->max_input_ports);
+	if (PRINT(2)) {
 		printf("%c\tinput params:\n", MARK_CHANGE(2));
 		for (i = 0; i < info->n_input_params; i++) {
 			uint32_t flags = 0;
@@ -160,8 +172,10 @@ static void node_event_info(void *object, struct pw_node_info *info)
 				flags |= SPA_DEBUG_FLAG_FORMAT;
 			spa_debug_pod(info->input_params[i], flags);
 		}
-
+	}
+	if (PRINT(3))
 		printf("%c\toutput ports: %u/%u\n", MARK_CHANGE(3), info->n_output_ports, info->max_output_ports);
+	if (PRINT(4)) {
 		printf("%c\toutput params:\n", MARK_CHANGE(4));
 		for (i = 0; i < info->n_output_params; i++) {
 			uint32_t flags = 0;
@@ -169,19 +183,34 @@ static void node_event_info(void *object, struct pw_node_info *info)
 				flags |= SPA_DEBUG_FLAG_FORMAT;
 			spa_debug_pod(info->output_params[i], flags);
 		}
-
+	}
+	if (PRINT(5)) {
 		printf("%c\tstate: \"%s\"", MARK_CHANGE(5), pw_node_state_as_string(info->state));
 		if (info->state == PW_NODE_STATE_ERROR && info->error)
 			printf(" \"%s\"\n", info->error);
 		else
 			printf("\n");
-		print_properties(info->props, MARK_CHANGE(6));
 	}
+	if (PRINT(6))
+		print_properties(info->props, MARK_CHANGE(6));
+	if (PRINT(7))
+		printf("%c\txruns: %u\n", MARK_CHANGE(7), info->n_xruns);
+}
+
+static void node_event_xrun(void *object, uint64_t cycle, uint64_t missing)
+{
+        struct proxy_data *data = object;
+
+	printf("xrun:\n");
+	printf("\tid: %d\n", data->id);
+	printf("\tcycle: %"PRIu64"\n", cycle);
+	printf("\tmissing: %"PRIu64"\n", missing);
 }
 
 static const struct pw_node_proxy_events node_events = {
 	PW_VERSION_NODE_PROXY_EVENTS,
-        .info = node_event_info
+        .info = node_event_info,
+        .xrun = node_event_xrun,
 };
 
 static void factory_event_info(void *object, struct pw_factory_info *info)
@@ -190,13 +219,14 @@ static void factory_event_info(void *object, struct pw_factory_info *info)
 	struct pw_type *t = pw_core_get_type(data->data->core);
 	bool print_all, print_mark;
 
-	print_all = true;
         if (data->info == NULL) {
 		printf("added:\n");
+		print_all = true;
 		print_mark = false;
 	}
         else {
 		printf("changed:\n");
+		print_all = false;
 		print_mark = true;
 	}
 
@@ -210,9 +240,8 @@ static void factory_event_info(void *object, struct pw_factory_info *info)
 	printf("\ttype: %s (version %d)\n", PW_TYPE_INTERFACE__Factory, data->version);
 	printf("\tname: \"%s\"\n", info->name);
 	printf("\tobject-type: %s/%d\n", spa_type_map_get_type(t->map, info->type), info->version);
-	if (print_all) {
+	if (PRINT(0))
 		print_properties(info->props, MARK_CHANGE(0));
-	}
 }
 
 static const struct pw_factory_proxy_events factory_events = {
@@ -225,13 +254,14 @@ static void client_event_info(void *object, struct pw_client_info *info)
         struct proxy_data *data = object;
 	bool print_all, print_mark;
 
-	print_all = true;
         if (data->info == NULL) {
 		printf("added:\n");
+		print_all = true;
 		print_mark = false;
 	}
         else {
 		printf("changed:\n");
+		print_all = false;
 		print_mark = true;
 	}
 
@@ -243,9 +273,8 @@ static void client_event_info(void *object, struct pw_client_info *info)
 					  data->permissions & PW_PERM_W ? 'w' : '-',
 					  data->permissions & PW_PERM_X ? 'x' : '-');
 	printf("\ttype: %s (version %d)\n", PW_TYPE_INTERFACE__Client, data->version);
-	if (print_all) {
+	if (PRINT(0))
 		print_properties(info->props, MARK_CHANGE(0));
-	}
 }
 
 static const struct pw_client_proxy_events client_events = {
@@ -258,13 +287,14 @@ static void link_event_info(void *object, struct pw_link_info *info)
         struct proxy_data *data = object;
 	bool print_all, print_mark;
 
-	print_all = true;
         if (data->info == NULL) {
 		printf("added:\n");
+		print_all = true;
 		print_mark = false;
 	}
         else {
 		printf("changed:\n");
+		print_all = false;
 		print_mark = true;
 	}
 
@@ -276,18 +306,23 @@ static void link_event_info(void *object, struct pw_link_info *info)
 					  data->permissions & PW_PERM_W ? 'w' : '-',
 					  data->permissions & PW_PERM_X ? 'x' : '-');
 	printf("\ttype: %s (version %d)\n", PW_TYPE_INTERFACE__Link, data->version);
-	if (print_all) {
+	if (PRINT(0)) {
 		printf("%c\toutput-node-id: %u\n", MARK_CHANGE(0), info->output_node_id);
 		printf("%c\toutput-port-id: %u\n", MARK_CHANGE(0), info->output_port_id);
+	}
+	if (PRINT(1)) {
 		printf("%c\tinput-node-id: %u\n", MARK_CHANGE(1), info->input_node_id);
 		printf("%c\tinput-port-id: %u\n", MARK_CHANGE(1), info->input_port_id);
+	}
+	if (PRINT(2)) {
 		printf("%c\tformat:\n", MARK_CHANGE(2));
 		if (info->format)
 			spa_debug_pod(info->format, SPA_DEBUG_FLAG_FORMAT);
 		else
 			printf("\t\tnone\n");
-		print_properties(info->props, MARK_CHANGE(3));
 	}
+	if (PRINT(3))
+		print_properties(info->props, MARK_CHANGE(3));
 }
 
 static const struct pw_link_proxy_events link_events = {
@@ -362,7 +397,7 @@ static void registry_event_global(void *data, uint32_t id, uint32_t parent_id,
 	}
 
         proxy = pw_registry_proxy_bind(d->registry_proxy, id, type,
-				       client_version,
+				       SPA_MIN(version, client_version),
 				       sizeof(struct proxy_data));
         if (proxy == NULL)
                 goto no_mem;
@@ -0,0 +1,306 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <pipewire/pipewire.h>
+
+#include "extensions/profiler.h"
+
+/* Reads the timing records of the nodes that the daemon writes when the
+ * pipewire.profiler property is set and prints a report every second:
+ *
+ *  - the DSP load of each node, the time it processed over the period
+ *  - a histogram of the delay between the start of the cycle and the
+ *    start of the node, the jitter of the wakeup of the node
+ *  - the nodes that caused the xruns, the first node that finished after
+ *    the end of the cycle
+ */
+
+#define READ_INTERVAL	10	/* msec */
+#define REPORT_INTERVAL	1	/* sec */
+
+#define MAX_NODES	128
+#define N_BUCKETS	7
+
+static const uint64_t bucket_limits[N_BUCKETS - 1] = {
+	10 * SPA_NSEC_PER_USEC,
+	50 * SPA_NSEC_PER_USEC,
+	100 * SPA_NSEC_PER_USEC,
+	500 * SPA_NSEC_PER_USEC,
+	1 * SPA_NSEC_PER_MSEC,
+	5 * SPA_NSEC_PER_MSEC,
+};
+
+static const char *bucket_names[N_BUCKETS] = {
+	"<10us", "<50us", "<100us", "<500us", "<1ms", "<5ms", ">=5ms",
+};
+
+struct node {
+	uint32_t id;
+	bool remote;
+	char name[32];
+
+	uint64_t count;
+	uint64_t busy;
+	uint64_t busy_max;
+	uint64_t period;
+	uint64_t delay[N_BUCKETS];
+	uint64_t xruns;
+};
+
+struct data {
+	struct pw_main_loop *loop;
+
+	struct pw_profiler_area *area;
+	uint32_t read_index[PW_PROFILER_MAX_LOOPS];
+
+	uint64_t cycles;
+	uint64_t period_min;
+	uint64_t period_max;
+	uint64_t period_sum;
+	uint64_t n_periods;
+	uint64_t xruns;
+	uint64_t lost;
+
+	struct node nodes[MAX_NODES];
+	uint32_t n_nodes;
+};
+
+static struct node *find_node(struct data *data, struct pw_profiler_record *r)
+{
+	bool remote = r->flags & PW_PROFILER_RECORD_FLAG_REMOTE;
+	struct node *n;
+	uint32_t i;
+
+	for (i = 0; i < data->n_nodes; i++) {
+		n = &data->nodes[i];
+		if (n->id == r->node_id && n->remote == remote)
+			return n;
+	}
+	if (data->n_nodes == MAX_NODES)
+		return NULL;
+
+	n = &data->nodes[data->n_nodes++];
+	memset(n, 0, sizeof(struct node));
+	n->id = r->node_id;
+	n->remote = remote;
+	strncpy(n->name, r->name, sizeof(n->name) - 1);
+
+	return n;
+}
+
+static void add_record(struct data *data, struct pw_profiler_record *r)
+{
+	struct node *n;
+	uint64_t busy, delay;
+	int i;
+
+	if ((n = find_node(data, r)) == NULL)
+		return;
+
+	busy = r->end > r->start ? r->end - r->start : 0;
+	delay = r->start > r->signal ? r->start - r->signal : 0;
+
+	n->count++;
+	n->busy += busy;
+	n->busy_max = SPA_MAX(n->busy_max, busy);
+	n->period += r->period;
+
+	for (i = 0; i < N_BUCKETS - 1; i++)
+		if (delay < bucket_limits[i])
+			break;
+	n->delay[i]++;
+
+	if (r->flags & PW_PROFILER_RECORD_FLAG_XRUN) {
+		n->xruns++;
+		data->xruns++;
+	}
+	if (r->flags & PW_PROFILER_RECORD_FLAG_DRIVER) {
+		data->cycles++;
+		if (r->period > 0) {
+			if (data->n_periods == 0 || r->period < data->period_min)
+				data->period_min = r->period;
+			data->period_max = SPA_MAX(data->period_max, r->period);
+			data->period_sum += r->period;
+			data->n_periods++;
+		}
+	}
+}
+
+static void read_ring(struct data *data, uint32_t index)
+{
+	struct pw_profiler_ring *ring = &data->area->rings[index];
+	struct pw_profiler_record r;
+	uint32_t write_index, read_index = data->read_index[index];
+
+	write_index = __atomic_load_n(&ring->write_index, __ATOMIC_ACQUIRE);
+
+	if (write_index - read_index > PW_PROFILER_N_RECORDS) {
+		data->lost += write_index - read_index - PW_PROFILER_N_RECORDS;
+		read_index = write_index - PW_PROFILER_N_RECORDS;
+	}
+	for (; read_index != write_index; read_index++) {
+		r = ring->records[read_index & (PW_PROFILER_N_RECORDS - 1)];
+
+		/* the record could have been written again while we copied it */
+		if (__atomic_load_n(&ring->write_index, __ATOMIC_ACQUIRE) - read_index >=
+		    PW_PROFILER_N_RECORDS) {
+			data->lost++;
+			continue;
+		}
+		add_record(data, &r);
+	}
+	data->read_index[index] = read_index;
+}
+
+static void do_read(void *data, uint64_t expirations)
+{
+	struct data *d = data;
+	uint32_t i, n_rings;
+
+	n_rings = SPA_MIN(d->area->n_rings, PW_PROFILER_MAX_LOOPS);
+	for (i = 0; i < n_rings; i++)
+		read_ring(d, i);
+}
+
+static void do_report(void *data, uint64_t expirations)
+{
+	struct data *d = data;
+	uint32_t i;
+	int j;
+
+	if (d->n_periods > 0)
+		printf("cycles %"PRIu64" period avg %.3fms min %.3fms max %.3fms xruns %"PRIu64
+		       " lost %"PRIu64"\n", d->cycles,
+		       (double) d->period_sum / d->n_periods / SPA_NSEC_PER_MSEC,
+		       (double) d->period_min / SPA_NSEC_PER_MSEC,
+		       (double) d->period_max / SPA_NSEC_PER_MSEC,
+		       d->xruns, d->lost);
+	else
+		printf("cycles %"PRIu64" xruns %"PRIu64" lost %"PRIu64"\n",
+		       d->cycles, d->xruns, d->lost);
+
+	printf("%5s %-24s %6s %8s %8s %8s %6s", "id", "name", "where",
+	       "count", "avg(us)", "max(us)", "load");
+	for (j = 0; j < N_BUCKETS; j++)
+		printf(" %7s", bucket_names[j]);
+	printf(" %6s\n", "xruns");
+
+	for (i = 0; i < d->n_nodes; i++) {
+		struct node *n = &d->nodes[i];
+
+		if (n->count == 0)
+			continue;
+
+		printf("%5d %-24.24s %6s %8"PRIu64" %8.1f %8.1f %5.1f%%", n->id, n->name,
+		       n->remote ? "client" : "server", n->count,
+		       (double) n->busy / n->count / SPA_NSEC_PER_USEC,
+		       (double) n->busy_max / SPA_NSEC_PER_USEC,
+		       n->period > 0 ? 100.0 * n->busy / n->period : 0.0);
+		for (j = 0; j < N_BUCKETS; j++)
+			printf(" %7"PRIu64, n->delay[j]);
+		printf(" %6"PRIu64"\n", n->xruns);
+
+		memset(&n->count, 0, sizeof(struct node) - offsetof(struct node, count));
+	}
+	printf("\n");
+	fflush(stdout);
+
+	d->cycles = d->period_min = d->period_max = d->period_sum = d->n_periods = 0;
+	d->xruns = d->lost = 0;
+}
+
+static void do_quit(void *data, int signal_number)
+{
+	struct data *d = data;
+	pw_main_loop_quit(d->loop);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0 };
+	struct pw_loop *l;
+	struct spa_source *source;
+	struct timespec value, interval;
+	const char *remote;
+	char name[256];
+	uint32_t i;
+	int fd;
+
+	pw_init(&argc, &argv);
+
+	if (argc > 1)
+		remote = argv[1];
+	else if ((remote = getenv("PIPEWIRE_REMOTE")) == NULL)
+		remote = "pipewire-0";
+
+	snprintf(name, sizeof(name), PW_PROFILER_SHM_PREFIX "%s", remote);
+	if ((fd = shm_open(name, O_RDONLY, 0)) < 0) {
+		fprintf(stderr, "can't open %s: %m, is pipewire.profiler enabled?\n", name);
+		return -1;
+	}
+	data.area = mmap(NULL, sizeof(struct pw_profiler_area), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data.area == MAP_FAILED) {
+		fprintf(stderr, "can't map %s: %m\n", name);
+		return -1;
+	}
+	if (data.area->version != PW_PROFILER_VERSION) {
+		fprintf(stderr, "unsupported profiler version %d\n", data.area->version);
+		return -1;
+	}
+
+	/* only report the cycles from now on */
+	for (i = 0; i < PW_PROFILER_MAX_LOOPS; i++)
+		data.read_index[i] = data.area->rings[i].write_index;
+
+	data.loop = pw_main_loop_new(NULL);
+	if (data.loop == NULL)
+		return -1;
+
+	l = pw_main_loop_get_loop(data.loop);
+	pw_loop_add_signal(l, SIGINT, do_quit, &data);
+	pw_loop_add_signal(l, SIGTERM, do_quit, &data);
+
+	value.tv_sec = interval.tv_sec = 0;
+	value.tv_nsec = interval.tv_nsec = READ_INTERVAL * SPA_NSEC_PER_MSEC;
+	source = pw_loop_add_timer(l, do_read, &data);
+	pw_loop_update_timer(l, source, &value, &interval, false);
+
+	value.tv_sec = interval.tv_sec = REPORT_INTERVAL;
+	value.tv_nsec = interval.tv_nsec = 0;
+	source = pw_loop_add_timer(l, do_report, &data);
+	pw_loop_update_timer(l, source, &value, &interval, false);
+
+	pw_main_loop_run(data.loop);
+
+	pw_main_loop_destroy(data.loop);
+	munmap(data.area, sizeof(struct pw_profiler_area));
+
+	return 0;
+}